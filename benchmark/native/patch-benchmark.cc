@@ -0,0 +1,229 @@
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdlib.h>
+#include <vector>
+#include "catch.hpp"
+#include "patch.h"
+#include "text.h"
+
+using namespace std::chrono;
+using std::vector;
+using std::u16string;
+using std::move;
+
+static size_t allocation_count = 0;
+
+void *operator new(size_t size) {
+  allocation_count++;
+  void *result = malloc(size);
+  if (!result) throw std::bad_alloc();
+  return result;
+}
+
+void operator delete(void *pointer) noexcept {
+  free(pointer);
+}
+
+struct Edit {
+  Point start;
+  Point deletion_extent;
+  Text deleted_text;
+  Text inserted_text;
+};
+
+static vector<Edit> get_random_edits(uint32_t count) {
+  std::default_random_engine engine{0};
+  vector<Edit> edits;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t deleted_length = engine() % 4;
+    u16string inserted_text(engine() % 12, u'x');
+    if (engine() % 10 == 0) inserted_text.push_back(u'\n');
+    edits.push_back(Edit{
+      Point(engine() % 200, engine() % 80),
+      Point(0, deleted_length),
+      Text{u16string(deleted_length, u'y')},
+      Text{move(inserted_text)}
+    });
+  }
+  return edits;
+}
+
+static void splice(Patch &patch, Edit &edit) {
+  Point insertion_extent = edit.inserted_text.extent();
+  uint32_t deleted_text_size = edit.deleted_text.size();
+  patch.splice(
+    edit.start,
+    edit.deletion_extent,
+    insertion_extent,
+    move(edit.deleted_text),
+    move(edit.inserted_text),
+    deleted_text_size
+  );
+}
+
+TEST_CASE("Patch::splice - allocations per edit") {
+  uint32_t count = 20000;
+  auto edits = get_random_edits(count);
+
+  size_t allocation_count_before = allocation_count;
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  {
+    Patch patch;
+    for (Edit &edit : edits) splice(patch, edit);
+  }
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Splicing " << (end - start).count() << "ms, " <<
+    static_cast<double>(allocation_count - allocation_count_before) / count <<
+    " allocations per edit\n";
+}
+
+TEST_CASE("Patch::combine - allocations per squashed layer") {
+  uint32_t layer_count = 2000, edits_per_layer = 10;
+  auto edits = get_random_edits(layer_count * edits_per_layer);
+
+  size_t allocation_count_before = allocation_count;
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  {
+    Patch base_patch;
+    for (uint32_t i = 0; i < layer_count; i++) {
+      Patch layer_patch;
+      for (uint32_t j = 0; j < edits_per_layer; j++) {
+        splice(layer_patch, edits[i * edits_per_layer + j]);
+      }
+      base_patch.combine(layer_patch);
+    }
+  }
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Combining " << (end - start).count() << "ms, " <<
+    static_cast<double>(allocation_count - allocation_count_before) / (layer_count * edits_per_layer) <<
+    " allocations per edit\n";
+}
+
+TEST_CASE("Patch::combine - large patches") {
+  uint32_t count = 100000;
+  std::default_random_engine engine{0};
+  Patch patch, other_patch;
+  for (uint32_t i = 0; i < count; i++) {
+    patch.splice(Point(2 * i, engine() % 10), Point(0, 2), Point(0, 3), Text{u"ab"}, Text{u"cde"});
+    other_patch.splice(Point(2 * i + 1, engine() % 10), Point(0, 1), Point(0, 1), Text{u"f"}, Text{u"g"});
+  }
+  for (uint32_t i = 0; i < count; i += 4) {
+    other_patch.splice(Point(2 * i, 0), Point(1, 0), Point(0, 1), optional<Text>{}, optional<Text>{}, 0);
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  patch.combine(other_patch);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Combining " << patch.get_change_count() << " changes " << (end - start).count() << "ms\n";
+}
+
+TEST_CASE("Patch::from_sorted_changes - sorted changes") {
+  uint32_t count = 100000;
+  vector<Text> texts;
+  vector<Patch::Change> changes;
+  texts.reserve(2 * count);
+  for (uint32_t i = 0; i < count; i++) {
+    texts.push_back(Text{u"ab"});
+    Text *old_text = &texts.back();
+    texts.push_back(Text{u"cde"});
+    Text *new_text = &texts.back();
+    changes.push_back(Patch::Change{
+      Point(i, 1), Point(i, 3), Point(i, 1), Point(i, 4),
+      old_text, new_text, 0, 0, 0
+    });
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Patch spliced_patch;
+  for (const Patch::Change &change : changes) {
+    spliced_patch.splice(change.new_start, Point(0, 2), Point(0, 3), Text{u"ab"}, Text{u"cde"});
+  }
+  milliseconds middle = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Patch built_patch = Patch::from_sorted_changes(changes);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Splicing " << count << " sorted changes " << (middle - start).count() << "ms, " <<
+    "building them " << (end - middle).count() << "ms\n";
+}
+
+TEST_CASE("Patch::serialize - round trip") {
+  uint32_t count = 100000;
+  std::default_random_engine engine{0};
+  Patch patch;
+  for (uint32_t i = 0; i < count; i++) {
+    patch.splice(Point(2 * i, engine() % 80), Point(0, 2), Point(0, 3), Text{u"ab"}, Text{u"cde"});
+  }
+
+  vector<uint8_t> bytes;
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Serializer serializer(bytes);
+  patch.serialize(serializer);
+  milliseconds middle = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Deserializer deserializer(bytes.data(), bytes.size());
+  Patch patch_copy(deserializer);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Serializing " << count << " changes into " << bytes.size() << " bytes " <<
+    (middle - start).count() << "ms, deserializing " << (end - middle).count() << "ms\n";
+}
+
+TEST_CASE("Patch::rebase - large patches") {
+  uint32_t count = 100000;
+  std::default_random_engine engine{0};
+  Patch patch, concurrent_patch;
+  for (uint32_t i = 0; i < count; i++) {
+    patch.splice(Point(2 * i, engine() % 10), Point(0, 2), Point(0, 3), Text{u"ab"}, Text{u"cde"});
+    concurrent_patch.splice(Point(i + engine() % 2, engine() % 10), Point(0, 1), Point(0, 1), Text{u"f"}, Text{u"g"});
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Patch rebased_patch = patch.rebase(concurrent_patch, Patch::RebaseTieBreak::ThisFirst);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Rebasing " << count << " changes over " << concurrent_patch.get_change_count() <<
+    " concurrent changes into " << rebased_patch.get_change_count() << " changes " << (end - start).count() << "ms\n";
+}
+
+TEST_CASE("Patch::translate_positions - many positions") {
+  uint32_t change_count = 10000, position_count = 100000;
+  std::default_random_engine engine{0};
+  Patch patch;
+  for (uint32_t i = 0; i < change_count; i++) {
+    patch.splice(Point(engine() % 5000, engine() % 80), Point(0, engine() % 4), Point(engine() % 2, engine() % 4));
+  }
+  vector<Point> positions;
+  for (uint32_t i = 0; i < position_count; i++) {
+    positions.push_back(Point(engine() % 5000, engine() % 80));
+  }
+
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  for (const Point &position : positions) {
+    patch.grab_change_starting_before_old_position(position);
+  }
+  milliseconds middle = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  auto translated_positions = patch.translate_positions(positions, Patch::TranslationDirection::OldToNew);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Finding changes for " << position_count << " positions one at a time " <<
+    (middle - start).count() << "ms, translating them together " << (end - middle).count() << "ms\n";
+}
+
+TEST_CASE("Patch::grab_change_starting_before_new_position - after sequential edits") {
+  uint32_t count = 100000, query_count = 10000;
+  std::default_random_engine engine{0};
+  Patch patch;
+  for (uint32_t i = 0; i < count; i++) {
+    patch.splice(Point(i, 0), Point(0, 1), Point(0, 2), Text{u"a"}, Text{u"bc"});
+  }
+
+  auto start = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+  patch.grab_change_starting_before_new_position(Point(engine() % count, 0));
+  auto middle = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+  for (uint32_t i = 0; i < query_count; i++) {
+    patch.grab_change_starting_before_new_position(Point(engine() % count, 0));
+  }
+  auto end = duration_cast<microseconds>(system_clock::now().time_since_epoch());
+  Patch::TreeStats stats = patch.get_tree_stats();
+  std::cout << "Querying after " << count << " sequential edits: first query " << (middle - start).count() <<
+    "us, " << query_count << " more queries " << (end - middle).count() << "us, " <<
+    "average depth " << static_cast<double>(stats.total_access_depth) / stats.access_count <<
+    ", maximum depth " << stats.max_access_depth << ", " << stats.rebalance_count << " rebalances\n";
+}
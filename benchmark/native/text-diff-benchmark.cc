@@ -0,0 +1,69 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include "catch.hpp"
+#include "text.h"
+#include "text-slice.h"
+#include "text-diff.h"
+
+using namespace std::chrono;
+using std::u16string;
+
+static u16string get_random_line(std::default_random_engine &engine) {
+  u16string result(engine() % 4, u' ');
+  for (uint32_t i = 0, n = engine() % 60; i < n; i++) {
+    result.push_back(u'a' + engine() % 26);
+  }
+  result.push_back(u'\n');
+  return result;
+}
+
+static void benchmark_text_diff(const char *description, const Text &old_text, const Text &new_text,
+                                unsigned thread_count = 1) {
+  milliseconds start = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  Patch patch = text_diff(old_text, new_text, thread_count);
+  milliseconds end = duration_cast<milliseconds>(system_clock::now().time_since_epoch());
+  std::cout << "Diffing " << description << " " << (end - start).count() << "ms, " <<
+    patch.get_change_count() << " changes\n";
+}
+
+TEST_CASE("text_diff - large text with scattered edits") {
+  uint32_t line_count = 100000;
+  std::default_random_engine engine{0};
+  u16string old_content, new_content;
+  for (uint32_t i = 0; i < line_count; i++) {
+    u16string line = get_random_line(engine);
+    old_content += line;
+    switch (engine() % 100) {
+      case 0: new_content += get_random_line(engine); break;
+      case 1: new_content += get_random_line(engine) + line; break;
+      case 2: line.insert(0, u"// "); new_content += line; break;
+      case 3: break;
+      default: new_content += line; break;
+    }
+  }
+  Text old_text{old_content}, new_text{new_content};
+  benchmark_text_diff("a large text with scattered edits", old_text, new_text);
+
+  Text edited_text{old_content}, inserted_text{u"x"};
+  edited_text.splice(Point(line_count / 2, 0), Point(), inserted_text);
+  benchmark_text_diff("a large text with one edit", old_text, edited_text);
+}
+
+TEST_CASE("text_diff - very large text on multiple threads") {
+  uint32_t line_count = 2000000;
+  std::default_random_engine engine{0};
+  u16string old_content, new_content;
+  for (uint32_t i = 0; i < line_count; i++) {
+    u16string line = get_random_line(engine);
+    old_content += line;
+    switch (engine() % 100) {
+      case 0: new_content += get_random_line(engine); break;
+      case 1: line.insert(0, u"// "); new_content += line; break;
+      default: new_content += line; break;
+    }
+  }
+  Text old_text{old_content}, new_text{new_content};
+  benchmark_text_diff("a very large text on one thread", old_text, new_text);
+  benchmark_text_diff("a very large text on four threads", old_text, new_text, 4);
+}
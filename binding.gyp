@@ -13,6 +13,7 @@
                 "src/bindings/range-wrapper.cc",
                 "src/bindings/text-buffer-wrapper.cc",
                 "src/bindings/text-buffer-snapshot-wrapper.cc",
+                "src/bindings/live-search-wrapper.cc",
                 "src/bindings/text-reader.cc",
                 "src/bindings/string-conversion.cc",
                 "src/bindings/text-writer.cc",
@@ -29,16 +30,22 @@
                 "./vendor/pcre/pcre.gyp:pcre",
             ],
             "sources": [
+                "src/core/aho-corasick.cc",
                 "src/core/encoding-conversion.cc",
+                "src/core/file-searcher.cc",
                 "src/core/marker-index.cc",
                 "src/core/patch.cc",
                 "src/core/point.cc",
                 "src/core/range.cc",
                 "src/core/regex.cc",
+                "src/core/regex-cache.cc",
+                "src/core/regex-nfa.cc",
+                "src/core/search-context.cc",
                 "src/core/text.cc",
                 "src/core/text-buffer.cc",
                 "src/core/text-slice.cc",
                 "src/core/text-diff.cc",
+                "src/core/trigram-index.cc",
                 "src/core/libmba-diff.cc",
             ],
             "include_dirs": [
@@ -85,7 +92,9 @@
                     "test/native/test-helpers.cc",
                     "test/native/tests.cc",
                     "test/native/encoding-conversion-test.cc",
+                    "test/native/file-searcher-test.cc",
                     "test/native/patch-test.cc",
+                    "test/native/regex-test.cc",
                     "test/native/text-buffer-test.cc",
                     "test/native/text-test.cc",
                     "test/native/text-diff-test.cc",
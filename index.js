@@ -100,7 +100,7 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
   }
 
   const {compose} = Patch
-  const {splice} = Patch.prototype
+  const {splice, rebase, translateOldPositions, translateNewPositions} = Patch.prototype
 
   Patch.compose = function (patches) {
     const result = compose.call(this, patches)
@@ -113,6 +113,18 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
       throw new Error('Patch does not apply')
     }
   }, splice)
+
+  Patch.prototype.rebase = function (concurrentPatch, concurrentFirst) {
+    return rebase.call(this, concurrentPatch, Boolean(concurrentFirst))
+  }
+
+  Patch.prototype.translateOldPositions = function (positions, clipForward) {
+    return translateOldPositions.call(this, positions, Boolean(clipForward))
+  }
+
+  Patch.prototype.translateNewPositions = function (positions, clipForward) {
+    return translateNewPositions.call(this, positions, Boolean(clipForward))
+  }
 } else {
   try {
     binding = require('./build/Release/superstring.node')
@@ -127,8 +139,10 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
   const {TextBuffer, TextWriter, TextReader} = binding
   const {
     load, save, baseTextMatchesFile,
-    find, findAll, findSync, findAllSync, findWordsWithSubsequenceInRange
+    find, findAll, findAllStreaming, findSync, findAllSync, findAllMultiSync, replaceAllSync,
+    findBackwardSync, countAll, countAllSync, buildTrigramIndex, findWordsWithSubsequenceInRange
   } = TextBuffer.prototype
+  const {searchFiles, setRegexLimits, setRegexEngine} = TextBuffer
 
   TextBuffer.prototype.load = function (source, options, progressCallback) {
     if (typeof options !== 'object') {
@@ -239,6 +253,33 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     })
   }
 
+  // Calls `batchCallback` with packed Uint32Arrays of matches while the search
+  // is running, four values (start row, start column, end row, end column) per
+  // match. Returning `false` from the callback stops the search. A search that
+  // exceeds the match limit resolves with `limitExceeded` set, while one that
+  // fails for any other reason rejects.
+  TextBuffer.prototype.findAllStreaming = function (pattern, options, batchCallback) {
+    if (typeof options !== 'object' || options === null) {
+      batchCallback = options
+      options = {}
+    }
+
+    return new Promise((resolve, reject) => {
+      findAllStreaming.call(
+        this,
+        pattern,
+        batchCallback,
+        (error, matchCount, cancelled, limitExceeded) => {
+          error ? reject(error) : resolve({matchCount, cancelled, limitExceeded})
+        },
+        options.range || null,
+        options.batchSize == null ? 1000 : options.batchSize,
+        options.maxCount == null ? 0xFFFFFFFF : options.maxCount,
+        options.cancelOnEdit === true
+      )
+    })
+  }
+
   TextBuffer.prototype.findSync = function (pattern) {
     return this.findInRangeSync(pattern, null)
   }
@@ -256,6 +297,51 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     return interpretRangeArray(findAllSync.call(this, pattern, range))
   }
 
+  TextBuffer.prototype.findBackwardSync = function (pattern) {
+    return this.findBackwardInRangeSync(pattern, null)
+  }
+
+  TextBuffer.prototype.findBackwardInRangeSync = function (pattern, range) {
+    const result = findBackwardSync.call(this, pattern, range)
+    return result.length > 0 ? interpretRange(result) : null
+  }
+
+  TextBuffer.prototype.countAllSync = function (pattern, options = {}) {
+    return countAllSync.call(this, pattern, options.range || null, options.limit)
+  }
+
+  TextBuffer.prototype.countAll = function (pattern, options = {}) {
+    return new Promise((resolve, reject) => {
+      countAll.call(this, pattern, (error, count) => {
+        error ? reject(error) : resolve(count)
+      }, options.range || null, options.limit)
+    })
+  }
+
+  TextBuffer.prototype.buildTrigramIndex = function () {
+    return new Promise((resolve, reject) => {
+      buildTrigramIndex.call(this, (error, installed) => {
+        error ? reject(error) : resolve(installed)
+      })
+    })
+  }
+
+  TextBuffer.prototype.findAllMultiSync = function (patterns) {
+    return interpretPatternMatchArray(findAllMultiSync.call(this, patterns, null))
+  }
+
+  TextBuffer.prototype.findAllMultiInRangeSync = function (patterns, range) {
+    return interpretPatternMatchArray(findAllMultiSync.call(this, patterns, range))
+  }
+
+  TextBuffer.prototype.replaceAllSync = function (pattern, replacement) {
+    return replaceAllSync.call(this, pattern, replacement, null)
+  }
+
+  TextBuffer.prototype.replaceAllInRangeSync = function (pattern, replacement, range) {
+    return replaceAllSync.call(this, pattern, replacement, range)
+  }
+
   TextBuffer.prototype.findWordsWithSubsequence = function (query, extraWordCharacters, maxCount) {
     return this.findWordsWithSubsequenceInRange(query, extraWordCharacters, maxCount, {
       start: {row: 0, column: 0},
@@ -282,6 +368,60 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     )
   }
 
+  // Bounds the time spent on a single match attempt by regexes prone to
+  // catastrophic backtracking. Limits of 0 restore PCRE's defaults. Async
+  // searches that exceed a limit are rejected, while streaming searches report
+  // `limitExceeded` along with the matches found before the limit was hit.
+  TextBuffer.setRegexLimits = function ({matchLimit = 0, depthLimit = 0, jitStackSize = 0} = {}) {
+    setRegexLimits.call(this, matchLimit, depthLimit, jitStackSize)
+  }
+
+  const REGEX_ENGINES = ['backtracking', 'nfa', 'automatic']
+
+  // Chooses how regexes are matched. The 'nfa' engine finds the same matches
+  // as the default 'backtracking' one in time linear in the length of the
+  // searched text, but is slower on typical patterns. 'automatic' uses it only
+  // for patterns prone to catastrophic backtracking. Patterns that it doesn't
+  // support, such as those with backreferences, always use backtracking.
+  TextBuffer.setRegexEngine = function (engine = 'backtracking') {
+    const index = REGEX_ENGINES.indexOf(engine)
+    if (index === -1) throw new Error(`Unknown regex engine: ${engine}`)
+    setRegexEngine.call(this, index)
+  }
+
+  // Searches files on disk on several threads, calling `resultCallback` with
+  // the matches of each file as soon as it has been searched. Returning `false`
+  // from the callback stops the search.
+  TextBuffer.searchFiles = function (paths, pattern, options, resultCallback) {
+    if (typeof options !== 'object' || options === null) {
+      resultCallback = options
+      options = {}
+    }
+
+    const encoding = normalizeEncoding(options.encoding || 'UTF-8')
+    return new Promise((resolve, reject) => {
+      searchFiles.call(
+        this,
+        paths,
+        pattern,
+        encoding,
+        options.maxMatchesPerFile,
+        options.threadCount,
+        (result) => {
+          if (result.error) return resultCallback({path: result.path, error: result.error})
+          const matches = interpretRangeArray(result.ranges).map((range, i) => ({
+            range,
+            lineText: result.lineTexts[i]
+          }))
+          return resultCallback({path: result.path, matches, reachedMatchLimit: result.reachedMatchLimit})
+        },
+        (error, cancelled) => {
+          error ? reject(error) : resolve({cancelled})
+        }
+      )
+    })
+  }
+
   TextBuffer.prototype.baseTextMatchesFile = function (source, encoding = 'UTF8') {
     return new Promise((resolve, reject) => {
       const callback = (error, result) => {
@@ -326,6 +466,20 @@ if (process.env.SUPERSTRING_USE_BROWSER_VERSION) {
     return ranges
   }
 
+  function interpretPatternMatchArray (rawData) {
+    const matchCount = rawData.length / 5
+    const matches = new Array(matchCount)
+    let rawIndex = 0
+    for (let matchIndex = 0; matchIndex < matchCount; matchIndex++) {
+      matches[matchIndex] = {
+        range: interpretRange(rawData, rawIndex),
+        patternIndex: rawData[rawIndex + 4]
+      }
+      rawIndex += 5
+    }
+    return matches
+  }
+
   function interpretRange (rawData, index = 0) {
     return {
       start: {
@@ -7,6 +7,7 @@
 #include "text-reader.h"
 #include "text-buffer-wrapper.h"
 #include "text-buffer-snapshot-wrapper.h"
+#include "live-search-wrapper.h"
 
 using namespace v8;
 
@@ -19,6 +20,7 @@ void Init(Local<Object> exports) {
   TextWriter::init(exports);
   TextReader::init(exports);
   TextBufferSnapshotWrapper::init();
+  LiveSearchWrapper::init();
 }
 
 NODE_MODULE(superstring, Init)
@@ -77,6 +77,85 @@ bool splice_with_text(Patch &patch, Point start, Point deleted_extent, Point ins
   );
 }
 
+emscripten::val get_changes_packed(Patch &patch) {
+  static const uint32_t missing_text_offset = UINT32_MAX;
+
+  vector<uint32_t> coordinates;
+  std::u16string text;
+  auto append_text = [&text, &coordinates](const Text *change_text) {
+    if (change_text) {
+      coordinates.push_back(text.size());
+      text.append(change_text->begin(), change_text->end());
+      coordinates.push_back(text.size());
+    } else {
+      coordinates.push_back(missing_text_offset);
+      coordinates.push_back(missing_text_offset);
+    }
+  };
+
+  for (const Patch::Change &change : patch.get_changes()) {
+    for (const Point &point : {change.old_start, change.old_end, change.new_start, change.new_end}) {
+      coordinates.push_back(point.row);
+      coordinates.push_back(point.column);
+    }
+    append_text(change.old_text);
+    append_text(change.new_text);
+  }
+
+  auto changes = emscripten::val::global("Uint32Array").new_(coordinates.size());
+  changes.call<void>("set", emscripten::val(emscripten::typed_memory_view(coordinates.size(), coordinates.data())));
+  auto result = emscripten::val::object();
+  result.set("changes", changes);
+  result.set("text", em_transmit(text));
+  return result;
+}
+
+emscripten::val translate_positions(Patch &patch, emscripten::val js_positions, bool clip_forward,
+                                    Patch::TranslationDirection direction) {
+  vector<Point> positions;
+  for (unsigned i = 0, length = js_positions["length"].as<unsigned>(); i + 1 < length; i += 2) {
+    positions.push_back(Point(js_positions[i].as<unsigned>(), js_positions[i + 1].as<unsigned>()));
+  }
+
+  vector<uint32_t> coordinates;
+  coordinates.reserve(positions.size() * 2);
+  auto clip_direction = clip_forward ? Patch::ClipDirection::Forward : Patch::ClipDirection::Backward;
+  for (const Point &position : patch.translate_positions(positions, direction, clip_direction)) {
+    coordinates.push_back(position.row);
+    coordinates.push_back(position.column);
+  }
+
+  auto result = emscripten::val::global("Uint32Array").new_(coordinates.size());
+  result.call<void>("set", emscripten::val(emscripten::typed_memory_view(coordinates.size(), coordinates.data())));
+  return result;
+}
+
+emscripten::val translate_old_positions(Patch &patch, emscripten::val js_positions, bool clip_forward) {
+  return translate_positions(patch, js_positions, clip_forward, Patch::TranslationDirection::OldToNew);
+}
+
+emscripten::val translate_new_positions(Patch &patch, emscripten::val js_positions, bool clip_forward) {
+  return translate_positions(patch, js_positions, clip_forward, Patch::TranslationDirection::NewToOld);
+}
+
+Patch rebase(Patch &patch, const Patch &concurrent_patch, bool concurrent_first) {
+  return patch.rebase(
+    concurrent_patch,
+    concurrent_first ? Patch::RebaseTieBreak::ConcurrentFirst : Patch::RebaseTieBreak::ThisFirst
+  );
+}
+
+emscripten::val get_tree_stats(Patch &patch) {
+  Patch::TreeStats stats = patch.get_tree_stats();
+  auto result = emscripten::val::object();
+  result.set("accessCount", static_cast<double>(stats.access_count));
+  result.set("totalAccessDepth", static_cast<double>(stats.total_access_depth));
+  result.set("maxAccessDepth", stats.max_access_depth);
+  result.set("rotationCount", static_cast<double>(stats.rotation_count));
+  result.set("rebalanceCount", stats.rebalance_count);
+  return result;
+}
+
 template <typename T>
 void change_set_noop(Patch::Change &change, T const &) {}
 
@@ -89,13 +168,18 @@ EMSCRIPTEN_BINDINGS(Patch) {
     .function("spliceOld", WRAP(&Patch::splice_old))
     .function("copy", WRAP(&Patch::copy))
     .function("invert", WRAP(&Patch::invert))
+    .function("rebase", WRAP(&rebase))
     .function("getChanges", WRAP(&Patch::get_changes))
+    .function("getChangesPacked", WRAP(&get_changes_packed))
     .function("getChangesInNewRange", WRAP(&Patch::grab_changes_in_new_range))
     .function("getChangesInOldRange", WRAP(&Patch::grab_changes_in_old_range))
     .function("getChangeCount", WRAP(&Patch::get_change_count))
     .function("changeForOldPosition", WRAP(&Patch::grab_change_starting_before_old_position))
     .function("changeForNewPosition", WRAP(&Patch::grab_change_starting_before_new_position))
+    .function("translateOldPositions", WRAP(&translate_old_positions))
+    .function("translateNewPositions", WRAP(&translate_new_positions))
     .function("getBounds", WRAP(&Patch::get_bounds))
+    .function("getTreeStats", WRAP(&get_tree_stats))
     .function("rebalance", WRAP(&Patch::rebalance))
     .function("serialize", WRAP(&serialize))
     .class_function("compose", WRAP_STATIC(&compose), emscripten::allow_raw_pointers())
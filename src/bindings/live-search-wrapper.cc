@@ -0,0 +1,111 @@
+#include "live-search-wrapper.h"
+#include "point-wrapper.h"
+#include "range-wrapper.h"
+
+using namespace v8;
+using std::vector;
+
+static Nan::Persistent<v8::Function> live_search_wrapper_constructor;
+
+static Local<Array> marker_ids_to_js(const vector<MarkerIndex::MarkerId> &marker_ids) {
+  Local<Array> js_array = Nan::New<Array>(marker_ids.size());
+  for (size_t i = 0; i < marker_ids.size(); i++) {
+    Nan::Set(js_array, i, Nan::New<Integer>(marker_ids[i]));
+  }
+  return js_array;
+}
+
+void LiveSearchWrapper::init() {
+  auto class_name = Nan::New("LiveSearch").ToLocalChecked();
+
+  auto constructor_template = Nan::New<FunctionTemplate>(construct);
+  constructor_template->SetClassName(class_name);
+  constructor_template->InstanceTemplate()->SetInternalFieldCount(1);
+
+  const auto &prototype_template = constructor_template->PrototypeTemplate();
+  Nan::SetTemplate(prototype_template, Nan::New("getMatchCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_match_count), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getRange").ToLocalChecked(), Nan::New<FunctionTemplate>(get_range), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findIntersecting").ToLocalChecked(), Nan::New<FunctionTemplate>(find_intersecting), None);
+  Nan::SetTemplate(prototype_template, Nan::New("takeChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(take_changes), None);
+  Nan::SetTemplate(prototype_template, Nan::New("destroy").ToLocalChecked(), Nan::New<FunctionTemplate>(destroy), None);
+
+  live_search_wrapper_constructor.Reset(Nan::GetFunction(constructor_template).ToLocalChecked());
+}
+
+LiveSearchWrapper::LiveSearchWrapper(Local<Object> js_buffer, TextBuffer::LiveSearch *live_search) :
+  live_search{live_search} {
+  js_text_buffer.Reset(Isolate::GetCurrent(), js_buffer);
+}
+
+LiveSearchWrapper::~LiveSearchWrapper() {
+  delete live_search;
+  js_text_buffer.Reset();
+}
+
+Local<Value> LiveSearchWrapper::new_instance(Local<Object> js_buffer, TextBuffer::LiveSearch *live_search) {
+  Local<Object> result;
+  if (Nan::NewInstance(Nan::New(live_search_wrapper_constructor)).ToLocal(&result)) {
+    (new LiveSearchWrapper(js_buffer, live_search))->Wrap(result);
+    return result;
+  } else {
+    delete live_search;
+    return Nan::Null();
+  }
+}
+
+LiveSearchWrapper *LiveSearchWrapper::from_js(Local<Value> value) {
+  auto wrapper = Nan::ObjectWrap::Unwrap<LiveSearchWrapper>(Nan::To<Object>(value).ToLocalChecked());
+  if (!wrapper->live_search) {
+    Nan::ThrowError("This live search has been destroyed");
+    return nullptr;
+  }
+  return wrapper;
+}
+
+void LiveSearchWrapper::construct(const Nan::FunctionCallbackInfo<Value> &info) {
+  info.GetReturnValue().Set(Nan::Null());
+}
+
+void LiveSearchWrapper::get_match_count(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = from_js(info.This());
+  if (!wrapper) return;
+  info.GetReturnValue().Set(Nan::New<Number>(wrapper->live_search->match_count()));
+}
+
+void LiveSearchWrapper::get_range(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = from_js(info.This());
+  if (!wrapper) return;
+  Nan::Maybe<unsigned> id = Nan::To<unsigned>(info[0]);
+  if (id.IsJust()) {
+    info.GetReturnValue().Set(RangeWrapper::from_range(wrapper->live_search->get_range(id.FromJust())));
+  }
+}
+
+void LiveSearchWrapper::find_intersecting(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = from_js(info.This());
+  if (!wrapper) return;
+  optional<Point> start = PointWrapper::point_from_js(info[0]);
+  optional<Point> end = PointWrapper::point_from_js(info[1]);
+  if (start && end) {
+    info.GetReturnValue().Set(marker_ids_to_js(wrapper->live_search->find_intersecting(Range{*start, *end})));
+  }
+}
+
+void LiveSearchWrapper::take_changes(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = from_js(info.This());
+  if (!wrapper) return;
+  auto changes = wrapper->live_search->take_changes();
+  auto result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("added").ToLocalChecked(), marker_ids_to_js(changes.added));
+  Nan::Set(result, Nan::New("removed").ToLocalChecked(), marker_ids_to_js(changes.removed));
+  info.GetReturnValue().Set(result);
+}
+
+void LiveSearchWrapper::destroy(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto wrapper = Nan::ObjectWrap::Unwrap<LiveSearchWrapper>(Nan::To<Object>(info.This()).ToLocalChecked());
+  if (wrapper->live_search) {
+    delete wrapper->live_search;
+    wrapper->live_search = nullptr;
+    wrapper->js_text_buffer.Reset();
+  }
+}
@@ -0,0 +1,29 @@
+#ifndef SUPERSTRING_LIVE_SEARCH_WRAPPER_H
+#define SUPERSTRING_LIVE_SEARCH_WRAPPER_H
+
+#include "nan.h"
+#include "text-buffer.h"
+
+class LiveSearchWrapper : public Nan::ObjectWrap {
+public:
+  static void init();
+
+  static v8::Local<v8::Value> new_instance(v8::Local<v8::Object>, TextBuffer::LiveSearch *);
+
+private:
+  LiveSearchWrapper(v8::Local<v8::Object> js_buffer, TextBuffer::LiveSearch *live_search);
+  ~LiveSearchWrapper();
+
+  static LiveSearchWrapper *from_js(v8::Local<v8::Value>);
+  static void construct(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_match_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_intersecting(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void take_changes(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void destroy(const Nan::FunctionCallbackInfo<v8::Value> &info);
+
+  v8::Persistent<v8::Object> js_text_buffer;
+  TextBuffer::LiveSearch *live_search;
+};
+
+#endif // SUPERSTRING_LIVE_SEARCH_WRAPPER_H
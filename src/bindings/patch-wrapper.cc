@@ -13,6 +13,8 @@ using std::u16string;
 
 static Nan::Persistent<String> new_text_string;
 static Nan::Persistent<String> old_text_string;
+static Nan::Persistent<String> changes_string;
+static Nan::Persistent<String> text_string;
 static Nan::Persistent<v8::Function> change_wrapper_constructor;
 static Nan::Persistent<v8::FunctionTemplate> patch_wrapper_constructor_template;
 static Nan::Persistent<v8::Function> patch_wrapper_constructor;
@@ -111,6 +113,8 @@ class ChangeWrapper : public Nan::ObjectWrap {
 
 void PatchWrapper::init(Local<Object> exports) {
   ChangeWrapper::init();
+  changes_string.Reset(Nan::New("changes").ToLocalChecked());
+  text_string.Reset(Nan::New("text").ToLocalChecked());
 
   Local<FunctionTemplate> constructor_template_local = Nan::New<FunctionTemplate>(construct);
   constructor_template_local->SetClassName(Nan::New<String>("Patch").ToLocalChecked());
@@ -123,7 +127,10 @@ void PatchWrapper::init(Local<Object> exports) {
   Nan::SetTemplate(prototype_template, Nan::New("spliceOld").ToLocalChecked(), Nan::New<FunctionTemplate>(splice_old), None);
   Nan::SetTemplate(prototype_template, Nan::New("copy").ToLocalChecked(), Nan::New<FunctionTemplate>(copy), None);
   Nan::SetTemplate(prototype_template, Nan::New("invert").ToLocalChecked(), Nan::New<FunctionTemplate>(invert), None);
+  Nan::SetTemplate(prototype_template, Nan::New("rebase").ToLocalChecked(), Nan::New<FunctionTemplate>(rebase), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChanges").ToLocalChecked(), Nan::New<FunctionTemplate>(get_changes), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getChangesPacked").ToLocalChecked(),
+                          Nan::New<FunctionTemplate>(get_changes_packed), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChangesInOldRange").ToLocalChecked(),
                           Nan::New<FunctionTemplate>(get_changes_in_old_range), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChangesInNewRange").ToLocalChecked(),
@@ -132,12 +139,17 @@ void PatchWrapper::init(Local<Object> exports) {
                           Nan::New<FunctionTemplate>(change_for_old_position), None);
   Nan::SetTemplate(prototype_template, Nan::New("changeForNewPosition").ToLocalChecked(),
                           Nan::New<FunctionTemplate>(change_for_new_position), None);
+  Nan::SetTemplate(prototype_template, Nan::New("translateOldPositions").ToLocalChecked(),
+                          Nan::New<FunctionTemplate>(translate_old_positions), None);
+  Nan::SetTemplate(prototype_template, Nan::New("translateNewPositions").ToLocalChecked(),
+                          Nan::New<FunctionTemplate>(translate_new_positions), None);
   Nan::SetTemplate(prototype_template, Nan::New("serialize").ToLocalChecked(), Nan::New<FunctionTemplate>(serialize), None);
   Nan::SetTemplate(prototype_template, Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(get_dot_graph), None);
   Nan::SetTemplate(prototype_template, Nan::New("getJSON").ToLocalChecked(), Nan::New<FunctionTemplate>(get_json), None);
   Nan::SetTemplate(prototype_template, Nan::New("rebalance").ToLocalChecked(), Nan::New<FunctionTemplate>(rebalance), None);
   Nan::SetTemplate(prototype_template, Nan::New("getChangeCount").ToLocalChecked(), Nan::New<FunctionTemplate>(get_change_count), None);
   Nan::SetTemplate(prototype_template, Nan::New("getBounds").ToLocalChecked(), Nan::New<FunctionTemplate>(get_bounds), None);
+  Nan::SetTemplate(prototype_template, Nan::New("getTreeStats").ToLocalChecked(), Nan::New<FunctionTemplate>(get_tree_stats), None);
   patch_wrapper_constructor_template.Reset(constructor_template_local);
   patch_wrapper_constructor.Reset(Nan::GetFunction(constructor_template_local).ToLocalChecked());
   Nan::Set(exports, Nan::New("Patch").ToLocalChecked(), Nan::New(patch_wrapper_constructor));
@@ -236,6 +248,25 @@ void PatchWrapper::invert(const Nan::FunctionCallbackInfo<Value> &info) {
   }
 }
 
+void PatchWrapper::rebase(const Nan::FunctionCallbackInfo<Value> &info) {
+  Local<Object> result;
+  if (Nan::NewInstance(Nan::New(patch_wrapper_constructor)).ToLocal(&result)) {
+    if (!info[0]->IsObject() || !Nan::New(patch_wrapper_constructor_template)->HasInstance(info[0])) {
+      Nan::ThrowTypeError("Patch.rebase must be called with a patch");
+      return;
+    }
+
+    Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+    Patch &concurrent_patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(Local<Object>::Cast(info[0]))->patch;
+    auto tie_break = Nan::To<bool>(info[1]).FromMaybe(false) ?
+      Patch::RebaseTieBreak::ConcurrentFirst :
+      Patch::RebaseTieBreak::ThisFirst;
+    auto wrapper = new PatchWrapper{patch.rebase(concurrent_patch, tie_break)};
+    wrapper->Wrap(result);
+    info.GetReturnValue().Set(result);
+  }
+}
+
 void PatchWrapper::get_changes(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
 
@@ -249,6 +280,63 @@ void PatchWrapper::get_changes(const Nan::FunctionCallbackInfo<Value> &info) {
   info.GetReturnValue().Set(js_result);
 }
 
+// Returns every change as twelve integers in a single `Uint32Array`: the rows
+// and columns of `oldStart`, `oldEnd`, `newStart` and `newEnd`, followed by the
+// start and end offsets of the old and new texts within one concatenated
+// string. The offsets of a missing text are both `0xFFFFFFFF`. This avoids
+// allocating a wrapper object and two strings per change.
+void PatchWrapper::get_changes_packed(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  static const uint32_t fields_per_change = 12;
+  static const uint32_t missing_text_offset = UINT32_MAX;
+
+  auto changes = patch.get_changes();
+  uint32_t changes_buffer_size = changes.size() * fields_per_change * sizeof(uint32_t);
+  auto changes_buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), changes_buffer_size);
+  #if (V8_MAJOR_VERSION < 8)
+    uint32_t *changes_data = reinterpret_cast<uint32_t *>(changes_buffer->GetContents().Data());
+  #else
+    uint32_t *changes_data = reinterpret_cast<uint32_t *>(changes_buffer->GetBackingStore()->Data());
+  #endif
+
+  size_t text_size = 0;
+  for (const Patch::Change &change : changes) {
+    if (change.old_text) text_size += change.old_text->size();
+    if (change.new_text) text_size += change.new_text->size();
+  }
+  u16string text;
+  text.reserve(text_size);
+
+  auto append_text = [&text, &changes_data](const Text *change_text) {
+    if (change_text) {
+      *changes_data++ = text.size();
+      text.append(change_text->begin(), change_text->end());
+      *changes_data++ = text.size();
+    } else {
+      *changes_data++ = missing_text_offset;
+      *changes_data++ = missing_text_offset;
+    }
+  };
+
+  for (const Patch::Change &change : changes) {
+    *changes_data++ = change.old_start.row;
+    *changes_data++ = change.old_start.column;
+    *changes_data++ = change.old_end.row;
+    *changes_data++ = change.old_end.column;
+    *changes_data++ = change.new_start.row;
+    *changes_data++ = change.new_start.column;
+    *changes_data++ = change.new_end.row;
+    *changes_data++ = change.new_end.column;
+    append_text(change.old_text);
+    append_text(change.new_text);
+  }
+
+  Local<Object> js_result = Nan::New<Object>();
+  Nan::Set(js_result, Nan::New(changes_string), v8::Uint32Array::New(changes_buffer, 0, changes.size() * fields_per_change));
+  Nan::Set(js_result, Nan::New(text_string), string_conversion::string_to_js(text));
+  info.GetReturnValue().Set(js_result);
+}
+
 void PatchWrapper::get_changes_in_old_range(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
 
@@ -311,6 +399,57 @@ void PatchWrapper::change_for_new_position(const Nan::FunctionCallbackInfo<Value
   }
 }
 
+// Takes a `Uint32Array` of row and column pairs and returns the translated
+// positions in the same form. Positions inside a change are clipped to its
+// start, or to its end if the second argument is true.
+static void translate_positions(const Nan::FunctionCallbackInfo<Value> &info, const Patch &patch,
+                                Patch::TranslationDirection direction) {
+  if (!info[0]->IsUint32Array()) {
+    Nan::ThrowTypeError("Expected a Uint32Array of row and column pairs");
+    return;
+  }
+  Nan::TypedArrayContents<uint32_t> js_positions(info[0]);
+  if (js_positions.length() % 2 != 0) {
+    Nan::ThrowTypeError("Expected a Uint32Array of row and column pairs");
+    return;
+  }
+  auto clip_direction = Nan::To<bool>(info[1]).FromMaybe(false) ?
+    Patch::ClipDirection::Forward :
+    Patch::ClipDirection::Backward;
+
+  vector<Point> positions;
+  positions.reserve(js_positions.length() / 2);
+  for (size_t i = 0; i < js_positions.length(); i += 2) {
+    positions.push_back(Point((*js_positions)[i], (*js_positions)[i + 1]));
+  }
+
+  vector<Point> result = patch.translate_positions(positions, direction, clip_direction);
+
+  uint32_t result_buffer_size = result.size() * sizeof(Point);
+  auto result_buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), result_buffer_size);
+  #if (V8_MAJOR_VERSION < 8)
+    uint32_t *result_data = reinterpret_cast<uint32_t *>(result_buffer->GetContents().Data());
+  #else
+    uint32_t *result_data = reinterpret_cast<uint32_t *>(result_buffer->GetBackingStore()->Data());
+  #endif
+  for (const Point &position : result) {
+    *result_data++ = position.row;
+    *result_data++ = position.column;
+  }
+
+  info.GetReturnValue().Set(v8::Uint32Array::New(result_buffer, 0, result.size() * 2));
+}
+
+void PatchWrapper::translate_old_positions(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  translate_positions(info, patch, Patch::TranslationDirection::OldToNew);
+}
+
+void PatchWrapper::translate_new_positions(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  translate_positions(info, patch, Patch::TranslationDirection::NewToOld);
+}
+
 void PatchWrapper::serialize(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
 
@@ -330,11 +469,8 @@ void PatchWrapper::deserialize(const Nan::FunctionCallbackInfo<Value> &info) {
   Local<Object> result;
   if (Nan::NewInstance(Nan::New(patch_wrapper_constructor)).ToLocal(&result)) {
     if (info[0]->IsUint8Array()) {
-      auto *data = node::Buffer::Data(info[0]);
-
-      static vector<uint8_t> input;
-      input.assign(data, data + node::Buffer::Length(info[0]));
-      Deserializer deserializer(input);
+      auto *data = reinterpret_cast<const uint8_t *>(node::Buffer::Data(info[0]));
+      Deserializer deserializer(data, node::Buffer::Length(info[0]));
       PatchWrapper *wrapper = new PatchWrapper(Patch{deserializer});
       wrapper->Wrap(result);
       info.GetReturnValue().Set(result);
@@ -404,6 +540,18 @@ void PatchWrapper::get_bounds(const Nan::FunctionCallbackInfo<Value> &info) {
   }
 }
 
+void PatchWrapper::get_tree_stats(const Nan::FunctionCallbackInfo<Value> &info) {
+  Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
+  Patch::TreeStats stats = patch.get_tree_stats();
+  Local<Object> js_result = Nan::New<Object>();
+  Nan::Set(js_result, Nan::New("accessCount").ToLocalChecked(), Nan::New<Number>(stats.access_count));
+  Nan::Set(js_result, Nan::New("totalAccessDepth").ToLocalChecked(), Nan::New<Number>(stats.total_access_depth));
+  Nan::Set(js_result, Nan::New("maxAccessDepth").ToLocalChecked(), Nan::New<Number>(stats.max_access_depth));
+  Nan::Set(js_result, Nan::New("rotationCount").ToLocalChecked(), Nan::New<Number>(stats.rotation_count));
+  Nan::Set(js_result, Nan::New("rebalanceCount").ToLocalChecked(), Nan::New<Number>(stats.rebalance_count));
+  info.GetReturnValue().Set(js_result);
+}
+
 void PatchWrapper::rebalance(const Nan::FunctionCallbackInfo<Value> &info) {
   Patch &patch = Nan::ObjectWrap::Unwrap<PatchWrapper>(info.This())->patch;
   patch.rebalance();
@@ -13,11 +13,15 @@ class PatchWrapper : public Nan::ObjectWrap {
   static void splice_old(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void copy(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void invert(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void rebase(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_changes(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_changes_packed(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_changes_in_old_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_changes_in_new_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void change_for_old_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void change_for_new_position(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void translate_old_positions(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void translate_new_positions(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void serialize(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void deserialize(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void compose(const Nan::FunctionCallbackInfo<v8::Value> &info);
@@ -25,6 +29,7 @@ class PatchWrapper : public Nan::ObjectWrap {
   static void get_json(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_change_count(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_bounds(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_tree_stats(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void rebalance(const Nan::FunctionCallbackInfo<v8::Value> &info);
 
   Patch patch;
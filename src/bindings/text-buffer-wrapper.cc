@@ -1,7 +1,10 @@
 #include "text-buffer-wrapper.h"
+#include <atomic>
 #include <sstream>
 #include <iomanip>
 #include <stdio.h>
+#include <mutex>
+#include <thread>
 #include "number-conversion.h"
 #include "point-wrapper.h"
 #include "range-wrapper.h"
@@ -9,9 +12,12 @@
 #include "string-conversion.h"
 #include "patch-wrapper.h"
 #include "text-buffer-snapshot-wrapper.h"
+#include "live-search-wrapper.h"
 #include "text-writer.h"
 #include "text-slice.h"
 #include "text-diff.h"
+#include "regex-cache.h"
+#include "file-searcher.h"
 #include "noop.h"
 #include <sys/stat.h>
 
@@ -74,13 +80,13 @@ static size_t CHUNK_SIZE = 10 * 1024;
 
 class RegexWrapper : public Nan::ObjectWrap {
  public:
-  Regex regex;
+  std::shared_ptr<const Regex> regex;
   static Nan::Persistent<Function> constructor;
   static void construct(const Nan::FunctionCallbackInfo<v8::Value> &info) {}
 
-  RegexWrapper(Regex &&regex) : regex{move(regex)} {}
+  RegexWrapper(std::shared_ptr<const Regex> regex) : regex{move(regex)} {}
 
-  static const Regex *regex_from_js(const Local<Value> &value) {
+  static std::shared_ptr<const Regex> regex_from_js(const Local<Value> &value) {
     Local<String> js_pattern;
     Local<RegExp> js_regex;
     Local<String> cache_key = Nan::New("__textBufferRegex").ToLocalChecked();
@@ -93,7 +99,7 @@ class RegexWrapper : public Nan::ObjectWrap {
       js_regex = Local<RegExp>::Cast(value);
       Local<Value> stored_regex = Nan::Get(js_regex, cache_key).ToLocalChecked();
       if (!stored_regex->IsUndefined()) {
-        return &Nan::ObjectWrap::Unwrap<RegexWrapper>(Nan::To<Object>(stored_regex).ToLocalChecked())->regex;
+        return Nan::ObjectWrap::Unwrap<RegexWrapper>(Nan::To<Object>(stored_regex).ToLocalChecked())->regex;
       }
       js_pattern = js_regex->GetSource();
       if (js_regex->GetFlags() & RegExp::kIgnoreCase) ignore_case = true;
@@ -105,22 +111,26 @@ class RegexWrapper : public Nan::ObjectWrap {
 
     u16string error_message;
     optional<u16string> pattern = string_conversion::string_from_js(js_pattern);
-    Regex regex(*pattern, &error_message, ignore_case, unicode);
-    if (!error_message.empty()) {
+    auto regex = RegexCache::shared().get(*pattern, &error_message, ignore_case, unicode);
+    if (!regex) {
       Nan::ThrowError(string_conversion::string_to_js(error_message));
       return nullptr;
     }
 
-    Local<Object> result;
-    if (!Nan::New(constructor)->NewInstance(Nan::GetCurrentContext()).ToLocal(&result)) {
-      Nan::ThrowError("Could not create regex wrapper");
-      return nullptr;
+    // Remember the compiled regex on the RegExp object itself, so that passing
+    // the same RegExp again doesn't even require a cache lookup.
+    if (!js_regex.IsEmpty()) {
+      Local<Object> result;
+      if (!Nan::New(constructor)->NewInstance(Nan::GetCurrentContext()).ToLocal(&result)) {
+        Nan::ThrowError("Could not create regex wrapper");
+        return nullptr;
+      }
+
+      (new RegexWrapper(regex))->Wrap(result);
+      Nan::Set(js_regex, cache_key, result);
     }
 
-    auto regex_wrapper = new RegexWrapper(move(regex));
-    regex_wrapper->Wrap(result);
-    if (!js_regex.IsEmpty()) Nan::Set(js_regex, cache_key, result);
-    return &regex_wrapper->regex;
+    return regex;
   }
 
   static void init() {
@@ -221,11 +231,27 @@ void TextBufferWrapper::init(Local<Object> exports) {
   Nan::SetTemplate(prototype_template, Nan::New("find").ToLocalChecked(), Nan::New<FunctionTemplate>(find), None);
   Nan::SetTemplate(prototype_template, Nan::New("findSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_sync), None);
   Nan::SetTemplate(prototype_template, Nan::New("findAll").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAllStreaming").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_streaming), None);
   Nan::SetTemplate(prototype_template, Nan::New("findAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findBackwardSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_backward_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("countAll").ToLocalChecked(), Nan::New<FunctionTemplate>(count_all), None);
+  Nan::SetTemplate(prototype_template, Nan::New("countAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(count_all_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("buildTrigramIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(build_trigram_index), None);
+  Nan::SetTemplate(prototype_template, Nan::New("clearTrigramIndex").ToLocalChecked(), Nan::New<FunctionTemplate>(clear_trigram_index), None);
+  Nan::SetTemplate(prototype_template, Nan::New("findAllMultiSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_all_multi_sync), None);
+  Nan::SetTemplate(prototype_template, Nan::New("replaceAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(replace_all_sync), None);
   Nan::SetTemplate(prototype_template, Nan::New("findAndMarkAllSync").ToLocalChecked(), Nan::New<FunctionTemplate>(find_and_mark_all_sync), None);
   Nan::SetTemplate(prototype_template, Nan::New("findWordsWithSubsequenceInRange").ToLocalChecked(), Nan::New<FunctionTemplate>(find_words_with_subsequence_in_range), None);
   Nan::SetTemplate(prototype_template, Nan::New("getDotGraph").ToLocalChecked(), Nan::New<FunctionTemplate>(dot_graph), None);
   Nan::SetTemplate(prototype_template, Nan::New("getSnapshot").ToLocalChecked(), Nan::New<FunctionTemplate>(get_snapshot), None);
+  Nan::SetTemplate(prototype_template, Nan::New("createLiveSearch").ToLocalChecked(), Nan::New<FunctionTemplate>(create_live_search), None);
+  Nan::SetTemplate(constructor_template, Nan::New("getRegexCacheStats").ToLocalChecked(), Nan::New<FunctionTemplate>(get_regex_cache_stats), None);
+  Nan::SetTemplate(constructor_template, Nan::New("setRegexCacheCapacity").ToLocalChecked(), Nan::New<FunctionTemplate>(set_regex_cache_capacity), None);
+  Nan::SetTemplate(constructor_template, Nan::New("setRegexLimits").ToLocalChecked(), Nan::New<FunctionTemplate>(set_regex_limits), None);
+  Nan::SetTemplate(constructor_template, Nan::New("setRegexEngine").ToLocalChecked(), Nan::New<FunctionTemplate>(set_regex_engine), None);
+  Nan::SetTemplate(constructor_template, Nan::New("serializeRegexCache").ToLocalChecked(), Nan::New<FunctionTemplate>(serialize_regex_cache), None);
+  Nan::SetTemplate(constructor_template, Nan::New("loadRegexCache").ToLocalChecked(), Nan::New<FunctionTemplate>(load_regex_cache), None);
+  Nan::SetTemplate(constructor_template, Nan::New("searchFiles").ToLocalChecked(), Nan::New<FunctionTemplate>(search_files), None);
   RegexWrapper::init();
   SubsequenceMatchWrapper::init();
   Nan::Set(exports, Nan::New("TextBuffer").ToLocalChecked(), Nan::GetFunction(constructor_template).ToLocalChecked());
@@ -396,36 +422,43 @@ static Local<Value> encode_ranges(const vector<Range> &ranges) {
   return result;
 }
 
+// Returns the message of the error that a search which ended with the given
+// status is reported with, or null if it ended normally.
+static const char *search_error_message(TextBuffer::SearchStatus status) {
+  switch (status) {
+    case TextBuffer::SearchStatus::LimitExceeded:
+      return "Regular expression search exceeded its match limit";
+    case TextBuffer::SearchStatus::Failed:
+      return "Regular expression search failed";
+    default:
+      return nullptr;
+  }
+}
+
 template <bool single_result>
 class TextBufferSearcher : public Nan::AsyncWorker {
   const TextBuffer::Snapshot *snapshot;
-  const Regex *regex;
+  std::shared_ptr<const Regex> regex;
   Range search_range;
   vector<Range> matches;
-  Nan::Persistent<Value> argument;
 
 public:
   TextBufferSearcher(Nan::Callback *completion_callback,
                      const TextBuffer::Snapshot *snapshot,
-                     const Regex *regex,
-                     const Range &search_range,
-                     Local<Value> arg) :
+                     std::shared_ptr<const Regex> regex,
+                     const Range &search_range) :
     AsyncWorker(completion_callback, "TextBuffer.find"),
     snapshot{snapshot},
-    regex{regex},
-    search_range(search_range) {
-    argument.Reset(arg);
-  }
+    regex{move(regex)},
+    search_range(search_range) {}
 
   void Execute() {
-    if (single_result) {
-      auto find_result = snapshot->find(*regex, search_range);
-      if (find_result) {
-        matches.push_back(*find_result);
-      }
-    } else {
-      matches = snapshot->find_all(*regex, search_range);
-    }
+    auto status = snapshot->scan(*regex, search_range, [this](Range match) -> bool {
+      matches.push_back(match);
+      return single_result;
+    });
+    const char *error_message = search_error_message(status);
+    if (error_message) SetErrorMessage(error_message);
   }
 
   void HandleOKCallback() {
@@ -433,11 +466,16 @@ public:
     Local<Value> argv[] = {Nan::Null(), encode_ranges(matches)};
     callback->Call(2, argv, async_resource);
   }
+
+  void HandleErrorCallback() {
+    delete snapshot;
+    Nan::AsyncWorker::HandleErrorCallback();
+  }
 };
 
 void TextBufferWrapper::find_sync(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
-  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  auto regex = RegexWrapper::regex_from_js(info[0]);
   if (regex) {
     optional<Range> search_range;
     if (info[1]->IsObject()) {
@@ -456,9 +494,30 @@ void TextBufferWrapper::find_sync(const Nan::FunctionCallbackInfo<Value> &info)
   }
 }
 
+void TextBufferWrapper::find_backward_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    optional<Range> search_range;
+    if (info[1]->IsObject()) {
+      search_range = RangeWrapper::range_from_js(info[1]);
+      if (!search_range) return;
+    }
+
+    auto match = text_buffer.find_backward(
+      *regex,
+      search_range ? *search_range : Range::all_inclusive()
+    );
+    vector<Range> matches;
+    if (match) matches.push_back(*match);
+
+    info.GetReturnValue().Set(encode_ranges(matches));
+  }
+}
+
 void TextBufferWrapper::find_all_sync(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
-  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  auto regex = RegexWrapper::regex_from_js(info[0]);
   if (regex) {
     optional<Range> search_range;
     if (info[1]->IsObject()) {
@@ -475,6 +534,116 @@ void TextBufferWrapper::find_all_sync(const Nan::FunctionCallbackInfo<Value> &in
   }
 }
 
+static optional<uint32_t> count_limit_from_js(Local<Value> value) {
+  if (!value->IsNumber()) return optional<uint32_t>{};
+  return number_conversion::number_from_js<uint32_t>(value);
+}
+
+void TextBufferWrapper::count_all_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    optional<Range> search_range;
+    if (info[1]->IsObject()) {
+      search_range = RangeWrapper::range_from_js(info[1]);
+      if (!search_range) return;
+    }
+
+    auto result = text_buffer.count_all(
+      *regex,
+      search_range ? *search_range : Range::all_inclusive(),
+      count_limit_from_js(info[2])
+    );
+
+    const char *error_message = search_error_message(result.status);
+    if (error_message) {
+      Nan::ThrowError(error_message);
+      return;
+    }
+
+    info.GetReturnValue().Set(Nan::New<Number>(result.count));
+  }
+}
+
+void TextBufferWrapper::find_all_multi_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  if (!info[0]->IsArray()) {
+    Nan::ThrowTypeError("Expected an array of patterns");
+    return;
+  }
+
+  auto js_patterns = info[0].As<Array>();
+  vector<std::shared_ptr<const Regex>> regexes;
+  vector<const Regex *> regex_pointers;
+  for (uint32_t i = 0, n = js_patterns->Length(); i < n; i++) {
+    auto regex = RegexWrapper::regex_from_js(Nan::Get(js_patterns, i).ToLocalChecked());
+    if (!regex) return;
+    regex_pointers.push_back(regex.get());
+    regexes.push_back(move(regex));
+  }
+
+  optional<Range> search_range;
+  if (info[1]->IsObject()) {
+    search_range = RangeWrapper::range_from_js(info[1]);
+    if (!search_range) return;
+  }
+
+  auto matches = text_buffer.find_all_multi(
+    regex_pointers,
+    search_range ? *search_range : Range::all_inclusive()
+  );
+
+  // Each match is encoded as its range followed by the index of its pattern.
+  auto length = matches.size() * 5;
+  auto buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), length * sizeof(uint32_t));
+  auto result = v8::Uint32Array::New(buffer, 0, length);
+  #if (V8_MAJOR_VERSION < 8)
+    auto data = static_cast<uint32_t *>(buffer->GetContents().Data());
+  #else
+    auto data = static_cast<uint32_t *>(buffer->GetBackingStore()->Data());
+  #endif
+  for (const auto &match : matches) {
+    *data++ = match.first.start.row;
+    *data++ = match.first.start.column;
+    *data++ = match.first.end.row;
+    *data++ = match.first.end.column;
+    *data++ = match.second;
+  }
+
+  info.GetReturnValue().Set(result);
+}
+
+void TextBufferWrapper::replace_all_sync(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This());
+  auto &text_buffer = text_buffer_wrapper->text_buffer;
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (!regex) return;
+
+  auto replacement = string_conversion::string_from_js(info[1]);
+  if (!replacement) {
+    Nan::ThrowTypeError("Replacement must be a string");
+    return;
+  }
+
+  optional<Range> search_range;
+  if (info[2]->IsObject()) {
+    search_range = RangeWrapper::range_from_js(info[2]);
+    if (!search_range) return;
+  }
+
+  text_buffer_wrapper->cancel_queued_workers();
+  auto result = text_buffer.replace_all(
+    *regex,
+    *replacement,
+    search_range ? *search_range : Range::all_inclusive()
+  );
+
+  Local<Object> js_result = Nan::New<Object>();
+  Nan::Set(js_result, Nan::New("replacementCount").ToLocalChecked(), Nan::New<Number>(result.replacement_count));
+  Nan::Set(js_result, Nan::New("invertedChanges").ToLocalChecked(), PatchWrapper::from_patch(move(result.inverted_changes)));
+  info.GetReturnValue().Set(js_result);
+}
+
 void TextBufferWrapper::find_and_mark_all_sync(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   MarkerIndex *marker_index = MarkerIndexWrapper::from_js(info[0]);
@@ -484,7 +653,7 @@ void TextBufferWrapper::find_and_mark_all_sync(const Nan::FunctionCallbackInfo<V
   if (!info[2]->IsBoolean()) return;
   bool exclusive = Nan::To<bool>(info[2]).FromMaybe(false);
 
-  const Regex *regex = RegexWrapper::regex_from_js(info[3]);
+  auto regex = RegexWrapper::regex_from_js(info[3]);
   if (regex) {
     optional<Range> search_range;
     if (info[4]->IsObject()) {
@@ -507,7 +676,7 @@ void TextBufferWrapper::find_and_mark_all_sync(const Nan::FunctionCallbackInfo<V
 void TextBufferWrapper::find(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto callback = new Nan::Callback(info[1].As<Function>());
-  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  auto regex = RegexWrapper::regex_from_js(info[0]);
   if (regex) {
     optional<Range> search_range;
     if (info[2]->IsObject()) {
@@ -518,8 +687,7 @@ void TextBufferWrapper::find(const Nan::FunctionCallbackInfo<Value> &info) {
       callback,
       text_buffer.create_snapshot(),
       regex,
-      search_range ? *search_range : Range::all_inclusive(),
-      info[0]
+      search_range ? *search_range : Range::all_inclusive()
     ));
   }
 }
@@ -527,7 +695,7 @@ void TextBufferWrapper::find(const Nan::FunctionCallbackInfo<Value> &info) {
 void TextBufferWrapper::find_all(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   auto callback = new Nan::Callback(info[1].As<Function>());
-  const Regex *regex = RegexWrapper::regex_from_js(info[0]);
+  auto regex = RegexWrapper::regex_from_js(info[0]);
   if (regex) {
     optional<Range> search_range;
     if (info[2]->IsObject()) {
@@ -535,15 +703,252 @@ void TextBufferWrapper::find_all(const Nan::FunctionCallbackInfo<Value> &info) {
       if (!search_range) return;
     }
     Nan::AsyncQueueWorker(new TextBufferSearcher<false>(
+      callback,
+      text_buffer.create_snapshot(),
+      regex,
+      search_range ? *search_range : Range::all_inclusive()
+    ));
+  }
+}
+
+class TextBufferCounter : public Nan::AsyncWorker {
+  const TextBuffer::Snapshot *snapshot;
+  std::shared_ptr<const Regex> regex;
+  Range search_range;
+  optional<uint32_t> limit;
+  uint32_t count;
+
+public:
+  TextBufferCounter(Nan::Callback *completion_callback,
+                    const TextBuffer::Snapshot *snapshot,
+                    std::shared_ptr<const Regex> regex,
+                    const Range &search_range,
+                    optional<uint32_t> limit) :
+    AsyncWorker(completion_callback, "TextBuffer.countAll"),
+    snapshot{snapshot},
+    regex{move(regex)},
+    search_range(search_range),
+    limit{limit},
+    count{0} {}
+
+  void Execute() {
+    auto result = snapshot->count_all(*regex, search_range, limit);
+    count = result.count;
+    const char *error_message = search_error_message(result.status);
+    if (error_message) SetErrorMessage(error_message);
+  }
+
+  void HandleOKCallback() {
+    delete snapshot;
+    Local<Value> argv[] = {Nan::Null(), Nan::New<Number>(count)};
+    callback->Call(2, argv, async_resource);
+  }
+
+  void HandleErrorCallback() {
+    delete snapshot;
+    Nan::AsyncWorker::HandleErrorCallback();
+  }
+};
+
+void TextBufferWrapper::count_all(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto callback = new Nan::Callback(info[1].As<Function>());
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    optional<Range> search_range;
+    if (info[2]->IsObject()) {
+      search_range = RangeWrapper::range_from_js(info[2]);
+      if (!search_range) return;
+    }
+    Nan::AsyncQueueWorker(new TextBufferCounter(
       callback,
       text_buffer.create_snapshot(),
       regex,
       search_range ? *search_range : Range::all_inclusive(),
-      info[0]
+      count_limit_from_js(info[3])
     ));
   }
 }
 
+// Indexes the buffer's base text on a background thread. The index is only
+// installed if the base text hasn't been replaced in the meantime.
+class TrigramIndexBuilder : public Nan::AsyncWorker {
+  Nan::Persistent<Object> buffer;
+  const TextBuffer::Snapshot *snapshot;
+  TrigramIndex index;
+
+public:
+  TrigramIndexBuilder(Nan::Callback *completion_callback, Local<Object> buffer) :
+    AsyncWorker(completion_callback, "TextBuffer.buildTrigramIndex") {
+    this->buffer.Reset(buffer);
+    snapshot = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(buffer)->text_buffer.create_snapshot();
+  }
+
+  void Execute() {
+    index = snapshot->build_trigram_index();
+  }
+
+  void HandleOKCallback() {
+    auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(Nan::New(buffer))->text_buffer;
+    bool installed = text_buffer.install_trigram_index(move(index), *snapshot);
+    delete snapshot;
+    Local<Value> argv[] = {Nan::Null(), Nan::New<Boolean>(installed)};
+    callback->Call(2, argv, async_resource);
+  }
+};
+
+void TextBufferWrapper::build_trigram_index(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto callback = new Nan::Callback(info[0].As<Function>());
+  Nan::AsyncQueueWorker(new TrigramIndexBuilder(callback, info.This()));
+}
+
+void TextBufferWrapper::clear_trigram_index(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  text_buffer.clear_trigram_index();
+}
+
+// Delivers matches to a JS callback in batches while the search is still
+// running. The search stops early when the batch callback returns `false`,
+// when `max_count` matches have been found, or, if `cancel_on_edit` is set,
+// when the buffer is modified.
+class TextBufferStreamingSearcher : public Nan::AsyncProgressQueueWorker<uint32_t>, public CancellableWorker {
+  Nan::Persistent<Object> buffer;
+  Nan::Callback *batch_callback;
+  const TextBuffer::Snapshot *snapshot;
+  std::shared_ptr<const Regex> regex;
+  Range search_range;
+  uint32_t batch_size;
+  uint32_t max_count;
+  uint32_t match_count;
+  bool limit_exceeded;
+  std::atomic<bool> cancelled;
+
+public:
+  TextBufferStreamingSearcher(Local<Object> buffer,
+                              Nan::Callback *batch_callback,
+                              Nan::Callback *completion_callback,
+                              std::shared_ptr<const Regex> regex,
+                              const Range &search_range,
+                              uint32_t batch_size,
+                              uint32_t max_count) :
+    AsyncProgressQueueWorker(completion_callback, "TextBuffer.findAllStreaming"),
+    batch_callback{batch_callback},
+    regex{move(regex)},
+    search_range(search_range),
+    batch_size{batch_size > 0 ? batch_size : 1},
+    max_count{max_count},
+    match_count{0},
+    limit_exceeded{false},
+    cancelled{false} {
+    this->buffer.Reset(buffer);
+    snapshot = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(buffer)->text_buffer.create_snapshot();
+  }
+
+  ~TextBufferStreamingSearcher() {
+    delete batch_callback;
+  }
+
+  void Execute(const Nan::AsyncProgressQueueWorker<uint32_t>::ExecutionProgress &progress) {
+    if (max_count == 0) return;
+
+    vector<Range> batch;
+    batch.reserve(batch_size);
+    auto status = snapshot->scan(*regex, search_range, [&](Range match) -> bool {
+      if (cancelled) return true;
+      batch.push_back(match);
+      match_count++;
+      if (batch.size() == batch_size) {
+        progress.Send(reinterpret_cast<const uint32_t *>(batch.data()), batch.size() * 4);
+        batch.clear();
+      }
+      return match_count >= max_count;
+    }, [this]() -> bool { return cancelled; });
+    limit_exceeded = status == TextBuffer::SearchStatus::LimitExceeded;
+    if (status == TextBuffer::SearchStatus::Failed) SetErrorMessage(search_error_message(status));
+    if (!batch.empty() && !cancelled) {
+      progress.Send(reinterpret_cast<const uint32_t *>(batch.data()), batch.size() * 4);
+    }
+  }
+
+  void CancelIfQueued() {
+    cancelled = true;
+  }
+
+  void HandleProgressCallback(const uint32_t *data, size_t count) {
+    if (cancelled || !data) return;
+    Nan::HandleScope scope;
+    auto array_buffer = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), count * sizeof(uint32_t));
+    #if (V8_MAJOR_VERSION < 8)
+      auto array_data = array_buffer->GetContents().Data();
+    #else
+      auto array_data = array_buffer->GetBackingStore()->Data();
+    #endif
+    memcpy(array_data, data, count * sizeof(uint32_t));
+    Local<Value> argv[] = {v8::Uint32Array::New(array_buffer, 0, count)};
+    auto result = batch_callback->Call(1, argv, async_resource);
+    if (!result.IsEmpty() && result.ToLocalChecked()->IsFalse()) cancelled = true;
+  }
+
+  void HandleOKCallback() {
+    finish();
+    Local<Value> argv[] = {
+      Nan::Null(),
+      Nan::New<Number>(match_count),
+      Nan::New<Boolean>(cancelled.load()),
+      Nan::New<Boolean>(limit_exceeded)
+    };
+    callback->Call(4, argv, async_resource);
+  }
+
+  void HandleErrorCallback() {
+    finish();
+    Nan::AsyncProgressQueueWorker<uint32_t>::HandleErrorCallback();
+  }
+
+private:
+  void finish() {
+    delete snapshot;
+    auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(Nan::New(buffer));
+    text_buffer_wrapper->outstanding_workers.erase(this);
+  }
+};
+
+void TextBufferWrapper::find_all_streaming(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto js_buffer = info.This();
+  auto text_buffer_wrapper = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(js_buffer);
+  if (!info[1]->IsFunction() || !info[2]->IsFunction()) {
+    Nan::ThrowTypeError("Expected batch and completion callbacks");
+    return;
+  }
+
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (!regex) return;
+
+  optional<Range> search_range;
+  if (info[3]->IsObject()) {
+    search_range = RangeWrapper::range_from_js(info[3]);
+    if (!search_range) return;
+  }
+
+  optional<uint32_t> batch_size, max_count;
+  if (info[4]->IsNumber()) batch_size = number_conversion::number_from_js<uint32_t>(info[4]);
+  if (info[5]->IsNumber()) max_count = number_conversion::number_from_js<uint32_t>(info[5]);
+  bool cancel_on_edit = info[6]->IsTrue();
+
+  auto worker = new TextBufferStreamingSearcher(
+    js_buffer,
+    new Nan::Callback(info[1].As<Function>()),
+    new Nan::Callback(info[2].As<Function>()),
+    move(regex),
+    search_range ? *search_range : Range::all_inclusive(),
+    batch_size ? *batch_size : 1000,
+    max_count ? *max_count : UINT32_MAX
+  );
+
+  if (cancel_on_edit) text_buffer_wrapper->outstanding_workers.insert(worker);
+  Nan::AsyncQueueWorker(worker);
+}
+
 void TextBufferWrapper::find_words_with_subsequence_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info) {
   class FindWordsWithSubsequenceInRangeWorker : public Nan::AsyncWorker, public CancellableWorker {
     Nan::Persistent<Object> buffer;
@@ -747,6 +1152,11 @@ class Loader {
   bool force;
   bool compute_patch;
 
+  // A buffer that has a trigram index gets a new one for the loaded text,
+  // built here on the worker thread rather than when the text is installed.
+  bool build_trigram_index;
+  TrigramIndex trigram_index;
+
  public:
   bool cancelled;
 
@@ -761,6 +1171,7 @@ class Loader {
     encoding_name{move(encoding_name)},
     force{force},
     compute_patch{compute_patch},
+    build_trigram_index{buffer->has_trigram_index()},
     cancelled{false} {}
 
   Loader(Nan::Callback *progress_callback, Nan::AsyncResource *async_resource,
@@ -772,6 +1183,7 @@ class Loader {
     loaded_text{move(text)},
     force{force},
     compute_patch{compute_patch},
+    build_trigram_index{buffer->has_trigram_index()},
     cancelled{false} {}
 
   ~Loader() {
@@ -781,7 +1193,14 @@ class Loader {
   template <typename Callback>
   void Execute(const Callback &callback) {
     if (!loaded_text) loaded_text = Text{load_file(file_name, encoding_name, &error, callback)};
-    if (!error && compute_patch) patch = text_diff(snapshot->base_text(), *loaded_text);
+    if (!error && compute_patch) {
+      patch = text_diff(
+        snapshot->base_text(),
+        *loaded_text,
+        std::max(std::thread::hardware_concurrency(), 1u)
+      );
+    }
+    if (!error && build_trigram_index) trigram_index = TrigramIndex(*loaded_text);
   }
 
   pair<Local<Value>, Local<Value>> Finish(Nan::AsyncResource* caller_async_resource = nullptr) {
@@ -828,7 +1247,11 @@ class Loader {
     }
 
     if (has_changed) {
-      buffer->reset(move(*loaded_text));
+      if (build_trigram_index && buffer->has_trigram_index()) {
+        buffer->reset(move(*loaded_text), move(trigram_index));
+      } else {
+        buffer->reset(move(*loaded_text));
+      }
     } else {
       buffer->flush_changes();
     }
@@ -1158,10 +1581,8 @@ void TextBufferWrapper::serialize_changes(const Nan::FunctionCallbackInfo<Value>
 void TextBufferWrapper::deserialize_changes(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   if (info[0]->IsUint8Array()) {
-    auto *data = node::Buffer::Data(info[0]);
-    static vector<uint8_t> input;
-    input.assign(data, data + node::Buffer::Length(info[0]));
-    Deserializer deserializer(input);
+    auto *data = reinterpret_cast<const uint8_t *>(node::Buffer::Data(info[0]));
+    Deserializer deserializer(data, node::Buffer::Length(info[0]));
     text_buffer.deserialize_changes(deserializer);
   }
 }
@@ -1195,11 +1616,195 @@ void TextBufferWrapper::get_snapshot(const Nan::FunctionCallbackInfo<Value> &inf
   info.GetReturnValue().Set(TextBufferSnapshotWrapper::new_instance(info.This(), reinterpret_cast<void *>(snapshot)));
 }
 
+void TextBufferWrapper::create_live_search(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
+  auto regex = RegexWrapper::regex_from_js(info[0]);
+  if (regex) {
+    auto live_search = text_buffer.create_live_search(move(regex));
+    info.GetReturnValue().Set(LiveSearchWrapper::new_instance(info.This(), live_search));
+  }
+}
+
 void TextBufferWrapper::dot_graph(const Nan::FunctionCallbackInfo<Value> &info) {
   auto &text_buffer = Nan::ObjectWrap::Unwrap<TextBufferWrapper>(info.This())->text_buffer;
   info.GetReturnValue().Set(Nan::New<String>(text_buffer.get_dot_graph()).ToLocalChecked());
 }
 
+void TextBufferWrapper::get_regex_cache_stats(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto stats = RegexCache::shared().get_stats();
+  Local<Object> result = Nan::New<Object>();
+  Nan::Set(result, Nan::New("hits").ToLocalChecked(), Nan::New<Number>(stats.hits));
+  Nan::Set(result, Nan::New("misses").ToLocalChecked(), Nan::New<Number>(stats.misses));
+  Nan::Set(result, Nan::New("evictions").ToLocalChecked(), Nan::New<Number>(stats.evictions));
+  Nan::Set(result, Nan::New("size").ToLocalChecked(), Nan::New<Number>(stats.size));
+  Nan::Set(result, Nan::New("capacity").ToLocalChecked(), Nan::New<Number>(stats.capacity));
+  info.GetReturnValue().Set(result);
+}
+
+void TextBufferWrapper::set_regex_cache_capacity(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto capacity = number_conversion::number_from_js<uint32_t>(info[0]);
+  if (capacity) {
+    RegexCache::shared().set_capacity(*capacity);
+  }
+}
+
+void TextBufferWrapper::set_regex_limits(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto match_limit = number_conversion::number_from_js<uint32_t>(info[0]);
+  auto depth_limit = number_conversion::number_from_js<uint32_t>(info[1]);
+  auto jit_stack_size = number_conversion::number_from_js<uint32_t>(info[2]);
+  if (match_limit && depth_limit && jit_stack_size) {
+    Regex::set_default_limits(*match_limit, *depth_limit);
+    Regex::set_jit_stack_size(*jit_stack_size);
+  }
+}
+
+void TextBufferWrapper::set_regex_engine(const Nan::FunctionCallbackInfo<Value> &info) {
+  auto engine = number_conversion::number_from_js<uint32_t>(info[0]);
+  if (engine && *engine <= static_cast<uint32_t>(Regex::Engine::Automatic)) {
+    Regex::set_default_engine(static_cast<Regex::Engine>(*engine));
+  }
+}
+
+void TextBufferWrapper::serialize_regex_cache(const Nan::FunctionCallbackInfo<Value> &info) {
+  vector<uint8_t> output;
+  Serializer serializer(output);
+  RegexCache::shared().serialize(serializer);
+  Local<Object> result;
+  if (Nan::CopyBuffer(reinterpret_cast<char *>(output.data()), output.size()).ToLocal(&result)) {
+    info.GetReturnValue().Set(result);
+  }
+}
+
+void TextBufferWrapper::load_regex_cache(const Nan::FunctionCallbackInfo<Value> &info) {
+  bool result = false;
+  if (info[0]->IsUint8Array()) {
+    auto *data = reinterpret_cast<const uint8_t *>(node::Buffer::Data(info[0]));
+    Deserializer deserializer(data, node::Buffer::Length(info[0]));
+    result = RegexCache::shared().deserialize(deserializer);
+  }
+  info.GetReturnValue().Set(Nan::New<Boolean>(result));
+}
+
+class FileSearchWorker : public Nan::AsyncProgressQueueWorker<char> {
+  Nan::Callback *result_callback;
+  FileSearcher searcher;
+  vector<string> paths;
+  unsigned thread_count;
+  std::mutex pending_results_mutex;
+  vector<FileSearcher::FileResult> pending_results;
+  std::atomic<bool> cancelled;
+
+public:
+  FileSearchWorker(Nan::Callback *result_callback,
+                   Nan::Callback *completion_callback,
+                   std::shared_ptr<const Regex> regex,
+                   vector<string> &&paths,
+                   string &&encoding_name,
+                   uint32_t max_matches_per_file,
+                   unsigned thread_count) :
+    AsyncProgressQueueWorker(completion_callback, "TextBuffer.searchFiles"),
+    result_callback{result_callback},
+    searcher{move(regex), move(encoding_name), max_matches_per_file},
+    paths{move(paths)},
+    thread_count{thread_count},
+    cancelled{false} {}
+
+  ~FileSearchWorker() {
+    delete result_callback;
+  }
+
+  void Execute(const Nan::AsyncProgressQueueWorker<char>::ExecutionProgress &progress) {
+    searcher.search_files(paths, thread_count, [this, &progress](FileSearcher::FileResult &&result) {
+      if (cancelled) return true;
+      std::lock_guard<std::mutex> lock(pending_results_mutex);
+      pending_results.push_back(move(result));
+      char signal = 0;
+      progress.Send(&signal, 1);
+      return false;
+    });
+  }
+
+  void HandleProgressCallback(const char *, size_t) {
+    Nan::HandleScope scope;
+    vector<FileSearcher::FileResult> results;
+    {
+      std::lock_guard<std::mutex> lock(pending_results_mutex);
+      results.swap(pending_results);
+    }
+
+    for (auto &result : results) {
+      if (cancelled) return;
+
+      Local<Object> js_result = Nan::New<Object>();
+      Nan::Set(js_result, Nan::New("path").ToLocalChecked(), Nan::New(result.path).ToLocalChecked());
+      if (result.error_number) {
+        Error error{result.error_number, result.error_syscall};
+        Nan::Set(js_result, Nan::New("error").ToLocalChecked(), error_to_js(error, "", result.path));
+      } else {
+        vector<Range> ranges;
+        vector<Local<String>> line_texts;
+        for (const u16string &line_text : result.line_texts) {
+          line_texts.push_back(string_conversion::string_to_js(line_text));
+        }
+        Local<Array> js_line_texts = Nan::New<Array>(result.matches.size());
+        for (uint32_t i = 0; i < result.matches.size(); i++) {
+          ranges.push_back(result.matches[i].range);
+          Nan::Set(js_line_texts, i, line_texts[result.matches[i].line_index]);
+        }
+        Nan::Set(js_result, Nan::New("ranges").ToLocalChecked(), encode_ranges(ranges));
+        Nan::Set(js_result, Nan::New("lineTexts").ToLocalChecked(), js_line_texts);
+        Nan::Set(js_result, Nan::New("reachedMatchLimit").ToLocalChecked(), Nan::New<Boolean>(result.reached_match_limit));
+      }
+
+      Local<Value> argv[] = {js_result};
+      auto callback_result = result_callback->Call(1, argv, async_resource);
+      if (!callback_result.IsEmpty() && callback_result.ToLocalChecked()->IsFalse()) cancelled = true;
+    }
+  }
+
+  void HandleOKCallback() {
+    HandleProgressCallback(nullptr, 0);
+    Local<Value> argv[] = {Nan::Null(), Nan::New<Boolean>(cancelled.load())};
+    callback->Call(2, argv, async_resource);
+  }
+};
+
+void TextBufferWrapper::search_files(const Nan::FunctionCallbackInfo<Value> &info) {
+  if (!info[0]->IsArray() || !info[2]->IsString() || !info[5]->IsFunction() || !info[6]->IsFunction()) {
+    Nan::ThrowTypeError("Invalid arguments");
+    return;
+  }
+
+  auto regex = RegexWrapper::regex_from_js(info[1]);
+  if (!regex) return;
+
+  string encoding_name = *Nan::Utf8String(info[2].As<String>());
+  if (!transcoding_from(encoding_name.c_str())) {
+    Nan::ThrowError(("Invalid encoding name: " + encoding_name).c_str());
+    return;
+  }
+
+  auto js_paths = info[0].As<Array>();
+  vector<string> paths;
+  for (uint32_t i = 0, n = js_paths->Length(); i < n; i++) {
+    paths.push_back(*Nan::Utf8String(Nan::Get(js_paths, i).ToLocalChecked()));
+  }
+
+  optional<uint32_t> max_matches_per_file, thread_count;
+  if (info[3]->IsNumber()) max_matches_per_file = number_conversion::number_from_js<uint32_t>(info[3]);
+  if (info[4]->IsNumber()) thread_count = number_conversion::number_from_js<uint32_t>(info[4]);
+
+  Nan::AsyncQueueWorker(new FileSearchWorker(
+    new Nan::Callback(info[5].As<Function>()),
+    new Nan::Callback(info[6].As<Function>()),
+    move(regex),
+    move(paths),
+    move(encoding_name),
+    max_matches_per_file ? *max_matches_per_file : UINT32_MAX,
+    thread_count ? *thread_count : std::max(std::thread::hardware_concurrency(), 1u)
+  ));
+}
+
 void TextBufferWrapper::cancel_queued_workers() {
   for (auto worker : outstanding_workers) {
     worker->CancelIfQueued();
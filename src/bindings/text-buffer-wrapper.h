@@ -36,7 +36,15 @@ private:
   static void find(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_all(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_all_streaming(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_backward_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void count_all(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void count_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void build_trigram_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void clear_trigram_index(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void find_all_multi_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void replace_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_and_mark_all_sync(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void find_words_with_subsequence_in_range(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void is_modified(const Nan::FunctionCallbackInfo<v8::Value> &info);
@@ -50,7 +58,15 @@ private:
   static void reset(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void base_text_digest(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void get_snapshot(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void create_live_search(const Nan::FunctionCallbackInfo<v8::Value> &info);
   static void dot_graph(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void get_regex_cache_stats(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void set_regex_cache_capacity(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void set_regex_limits(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void set_regex_engine(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void serialize_regex_cache(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void load_regex_cache(const Nan::FunctionCallbackInfo<v8::Value> &info);
+  static void search_files(const Nan::FunctionCallbackInfo<v8::Value> &info);
 
   void cancel_queued_workers();
 };
@@ -0,0 +1,89 @@
+#include "aho-corasick.h"
+#include <algorithm>
+
+using std::pair;
+using std::u16string;
+using std::vector;
+
+const uint32_t AhoCorasick::NONE;
+const uint32_t AhoCorasick::INITIAL_STATE;
+
+static bool compare_transitions(const pair<char16_t, uint32_t> &transition, char16_t character) {
+  return transition.first < character;
+}
+
+AhoCorasick::AhoCorasick(const vector<u16string> &patterns, bool ignore_case) :
+  max_pattern_length_{0},
+  ignore_case{ignore_case} {
+  nodes.push_back(Node{{}, INITIAL_STATE, NONE, NONE});
+
+  for (uint32_t pattern_index = 0; pattern_index < patterns.size(); pattern_index++) {
+    const u16string &pattern = patterns[pattern_index];
+    pattern_lengths.push_back(pattern.size());
+    if (pattern.size() > max_pattern_length_) max_pattern_length_ = pattern.size();
+
+    uint32_t node_index = INITIAL_STATE;
+    for (char16_t character : pattern) {
+      if (ignore_case && character >= 'A' && character <= 'Z') character += 'a' - 'A';
+
+      auto &transitions = nodes[node_index].transitions;
+      auto iter = std::lower_bound(transitions.begin(), transitions.end(), character, compare_transitions);
+      if (iter != transitions.end() && iter->first == character) {
+        node_index = iter->second;
+      } else {
+        uint32_t new_node_index = nodes.size();
+        transitions.insert(iter, {character, new_node_index});
+        nodes.push_back(Node{{}, INITIAL_STATE, NONE, NONE});
+        node_index = new_node_index;
+      }
+    }
+
+    if (!pattern.empty() && nodes[node_index].pattern_index == NONE) {
+      nodes[node_index].pattern_index = pattern_index;
+    }
+  }
+
+  // Compute failure and output links in breadth-first order, so that the links
+  // of every shallower node are available when they are needed.
+  vector<uint32_t> queue;
+  for (const auto &transition : nodes[INITIAL_STATE].transitions) {
+    queue.push_back(transition.second);
+  }
+
+  for (size_t i = 0; i < queue.size(); i++) {
+    uint32_t node_index = queue[i];
+    for (const auto &transition : nodes[node_index].transitions) {
+      uint32_t child_index = transition.second;
+      uint32_t failure = nodes[node_index].failure;
+      uint32_t child_failure;
+      for (;;) {
+        child_failure = this->transition(failure, transition.first);
+        if (child_failure != NONE || failure == INITIAL_STATE) break;
+        failure = nodes[failure].failure;
+      }
+      if (child_failure == NONE) child_failure = INITIAL_STATE;
+
+      Node &child = nodes[child_index];
+      child.failure = child_failure;
+      child.output = nodes[child_failure].pattern_index == NONE ?
+        nodes[child_failure].output :
+        child_failure;
+      queue.push_back(child_index);
+    }
+  }
+}
+
+uint32_t AhoCorasick::transition(uint32_t node_index, char16_t character) const {
+  const auto &transitions = nodes[node_index].transitions;
+  auto iter = std::lower_bound(transitions.begin(), transitions.end(), character, compare_transitions);
+  if (iter != transitions.end() && iter->first == character) return iter->second;
+  return NONE;
+}
+
+uint32_t AhoCorasick::pattern_length(uint32_t pattern_index) const {
+  return pattern_lengths[pattern_index];
+}
+
+uint32_t AhoCorasick::max_pattern_length() const {
+  return max_pattern_length_;
+}
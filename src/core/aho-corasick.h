@@ -0,0 +1,64 @@
+#ifndef SUPERSTRING_AHO_CORASICK_H_
+#define SUPERSTRING_AHO_CORASICK_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Finds occurrences of any of a set of literal strings in a single pass over
+// the searched text. The text can be fed one character at a time, so matches
+// that straddle chunk boundaries are found without copying.
+class AhoCorasick {
+  struct Node {
+    std::vector<std::pair<char16_t, uint32_t>> transitions;
+    uint32_t failure;
+    uint32_t output;
+    uint32_t pattern_index;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> pattern_lengths;
+  uint32_t max_pattern_length_;
+  bool ignore_case;
+
+  uint32_t transition(uint32_t node_index, char16_t character) const;
+
+ public:
+  static const uint32_t NONE = UINT32_MAX;
+  static const uint32_t INITIAL_STATE = 0;
+
+  // When `ignore_case` is true, ASCII letters are compared case-insensitively.
+  AhoCorasick(const std::vector<std::u16string> &patterns, bool ignore_case = false);
+
+  uint32_t pattern_length(uint32_t pattern_index) const;
+  uint32_t max_pattern_length() const;
+
+  // Advances the automaton from `state` over `character`, and calls `callback`
+  // with the index of every pattern that ends with that character. When
+  // several patterns are identical, only the lowest index is reported.
+  template <typename Callback>
+  uint32_t step(uint32_t state, char16_t character, const Callback &callback) const {
+    if (ignore_case && character >= 'A' && character <= 'Z') character += 'a' - 'A';
+
+    uint32_t next_state;
+    for (;;) {
+      next_state = transition(state, character);
+      if (next_state != NONE || state == INITIAL_STATE) break;
+      state = nodes[state].failure;
+    }
+    if (next_state == NONE) next_state = INITIAL_STATE;
+
+    uint32_t node_index = nodes[next_state].pattern_index == NONE ?
+      nodes[next_state].output :
+      next_state;
+    while (node_index != NONE) {
+      callback(nodes[node_index].pattern_index);
+      node_index = nodes[node_index].output;
+    }
+
+    return next_state;
+  }
+};
+
+#endif  // SUPERSTRING_AHO_CORASICK_H_
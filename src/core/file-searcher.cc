@@ -0,0 +1,163 @@
+#include "file-searcher.h"
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include "encoding-conversion.h"
+#include "text-buffer.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+using std::move;
+using std::string;
+using std::u16string;
+using std::vector;
+
+const uint32_t FileSearcher::BINARY_DETECTION_LENGTH;
+
+#ifdef WIN32
+
+static FILE *open_file(const string &name) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, name.c_str(), name.length(), nullptr, 0);
+  std::wstring wide_name(length, 0);
+  MultiByteToWideChar(CP_UTF8, 0, name.c_str(), name.length(), &wide_name[0], length);
+  return _wfopen(wide_name.c_str(), L"rb");
+}
+
+#else
+
+static FILE *open_file(const string &name) {
+  return fopen(name.c_str(), "rb");
+}
+
+#endif
+
+// In encodings with multi-byte code units, NUL bytes are common in text files,
+// so they can't be used to detect binary content. Rather than matching the
+// many spellings of encoding names, this checks how many bytes a single ASCII
+// character takes in the encoding.
+static bool has_single_byte_code_units(const string &encoding_name) {
+  auto conversion = transcoding_to(encoding_name.c_str());
+  if (!conversion) return true;
+  u16string character{u"a"};
+  size_t start_offset = 0;
+  char output[16];
+  return conversion->encode(character, &start_offset, character.size(), output, sizeof(output), true) <= 1;
+}
+
+FileSearcher::FileSearcher(std::shared_ptr<const Regex> regex, string encoding_name,
+                           uint32_t max_matches_per_file) :
+  regex{move(regex)},
+  encoding_name{move(encoding_name)},
+  max_matches_per_file{max_matches_per_file},
+  detect_binary_files{has_single_byte_code_units(this->encoding_name)} {}
+
+bool FileSearcher::has_valid_encoding() const {
+  return static_cast<bool>(transcoding_from(encoding_name.c_str()));
+}
+
+FileSearcher::FileResult FileSearcher::search_file(const string &path) const {
+  FileResult result{path, {}, {}, false, 0, nullptr};
+  if (max_matches_per_file == 0) return result;
+
+  auto conversion = transcoding_from(encoding_name.c_str());
+  if (!conversion) {
+    result.error_number = EINVAL;
+    result.error_syscall = "iconv_open";
+    return result;
+  }
+
+  FILE *file = open_file(path);
+  if (!file) {
+    result.error_number = errno;
+    result.error_syscall = "open";
+    return result;
+  }
+
+  struct stat file_stats;
+  if (fstat(fileno(file), &file_stats) != 0) {
+    result.error_number = errno;
+    result.error_syscall = "stat";
+    fclose(file);
+    return result;
+  }
+
+  // Read the whole file at once. Files whose size isn't known up front, such
+  // as pipes, are read in chunks that double in size.
+  bool has_known_size = (file_stats.st_mode & S_IFMT) == S_IFREG && file_stats.st_size > 0;
+  vector<char> input(has_known_size ? file_stats.st_size : 64 * 1024);
+  size_t input_length = 0;
+  for (;;) {
+    input_length += fread(input.data() + input_length, 1, input.size() - input_length, file);
+    if (ferror(file)) {
+      result.error_number = errno;
+      result.error_syscall = "read";
+      fclose(file);
+      return result;
+    }
+    if (has_known_size || input_length < input.size() || feof(file)) break;
+    input.resize(input.size() * 2);
+  }
+  fclose(file);
+
+  if (detect_binary_files) {
+    auto detection_end = input.begin() + std::min<size_t>(input_length, BINARY_DETECTION_LENGTH);
+    if (std::find(input.begin(), detection_end, '\0') != detection_end) return result;
+  }
+
+  u16string content;
+  conversion->decode(content, input.data(), input_length, true);
+  vector<char>().swap(input);
+
+  TextBuffer buffer{move(content)};
+  uint32_t current_row = UINT32_MAX;
+  buffer.scan(*regex, Range::all_inclusive(), [&](Range match) -> bool {
+    if (match.start.row != current_row) {
+      current_row = match.start.row;
+      result.line_texts.push_back(*buffer.line_for_row(current_row));
+    }
+    result.matches.push_back(Match{match, static_cast<uint32_t>(result.line_texts.size() - 1)});
+    if (result.matches.size() >= max_matches_per_file) {
+      result.reached_match_limit = true;
+      return true;
+    }
+    return false;
+  });
+
+  return result;
+}
+
+void FileSearcher::search_files(const vector<string> &paths, unsigned thread_count,
+                                const std::function<bool(FileResult &&)> &callback) const {
+  std::atomic<size_t> next_path_index{0};
+  std::atomic<bool> stopped{false};
+  std::mutex callback_mutex;
+
+  auto search_remaining_files = [&]() {
+    while (!stopped) {
+      size_t path_index = next_path_index++;
+      if (path_index >= paths.size()) break;
+
+      FileResult result = search_file(paths[path_index]);
+      if (result.matches.empty() && result.error_number == 0) continue;
+
+      std::lock_guard<std::mutex> lock(callback_mutex);
+      if (stopped) break;
+      if (callback(move(result))) stopped = true;
+    }
+  };
+
+  thread_count = std::min<size_t>(std::max(thread_count, 1u), paths.size());
+  vector<std::thread> threads;
+  for (unsigned i = 1; i < thread_count; i++) {
+    threads.push_back(std::thread(search_remaining_files));
+  }
+  search_remaining_files();
+  for (auto &thread : threads) thread.join();
+}
@@ -0,0 +1,57 @@
+#ifndef SUPERSTRING_FILE_SEARCHER_H_
+#define SUPERSTRING_FILE_SEARCHER_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "range.h"
+#include "regex.h"
+
+// Searches files on disk for matches of a regex without loading them into
+// buffers. Each file is read with a single large read, decoded, and scanned in
+// the same way as a TextBuffer. Files that look binary are skipped.
+class FileSearcher {
+ public:
+  static const uint32_t BINARY_DETECTION_LENGTH = 8000;
+
+  // Matches refer to the text of their line by its index in `line_texts`, so
+  // that a long line with many matches is only stored once.
+  struct Match {
+    Range range;
+    uint32_t line_index;
+  };
+
+  struct FileResult {
+    std::string path;
+    std::vector<Match> matches;
+    std::vector<std::u16string> line_texts;
+    bool reached_match_limit;
+    int error_number;
+    const char *error_syscall;
+  };
+
+  FileSearcher(std::shared_ptr<const Regex>, std::string encoding_name,
+               uint32_t max_matches_per_file = UINT32_MAX);
+
+  bool has_valid_encoding() const;
+
+  // Searches a single file. If the file cannot be read, `error_number` and
+  // `error_syscall` describe the failure.
+  FileResult search_file(const std::string &path) const;
+
+  // Searches the given files on `thread_count` threads. The callback is called
+  // once for every file that contains matches or could not be read, from
+  // whichever thread searched that file, but never concurrently. Returning
+  // true from the callback stops the search.
+  void search_files(const std::vector<std::string> &paths, unsigned thread_count,
+                    const std::function<bool(FileResult &&)> &callback) const;
+
+ private:
+  std::shared_ptr<const Regex> regex;
+  std::string encoding_name;
+  uint32_t max_matches_per_file;
+  bool detect_binary_files;
+};
+
+#endif  // SUPERSTRING_FILE_SEARCHER_H_
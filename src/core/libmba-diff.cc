@@ -14,6 +14,8 @@
  * 4. The whitespace has been normalized.
  * 5. Before computing the edit script, the common suffix is removed from th
  *    two input strings.
+ * 6. The algorithm is templated on the element type, so that it can also
+ *    compare sequences of `uint32_t`, such as line ids.
  */
 
 /* diff - compute a shortest edit script (SES) given two sequences
@@ -86,9 +88,10 @@ static int _v(struct _ctx *ctx, int k, int r) {
   return ctx->buf[j];
 }
 
+template <typename T>
 static int _find_middle_snake(
-  const char16_t *a, int aoff, int n,
-  const char16_t *b, int boff, int m,
+  const T *a, int aoff, int n,
+  const T *b, int boff, int m,
   struct _ctx *ctx, struct middle_snake *ms
 ) {
   int delta, odd, mid, d;
@@ -118,8 +121,8 @@ static int _find_middle_snake(
 
       ms->x = x;
       ms->y = y;
-      const char16_t *a0 = a + aoff;
-      const char16_t *b0 = b + boff;
+      const T *a0 = a + aoff;
+      const T *b0 = b + boff;
       while (x < n && y < m && a0[x] == b0[y]) {
         x++; y++;
       }
@@ -146,8 +149,8 @@ static int _find_middle_snake(
 
       ms->u = x;
       ms->v = y;
-      const char16_t *a0 = a + aoff;
-      const char16_t *b0 = b + boff;
+      const T *a0 = a + aoff;
+      const T *b0 = b + boff;
       while (x > 0 && y > 0 && a0[x - 1] == b0[y - 1]) {
         x--; y--;
       }
@@ -184,9 +187,10 @@ static void _edit(struct _ctx *ctx, diff_op op, int off, int len) {
   }
 }
 
+template <typename T>
 static int _ses(
-  const char16_t *a, uint32_t aoff, uint32_t n,
-  const char16_t *b, uint32_t boff, uint32_t m,
+  const T *a, uint32_t aoff, uint32_t n,
+  const T *b, uint32_t boff, uint32_t m,
   struct _ctx *ctx
 ) {
   struct middle_snake ms;
@@ -263,8 +267,9 @@ static int _ses(
   return d;
 }
 
-int diff(const char16_t *a, uint32_t n, const char16_t *b, uint32_t m,
-         int dmax, vector<diff_edit> *ses) {
+template <typename T>
+static int _diff(const T *a, uint32_t n, const T *b, uint32_t m,
+                 int dmax, vector<diff_edit> *ses) {
   struct _ctx ctx;
   ctx.ses = ses;
   ctx.dmax = dmax ? dmax : INT_MAX;
@@ -305,3 +310,13 @@ int diff(const char16_t *a, uint32_t n, const char16_t *b, uint32_t m,
   if (ses->front().op == 0) ses->clear();
   return d;
 }
+
+int diff(const char16_t *a, uint32_t n, const char16_t *b, uint32_t m,
+         int dmax, vector<diff_edit> *ses) {
+  return _diff(a, n, b, m, dmax, ses);
+}
+
+int diff(const uint32_t *a, uint32_t n, const uint32_t *b, uint32_t m,
+         int dmax, vector<diff_edit> *ses) {
+  return _diff(a, n, b, m, dmax, ses);
+}
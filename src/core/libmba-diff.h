@@ -22,4 +22,10 @@ int diff(
   int dmax, std::vector<diff_edit> *ses
 );
 
+int diff(
+  const uint32_t *old_sequence, uint32_t old_length,
+  const uint32_t *new_sequence, uint32_t new_length,
+  int dmax, std::vector<diff_edit> *ses
+);
+
 #endif  // MBA_DIFF_H_
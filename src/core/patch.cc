@@ -2,22 +2,122 @@
 #include "optional.h"
 #include "text.h"
 #include "text-slice.h"
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <deque>
 #include <cmath>
 #include <memory>
+#include <new>
 #include <stdio.h>
 #include <sstream>
+#include <type_traits>
 #include <vector>
 
 using std::function;
 using std::move;
 using std::vector;
+using std::u16string;
 using std::unique_ptr;
 using std::ostream;
 using std::endl;
 using Change = Patch::Change;
 
-static const uint32_t SERIALIZATION_VERSION = 1;
+// Version 1 wrote every number as a uint32 and interleaved the tree's
+// transitions and texts with the nodes. Version 2 writes numbers as varints,
+// packs the transitions into two bits each and stores all of the texts in a
+// single UTF-16 section, so that they can be read without copying the input.
+// Both versions can be read.
+static const uint32_t SERIALIZATION_VERSION = 2;
+
+// Flags that version 2 writes for each node, saying which texts follow it.
+static const uint32_t SERIALIZED_NODE_HAS_OLD_TEXT = 1;
+static const uint32_t SERIALIZED_NODE_HAS_NEW_TEXT = 2;
+
+// Splaying accesses that descend deeper than this many times the depth of a
+// balanced tree count towards rebalancing it.
+static const double REBALANCING_DEPTH_FACTOR = 4;
+
+uint32_t Patch::SPLICING_COMBINE_CHANGE_COUNT_RATIO = 8;
+
+static void serialize_point(Serializer &output, Point point) {
+  output.append_varint(point.row);
+  output.append_varint(point.column);
+}
+
+static Point deserialize_point(Deserializer &input) {
+  uint32_t row = input.read_varint();
+  return Point(row, input.read_varint());
+}
+
+static void serialize_text(vector<uint8_t> &output, const Text &text) {
+  for (char16_t character : text.content) {
+    output.push_back(character & 0xFF);
+    output.push_back(character >> 8);
+  }
+}
+
+static Text deserialize_text(Deserializer &input, uint32_t size) {
+  u16string content(size, 0);
+  const uint8_t *bytes = input.read_bytes(2 * static_cast<size_t>(size));
+  if (bytes) {
+    for (uint32_t i = 0; i < size; i++) {
+      content[i] = bytes[2 * i] | (bytes[2 * i + 1] << 8);
+    }
+  }
+  return Text{move(content)};
+}
+
+// A text that nodes of several patches can refer to, so that copying,
+// inverting or combining patches doesn't copy their texts. Shared texts are
+// never modified; a node that needs to change one replaces it instead.
+struct SharedText : Text {
+  std::atomic<uint32_t> reference_count;
+
+  SharedText(Text &&text) : Text(move(text)), reference_count{1} {}
+  SharedText(Deserializer &input) : Text(input), reference_count{1} {}
+};
+
+// The storage of released texts, which is reused for new texts so that
+// replacing the texts of a change doesn't allocate. Texts can be shared by
+// several patches and outlive the one that created them, so they are pooled
+// per thread rather than with each patch's nodes.
+static const size_t MAX_POOLED_TEXTS_PER_THREAD = 1024;
+
+struct SharedTextPool {
+  using Slot = std::aligned_storage<sizeof(SharedText), alignof(SharedText)>::type;
+  vector<unique_ptr<Slot>> slots;
+};
+
+static thread_local SharedTextPool shared_text_pool;
+
+template <typename T>
+static SharedText *new_shared_text(T &&argument) {
+  unique_ptr<SharedTextPool::Slot> slot;
+  if (shared_text_pool.slots.empty()) {
+    slot.reset(new SharedTextPool::Slot);
+  } else {
+    slot = move(shared_text_pool.slots.back());
+    shared_text_pool.slots.pop_back();
+  }
+  return new (slot.release()) SharedText{std::forward<T>(argument)};
+}
+
+static Text *retain_text(Text *text) {
+  if (text) static_cast<SharedText *>(text)->reference_count++;
+  return text;
+}
+
+static void release_text(Text *text) {
+  if (text && --static_cast<SharedText *>(text)->reference_count == 0) {
+    SharedText *shared_text = static_cast<SharedText *>(text);
+    shared_text->~SharedText();
+    unique_ptr<SharedTextPool::Slot> slot{reinterpret_cast<SharedTextPool::Slot *>(shared_text)};
+    if (shared_text_pool.slots.size() < MAX_POOLED_TEXTS_PER_THREAD) {
+      shared_text_pool.slots.push_back(move(slot));
+    }
+  }
+}
 
 struct Patch::Node {
   Node *left;
@@ -29,8 +129,9 @@ struct Patch::Node {
   Point old_distance_from_left_ancestor;
   Point new_distance_from_left_ancestor;
 
-  unique_ptr<Text> old_text;
-  unique_ptr<Text> new_text;
+  // These are `SharedText`s, which may also belong to other patches.
+  Text *old_text;
+  Text *new_text;
   uint32_t old_text_size_;
 
   uint32_t old_subtree_text_size;
@@ -43,8 +144,8 @@ struct Patch::Node {
     Point new_extent,
     Point old_distance_from_left_ancestor,
     Point new_distance_from_left_ancestor,
-    unique_ptr<Text> &&old_text,
-    unique_ptr<Text> &&new_text,
+    optional<Text> &&old_text,
+    optional<Text> &&new_text,
     uint32_t old_text_size
   ) :
     left{left},
@@ -53,35 +154,85 @@ struct Patch::Node {
     new_extent{new_extent},
     old_distance_from_left_ancestor{old_distance_from_left_ancestor},
     new_distance_from_left_ancestor{new_distance_from_left_ancestor},
-    old_text{std::move(old_text)},
-    new_text{std::move(new_text)},
+    old_text{old_text ? new_shared_text(move(*old_text)) : nullptr},
+    new_text{new_text ? new_shared_text(move(*new_text)) : nullptr},
     old_text_size_{old_text_size} {
     compute_subtree_text_sizes();
   }
 
+  Node(
+    Node *left,
+    Node *right,
+    Point old_extent,
+    Point new_extent,
+    Point old_distance_from_left_ancestor,
+    Point new_distance_from_left_ancestor,
+    Text *old_text,
+    Text *new_text,
+    uint32_t old_text_size
+  ) :
+    left{left},
+    right{right},
+    old_extent{old_extent},
+    new_extent{new_extent},
+    old_distance_from_left_ancestor{old_distance_from_left_ancestor},
+    new_distance_from_left_ancestor{new_distance_from_left_ancestor},
+    old_text{retain_text(old_text)},
+    new_text{retain_text(new_text)},
+    old_text_size_{old_text_size} {}
+
   Node(Deserializer &input) :
     left{nullptr},
     right{nullptr},
     old_extent{input},
     new_extent{input},
     old_distance_from_left_ancestor{input},
-    new_distance_from_left_ancestor{input} {
+    new_distance_from_left_ancestor{input},
+    old_text{nullptr},
+    new_text{nullptr} {
 
     if (input.read<uint32_t>()) {
-      old_text = unique_ptr<Text>{new Text{input}};
+      old_text = new_shared_text(input);
       old_text_size_ = 0;
     } else {
-      old_text = nullptr;
       old_text_size_ = input.read<uint32_t>();
     }
 
     if (input.read<uint32_t>()) {
-      new_text = unique_ptr<Text>{new Text{input}};
+      new_text = new_shared_text(input);
+    }
+  }
+
+  Node(Deserializer &input, Deserializer &text_input) :
+    left{nullptr},
+    right{nullptr},
+    old_extent{deserialize_point(input)},
+    new_extent{deserialize_point(input)},
+    old_distance_from_left_ancestor{deserialize_point(input)},
+    new_distance_from_left_ancestor{deserialize_point(input)},
+    old_text{nullptr},
+    new_text{nullptr},
+    old_text_size_{0} {
+
+    uint32_t flags = input.read_varint();
+    if (flags & SERIALIZED_NODE_HAS_OLD_TEXT) {
+      old_text = new_shared_text(deserialize_text(text_input, input.read_varint()));
     } else {
-      new_text = nullptr;
+      old_text_size_ = input.read_varint();
+    }
+
+    if (flags & SERIALIZED_NODE_HAS_NEW_TEXT) {
+      new_text = new_shared_text(deserialize_text(text_input, input.read_varint()));
     }
   }
 
+  Node(const Node &) = delete;
+
+  ~Node() {
+    release_text(old_text);
+    release_text(new_text);
+  }
+
   void compute_subtree_text_sizes() {
     old_subtree_text_size =
       old_text_size() + left_subtree_old_text_size() + right_subtree_old_text_size();
@@ -91,14 +242,31 @@ struct Patch::Node {
 
   void set_old_text(optional<Text> &&text, uint32_t old_text_size) {
     if (text) {
-      old_text = unique_ptr<Text>{new Text{move(*text)}};
+      if (old_text && static_cast<SharedText *>(old_text)->reference_count == 1) {
+        *old_text = move(*text);
+      } else {
+        release_text(old_text);
+        old_text = new_shared_text(move(*text));
+      }
       old_text_size_ = 0;
     } else {
-      old_text = nullptr;
+      release_old_text();
       old_text_size_ = old_text_size;
     }
   }
 
+  void share_old_text(Text *text, uint32_t old_text_size) {
+    retain_text(text);
+    release_text(old_text);
+    old_text = text;
+    old_text_size_ = text ? 0 : old_text_size;
+  }
+
+  void release_old_text() {
+    release_text(old_text);
+    old_text = nullptr;
+  }
+
   uint32_t old_text_size() const {
     return old_text ? old_text->size() : old_text_size_;
   }
@@ -113,12 +281,28 @@ struct Patch::Node {
 
   void set_new_text(optional<Text> &&text) {
     if (text) {
-      new_text = unique_ptr<Text>{new Text{move(*text)}};
+      if (new_text && static_cast<SharedText *>(new_text)->reference_count == 1) {
+        *new_text = move(*text);
+      } else {
+        release_text(new_text);
+        new_text = new_shared_text(move(*text));
+      }
     } else {
-      new_text = nullptr;
+      release_new_text();
     }
   }
 
+  void share_new_text(Text *text) {
+    retain_text(text);
+    release_text(new_text);
+    new_text = text;
+  }
+
+  void release_new_text() {
+    release_text(new_text);
+    new_text = nullptr;
+  }
+
   uint32_t new_text_size() const {
     return new_text ? new_text->size() : 0;
   }
@@ -144,57 +328,27 @@ struct Patch::Node {
     }
   }
 
-  Node *copy() {
-    auto result = new Node{
-      left,
-      right,
-      old_extent,
-      new_extent,
-      old_distance_from_left_ancestor,
-      new_distance_from_left_ancestor,
-      old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
-      new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
-      old_text_size_,
-    };
-    result->old_subtree_text_size = old_subtree_text_size;
-    result->new_subtree_text_size = new_subtree_text_size;
-    return result;
-  }
-
-  Node *invert() {
-    auto result = new Node{
-      left,
-      right,
-      new_extent,
-      old_extent,
-      new_distance_from_left_ancestor,
-      old_distance_from_left_ancestor,
-      new_text ? unique_ptr<Text>(new Text(*new_text)) : nullptr,
-      old_text ? unique_ptr<Text>(new Text(*old_text)) : nullptr,
-      new_text ? new_text->size() : 0
-    };
-    result->old_subtree_text_size = new_subtree_text_size;
-    result->new_subtree_text_size = old_subtree_text_size;
-    return result;
-  }
+  Node *copy(NodeAllocator &) const;
+  Node *invert(NodeAllocator &) const;
 
-  void serialize(Serializer &output) const {
-    old_extent.serialize(output);
-    new_extent.serialize(output);
-    old_distance_from_left_ancestor.serialize(output);
-    new_distance_from_left_ancestor.serialize(output);
+  void serialize(Serializer &output, vector<uint8_t> &text_output) const {
+    serialize_point(output, old_extent);
+    serialize_point(output, new_extent);
+    serialize_point(output, old_distance_from_left_ancestor);
+    serialize_point(output, new_distance_from_left_ancestor);
+    uint32_t flags = 0;
+    if (old_text) flags |= SERIALIZED_NODE_HAS_OLD_TEXT;
+    if (new_text) flags |= SERIALIZED_NODE_HAS_NEW_TEXT;
+    output.append_varint(flags);
     if (old_text) {
-      output.append<uint32_t>(1);
-      old_text->serialize(output);
+      output.append_varint(old_text->size());
+      serialize_text(text_output, *old_text);
     } else {
-      output.append<uint32_t>(0);
-      output.append<uint32_t>(old_text_size_);
+      output.append_varint(old_text_size_);
     }
     if (new_text) {
-      output.append<uint32_t>(1);
-      new_text->serialize(output);
-    } else {
-      output.append<uint32_t>(0);
+      output.append_varint(new_text->size());
+      serialize_text(text_output, *new_text);
     }
   }
 
@@ -279,6 +433,108 @@ struct Patch::Node {
   }
 };
 
+// Nodes are allocated from slabs that belong to a single patch. Freed nodes
+// are reused by later splices, and the slabs are released all at once when
+// the patch is destroyed instead of freeing every node separately.
+class Patch::NodeAllocator {
+  union Slot {
+    Slot *next_free_slot;
+    std::aligned_storage<sizeof(Node), alignof(Node)>::type node;
+  };
+
+  struct Slab {
+    unique_ptr<Slot[]> slots;
+    uint32_t size;
+  };
+
+  static const uint32_t MIN_SLAB_SIZE = 8;
+  static const uint32_t MAX_SLAB_SIZE = 1024;
+
+  vector<Slab> slabs;
+  uint32_t current_slab_index;
+  uint32_t used_slot_count;
+  Slot *free_slot;
+
+public:
+  NodeAllocator() : current_slab_index{0}, used_slot_count{0}, free_slot{nullptr} {}
+
+  template <typename... Args>
+  Node *allocate(Args &&... args) {
+    Slot *slot;
+    if (free_slot) {
+      slot = free_slot;
+      free_slot = slot->next_free_slot;
+    } else {
+      if (current_slab_index < slabs.size() && used_slot_count == slabs[current_slab_index].size) {
+        current_slab_index++;
+        used_slot_count = 0;
+      }
+      if (current_slab_index == slabs.size()) {
+        uint32_t size = MIN_SLAB_SIZE;
+        if (!slabs.empty()) size = slabs.back().size < MAX_SLAB_SIZE ? 2 * slabs.back().size : MAX_SLAB_SIZE;
+        slabs.push_back(Slab{unique_ptr<Slot[]>{new Slot[size]}, size});
+      }
+      slot = &slabs[current_slab_index].slots[used_slot_count++];
+    }
+    return new (&slot->node) Node{std::forward<Args>(args)...};
+  }
+
+  void free(Node *node) {
+    node->~Node();
+    Slot *slot = reinterpret_cast<Slot *>(node);
+    slot->next_free_slot = free_slot;
+    free_slot = slot;
+  }
+
+  // Makes every slot available again, once all of the nodes have been
+  // destroyed, while keeping the slabs for reuse.
+  void reset() {
+    current_slab_index = 0;
+    used_slot_count = 0;
+    free_slot = nullptr;
+  }
+};
+
+Patch::Node *Patch::Node::copy(NodeAllocator &allocator) const {
+  auto result = allocator.allocate(
+    left,
+    right,
+    old_extent,
+    new_extent,
+    old_distance_from_left_ancestor,
+    new_distance_from_left_ancestor,
+    old_text,
+    new_text,
+    old_text_size_
+  );
+  result->old_subtree_text_size = old_subtree_text_size;
+  result->new_subtree_text_size = new_subtree_text_size;
+  return result;
+}
+
+Patch::Node *Patch::Node::invert(NodeAllocator &allocator) const {
+  auto result = allocator.allocate(
+    left,
+    right,
+    new_extent,
+    old_extent,
+    new_distance_from_left_ancestor,
+    old_distance_from_left_ancestor,
+    new_text,
+    old_text,
+    new_text_size()
+  );
+  result->old_subtree_text_size = new_subtree_text_size;
+  result->new_subtree_text_size = old_subtree_text_size;
+  return result;
+}
+
+template <typename... Args>
+Patch::Node *Patch::allocate_node(Args &&... args) {
+  if (!node_allocator) node_allocator.reset(new NodeAllocator);
+  return node_allocator->allocate(std::forward<Args>(args)...);
+}
+
 struct Patch::PositionStackEntry {
   Point old_end;
   Point new_end;
@@ -316,45 +572,106 @@ struct Patch::NewCoordinates {
 // Construction and destruction
 
 Patch::Patch(bool merges_adjacent_changes)
-  : root{nullptr}, change_count{0}, merges_adjacent_changes{merges_adjacent_changes} {}
+  : root{nullptr}, change_count{0}, merges_adjacent_changes{merges_adjacent_changes},
+    tree_stats{}, excess_access_depth{0} {}
 
 Patch::Patch(Patch &&other)
   : root{nullptr}, change_count{other.change_count},
-    merges_adjacent_changes{other.merges_adjacent_changes} {
+    merges_adjacent_changes{other.merges_adjacent_changes},
+    tree_stats{}, excess_access_depth{0} {
   *this = move(other);
 }
 
-Patch::Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes)
-  : root{root}, change_count{change_count},
-    merges_adjacent_changes{merges_adjacent_changes} {}
-
 enum Transition : uint32_t { None, Left, Right, Up };
 
 Patch::Patch(Deserializer &input) :
   root{nullptr},
   change_count{0},
-  merges_adjacent_changes{true} {
+  merges_adjacent_changes{true},
+  tree_stats{},
+  excess_access_depth{0} {
   uint32_t serialization_version = input.read<uint32_t>();
+  if (serialization_version == 1) {
+    deserialize_version_1(input);
+    return;
+  }
   if (serialization_version != SERIALIZATION_VERSION) return;
 
+  uint32_t count = input.read_varint();
+  if (count == 0) return;
+
+  uint32_t text_size = input.read_varint();
+  const uint8_t *text_bytes = input.read_bytes(2 * static_cast<size_t>(text_size));
+  uint32_t transition_count = input.read_varint();
+  const uint8_t *transitions = input.read_bytes((transition_count + 3) / 4);
+  if (!text_bytes || !transitions) return;
+  Deserializer text_input(text_bytes, 2 * static_cast<size_t>(text_size));
+
+  node_stack.reserve(count);
+  root = allocate_node(input, text_input);
+  change_count = 1;
+  Node *node = root, *next_node = nullptr;
+
+  for (uint32_t i = 0; i < transition_count; i++) {
+    switch ((transitions[i / 4] >> (2 * (i % 4))) & 3) {
+    case Left:
+      if (change_count == count) break;
+      next_node = allocate_node(input, text_input);
+      node->left = next_node;
+      node_stack.push_back(node);
+      node = next_node;
+      change_count++;
+      continue;
+    case Right:
+      if (change_count == count) break;
+      next_node = allocate_node(input, text_input);
+      node->right = next_node;
+      node_stack.push_back(node);
+      node = next_node;
+      change_count++;
+      continue;
+    case Up:
+      if (node_stack.empty()) break;
+      node->compute_subtree_text_sizes();
+      node = node_stack.back();
+      node_stack.pop_back();
+      continue;
+    }
+
+    clear();
+    return;
+  }
+
+  if (change_count != count) {
+    clear();
+    return;
+  }
+
+  node->compute_subtree_text_sizes();
+  for (auto iter = node_stack.rbegin(); iter != node_stack.rend(); ++iter) {
+    (*iter)->compute_subtree_text_sizes();
+  }
+}
+
+void Patch::deserialize_version_1(Deserializer &input) {
   change_count = input.read<uint32_t>();
   if (change_count == 0) return;
 
   node_stack.reserve(change_count);
-  root = new Node(input);
+  root = allocate_node(input);
   Node *node = root, *next_node = nullptr;
 
   for (uint32_t i = 1; i < change_count;) {
     switch (input.read<uint32_t>()) {
     case Left:
-      next_node = new Node(input);
+      next_node = allocate_node(input);
       node->left = next_node;
       node_stack.push_back(node);
       node = next_node;
       i++;
       break;
     case Right:
-      next_node = new Node(input);
+      next_node = allocate_node(input);
       node->right = next_node;
       node_stack.push_back(node);
       node = next_node;
@@ -366,7 +683,7 @@ Patch::Patch(Deserializer &input) :
       node_stack.pop_back();
       break;
     default:
-      delete root;
+      clear();
       return;
     }
   }
@@ -379,44 +696,59 @@ Patch::Patch(Deserializer &input) :
 
 Patch &Patch::operator=(Patch &&other) {
   std::swap(root, other.root);
+  std::swap(node_allocator, other.node_allocator);
   std::swap(left_ancestor_stack, other.left_ancestor_stack);
   std::swap(node_stack, other.node_stack);
   std::swap(change_count, other.change_count);
+  std::swap(tree_stats, other.tree_stats);
+  std::swap(excess_access_depth, other.excess_access_depth);
   merges_adjacent_changes = other.merges_adjacent_changes;
   return *this;
 }
 
 Patch::~Patch() {
-  if (root) delete_node(&root);
+  clear();
 }
 
-void Patch::serialize(Serializer &output) {
+void Patch::serialize(Serializer &output) const {
   output.append(SERIALIZATION_VERSION);
-  output.append(change_count);
+  output.append_varint(change_count);
 
   if (!root) return;
-  root->serialize(output);
 
-  Node *node = root;
-  node_stack.clear();
+  // The texts and the tree's transitions are written before the nodes, so
+  // that they can be located before the nodes are read.
+  vector<uint8_t> node_bytes, text_bytes, transitions;
+  Serializer node_output(node_bytes);
+  uint32_t transition_count = 0;
+  auto append_transition = [&transitions, &transition_count](Transition transition) {
+    if (transition_count % 4 == 0) transitions.push_back(0);
+    transitions.back() |= transition << (2 * (transition_count % 4));
+    transition_count++;
+  };
+
+  root->serialize(node_output, text_bytes);
+
+  const Node *node = root;
+  vector<const Node *> node_stack;
   int previous_node_child_index = -1;
 
   while (node) {
     if (node->left && previous_node_child_index < 0) {
-      output.append<uint32_t>(Left);
-      node->left->serialize(output);
+      append_transition(Left);
+      node->left->serialize(node_output, text_bytes);
       node_stack.push_back(node);
       node = node->left;
       previous_node_child_index = -1;
     } else if (node->right && previous_node_child_index < 1) {
-      output.append<uint32_t>(Right);
-      node->right->serialize(output);
+      append_transition(Right);
+      node->right->serialize(node_output, text_bytes);
       node_stack.push_back(node);
       node = node->right;
       previous_node_child_index = -1;
     } else if (!node_stack.empty()) {
-      output.append<uint32_t>(Up);
-      Node *parent = node_stack.back();
+      append_transition(Up);
+      const Node *parent = node_stack.back();
       node_stack.pop_back();
       previous_node_child_index = (node == parent->left) ? 0 : 1;
       node = parent;
@@ -424,54 +756,241 @@ void Patch::serialize(Serializer &output) {
       break;
     }
   }
+
+  output.append_varint(text_bytes.size() / 2);
+  output.append_bytes(text_bytes.data(), text_bytes.size());
+  output.append_varint(transition_count);
+  output.append_bytes(transitions.data(), transitions.size());
+  output.append_bytes(node_bytes.data(), node_bytes.size());
 }
 
-Patch Patch::copy() {
-  Node *new_root = nullptr;
+Patch Patch::copy() const {
+  Patch result{merges_adjacent_changes};
   if (root) {
-    new_root = root->copy();
-    node_stack.clear();
-    node_stack.push_back(new_root);
+    result.node_allocator.reset(new NodeAllocator);
+    result.root = root->copy(*result.node_allocator);
+    result.change_count = change_count;
+    vector<Node *> &node_stack = result.node_stack;
+    node_stack.push_back(result.root);
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->copy();
+        node->left = node->left->copy(*result.node_allocator);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->copy();
+        node->right = node->right->copy(*result.node_allocator);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{new_root, change_count, merges_adjacent_changes};
+  return result;
 }
 
-Patch Patch::invert() {
-  Node *inverted_root = nullptr;
+Patch Patch::invert() const {
+  Patch result{merges_adjacent_changes};
   if (root) {
-    inverted_root = root->invert();
-    node_stack.clear();
-    node_stack.push_back(inverted_root);
+    result.node_allocator.reset(new NodeAllocator);
+    result.root = root->invert(*result.node_allocator);
+    result.change_count = change_count;
+    vector<Node *> &node_stack = result.node_stack;
+    node_stack.push_back(result.root);
 
     while (!node_stack.empty()) {
       Node *node = node_stack.back();
       node_stack.pop_back();
       if (node->left) {
-        node->left = node->left->invert();
+        node->left = node->left->invert(*result.node_allocator);
         node_stack.push_back(node->left);
       }
       if (node->right) {
-        node->right = node->right->invert();
+        node->right = node->right->invert(*result.node_allocator);
         node_stack.push_back(node->right);
       }
     }
   }
 
-  return Patch{inverted_root, change_count, merges_adjacent_changes};
+  return result;
+}
+
+Patch Patch::rebase(const Patch &concurrent, RebaseTieBreak tie_break) const {
+  vector<Change> changes = get_changes();
+  vector<Change> concurrent_changes = concurrent.get_changes();
+  vector<Change> rebased_changes;
+  std::deque<Text> rebased_texts;
+  rebased_changes.reserve(changes.size());
+
+  size_t concurrent_index = 0;
+  Point preceding_old_end, preceding_new_end;
+  Point rebased_old_end, rebased_new_end;
+
+  for (const Change &change : changes) {
+    // Skip the concurrent changes that end before this change starts. An
+    // insertion at the start of this change still affects where it goes.
+    while (concurrent_index < concurrent_changes.size()) {
+      const Change &concurrent_change = concurrent_changes[concurrent_index];
+      if (concurrent_change.old_end < change.old_start ||
+          (concurrent_change.old_end == change.old_start &&
+           concurrent_change.old_start < concurrent_change.old_end)) {
+        preceding_old_end = concurrent_change.old_end;
+        preceding_new_end = concurrent_change.new_end;
+        concurrent_index++;
+      } else {
+        break;
+      }
+    }
+
+    // The part of this change's old range that the concurrent patch left
+    // alone is split into pieces around the concurrent insertions, and the
+    // first piece inserts this change's new text.
+    Point new_extent = change.new_end.traversal(change.new_start);
+    Point position = change.old_start;
+    Point base_old_end = preceding_old_end, base_new_end = preceding_new_end;
+    bool overlapped = false, inserted = false, piece_open = false, piece_inserts = false;
+    Point piece_start, piece_end;
+    Text *piece_old_text = nullptr;
+
+    auto rebase_position = [&](Point old_position) {
+      return base_new_end.traverse(old_position.traversal(base_old_end));
+    };
+
+    auto open_piece = [&](Point start) {
+      piece_open = true;
+      piece_start = start;
+      piece_end = start;
+      piece_inserts = !inserted;
+      inserted = true;
+      piece_old_text = nullptr;
+    };
+
+    auto extend_piece = [&](Point start, Point end) {
+      if (!piece_open) open_piece(rebase_position(start));
+      piece_end = rebase_position(end);
+      if (change.old_text) {
+        TextSlice old_text_slice = TextSlice(*change.old_text).slice(Range{
+          start.traversal(change.old_start),
+          end.traversal(change.old_start)
+        });
+        if (piece_old_text) {
+          piece_old_text->append(old_text_slice);
+        } else {
+          rebased_texts.emplace_back(old_text_slice);
+          piece_old_text = &rebased_texts.back();
+        }
+      }
+    };
+
+    auto close_piece = [&]() {
+      if (!piece_open) return;
+      piece_open = false;
+      if (piece_start == piece_end && (!piece_inserts || new_extent.is_zero())) return;
+
+      if (change.old_text && !piece_old_text) {
+        rebased_texts.emplace_back();
+        piece_old_text = &rebased_texts.back();
+      }
+      Text *piece_new_text = nullptr;
+      if (change.new_text) {
+        if (piece_inserts) {
+          rebased_texts.push_back(*change.new_text);
+        } else {
+          rebased_texts.emplace_back();
+        }
+        piece_new_text = &rebased_texts.back();
+      }
+
+      Point new_start = rebased_new_end.traverse(piece_start.traversal(rebased_old_end));
+      Point new_end = piece_inserts ? new_start.traverse(new_extent) : new_start;
+      uint32_t old_text_size = overlapped ? 0 : change.old_text_size;
+      rebased_changes.push_back(Change{
+        piece_start, piece_end, new_start, new_end,
+        piece_old_text, piece_new_text, 0, 0, old_text_size
+      });
+      rebased_old_end = piece_end;
+      rebased_new_end = new_end;
+    };
+
+    for (size_t i = concurrent_index; i < concurrent_changes.size(); i++) {
+      const Change &concurrent_change = concurrent_changes[i];
+      if (!(concurrent_change.old_start < change.old_end ||
+            concurrent_change.old_start == change.old_start)) break;
+      overlapped = true;
+
+      if (position < concurrent_change.old_start) {
+        extend_piece(position, concurrent_change.old_start);
+      } else if (!inserted && concurrent_change.old_start == change.old_start &&
+                 tie_break == RebaseTieBreak::ThisFirst) {
+        open_piece(concurrent_change.new_start);
+      }
+
+      if (concurrent_change.new_start != concurrent_change.new_end) close_piece();
+      if (position < concurrent_change.old_end) position = concurrent_change.old_end;
+      base_old_end = concurrent_change.old_end;
+      base_new_end = concurrent_change.new_end;
+    }
+
+    if (position < change.old_end) {
+      extend_piece(position, change.old_end);
+    } else if (!inserted) {
+      open_piece(rebase_position(position));
+    }
+    close_piece();
+  }
+
+  return from_sorted_changes(rebased_changes, merges_adjacent_changes);
+}
+
+Patch Patch::from_sorted_changes(const vector<Change> &changes, bool merges_adjacent_changes) {
+  Patch result{merges_adjacent_changes};
+  vector<Change> merged_changes;
+  vector<Node *> nodes;
+  merged_changes.reserve(changes.size());
+  nodes.reserve(changes.size());
+
+  for (const Change &change : changes) {
+    if (change.old_start == change.old_end && change.new_start == change.new_end) continue;
+
+    if (merges_adjacent_changes && !merged_changes.empty() &&
+        merged_changes.back().new_end == change.new_start) {
+      Change &previous_change = merged_changes.back();
+      Node *node = nodes.back();
+      previous_change.old_end = change.old_end;
+      previous_change.new_end = change.new_end;
+      if (node->old_text && change.old_text) {
+        node->old_text->append(*change.old_text);
+      } else {
+        uint32_t old_text_size = node->old_text_size() +
+          (change.old_text ? change.old_text->size() : change.old_text_size);
+        node->release_old_text();
+        node->old_text_size_ = old_text_size;
+      }
+      if (node->new_text && change.new_text) {
+        node->new_text->append(*change.new_text);
+      } else {
+        node->release_new_text();
+      }
+      continue;
+    }
+
+    Text *no_text = nullptr;
+    Node *node = result.allocate_node(
+      nullptr, nullptr, Point(), Point(), Point(), Point(),
+      no_text, no_text, change.old_text_size
+    );
+    if (change.old_text) node->set_old_text(move(*change.old_text), 0);
+    if (change.new_text) node->set_new_text(move(*change.new_text));
+    merged_changes.push_back(change);
+    nodes.push_back(node);
+  }
+
+  result.root = result.build_balanced_tree(
+    merged_changes.data(), nodes.data(), merged_changes.size(), Point(), Point()
+  );
+  result.change_count = merged_changes.size();
+  return result;
 }
 
 // Mutations
@@ -482,6 +1001,8 @@ bool Patch::splice(Point new_splice_start,
                    uint32_t deleted_text_size) {
   if (new_deletion_extent.is_zero() && new_insertion_extent.is_zero()) return true;
 
+  rebalance_if_degenerate();
+
   if (!root) {
     root = build_node(nullptr, nullptr, new_splice_start, new_splice_start,
                      new_deletion_extent, new_insertion_extent,
@@ -779,6 +1300,7 @@ bool Patch::splice(Point new_splice_start,
 void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
                       Point old_insertion_extent) {
   if (!root) return;
+  rebalance_if_degenerate();
 
   Point old_deletion_end = old_splice_start.traverse(old_deletion_extent);
   Point old_insertion_end = old_splice_start.traverse(old_insertion_extent);
@@ -848,20 +1370,18 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
         upper_bound->old_extent =
             lower_bound->old_extent.traverse(upper_bound->old_extent);
         if (lower_bound->old_text && upper_bound->old_text) {
-          lower_bound->old_text->append(*upper_bound->old_text);
-          std::swap(upper_bound->old_text, lower_bound->old_text);
+          upper_bound->set_old_text(Text::concat(*lower_bound->old_text, *upper_bound->old_text), 0);
         } else {
-          upper_bound->old_text = nullptr;
+          upper_bound->release_old_text();
           upper_bound->old_text_size_ += lower_bound->old_text_size_;
         }
 
         upper_bound->new_extent =
             lower_bound->new_extent.traverse(upper_bound->new_extent);
         if (lower_bound->new_text && upper_bound->new_text) {
-          lower_bound->new_text->append(*upper_bound->new_text);
-          std::swap(upper_bound->new_text, lower_bound->new_text);
+          upper_bound->set_new_text(Text::concat(*lower_bound->new_text, *upper_bound->new_text));
         } else {
-          upper_bound->new_text = nullptr;
+          upper_bound->release_new_text();
         }
 
         upper_bound->left = lower_bound->left;
@@ -878,7 +1398,285 @@ void Patch::splice_old(Point old_splice_start, Point old_deletion_extent,
   if (upper_bound) upper_bound->compute_subtree_text_sizes();
 }
 
+// Computes the old text for a splice by replacing the parts of the deleted
+// text that are covered by the given overlapping changes with those changes'
+// old text.
+static std::pair<optional<Text>, bool> compute_old_text_for_changes(
+  const Text &deleted_text, Point new_splice_start,
+  const Change *overlapping_changes_begin, const Change *overlapping_changes_end
+) {
+  Text result;
+
+  TextSlice deleted_text_slice = TextSlice(deleted_text);
+  Point deleted_text_slice_start = new_splice_start;
+
+  for (auto change = overlapping_changes_begin; change != overlapping_changes_end; ++change) {
+    if (!change->old_text) return {optional<Text>{}, true};
+
+    if (change->new_start > deleted_text_slice_start) {
+      auto split_result = deleted_text_slice.split(
+        change->new_start.traversal(deleted_text_slice_start)
+      );
+      if (!split_result.first.is_valid()) return {optional<Text>{}, false};
+      deleted_text_slice_start = change->new_start;
+      deleted_text_slice = split_result.second;
+      result.append(split_result.first);
+    }
+
+    result.append(*change->old_text);
+    deleted_text_slice = deleted_text_slice.suffix(Point::min(
+      deleted_text_slice.extent(),
+      change->new_end.traversal(deleted_text_slice_start)
+    ));
+    deleted_text_slice_start = change->new_end;
+
+    if (!deleted_text_slice.is_valid()) return {optional<Text>{}, false};
+  }
+
+  result.append(deleted_text_slice);
+  return {move(result), true};
+}
+
+static uint32_t compute_old_text_size_for_changes(
+  uint32_t deleted_text_size, Point new_splice_start, Point new_deletion_end,
+  const Change *overlapping_changes_begin, const Change *overlapping_changes_end
+) {
+  uint32_t old_text_size = deleted_text_size;
+
+  for (auto change = overlapping_changes_begin; change != overlapping_changes_end; ++change) {
+    if (!change->new_text) return 0;
+
+    TextSlice overlapping_new_text = TextSlice(*change->new_text);
+    if (new_deletion_end < change->new_end) {
+      overlapping_new_text = overlapping_new_text.prefix(new_deletion_end.traversal(change->new_start));
+    }
+    if (new_splice_start > change->new_start) {
+      overlapping_new_text = overlapping_new_text.suffix(new_splice_start.traversal(change->new_start));
+    }
+
+    old_text_size -= overlapping_new_text.size();
+    old_text_size += change->old_text_size;
+  }
+
+  return old_text_size;
+}
+
 bool Patch::combine(const Patch &other, bool left_to_right) {
+  // Splicing a few changes into a large tree is cheaper than rebuilding it.
+  if (!merges_adjacent_changes ||
+      uint64_t(other.change_count) * SPLICING_COMBINE_CHANGE_COUNT_RATIO < change_count) {
+    return combine_by_splicing(other, left_to_right);
+  }
+
+  // Walk both patches in the coordinate space between them: the new
+  // coordinates of this patch and the old coordinates of the other. Each of
+  // the other patch's changes is applied as `splice` would apply it, but to
+  // a sorted vector of changes, where it can only overlap the last changes
+  // that have been emitted and this patch's next changes. Nothing is modified
+  // until every change has been combined, so that inconsistent patches leave
+  // this one as it was. Nodes of changes that aren't affected are reused as
+  // they are, and changes that don't overlap any of this patch's changes
+  // share the other patch's texts.
+  vector<Change> changes;
+  vector<Node *> nodes;
+  get_nodes(&changes, &nodes);
+  auto other_changes = other.get_changes();
+
+  vector<Change> result;
+  vector<Node *> result_nodes;
+  vector<bool> result_is_combined;
+  result.reserve(changes.size() + other_changes.size());
+  result_nodes.reserve(changes.size() + other_changes.size());
+  result_is_combined.reserve(changes.size() + other_changes.size());
+  vector<Node *> released_nodes;
+
+  // Texts computed for combined changes, which are released once the nodes
+  // have taken them or the patches turn out to be inconsistent.
+  vector<Text *> texts;
+  auto release_texts = [&texts]() {
+    for (Text *text : texts) release_text(text);
+  };
+
+  size_t index = 0;
+  Point previous_old_end, previous_new_end;
+  for (const Change &other_change : other_changes) {
+    Point new_splice_start = other_change.new_start;
+    Point new_deletion_end = new_splice_start.traverse(
+      other_change.old_end.traversal(other_change.old_start)
+    );
+    Point new_insertion_end = other_change.new_end;
+    if (new_deletion_end == new_splice_start && new_insertion_end == new_splice_start) continue;
+
+    for (; index < changes.size() && changes[index].new_start <= other_change.old_end; index++) {
+      result.push_back(changes[index]);
+      result.back().new_start = previous_new_end.traverse(changes[index].new_start.traversal(previous_old_end));
+      result.back().new_end = previous_new_end.traverse(changes[index].new_end.traversal(previous_old_end));
+      result_nodes.push_back(nodes[index]);
+      result_is_combined.push_back(false);
+    }
+    previous_old_end = other_change.old_end;
+    previous_new_end = new_insertion_end;
+
+    size_t overlap_index = result.size();
+    while (overlap_index > 0 && result[overlap_index - 1].new_end >= new_splice_start) {
+      overlap_index--;
+    }
+    const Change *overlapping_changes_begin = result.data() + overlap_index;
+    const Change *overlapping_changes_end = result.data() + result.size();
+    const Change *preceding_change = overlap_index > 0 ? &result[overlap_index - 1] : nullptr;
+    const Change *lower_bound = nullptr, *upper_bound = nullptr;
+    if (overlapping_changes_begin != overlapping_changes_end) {
+      if (overlapping_changes_begin->new_start <= new_splice_start) {
+        lower_bound = overlapping_changes_begin;
+      }
+      const Change *last_change = overlapping_changes_end - 1;
+      if (last_change->new_end >= new_deletion_end && last_change->new_end > new_splice_start) {
+        upper_bound = last_change;
+      }
+    }
+
+    Change combined_change{};
+    if (lower_bound) {
+      combined_change.old_start = lower_bound->old_start;
+      combined_change.new_start = lower_bound->new_start;
+    } else {
+      combined_change.old_start = preceding_change
+        ? preceding_change->old_end.traverse(new_splice_start.traversal(preceding_change->new_end))
+        : new_splice_start;
+      combined_change.new_start = new_splice_start;
+    }
+    if (overlapping_changes_begin != overlapping_changes_end) {
+      preceding_change = overlapping_changes_end - 1;
+    }
+    if (upper_bound) {
+      combined_change.old_end = upper_bound->old_end;
+      combined_change.new_end = new_insertion_end.traverse(upper_bound->new_end.traversal(new_deletion_end));
+    } else {
+      combined_change.old_end = preceding_change
+        ? preceding_change->old_end.traverse(new_deletion_end.traversal(preceding_change->new_end))
+        : new_deletion_end;
+      combined_change.new_end = new_insertion_end;
+    }
+
+    bool has_overlap = overlapping_changes_begin != overlapping_changes_end;
+    if (!has_overlap) {
+      combined_change.old_text = other_change.old_text;
+    } else if (other_change.old_text) {
+      auto old_text_result = compute_old_text_for_changes(
+        *other_change.old_text, new_splice_start,
+        overlapping_changes_begin, overlapping_changes_end
+      );
+      if (!old_text_result.second) {
+        release_texts();
+        return false;
+      }
+      if (old_text_result.first) {
+        texts.push_back(new_shared_text(move(*old_text_result.first)));
+        combined_change.old_text = texts.back();
+      }
+    }
+    if (combined_change.old_text) {
+      combined_change.old_text_size = combined_change.old_text->size();
+    } else {
+      combined_change.old_text_size = compute_old_text_size_for_changes(
+        other_change.old_text_size, new_splice_start, new_deletion_end,
+        overlapping_changes_begin, overlapping_changes_end
+      );
+    }
+
+    if (!has_overlap) {
+      combined_change.new_text = other_change.new_text;
+    } else if (
+      other_change.new_text &&
+      (!lower_bound || lower_bound->new_text) &&
+      (!upper_bound || upper_bound->new_text)
+    ) {
+      Text new_text;
+      if (lower_bound) {
+        TextSlice new_text_prefix = TextSlice(*lower_bound->new_text).prefix(
+          new_splice_start.traversal(lower_bound->new_start)
+        );
+        if (!new_text_prefix.is_valid()) {
+          release_texts();
+          return false;
+        }
+        new_text.append(new_text_prefix);
+      }
+      new_text.append(*other_change.new_text);
+      if (upper_bound) {
+        TextSlice new_text_suffix = TextSlice(*upper_bound->new_text).suffix(
+          new_deletion_end.traversal(upper_bound->new_start)
+        );
+        if (!new_text_suffix.is_valid()) {
+          release_texts();
+          return false;
+        }
+        new_text.append(new_text_suffix);
+      }
+      texts.push_back(new_shared_text(move(new_text)));
+      combined_change.new_text = texts.back();
+    }
+
+    bool is_empty =
+      combined_change.old_start == combined_change.old_end &&
+      combined_change.new_start == combined_change.new_end &&
+      lower_bound && lower_bound == upper_bound;
+    bool is_noop =
+      combined_change.old_text && combined_change.new_text &&
+      *combined_change.old_text == *combined_change.new_text;
+
+    // The first of the overlapping changes' nodes is reused for the combined
+    // change once its texts are no longer needed.
+    Node *node = nullptr;
+    for (size_t i = overlap_index; i < result_nodes.size(); i++) {
+      if (!node && !is_empty && !is_noop) {
+        node = result_nodes[i];
+      } else if (result_nodes[i]) {
+        released_nodes.push_back(result_nodes[i]);
+      }
+    }
+    result.resize(overlap_index);
+    result_nodes.resize(overlap_index);
+    result_is_combined.resize(overlap_index);
+    if (is_empty || is_noop) continue;
+
+    result.push_back(combined_change);
+    result_nodes.push_back(node);
+    result_is_combined.push_back(true);
+  }
+
+  for (; index < changes.size(); index++) {
+    result.push_back(changes[index]);
+    result.back().new_start = previous_new_end.traverse(changes[index].new_start.traversal(previous_old_end));
+    result.back().new_end = previous_new_end.traverse(changes[index].new_end.traversal(previous_old_end));
+    result_nodes.push_back(nodes[index]);
+    result_is_combined.push_back(false);
+  }
+
+  for (size_t i = 0; i < result.size(); i++) {
+    if (!result_is_combined[i]) continue;
+    const Change &change = result[i];
+    Node *&node = result_nodes[i];
+    if (node) {
+      node->share_old_text(change.old_text, change.old_text_size);
+      node->share_new_text(change.new_text);
+    } else {
+      node = allocate_node(
+        nullptr, nullptr, Point(), Point(), Point(), Point(),
+        change.old_text, change.new_text, change.old_text_size
+      );
+    }
+  }
+  for (Node *node : released_nodes) node_allocator->free(node);
+  release_texts();
+
+  root = build_balanced_tree(result.data(), result_nodes.data(), result.size(), Point(), Point());
+  change_count = result.size();
+  excess_access_depth = 0;
+  return true;
+}
+
+bool Patch::combine_by_splicing(const Patch &other, bool left_to_right) {
   auto changes = other.get_changes();
   if (left_to_right) {
     for (auto iter = changes.begin(), end = changes.end(); iter != end; ++iter) {
@@ -903,14 +1701,92 @@ bool Patch::combine(const Patch &other, bool left_to_right) {
   return true;
 }
 
+// Links the given nodes, which must be sorted, into a balanced tree.
+Patch::Node *Patch::build_balanced_tree(const Change *changes, Node **nodes, size_t count,
+                                        Point left_ancestor_old_end,
+                                        Point left_ancestor_new_end) {
+  if (count == 0) return nullptr;
+
+  size_t index = count / 2;
+  const Change &change = changes[index];
+  Node *node = nodes[index];
+  node->left = build_balanced_tree(
+    changes, nodes, index,
+    left_ancestor_old_end, left_ancestor_new_end
+  );
+  node->right = build_balanced_tree(
+    changes + index + 1, nodes + index + 1, count - index - 1,
+    change.old_end, change.new_end
+  );
+  node->old_extent = change.old_end.traversal(change.old_start);
+  node->new_extent = change.new_end.traversal(change.new_start);
+  node->old_distance_from_left_ancestor = change.old_start.traversal(left_ancestor_old_end);
+  node->new_distance_from_left_ancestor = change.new_start.traversal(left_ancestor_new_end);
+  node->compute_subtree_text_sizes();
+  return node;
+}
+
+// Collects the changes in order, along with the nodes that store them.
+void Patch::get_nodes(vector<Change> *changes, vector<Node *> *nodes) {
+  changes->reserve(change_count);
+  nodes->reserve(change_count);
+
+  node_stack.clear();
+  left_ancestor_stack.clear();
+  for (Node *node = root; node; node = node->left) {
+    node_stack.push_back(node);
+    left_ancestor_stack.push_back(PositionStackEntry{});
+  }
+
+  while (!node_stack.empty()) {
+    Node *node = node_stack.back();
+    PositionStackEntry left_ancestor_info = left_ancestor_stack.back();
+    node_stack.pop_back();
+    left_ancestor_stack.pop_back();
+
+    Point old_start = left_ancestor_info.old_end.traverse(node->old_distance_from_left_ancestor);
+    Point new_start = left_ancestor_info.new_end.traverse(node->new_distance_from_left_ancestor);
+    Point old_end = old_start.traverse(node->old_extent);
+    Point new_end = new_start.traverse(node->new_extent);
+    changes->push_back(Change{
+      old_start, old_end, new_start, new_end,
+      node->old_text, node->new_text,
+      0, 0, node->old_text_size()
+    });
+    nodes->push_back(node);
+
+    for (Node *child = node->right; child; child = child->left) {
+      node_stack.push_back(child);
+      left_ancestor_stack.push_back(PositionStackEntry{old_end, new_end, 0, 0});
+    }
+  }
+}
+
 void Patch::clear() {
-  if (root) delete_node(&root);
+  if (!root) return;
+
+  node_stack.clear();
+  node_stack.push_back(root);
+  while (!node_stack.empty()) {
+    Node *node = node_stack.back();
+    node_stack.pop_back();
+    if (node->left) node_stack.push_back(node->left);
+    if (node->right) node_stack.push_back(node->right);
+    node->~Node();
+  }
+
+  node_allocator->reset();
+  root = nullptr;
+  change_count = 0;
 }
 
 void Patch::rebalance() {
+  excess_access_depth = 0;
   if (!root)
     return;
 
+  tree_stats.rebalance_count++;
+
   // Transform tree to vine
   Node *pseudo_root = root, *pseudo_root_parent = nullptr;
   while (pseudo_root) {
@@ -974,6 +1850,91 @@ optional<Change> Patch::get_bounds() const {
   };
 }
 
+vector<Point> Patch::translate_positions(const vector<Point> &positions,
+                                        TranslationDirection direction,
+                                        ClipDirection clip_direction) const {
+  vector<Point> result(positions.size());
+  vector<uint32_t> order(positions.size());
+  for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+  if (!std::is_sorted(positions.begin(), positions.end())) {
+    std::stable_sort(order.begin(), order.end(), [&positions](uint32_t a, uint32_t b) {
+      return positions[a] < positions[b];
+    });
+  }
+
+  bool old_to_new = direction == TranslationDirection::OldToNew;
+  Point preceding_source_end, preceding_target_end;
+  auto sweep_order = order.begin();
+
+  const Node *node = root;
+  vector<const Node *> node_stack;
+  vector<PositionStackEntry> left_ancestor_stack{{}};
+  while (node && node->left) {
+    node_stack.push_back(node);
+    node = node->left;
+  }
+
+  while (node && sweep_order != order.end()) {
+    const PositionStackEntry &left_ancestor_info = left_ancestor_stack.back();
+    Point old_start = left_ancestor_info.old_end.traverse(node->old_distance_from_left_ancestor);
+    Point new_start = left_ancestor_info.new_end.traverse(node->new_distance_from_left_ancestor);
+    Point old_end = old_start.traverse(node->old_extent);
+    Point new_end = new_start.traverse(node->new_extent);
+    Point source_start = old_to_new ? old_start : new_start;
+    Point source_end = old_to_new ? old_end : new_end;
+    Point target_start = old_to_new ? new_start : old_start;
+    Point target_end = old_to_new ? new_end : old_end;
+
+    // Positions at the end of a non-empty change are left for the following
+    // changes, which may start at the same position.
+    for (; sweep_order != order.end(); ++sweep_order) {
+      Point position = positions[*sweep_order];
+      if (position < source_start) {
+        result[*sweep_order] = preceding_target_end.traverse(position.traversal(preceding_source_end));
+      } else if (position == source_start && source_start < source_end) {
+        result[*sweep_order] = target_start;
+      } else if (position < source_end || position == source_start) {
+        result[*sweep_order] = clip_direction == ClipDirection::Backward ? target_start : target_end;
+      } else {
+        break;
+      }
+    }
+
+    preceding_source_end = source_end;
+    preceding_target_end = target_end;
+
+    if (node->right) {
+      left_ancestor_stack.push_back(PositionStackEntry{old_end, new_end, 0, 0});
+      node_stack.push_back(node);
+      node = node->right;
+      while (node->left) {
+        node_stack.push_back(node);
+        node = node->left;
+      }
+    } else {
+      while (!node_stack.empty() && node_stack.back()->right == node) {
+        node = node_stack.back();
+        node_stack.pop_back();
+        left_ancestor_stack.pop_back();
+      }
+
+      if (node_stack.empty()) {
+        node = nullptr;
+      } else {
+        node = node_stack.back();
+        node_stack.pop_back();
+      }
+    }
+  }
+
+  for (; sweep_order != order.end(); ++sweep_order) {
+    Point position = positions[*sweep_order];
+    result[*sweep_order] = preceding_target_end.traverse(position.traversal(preceding_source_end));
+  }
+
+  return result;
+}
+
 vector<Change> Patch::get_changes_in_old_range(Point start, Point end) const {
   return get_changes_in_range<OldCoordinates>(start, end, false);
 }
@@ -1050,22 +2011,27 @@ Point Patch::new_position_for_new_offset(uint32_t target_offset,
 // Splaying reads
 
 vector<Change> Patch::grab_changes_in_old_range(Point start, Point end) {
+  rebalance_if_degenerate();
   return grab_changes_in_range<OldCoordinates>(start, end);
 }
 
 vector<Change> Patch::grab_changes_in_new_range(Point start, Point end) {
+  rebalance_if_degenerate();
   return grab_changes_in_range<NewCoordinates>(start, end);
 }
 
 optional<Change> Patch::grab_change_starting_before_old_position(Point target) {
+  rebalance_if_degenerate();
   return grab_change_starting_before_position<OldCoordinates>(target);
 }
 
 optional<Change> Patch::grab_change_starting_before_new_position(Point target) {
+  rebalance_if_degenerate();
   return grab_change_starting_before_position<NewCoordinates>(target);
 }
 
 optional<Change> Patch::grab_change_ending_after_new_position(Point target, bool exclusive) {
+  rebalance_if_degenerate();
   optional<Point> exclusive_lower_bound;
   if (exclusive) exclusive_lower_bound = target;
   if (splay_node_ending_after<NewCoordinates>(target, exclusive_lower_bound)) {
@@ -1091,9 +2057,20 @@ std::string Patch::get_json() const {
   return result.str();
 }
 
+Patch::TreeStats Patch::get_tree_stats() const {
+  return tree_stats;
+}
+
 // Private - mutations
 
 void Patch::splay_node(Node *node) {
+  uint32_t depth = node_stack.size();
+  tree_stats.access_count++;
+  tree_stats.total_access_depth += depth;
+  if (depth > tree_stats.max_access_depth) tree_stats.max_access_depth = depth;
+  uint32_t max_expected_depth = REBALANCING_DEPTH_FACTOR * std::log2(change_count + 1);
+  if (depth > max_expected_depth) excess_access_depth += depth - max_expected_depth;
+
   while (!node_stack.empty()) {
     Node *parent = node_stack.back();
     node_stack.pop_back();
@@ -1136,6 +2113,7 @@ void Patch::splay_node(Node *node) {
 }
 
 void Patch::rotate_node_left(Node *pivot, Node *root, Node *root_parent) {
+  tree_stats.rotation_count++;
   if (root_parent) {
     if (root_parent->left == root) {
       root_parent->left = pivot;
@@ -1161,6 +2139,7 @@ void Patch::rotate_node_left(Node *pivot, Node *root, Node *root_parent) {
 }
 
 void Patch::rotate_node_right(Node *pivot, Node *root, Node *root_parent) {
+  tree_stats.rotation_count++;
   if (root_parent) {
     if (root_parent->left == root) {
       root_parent->left = pivot;
@@ -1214,6 +2193,15 @@ void Patch::delete_root() {
   }
 }
 
+// Rebalancing takes a number of rotations proportional to the number of
+// changes, so it only happens once accesses have descended that much further
+// than they would in a balanced tree. It can't happen in the middle of a
+// splaying operation, since those rely on the splayed nodes staying at the
+// top of the tree, so it happens at the start of the next one instead.
+void Patch::rebalance_if_degenerate() {
+  if (excess_access_depth > change_count) rebalance();
+}
+
 void Patch::perform_rebalancing_rotations(uint32_t count) {
   Node *pseudo_root = root, *pseudo_root_parent = nullptr;
   for (uint32_t i = 0; i < count; i++) {
@@ -1233,70 +2221,36 @@ std::pair<optional<Text>, bool> Patch::compute_old_text(
 ) {
   if (!deleted_text) return {optional<Text>{}, true};
 
-  Text result;
-
   auto overlapping_changes = grab_changes_in_range<NewCoordinates>(
     new_splice_start,
     new_deletion_end,
     merges_adjacent_changes
   );
 
-  TextSlice deleted_text_slice = TextSlice(*deleted_text);
-  Point deleted_text_slice_start = new_splice_start;
-
-  for (const Change &change : overlapping_changes) {
-    if (!change.old_text) return {optional<Text>{}, true};
-
-    if (change.new_start > deleted_text_slice_start) {
-      auto split_result = deleted_text_slice.split(
-        change.new_start.traversal(deleted_text_slice_start)
-      );
-      if (!split_result.first.is_valid()) return {optional<Text>{}, false};
-      deleted_text_slice_start = change.new_start;
-      deleted_text_slice = split_result.second;
-      result.append(split_result.first);
-    }
-
-    result.append(*change.old_text);
-    deleted_text_slice = deleted_text_slice.suffix(Point::min(
-      deleted_text_slice.extent(),
-      change.new_end.traversal(deleted_text_slice_start)
-    ));
-    deleted_text_slice_start = change.new_end;
-
-    if (!deleted_text_slice.is_valid()) return {optional<Text>{}, false};
-  }
-
-  result.append(deleted_text_slice);
-  return {result, true};
+  return compute_old_text_for_changes(
+    *deleted_text,
+    new_splice_start,
+    overlapping_changes.data(),
+    overlapping_changes.data() + overlapping_changes.size()
+  );
 }
 
 uint32_t Patch::compute_old_text_size(uint32_t deleted_text_size,
                                       Point new_splice_start,
                                       Point new_deletion_end) {
-  uint32_t old_text_size = deleted_text_size;
   auto overlapping_changes = grab_changes_in_range<NewCoordinates>(
     new_splice_start,
     new_deletion_end,
     merges_adjacent_changes
   );
 
-  for (const Change &change : overlapping_changes) {
-    if (!change.new_text) return 0;
-
-    TextSlice overlapping_new_text = TextSlice(*change.new_text);
-    if (new_deletion_end < change.new_end) {
-      overlapping_new_text = overlapping_new_text.prefix(new_deletion_end.traversal(change.new_start));
-    }
-    if (new_splice_start > change.new_start) {
-      overlapping_new_text = overlapping_new_text.suffix(new_splice_start.traversal(change.new_start));
-    }
-
-    old_text_size -= overlapping_new_text.size();
-    old_text_size += change.old_text_size;
-  }
-
-  return old_text_size;
+  return compute_old_text_size_for_changes(
+    deleted_text_size,
+    new_splice_start,
+    new_deletion_end,
+    overlapping_changes.data(),
+    overlapping_changes.data() + overlapping_changes.size()
+  );
 }
 
 Patch::Node *Patch::build_node(Node *left, Node *right,
@@ -1306,17 +2260,17 @@ Patch::Node *Patch::build_node(Node *left, Node *right,
                        optional<Text> &&old_text, optional<Text> &&new_text,
                        uint32_t old_text_size) {
   change_count++;
-  return new Node{
+  return allocate_node(
     left,
     right,
     old_extent,
     new_extent,
     old_distance_from_left_ancestor,
     new_distance_from_left_ancestor,
-    old_text ? unique_ptr<Text>{new Text(*old_text)} : nullptr,
-    new_text ? unique_ptr<Text>{new Text(*new_text)} : nullptr,
+    move(old_text),
+    move(new_text),
     old_text_size
-  };
+  );
 }
 
 void Patch::delete_node(Node **node_to_delete) {
@@ -1331,7 +2285,7 @@ void Patch::delete_node(Node **node_to_delete) {
         node_stack.push_back(node->left);
       if (node->right)
         node_stack.push_back(node->right);
-      delete node;
+      node_allocator->free(node);
       change_count--;
     }
 
@@ -1488,8 +2442,8 @@ vector<Patch::Change> Patch::get_changes_in_range(Point start, Point end, bool i
 
     Point old_end = old_start.traverse(node->old_extent);
     Point new_end = new_start.traverse(node->new_extent);
-    Text *old_text = node->old_text.get();
-    Text *new_text = node->new_text.get();
+    Text *old_text = node->old_text;
+    Text *new_text = node->new_text;
     uint32_t old_text_size = node->old_text_size();
     uint32_t preceding_old_text_size =
       left_ancestor_info.total_old_text_size + node->left_subtree_old_text_size();
@@ -1579,8 +2533,8 @@ optional<Patch::Change> Patch::get_change_starting_before_position(Point target)
     return Change{
       old_start, old_start.traverse(found_node->old_extent),
       new_start, new_start.traverse(found_node->new_extent),
-      found_node->old_text.get(),
-      found_node->new_text.get(),
+      found_node->old_text,
+      found_node->new_text,
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
       found_node->old_text_size()
@@ -1629,8 +2583,8 @@ optional<Patch::Change> Patch::get_change_ending_after_position(Point target) co
     return Change{
       old_start, old_start.traverse(found_node->old_extent),
       new_start, new_start.traverse(found_node->new_extent),
-      found_node->old_text.get(),
-      found_node->new_text.get(),
+      found_node->old_text,
+      found_node->new_text,
       found_node_left_ancestor_info.total_old_text_size + found_node->left_subtree_old_text_size(),
       found_node_left_ancestor_info.total_new_text_size + found_node->left_subtree_new_text_size(),
       found_node->old_text_size()
@@ -1672,8 +2626,8 @@ vector<Change> Patch::grab_changes_in_range(Point start, Point end, bool inclusi
 
     Point old_end = old_start.traverse(node->old_extent);
     Point new_end = new_start.traverse(node->new_extent);
-    Text *old_text = node->old_text.get();
-    Text *new_text = node->new_text.get();
+    Text *old_text = node->old_text;
+    Text *new_text = node->new_text;
     uint32_t old_text_size = node->old_text_size();
     uint32_t preceding_old_text_size =
       left_ancestor_info.total_old_text_size + node->left_subtree_old_text_size();
@@ -1836,8 +2790,8 @@ Change Patch::change_for_root_node() {
   Point new_start = root->new_distance_from_left_ancestor;
   Point old_end = old_start.traverse(root->old_extent);
   Point new_end = new_start.traverse(root->new_extent);
-  Text *old_text = root->old_text.get();
-  Text *new_text = root->new_text.get();
+  Text *old_text = root->old_text;
+  Text *new_text = root->new_text;
   uint32_t old_text_size = root->old_text_size();
   uint32_t preceding_old_text_size = root->left_subtree_old_text_size();
   uint32_t preceding_new_text_size = root->left_subtree_new_text_size();
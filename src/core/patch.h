@@ -10,16 +10,32 @@
 #include <ostream>
 
 class Patch {
+public:
+  // Counts describing how deep splaying accesses had to descend, which grow
+  // when the tree degenerates, e.g. into a vine after sequential edits.
+  struct TreeStats {
+    uint64_t access_count;
+    uint64_t total_access_depth;
+    uint32_t max_access_depth;
+    uint64_t rotation_count;
+    uint32_t rebalance_count;
+  };
+
+private:
   struct Node;
+  class NodeAllocator;
   struct OldCoordinates;
   struct NewCoordinates;
   struct PositionStackEntry;
 
   Node *root;
+  std::unique_ptr<NodeAllocator> node_allocator;
   std::vector<Node *> node_stack;
   std::vector<PositionStackEntry> left_ancestor_stack;
   uint32_t change_count;
   bool merges_adjacent_changes;
+  TreeStats tree_stats;
+  uint64_t excess_access_depth;
 
 public:
   struct Change {
@@ -34,16 +50,56 @@ public:
     uint32_t old_text_size;
   };
 
+  enum class TranslationDirection {
+    OldToNew,
+    NewToOld,
+  };
+
+  // Where a position inside a change ends up when it is translated: the
+  // start or the end of the change in the other coordinate space.
+  enum class ClipDirection {
+    Backward,
+    Forward,
+  };
+
+  // Which insertion comes first when a rebased change and a concurrent change
+  // insert text at the same position.
+  enum class RebaseTieBreak {
+    ThisFirst,
+    ConcurrentFirst,
+  };
+
+  // `combine` splices the other patch's changes in one at a time when this
+  // patch has more than this many times as many changes, and merges the
+  // changes of both patches in one pass otherwise.
+  static uint32_t SPLICING_COMBINE_CHANGE_COUNT_RATIO;
+
   // Construction and destruction
   Patch(bool merges_adjacent_changes = true);
   Patch(Patch &&);
   Patch(Deserializer &input);
   Patch &operator=(Patch &&);
   ~Patch();
-  void serialize(Serializer &serializer);
-
-  Patch copy();
-  Patch invert();
+  void serialize(Serializer &serializer) const;
+
+  Patch copy() const;
+  Patch invert() const;
+
+  // Transforms this patch so that it applies after a concurrent patch that
+  // was made against the same old text, in one sweep over both patches'
+  // changes. Text that both patches delete is only deleted once, text that
+  // the concurrent patch inserts inside a deleted range is kept, and the
+  // tie break orders insertions that start at the same position. Rebasing
+  // two patches over each other with opposite tie breaks produces the same
+  // text whichever is applied first.
+  Patch rebase(const Patch &concurrent, RebaseTieBreak) const;
+
+  // Builds a balanced patch from changes that are sorted and don't overlap,
+  // without splaying for each of them. The texts that the changes point to
+  // are moved into the patch, and changes that touch are merged as `splice`
+  // would merge them.
+  static Patch from_sorted_changes(const std::vector<Change> &,
+                                   bool merges_adjacent_changes = true);
 
   // Mutations
   bool splice(Point new_splice_start,
@@ -57,6 +113,12 @@ public:
   void rebalance();
 
   // Non-splaying reads
+  //
+  // Like every const method, these keep their traversal state on the stack
+  // rather than in the patch. A patch that nothing modifies any more, such as
+  // a layer pinned by a snapshot, is effectively frozen and can be read from
+  // any number of threads at once. The splaying reads below restructure the
+  // tree, so they count as modifications.
   std::vector<Change> get_changes() const;
   size_t get_change_count() const;
   std::vector<Change> get_changes_in_old_range(Point start, Point end) const;
@@ -69,6 +131,13 @@ public:
                                     std::function<uint32_t(Point)> old_offset_for_old_position,
                                     std::function<Point(uint32_t)> old_position_for_old_offset) const;
 
+  // Translates many positions at once by sorting them and sweeping them
+  // alongside an in-order traversal of the changes, rather than searching the
+  // tree for each one. The results are in the same order as the positions.
+  std::vector<Point> translate_positions(const std::vector<Point> &positions,
+                                         TranslationDirection,
+                                         ClipDirection = ClipDirection::Backward) const;
+
   // Splaying reads
   std::vector<Change> grab_changes_in_old_range(Point start, Point end);
   std::vector<Change> grab_changes_in_new_range(Point start, Point end);
@@ -79,10 +148,9 @@ public:
   // Debugging
   std::string get_dot_graph() const;
   std::string get_json() const;
+  TreeStats get_tree_stats() const;
 
 private:
-  Patch(Node *root, uint32_t change_count, bool merges_adjacent_changes);
-
   template <typename CoordinateSpace>
   std::vector<Change> get_changes_in_range(Point, Point, bool inclusive) const;
 
@@ -111,6 +179,10 @@ private:
   Node *splay_node_ending_after(Point target, optional<Point> exclusive_lower_bound);
 
   Change change_for_root_node();
+  void deserialize_version_1(Deserializer &);
+  bool combine_by_splicing(const Patch &, bool left_to_right);
+  void get_nodes(std::vector<Change> *, std::vector<Node *> *);
+  Node *build_balanced_tree(const Change *, Node **, size_t, Point, Point);
 
   std::pair<optional<Text>, bool> compute_old_text(optional<Text> &&, Point, Point);
   uint32_t compute_old_text_size(uint32_t, Point, Point);
@@ -120,8 +192,10 @@ private:
   void rotate_node_left(Node *, Node *, Node *);
   void delete_root();
   void perform_rebalancing_rotations(uint32_t);
+  void rebalance_if_degenerate();
   Node *build_node(Node *, Node *, Point, Point, Point, Point,
                   optional<Text> &&, optional<Text> &&, uint32_t old_text_size);
+  template <typename... Args> Node *allocate_node(Args &&...);
   void delete_node(Node **);
   void remove_noop_change();
 };
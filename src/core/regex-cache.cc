@@ -0,0 +1,113 @@
+#include "regex-cache.h"
+
+using std::shared_ptr;
+using std::u16string;
+using std::vector;
+
+const size_t RegexCache::DEFAULT_CAPACITY;
+
+bool RegexCache::Key::operator==(const Key &other) const {
+  return ignore_case == other.ignore_case && unicode == other.unicode && pattern == other.pattern;
+}
+
+size_t RegexCache::KeyHash::operator()(const Key &key) const {
+  size_t result = std::hash<u16string>()(key.pattern);
+  return result ^ (key.ignore_case ? 0x9e3779b9 : 0) ^ (key.unicode ? 0x7f4a7c15 : 0);
+}
+
+RegexCache &RegexCache::shared() {
+  static RegexCache cache;
+  return cache;
+}
+
+RegexCache::RegexCache(size_t capacity) :
+  capacity{capacity}, hits{0}, misses{0}, evictions{0} {}
+
+shared_ptr<const Regex> RegexCache::get(const u16string &pattern, u16string *error_message,
+                                        bool ignore_case, bool unicode) {
+  Key key{pattern, ignore_case, unicode};
+
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto iter = entries_by_key.find(key);
+    if (iter != entries_by_key.end()) {
+      hits++;
+      entries.splice(entries.begin(), entries, iter->second);
+      return iter->second->second;
+    }
+    misses++;
+  }
+
+  // Compile outside of the lock so that a slow compilation on one thread
+  // doesn't block lookups of other patterns.
+  shared_ptr<const Regex> regex = std::make_shared<Regex>(pattern, error_message, ignore_case, unicode);
+  if (!error_message->empty()) return nullptr;
+
+  std::lock_guard<std::mutex> guard(mutex);
+  auto iter = entries_by_key.find(key);
+  if (iter != entries_by_key.end()) {
+    entries.splice(entries.begin(), entries, iter->second);
+    return iter->second->second;
+  }
+
+  if (capacity == 0) return regex;
+  entries.push_front(Entry{key, regex});
+  entries_by_key.insert({std::move(key), entries.begin()});
+  evict_excess_entries();
+  return regex;
+}
+
+void RegexCache::set_capacity(size_t new_capacity) {
+  std::lock_guard<std::mutex> guard(mutex);
+  capacity = new_capacity;
+  evict_excess_entries();
+}
+
+void RegexCache::clear() {
+  std::lock_guard<std::mutex> guard(mutex);
+  entries_by_key.clear();
+  entries.clear();
+  hits = 0;
+  misses = 0;
+  evictions = 0;
+}
+
+RegexCache::Stats RegexCache::get_stats() const {
+  std::lock_guard<std::mutex> guard(mutex);
+  return Stats{hits, misses, evictions, entries.size(), capacity};
+}
+
+void RegexCache::serialize(Serializer &output) const {
+  vector<shared_ptr<const Regex>> regexes;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto iter = entries.rbegin(); iter != entries.rend(); ++iter) regexes.push_back(iter->second);
+  }
+
+  vector<const Regex *> regex_pointers;
+  for (const auto &regex : regexes) regex_pointers.push_back(regex.get());
+  Regex::serialize(regex_pointers, output);
+}
+
+bool RegexCache::deserialize(Deserializer &input) {
+  auto regexes = Regex::deserialize(input);
+  if (!regexes) return false;
+
+  std::lock_guard<std::mutex> guard(mutex);
+  for (Regex &regex : *regexes) {
+    Key key{regex.source(), regex.ignore_case(), regex.unicode()};
+    if (entries_by_key.count(key)) continue;
+    entries.push_front(Entry{key, std::make_shared<Regex>(std::move(regex))});
+    entries_by_key.insert({std::move(key), entries.begin()});
+  }
+  evict_excess_entries();
+  return true;
+}
+
+void RegexCache::evict_excess_entries() {
+  while (entries.size() > capacity) {
+    entries_by_key.erase(entries.back().first);
+    entries.pop_back();
+    evictions++;
+  }
+}
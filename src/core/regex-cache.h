@@ -0,0 +1,76 @@
+#ifndef SUPERSTRING_REGEX_CACHE_H_
+#define SUPERSTRING_REGEX_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "regex.h"
+
+// A thread-safe, size-bounded cache of compiled regexes. Compiling and
+// JIT-compiling a pattern is expensive relative to most searches, so callers
+// that see the same pattern repeatedly (e.g. find-as-you-type, or many buffers
+// searched for the same string) should obtain their `Regex` from here.
+//
+// Entries are handed out as shared pointers so that evicting an entry never
+// invalidates a regex that is still being used by a search in progress.
+class RegexCache {
+ public:
+  static const size_t DEFAULT_CAPACITY = 128;
+
+  struct Stats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t size;
+    size_t capacity;
+  };
+
+  // The process-wide cache used by the bindings.
+  static RegexCache &shared();
+
+  explicit RegexCache(size_t capacity = DEFAULT_CAPACITY);
+
+  std::shared_ptr<const Regex> get(const std::u16string &pattern, std::u16string *error_message,
+                                   bool ignore_case = false, bool unicode = false);
+  void set_capacity(size_t);
+  void clear();
+  Stats get_stats() const;
+
+  // Writes every cached regex using `Regex::serialize`. Applications can save
+  // the result on exit and pass it to `deserialize` on the next launch to
+  // skip compiling the patterns they use most.
+  void serialize(Serializer &) const;
+
+  // Adds the regexes written by `serialize` to the cache, keeping their order
+  // of recent use. Patterns that are already cached are left untouched.
+  // Returns false if the data can't be used by this version of the library.
+  bool deserialize(Deserializer &);
+
+ private:
+  struct Key {
+    std::u16string pattern;
+    bool ignore_case;
+    bool unicode;
+    bool operator==(const Key &) const;
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &) const;
+  };
+
+  using Entry = std::pair<Key, std::shared_ptr<const Regex>>;
+
+  void evict_excess_entries();
+
+  mutable std::mutex mutex;
+  std::list<Entry> entries;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entries_by_key;
+  size_t capacity;
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+};
+
+#endif  // SUPERSTRING_REGEX_CACHE_H_
@@ -0,0 +1,971 @@
+#include "regex-nfa.h"
+#include <algorithm>
+
+using std::pair;
+using std::u16string;
+using std::unique_ptr;
+using std::vector;
+using CharacterRanges = vector<pair<char16_t, char16_t>>;
+
+static const uint32_t UNBOUNDED = UINT32_MAX;
+static const size_t MAX_INSTRUCTION_COUNT = 10000;
+static const uint32_t NO_SLOT = UINT32_MAX;
+static const uint32_t NO_INSTRUCTION = UINT32_MAX;
+static const uint32_t HIT_END_FLAG = 1u << 31;
+static const size_t UNSET = SIZE_MAX;
+
+namespace {
+
+struct Node {
+  enum Type {
+    Empty,
+    Character,
+    CharacterClass,
+    AnyExceptNewline,
+    Assertion,
+    Group,
+    Sequence,
+    Alternation,
+    Repetition,
+  } type;
+
+  char16_t character;
+
+  // The character set of a `CharacterClass`, the opcode of an `Assertion`,
+  // or the number of a capturing `Group`.
+  uint32_t index;
+
+  uint32_t min;
+  uint32_t max;
+  bool greedy;
+  vector<Node> children;
+
+  Node(Type type = Empty, char16_t character = 0, uint32_t index = 0)
+    : type{type}, character{character}, index{index}, min{0}, max{0}, greedy{true} {}
+};
+
+}  // namespace
+
+static bool is_digit(char16_t c) {
+  return c >= '0' && c <= '9';
+}
+
+static bool is_ascii_alphanumeric(char16_t c) {
+  return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_ascii_letter(char16_t c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_word_character(char16_t c) {
+  return is_ascii_alphanumeric(c) || c == '_';
+}
+
+static bool is_newline(char16_t c) {
+  return c == '\n' || c == '\r';
+}
+
+// Without the UTF option, PCRE's default tables only fold ASCII letters.
+static char16_t fold_case(char16_t c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static int hex_digit_value(char16_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void normalize(CharacterRanges &ranges) {
+  std::sort(ranges.begin(), ranges.end());
+  CharacterRanges result;
+  for (const auto &range : ranges) {
+    if (!result.empty() && range.first <= result.back().second + 1) {
+      result.back().second = std::max(result.back().second, range.second);
+    } else {
+      result.push_back(range);
+    }
+  }
+  ranges.swap(result);
+}
+
+static CharacterRanges complement(CharacterRanges ranges) {
+  normalize(ranges);
+  CharacterRanges result;
+  uint32_t next = 0;
+  for (const auto &range : ranges) {
+    if (range.first > next) result.push_back({static_cast<char16_t>(next), static_cast<char16_t>(range.first - 1)});
+    next = range.second + 1u;
+  }
+  if (next <= 0xFFFF) result.push_back({static_cast<char16_t>(next), 0xFFFF});
+  return result;
+}
+
+static bool is_class_escape(char16_t c) {
+  return u16string(u"dDwWsShHvV").find(c) != u16string::npos;
+}
+
+// Adds the characters matched by an escape such as `\d` or `\W`, using the
+// same definitions as PCRE when the UTF and UCP options are disabled.
+static void add_class_escape(char16_t c, CharacterRanges &ranges) {
+  CharacterRanges result;
+  switch (c | 0x20) {
+    case 'd':
+      result = {{'0', '9'}};
+      break;
+    case 'w':
+      result = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+      break;
+    case 's':
+      result = {{'\t', '\r'}, {' ', ' '}};
+      break;
+    case 'h':
+      result = {
+        {0x09, 0x09}, {0x20, 0x20}, {0xa0, 0xa0}, {0x1680, 0x1680}, {0x180e, 0x180e},
+        {0x2000, 0x200a}, {0x202f, 0x202f}, {0x205f, 0x205f}, {0x3000, 0x3000}
+      };
+      break;
+    case 'v':
+      result = {{0x0a, 0x0d}, {0x85, 0x85}, {0x2028, 0x2029}};
+      break;
+  }
+  if (c >= 'A' && c <= 'Z') result = complement(result);
+  ranges.insert(ranges.end(), result.begin(), result.end());
+}
+
+static void add_other_cases(CharacterRanges &ranges) {
+  size_t count = ranges.size();
+  for (size_t i = 0; i < count; i++) {
+    char16_t first = ranges[i].first, last = ranges[i].second;
+    if (first <= 'Z' && last >= 'A') {
+      ranges.push_back({fold_case(std::max<char16_t>(first, 'A')), fold_case(std::min<char16_t>(last, 'Z'))});
+    }
+    if (first <= 'z' && last >= 'a') {
+      ranges.push_back({
+        static_cast<char16_t>(std::max<char16_t>(first, 'a') - 32),
+        static_cast<char16_t>(std::min<char16_t>(last, 'z') - 32)
+      });
+    }
+  }
+}
+
+class RegexNFA::Compiler {
+  const u16string &pattern;
+  bool ignore_case;
+  RegexNFA &nfa;
+  size_t position;
+  uint32_t capture_count;
+  uint32_t loop_slot_count;
+  bool has_explicit_line_ending;
+
+ public:
+  Compiler(const u16string &pattern, bool ignore_case, RegexNFA &nfa)
+    : pattern(pattern), ignore_case{ignore_case}, nfa(nfa), position{0},
+      capture_count{0}, loop_slot_count{0}, has_explicit_line_ending{false} {}
+
+  bool compile() {
+    Node root;
+    if (!parse_alternation(root) || position < pattern.size()) return false;
+
+    nfa.capture_count_ = capture_count;
+    emit(Save, 0, 0);
+    if (!emit_node(root)) return false;
+    emit(Save, 0, 1);
+    emit(Match);
+    nfa.slot_count = 2 * (capture_count + 1) + loop_slot_count;
+
+    // PCRE doesn't start matches between a `\r` and a `\n`, unless the
+    // pattern mentions either of them explicitly. Whether it starts there for
+    // patterns that can only match at the start of a line also depends on
+    // the optimizations it picks for finding where matches can begin, so
+    // those patterns are left to the backtracking engine, as are patterns
+    // that can start with a class like `\s` or `[^a]` that contains either
+    // character.
+    if (has_explicit_line_ending && is_anchored_to_line_start(root)) return false;
+    if (!has_explicit_line_ending && can_start_with_line_ending(root)) return false;
+    nfa.skips_line_ending_middle = !has_explicit_line_ending;
+    return nfa.instructions.size() <= MAX_INSTRUCTION_COUNT;
+  }
+
+ private:
+  static bool is_anchored_to_line_start(const Node &node) {
+    switch (node.type) {
+      case Node::Assertion:
+        return node.index == BeginLine;
+      case Node::Repetition:
+        if (node.min > 0) return is_anchored_to_line_start(node.children[0]);
+        return node.max == UNBOUNDED && node.children[0].type == Node::AnyExceptNewline;
+      case Node::Group:
+      case Node::Sequence:
+        return !node.children.empty() && is_anchored_to_line_start(node.children[0]);
+      case Node::Alternation:
+        return std::all_of(node.children.begin(), node.children.end(), is_anchored_to_line_start);
+      default:
+        return false;
+    }
+  }
+
+  // Whether the first character of a match can be a `\r` or `\n` matched by
+  // a character class.
+  bool can_start_with_line_ending(const Node &node) const {
+    switch (node.type) {
+      case Node::CharacterClass: {
+        const CharacterSet &character_set = nfa.character_sets[node.index];
+        return character_set.contains('\r') || character_set.contains('\n');
+      }
+      case Node::Repetition:
+        return node.max > 0 && can_start_with_line_ending(node.children[0]);
+      case Node::Group:
+      case Node::Sequence:
+        for (const Node &child : node.children) {
+          if (can_start_with_line_ending(child)) return true;
+          if (!is_nullable(child)) return false;
+        }
+        return false;
+      case Node::Alternation:
+        return std::any_of(node.children.begin(), node.children.end(), [this](const Node &child) {
+          return can_start_with_line_ending(child);
+        });
+      default:
+        return false;
+    }
+  }
+
+  Node character_node(char16_t c) {
+    if (c == '\r' || c == '\n') has_explicit_line_ending = true;
+    return Node(Node::Character, c);
+  }
+
+  bool at_end(size_t offset = 0) const {
+    return position + offset >= pattern.size();
+  }
+
+  char16_t peek(size_t offset = 0) const {
+    return at_end(offset) ? 0 : pattern[position + offset];
+  }
+
+  bool parse_alternation(Node &result) {
+    Node branch;
+    if (!parse_sequence(branch)) return false;
+    if (at_end() || peek() != '|') {
+      result = std::move(branch);
+      return true;
+    }
+
+    result = Node(Node::Alternation);
+    result.children.push_back(std::move(branch));
+    while (!at_end() && peek() == '|') {
+      position++;
+      Node next_branch;
+      if (!parse_sequence(next_branch)) return false;
+      result.children.push_back(std::move(next_branch));
+    }
+    return true;
+  }
+
+  bool parse_sequence(Node &result) {
+    result = Node(Node::Sequence);
+    while (!at_end() && peek() != '|' && peek() != ')') {
+      Node atom;
+      if (!parse_atom(atom) || !parse_quantifiers(atom)) return false;
+      result.children.push_back(std::move(atom));
+    }
+    return true;
+  }
+
+  bool parse_atom(Node &result) {
+    char16_t c = pattern[position++];
+    switch (c) {
+      case '(':
+        return parse_group(result);
+      case '[':
+        return parse_class(result);
+      case '\\':
+        return parse_escape(result);
+      case '.':
+        result = Node(Node::AnyExceptNewline);
+        return true;
+      case '^':
+        result = Node(Node::Assertion, 0, BeginLine);
+        return true;
+      case '$':
+        result = Node(Node::Assertion, 0, EndLine);
+        return true;
+      case '*':
+      case '+':
+      case '?':
+        return false;
+      case '{': {
+        uint32_t min, max;
+        size_t end;
+        if (parse_counted_repetition(position - 1, &min, &max, &end)) return false;
+        break;
+      }
+    }
+
+    result = character_node(c);
+    return true;
+  }
+
+  // Parses a quantifier like `{2,5}` starting at `start`, which PCRE treats
+  // as a literal `{` unless it is well formed.
+  bool parse_counted_repetition(size_t start, uint32_t *min, uint32_t *max, size_t *end) const {
+    size_t i = start + 1;
+    if (i >= pattern.size() || !is_digit(pattern[i])) return false;
+    *min = 0;
+    while (i < pattern.size() && is_digit(pattern[i])) {
+      *min = *min * 10 + (pattern[i++] - '0');
+      if (*min > 0xFFFF) return false;
+    }
+    if (i >= pattern.size()) return false;
+    if (pattern[i] == '}') {
+      *max = *min;
+      *end = i;
+      return true;
+    }
+    if (pattern[i++] != ',' || i >= pattern.size()) return false;
+    if (pattern[i] == '}') {
+      *max = UNBOUNDED;
+      *end = i;
+      return true;
+    }
+    if (!is_digit(pattern[i])) return false;
+    *max = 0;
+    while (i < pattern.size() && is_digit(pattern[i])) {
+      *max = *max * 10 + (pattern[i++] - '0');
+      if (*max > 0xFFFF) return false;
+    }
+    if (i >= pattern.size() || pattern[i] != '}' || *max < *min) return false;
+    *end = i;
+    return true;
+  }
+
+  bool parse_quantifiers(Node &atom) {
+    while (!at_end()) {
+      uint32_t min, max;
+      size_t end;
+      switch (peek()) {
+        case '*': min = 0; max = UNBOUNDED; position++; break;
+        case '+': min = 1; max = UNBOUNDED; position++; break;
+        case '?': min = 0; max = 1; position++; break;
+        case '{':
+          if (!parse_counted_repetition(position, &min, &max, &end)) return true;
+          position = end + 1;
+          break;
+        default:
+          return true;
+      }
+
+      if (atom.type == Node::Assertion) return false;
+
+      // Possessive quantifiers can't be simulated without backtracking.
+      bool greedy = true;
+      if (peek() == '+') return false;
+      if (peek() == '?') {
+        greedy = false;
+        position++;
+      }
+
+      Node repetition(Node::Repetition);
+      repetition.min = min;
+      repetition.max = max;
+      repetition.greedy = greedy;
+      repetition.children.push_back(std::move(atom));
+      atom = std::move(repetition);
+    }
+    return true;
+  }
+
+  bool parse_group(Node &result) {
+    bool is_capturing = true;
+    if (peek() == '?') {
+      char16_t kind = peek(1);
+      if (kind == ':') {
+        position += 2;
+        is_capturing = false;
+      } else if (kind == 'P' && peek(2) == '<') {
+        position += 3;
+        if (!skip_group_name('>')) return false;
+      } else if (kind == '<' && peek(2) != '=' && peek(2) != '!') {
+        position += 2;
+        if (!skip_group_name('>')) return false;
+      } else if (kind == '\'') {
+        position += 2;
+        if (!skip_group_name('\'')) return false;
+      } else {
+        // Lookaround assertions, atomic groups, inline options, conditions,
+        // recursion and comments.
+        return false;
+      }
+    } else if (peek() == '*') {
+      // Backtracking verbs.
+      return false;
+    }
+
+    uint32_t group = is_capturing ? ++capture_count : 0;
+    Node body;
+    if (!parse_alternation(body) || at_end() || peek() != ')') return false;
+    position++;
+
+    if (is_capturing) {
+      result = Node(Node::Group, 0, group);
+      result.children.push_back(std::move(body));
+    } else {
+      result = std::move(body);
+    }
+    return true;
+  }
+
+  bool skip_group_name(char16_t terminator) {
+    size_t start = position;
+    while (!at_end() && is_word_character(peek())) position++;
+    if (position == start || at_end() || peek() != terminator) return false;
+    position++;
+    return true;
+  }
+
+  bool parse_escape(Node &result) {
+    if (at_end()) return false;
+    char16_t c = pattern[position++];
+
+    if (is_class_escape(c)) {
+      CharacterRanges ranges;
+      add_class_escape(c, ranges);
+      result = Node(Node::CharacterClass, 0, add_character_set(ranges, false));
+      return true;
+    }
+
+    switch (c) {
+      case 'b':
+        result = Node(Node::Assertion, 0, WordBoundary);
+        return true;
+      case 'B':
+        result = Node(Node::Assertion, 0, NotWordBoundary);
+        return true;
+      case 'A':
+        result = Node(Node::Assertion, 0, BeginSubject);
+        return true;
+    }
+
+    char16_t character;
+    if (!parse_character_escape(c, &character)) return false;
+    result = character_node(character);
+    return true;
+  }
+
+  // Parses an escape that stands for a single character. Returns false for
+  // letters and digits that have some other meaning, like backreferences.
+  bool parse_character_escape(char16_t c, char16_t *result) {
+    switch (c) {
+      case 't': *result = '\t'; return true;
+      case 'n': *result = '\n'; return true;
+      case 'r': *result = '\r'; return true;
+      case 'f': *result = '\f'; return true;
+      case 'e': *result = 0x1b; return true;
+      case 'a': *result = 0x07; return true;
+
+      case '0':
+        *result = 0;
+        for (int i = 0; i < 2 && !at_end() && peek() >= '0' && peek() <= '7'; i++) {
+          *result = *result * 8 + (pattern[position++] - '0');
+        }
+        return true;
+
+      case 'x':
+        *result = 0;
+        if (!at_end() && peek() == '{') {
+          position++;
+          uint32_t value = 0;
+          size_t start = position;
+          while (!at_end() && hex_digit_value(peek()) >= 0) {
+            value = value * 16 + hex_digit_value(pattern[position++]);
+            if (value > 0xFFFF) return false;
+          }
+          if (position == start || at_end() || peek() != '}') return false;
+          position++;
+          *result = value;
+        } else {
+          for (int i = 0; i < 2 && !at_end() && hex_digit_value(peek()) >= 0; i++) {
+            *result = *result * 16 + hex_digit_value(pattern[position++]);
+          }
+        }
+        return true;
+    }
+
+    if (is_ascii_alphanumeric(c)) return false;
+    *result = c;
+    return true;
+  }
+
+  bool parse_class(Node &result) {
+    bool negated = false;
+    if (peek() == '^') {
+      negated = true;
+      position++;
+    }
+
+    CharacterRanges ranges;
+    for (bool is_first = true;; is_first = false) {
+      if (at_end()) return false;
+      char16_t c = pattern[position++];
+      if (c == ']' && !is_first) break;
+
+      char16_t first;
+      switch (parse_class_item(c, &first, ranges)) {
+        case ClassItem::Unsupported:
+          return false;
+
+        case ClassItem::Escape:
+          // PCRE rejects ranges that start with an escape like `\d`.
+          if (peek() == '-' && !at_end(1) && peek(1) != ']') return false;
+          break;
+
+        case ClassItem::Character: {
+          char16_t last = first;
+          if (peek() == '-' && !at_end(1) && peek(1) != ']') {
+            position++;
+            c = pattern[position++];
+            if (parse_class_item(c, &last, ranges) != ClassItem::Character || last < first) return false;
+          }
+          ranges.push_back({first, last});
+          break;
+        }
+      }
+    }
+
+    result = Node(Node::CharacterClass, 0, add_character_set(ranges, negated));
+    return true;
+  }
+
+  enum class ClassItem {
+    Unsupported,
+    Character,
+    Escape,
+  };
+
+  // Parses an item within a character class, which is either a single
+  // character or an escape like `\d` whose characters are added to `ranges`.
+  ClassItem parse_class_item(char16_t c, char16_t *result, CharacterRanges &ranges) {
+    // POSIX classes and collating elements.
+    if (c == '[' && (peek() == ':' || peek() == '.' || peek() == '=')) return ClassItem::Unsupported;
+
+    if (c != '\\') {
+      *result = c;
+    } else {
+      if (at_end()) return ClassItem::Unsupported;
+      c = pattern[position++];
+      if (c == 'b') {
+        *result = '\b';
+      } else if (is_class_escape(c)) {
+        add_class_escape(c, ranges);
+        return ClassItem::Escape;
+      } else if (!parse_character_escape(c, result)) {
+        return ClassItem::Unsupported;
+      }
+    }
+
+    if (*result == '\r' || *result == '\n') has_explicit_line_ending = true;
+    return ClassItem::Character;
+  }
+
+  uint32_t add_character_set(CharacterRanges ranges, bool negated) {
+    if (ignore_case) add_other_cases(ranges);
+    if (negated) {
+      ranges = complement(ranges);
+    } else {
+      normalize(ranges);
+    }
+    nfa.character_sets.push_back({std::move(ranges)});
+    return nfa.character_sets.size() - 1;
+  }
+
+  uint32_t emit(Opcode opcode, char16_t character = 0, uint32_t index = 0) {
+    uint32_t result = nfa.instructions.size();
+    nfa.instructions.push_back({opcode, character, result + 1, NO_INSTRUCTION, index});
+    return result;
+  }
+
+  static bool is_nullable(const Node &node) {
+    switch (node.type) {
+      case Node::Empty:
+      case Node::Assertion:
+        return true;
+      case Node::Group:
+      case Node::Sequence:
+        return std::all_of(node.children.begin(), node.children.end(), is_nullable);
+      case Node::Alternation:
+        return std::any_of(node.children.begin(), node.children.end(), is_nullable);
+      case Node::Repetition:
+        return node.min == 0 || is_nullable(node.children[0]);
+      default:
+        return false;
+    }
+  }
+
+  // Whether the node contains an unbounded repetition of something that can
+  // match the empty string.
+  static bool contains_nullable_loop(const Node &node) {
+    if (node.type == Node::Repetition && node.max == UNBOUNDED && is_nullable(node.children[0])) return true;
+    return std::any_of(node.children.begin(), node.children.end(), contains_nullable_loop);
+  }
+
+  bool emit_node(const Node &node) {
+    if (nfa.instructions.size() > MAX_INSTRUCTION_COUNT) return false;
+
+    switch (node.type) {
+      case Node::Empty:
+        return true;
+
+      case Node::Character:
+        if (ignore_case && is_ascii_letter(node.character)) {
+          emit(CharacterIgnoringCase, fold_case(node.character));
+        } else {
+          emit(Character, node.character);
+        }
+        return true;
+
+      case Node::CharacterClass:
+        emit(CharacterClass, 0, node.index);
+        return true;
+
+      case Node::AnyExceptNewline:
+        emit(AnyExceptNewline);
+        return true;
+
+      case Node::Assertion:
+        emit(static_cast<Opcode>(node.index));
+        return true;
+
+      case Node::Group:
+        emit(Save, 0, 2 * node.index);
+        if (!emit_node(node.children[0])) return false;
+        emit(Save, 0, 2 * node.index + 1);
+        return true;
+
+      case Node::Sequence:
+        for (const Node &child : node.children) {
+          if (!emit_node(child)) return false;
+        }
+        return true;
+
+      case Node::Alternation: {
+        vector<uint32_t> jumps;
+        for (size_t i = 0; i < node.children.size(); i++) {
+          if (i + 1 < node.children.size()) {
+            uint32_t split = emit(Split);
+            if (!emit_node(node.children[i])) return false;
+            jumps.push_back(emit(Jump));
+            nfa.instructions[split].alternative = nfa.instructions.size();
+          } else if (!emit_node(node.children[i])) {
+            return false;
+          }
+        }
+        for (uint32_t jump : jumps) nfa.instructions[jump].next = nfa.instructions.size();
+        return true;
+      }
+
+      case Node::Repetition:
+        return emit_repetition(node);
+    }
+
+    return false;
+  }
+
+  void set_branches(uint32_t split, uint32_t preferred, uint32_t other, bool greedy) {
+    nfa.instructions[split].next = greedy ? preferred : other;
+    nfa.instructions[split].alternative = greedy ? other : preferred;
+  }
+
+  bool emit_repetition(const Node &node) {
+    const Node &body = node.children[0];
+
+    if (node.max != UNBOUNDED) {
+      for (uint32_t i = 0; i < node.min; i++) {
+        if (!emit_node(body)) return false;
+      }
+      vector<uint32_t> splits;
+      for (uint32_t i = node.min; i < node.max; i++) {
+        splits.push_back(emit(Split));
+        if (!emit_node(body)) return false;
+      }
+      uint32_t exit = nfa.instructions.size();
+      for (uint32_t split : splits) set_branches(split, split + 1, exit, node.greedy);
+      return true;
+    }
+
+    for (uint32_t i = 1; i < node.min; i++) {
+      if (!emit_node(body)) return false;
+    }
+
+    // Like PCRE, stop repeating a group once an iteration matches the empty
+    // string, by recording where each iteration started. Which iterations
+    // PCRE considers empty when such loops are nested doesn't follow from
+    // checking each loop on its own, so those patterns aren't supported.
+    uint32_t slot = NO_SLOT;
+    if (is_nullable(body)) {
+      if (contains_nullable_loop(body)) return false;
+      slot = 2 * (capture_count + 1) + loop_slot_count++;
+    }
+
+    uint32_t split = NO_INSTRUCTION;
+    if (node.min == 0) split = emit(Split);
+    uint32_t loop = nfa.instructions.size();
+    if (slot != NO_SLOT) emit(Save, 0, slot);
+    if (!emit_node(body)) return false;
+    uint32_t check = NO_INSTRUCTION;
+    if (slot != NO_SLOT) check = emit(RepeatCheck, 0, slot);
+
+    if (node.min == 0) {
+      nfa.instructions[emit(Jump)].next = split;
+    } else {
+      split = emit(Split);
+    }
+
+    uint32_t exit = nfa.instructions.size();
+    set_branches(split, loop, exit, node.greedy);
+    if (check != NO_INSTRUCTION) nfa.instructions[check].alternative = exit;
+    return true;
+  }
+};
+
+unique_ptr<RegexNFA> RegexNFA::compile(const u16string &pattern, bool ignore_case) {
+  unique_ptr<RegexNFA> result{new RegexNFA()};
+  Compiler compiler(pattern, ignore_case, *result);
+  if (!compiler.compile()) return nullptr;
+  return result;
+}
+
+uint32_t RegexNFA::capture_count() const {
+  return capture_count_;
+}
+
+bool RegexNFA::CharacterSet::contains(char16_t c) const {
+  auto iter = std::upper_bound(ranges.begin(), ranges.end(), c, [](char16_t c, const pair<char16_t, char16_t> &range) {
+    return c < range.first;
+  });
+  return iter != ranges.begin() && (iter - 1)->second >= c;
+}
+
+// Adds the thread at the given instruction to the list, following every
+// branch and assertion from there in priority order until reaching
+// instructions that consume a character or complete the match. The
+// workspace's `captures` hold the thread's capture slots.
+//
+// Each instruction is normally visited once per position, since any later
+// path to it has lower priority and the same future. The exception is a
+// repetition that starts another iteration without consuming anything, as
+// PCRE runs that iteration before stopping, so paths within such iterations
+// are tracked separately.
+void RegexNFA::add_thread(Workspace::ThreadList &list, uint32_t start_instruction,
+                          const char16_t *subject, size_t length, size_t position,
+                          bool is_beginning_of_line, bool is_end_of_line, bool is_end_search,
+                          Workspace &workspace) const {
+  auto &stack = workspace.stack;
+  auto &captures = workspace.captures;
+  uint32_t instruction_count = instructions.size();
+  stack.push_back({start_instruction, false, NO_SLOT, 0});
+
+  while (!stack.empty()) {
+    Workspace::StackEntry entry = stack.back();
+    stack.pop_back();
+    if (entry.restored_slot != NO_SLOT) {
+      captures[entry.restored_slot] = entry.restored_value;
+      continue;
+    }
+
+    uint32_t pc = entry.instruction;
+    bool in_new_iteration = entry.in_new_iteration;
+    for (;;) {
+      uint32_t key = in_new_iteration ? pc + instruction_count : pc;
+      uint32_t index = list.sparse[key];
+      if (index < list.size && (list.dense[index] & ~HIT_END_FLAG) == key) break;
+      index = list.size++;
+      list.sparse[key] = index;
+      list.dense[index] = key;
+
+      const Instruction &instruction = instructions[pc];
+      uint32_t next = instruction.next;
+      bool hits_end = false;
+      bool is_thread = false;
+
+      switch (instruction.opcode) {
+        case Split:
+          stack.push_back({instruction.alternative, in_new_iteration, NO_SLOT, 0});
+          break;
+
+        case Jump:
+          break;
+
+        case Save:
+          stack.push_back({NO_INSTRUCTION, false, instruction.index, captures[instruction.index]});
+          captures[instruction.index] = position;
+          if (instruction.index >= 2 * (capture_count_ + 1)) in_new_iteration = true;
+          break;
+
+        case RepeatCheck:
+          if (captures[instruction.index] == position) next = instruction.alternative;
+          break;
+
+        case BeginLine:
+          if (position == 0) {
+            if (!is_beginning_of_line) next = NO_INSTRUCTION;
+          } else if (position == length || !is_newline(subject[position - 1])) {
+            next = NO_INSTRUCTION;
+          }
+          break;
+
+        case EndLine:
+          if (position < length) {
+            if (!is_newline(subject[position])) next = NO_INSTRUCTION;
+          } else if (!is_end_of_line) {
+            next = NO_INSTRUCTION;
+          } else if (!is_end_search && position > captures[0]) {
+            hits_end = true;
+          }
+          break;
+
+        case BeginSubject:
+          if (position != 0) next = NO_INSTRUCTION;
+          break;
+
+        case WordBoundary:
+        case NotWordBoundary: {
+          // PCRE counts the character before the match as inspected, so this
+          // can report a partial match even at the start of the attempt.
+          if (position == length && !is_end_search && length > 0) {
+            hits_end = true;
+            break;
+          }
+          bool previous_is_word = position > 0 && is_word_character(subject[position - 1]);
+          bool current_is_word = position < length && is_word_character(subject[position]);
+          if ((previous_is_word != current_is_word) != (instruction.opcode == WordBoundary)) {
+            next = NO_INSTRUCTION;
+          }
+          break;
+        }
+
+        default:
+          is_thread = true;
+          break;
+      }
+
+      if (is_thread || hits_end) {
+        if (hits_end) list.dense[index] |= HIT_END_FLAG;
+        std::copy(captures.begin(), captures.end(), list.captures.begin() + index * slot_count);
+        break;
+      }
+      if (next == NO_INSTRUCTION) break;
+      pc = next;
+    }
+  }
+}
+
+RegexNFA::MatchResult RegexNFA::match(const char16_t *subject, size_t length,
+                                      bool is_beginning_of_line, bool is_end_of_line,
+                                      bool is_end_search, Workspace &workspace,
+                                      size_t *captures) const {
+  size_t instruction_count = instructions.size();
+  size_t capacity = 2 * instruction_count;
+  for (auto &list : workspace.lists) {
+    if (list.sparse.size() < capacity) {
+      list.sparse.resize(capacity);
+      list.dense.resize(capacity);
+    }
+    if (list.captures.size() < capacity * slot_count) {
+      list.captures.resize(capacity * slot_count);
+    }
+    list.size = 0;
+  }
+  workspace.captures.resize(slot_count);
+
+  MatchResult result{MatchResult::None, 0, 0};
+  Workspace::ThreadList *current = &workspace.lists[0];
+  Workspace::ThreadList *next = &workspace.lists[1];
+  bool matched = false;
+
+  for (size_t position = 0;; position++) {
+    // Threads that start further along have the lowest priority, and none
+    // are started once a match has been found.
+    bool is_line_ending_middle =
+      position > 0 && position < length && subject[position - 1] == '\r' && subject[position] == '\n';
+    if (!matched && !(is_line_ending_middle && skips_line_ending_middle)) {
+      std::fill(workspace.captures.begin(), workspace.captures.end(), UNSET);
+      add_thread(*current, 0, subject, length, position, is_beginning_of_line,
+                 is_end_of_line, is_end_search, workspace);
+    }
+
+    next->size = 0;
+    for (uint32_t i = 0; i < current->size; i++) {
+      uint32_t entry = current->dense[i];
+      const size_t *thread_captures = &current->captures[i * slot_count];
+
+      // With hard partial matching, PCRE reports a partial match as soon as
+      // any path reaches the end of the subject after consuming a character,
+      // unless a path with higher priority has already matched.
+      if (entry & HIT_END_FLAG) {
+        captures[0] = thread_captures[0];
+        captures[1] = length;
+        return MatchResult{MatchResult::Partial, thread_captures[0], length};
+      }
+
+      uint32_t pc = entry >= instruction_count ? entry - instruction_count : entry;
+      const Instruction &instruction = instructions[pc];
+      bool accepted = false;
+      switch (instruction.opcode) {
+        case Match:
+          matched = true;
+          std::copy(thread_captures, thread_captures + 2 * (capture_count_ + 1), captures);
+          result = MatchResult{MatchResult::Full, thread_captures[0], thread_captures[1]};
+          break;
+
+        case Character:
+        case CharacterIgnoringCase:
+        case CharacterClass:
+        case AnyExceptNewline:
+          if (position == length) {
+            if (!is_end_search && thread_captures[0] < length) {
+              captures[0] = thread_captures[0];
+              captures[1] = length;
+              return MatchResult{MatchResult::Partial, thread_captures[0], length};
+            }
+            continue;
+          }
+
+          switch (instruction.opcode) {
+            case Character:
+              accepted = subject[position] == instruction.character;
+              break;
+            case CharacterIgnoringCase:
+              accepted = fold_case(subject[position]) == instruction.character;
+              break;
+            case CharacterClass:
+              accepted = character_sets[instruction.index].contains(subject[position]);
+              break;
+            default:
+              accepted = !is_newline(subject[position]);
+              break;
+          }
+
+          if (accepted) {
+            std::copy(thread_captures, thread_captures + slot_count, workspace.captures.begin());
+            add_thread(*next, instruction.next, subject, length, position + 1,
+                       is_beginning_of_line, is_end_of_line, is_end_search, workspace);
+          }
+          continue;
+
+        default:
+          continue;
+      }
+
+      // Threads after a match have lower priority than it.
+      break;
+    }
+
+    std::swap(current, next);
+    if (position == length || (matched && current->size == 0)) break;
+  }
+
+  return result;
+}
@@ -0,0 +1,127 @@
+#ifndef SUPERSTRING_REGEX_NFA_H_
+#define SUPERSTRING_REGEX_NFA_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Matches a subset of PCRE's syntax by simulating a Thompson NFA, following
+// every way the pattern can match in parallel instead of backtracking. This
+// takes time proportional to the length of the subject times the size of the
+// pattern, however the pattern is written.
+//
+// Threads are kept in the order a backtracking engine would try them, so the
+// matches, capture groups and partial matches are the same as PCRE's with the
+// multiline and ANYCRLF options that `Regex` uses. Patterns outside of the
+// supported subset, e.g. those with backreferences, lookaround assertions,
+// inline options or Unicode properties, fail to compile. So do patterns for
+// which PCRE's results depend on its optimizations or on how it handles
+// empty iterations of nested loops, like `\s+$` or `((a?)*b?)*`.
+class RegexNFA {
+ public:
+  struct MatchResult {
+    enum {
+      None,
+      Partial,
+      Full,
+    } type;
+
+    size_t start_offset;
+    size_t end_offset;
+  };
+
+  // The thread lists used during a match, which can be reused across matches
+  // of any pattern.
+  class Workspace {
+    friend class RegexNFA;
+
+    struct ThreadList {
+      std::vector<uint32_t> sparse;
+      std::vector<uint32_t> dense;
+      std::vector<size_t> captures;
+      uint32_t size;
+    };
+
+    struct StackEntry {
+      uint32_t instruction;
+      bool in_new_iteration;
+      uint32_t restored_slot;
+      size_t restored_value;
+    };
+
+    ThreadList lists[2];
+    std::vector<StackEntry> stack;
+    std::vector<size_t> captures;
+  };
+
+  // Compiles a pattern that has gone through the same preprocessing that
+  // `Regex` applies before handing patterns to PCRE. Returns null if the
+  // pattern isn't supported.
+  static std::unique_ptr<RegexNFA> compile(const std::u16string &pattern, bool ignore_case);
+
+  uint32_t capture_count() const;
+
+  // Finds the first match in the subject, behaving like `pcre2_match` with
+  // `PCRE2_NOTBOL` unless `is_beginning_of_line` is set, `PCRE2_NOTEOL` unless
+  // `is_end_of_line` is set, and `PCRE2_PARTIAL_HARD` unless `is_end_search`
+  // is set. On a full match, `captures` receives the start and end offsets of
+  // the match and each capture group, with `SIZE_MAX` for groups that didn't
+  // participate.
+  MatchResult match(const char16_t *subject, size_t length, bool is_beginning_of_line,
+                    bool is_end_of_line, bool is_end_search, Workspace &,
+                    size_t *captures) const;
+
+ private:
+  enum Opcode : uint8_t {
+    Character,
+    CharacterIgnoringCase,
+    CharacterClass,
+    AnyExceptNewline,
+    Split,
+    Jump,
+    Save,
+    RepeatCheck,
+    BeginLine,
+    EndLine,
+    BeginSubject,
+    WordBoundary,
+    NotWordBoundary,
+    Match,
+  };
+
+  struct Instruction {
+    Opcode opcode;
+    char16_t character;
+    uint32_t next;
+
+    // The lower priority branch of a `Split`, or where a `RepeatCheck` goes
+    // when the iteration it ends was empty.
+    uint32_t alternative;
+
+    // The slot written by a `Save` or read by a `RepeatCheck`, or the
+    // character set of a `CharacterClass`.
+    uint32_t index;
+  };
+
+  struct CharacterSet {
+    std::vector<std::pair<char16_t, char16_t>> ranges;
+    bool contains(char16_t) const;
+  };
+
+  class Compiler;
+  friend class Compiler;
+
+  void add_thread(Workspace::ThreadList &, uint32_t instruction, const char16_t *subject,
+                  size_t length, size_t position, bool is_beginning_of_line,
+                  bool is_end_of_line, bool is_end_search, Workspace &) const;
+
+  std::vector<Instruction> instructions;
+  std::vector<CharacterSet> character_sets;
+  uint32_t capture_count_;
+  uint32_t slot_count;
+  bool skips_line_ending_middle;
+};
+
+#endif  // SUPERSTRING_REGEX_NFA_H_
@@ -1,13 +1,104 @@
 #include "regex.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <stdlib.h>
 #include "pcre2.h"
 
+using std::pair;
 using std::u16string;
+using std::vector;
 using MatchResult = Regex::MatchResult;
 
 const char16_t EMPTY_PATTERN[] = u".{0}";
 
-Regex::Regex() : code{nullptr} {}
+Regex::Regex() : code{nullptr}, ignore_case_{false}, unicode_{false}, backtracking_prone_{false},
+                 needs_jit_compile{false}, needs_nfa_compile{false} {}
+
+// Skips a character class starting at `i`, returning the index of its closing
+// bracket, or the end of the pattern if it isn't closed.
+static size_t skip_class(const u16string &pattern, size_t i) {
+  i++;
+  if (i < pattern.size() && pattern[i] == '^') i++;
+  if (i < pattern.size() && pattern[i] == ']') i++;
+  for (; i < pattern.size(); i++) {
+    if (pattern[i] == '\\') {
+      i++;
+    } else if (pattern[i] == '[' && i + 1 < pattern.size() && pattern[i + 1] == ':') {
+      size_t end = pattern.find(u":]", i + 2);
+      if (end != u16string::npos) i = end + 1;
+    } else if (pattern[i] == ']') {
+      break;
+    }
+  }
+  return i;
+}
+
+// Looks for a group that contains an unbounded repetition and is itself
+// repeated without bound. Atomic groups and possessive quantifiers can't
+// backtrack into their contents, so they are ignored.
+static bool has_nested_unbounded_repetition(const u16string &pattern) {
+  struct Group {
+    bool is_atomic;
+    bool has_unbounded_repetition;
+  };
+  vector<Group> groups;
+  bool last_atom_is_repeating_group = false;
+
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char16_t c = pattern[i];
+    bool closes_repeating_group = false;
+
+    switch (c) {
+      case '\\':
+        i++;
+        break;
+
+      case '[':
+        i = skip_class(pattern, i);
+        break;
+
+      case '(':
+        groups.push_back({i + 2 < pattern.size() && pattern[i + 1] == '?' && pattern[i + 2] == '>', false});
+        break;
+
+      case ')':
+        if (!groups.empty()) {
+          Group group = groups.back();
+          groups.pop_back();
+          closes_repeating_group = group.has_unbounded_repetition && !group.is_atomic;
+          if (closes_repeating_group && !groups.empty()) groups.back().has_unbounded_repetition = true;
+        }
+        break;
+
+      case '*':
+      case '+':
+      case '{': {
+        bool is_unbounded = c != '{';
+        if (c == '{') {
+          size_t j = i + 1;
+          while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9') j++;
+          if (j == i + 1 || j + 1 >= pattern.size() || pattern[j] != ',') break;
+          is_unbounded = pattern[j + 1] == '}';
+          i = pattern.find(u'}', j);
+          if (i == u16string::npos) return false;
+        }
+
+        bool is_possessive = i + 1 < pattern.size() && pattern[i + 1] == '+';
+        if (i + 1 < pattern.size() && (pattern[i + 1] == '?' || pattern[i + 1] == '+')) i++;
+        if (is_unbounded && !is_possessive) {
+          if (last_atom_is_repeating_group) return true;
+          if (!groups.empty()) groups.back().has_unbounded_repetition = true;
+        }
+        break;
+      }
+    }
+
+    last_atom_is_repeating_group = closes_repeating_group;
+  }
+
+  return false;
+}
 
 static u16string preprocess_pattern(const char16_t *pattern, uint32_t length) {
   u16string result;
@@ -47,7 +138,10 @@ static u16string preprocess_pattern(const char16_t *pattern, uint32_t length) {
 }
 
 
-Regex::Regex(const char16_t *pattern, uint32_t pattern_length, u16string *error_message, bool ignore_case, bool unicode) {
+Regex::Regex(const char16_t *pattern, uint32_t pattern_length, u16string *error_message, bool ignore_case, bool unicode)
+  : source_(pattern, pattern_length), ignore_case_{ignore_case}, unicode_{unicode},
+    backtracking_prone_{has_nested_unbounded_repetition(source_)},
+    needs_jit_compile{false}, needs_nfa_compile{false} {
   if (pattern_length == 0) {
     pattern = EMPTY_PATTERN;
     pattern_length = 4;
@@ -76,6 +170,8 @@ Regex::Regex(const char16_t *pattern, uint32_t pattern_length, u16string *error_
     return;
   }
 
+  needs_nfa_compile = !unicode;
+
   pcre2_jit_compile(
     code,
     PCRE2_JIT_COMPLETE|PCRE2_JIT_PARTIAL_HARD|PCRE2_JIT_PARTIAL_SOFT
@@ -85,7 +181,19 @@ Regex::Regex(const char16_t *pattern, uint32_t pattern_length, u16string *error_
 Regex::Regex(const u16string &pattern, u16string *error_message, bool ignore_case, bool unicode)
   : Regex(pattern.data(), pattern.size(), error_message, ignore_case, unicode) {}
 
-Regex::Regex(Regex &&other) : code{other.code} {
+Regex::Regex(pcre2_real_code_16 *code, u16string &&source, bool ignore_case, bool unicode)
+  : code{code}, source_{std::move(source)}, ignore_case_{ignore_case}, unicode_{unicode},
+    backtracking_prone_{has_nested_unbounded_repetition(source_)},
+    needs_jit_compile{true}, needs_nfa_compile{!unicode} {}
+
+Regex::Regex(Regex &&other)
+  : code{other.code}, source_{std::move(other.source_)},
+    ignore_case_{other.ignore_case_}, unicode_{other.unicode_},
+    backtracking_prone_{other.backtracking_prone_},
+    needs_jit_compile{other.needs_jit_compile.load()},
+    needs_nfa_compile{other.needs_nfa_compile.load()},
+    nfa{std::move(other.nfa)},
+    engine_{other.engine_} {
   other.code = nullptr;
 }
 
@@ -93,22 +201,633 @@ Regex::~Regex() {
   if (code) pcre2_code_free(code);
 }
 
+const u16string &Regex::source() const {
+  return source_;
+}
+
+bool Regex::ignore_case() const {
+  return ignore_case_;
+}
+
+bool Regex::unicode() const {
+  return unicode_;
+}
+
+bool Regex::is_backtracking_prone() const {
+  return backtracking_prone_;
+}
+
+uint32_t Regex::capture_count() const {
+  uint32_t result = 0;
+  if (code) pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &result);
+  return result;
+}
+
+static int hex_digit_value(char16_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static bool is_ascii_alphanumeric(char16_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+optional<u16string> Regex::literal() const {
+  static const u16string METACHARACTERS = u"^$.|?*+()[]{}";
+
+  if (!code || source_.empty()) return optional<u16string>{};
+
+  u16string result;
+  for (size_t i = 0; i < source_.size(); i++) {
+    char16_t c = source_[i];
+    if (c == '\\') {
+      if (i + 1 == source_.size()) return optional<u16string>{};
+      char16_t next = source_[++i];
+      switch (next) {
+        case 'n': result += u'\n'; break;
+        case 'r': result += u'\r'; break;
+        case 't': result += u'\t'; break;
+        case 'u': {
+          if (i + 4 >= source_.size()) return optional<u16string>{};
+          char16_t value = 0;
+          for (size_t j = i + 1; j <= i + 4; j++) {
+            int digit_value = hex_digit_value(source_[j]);
+            if (digit_value < 0) return optional<u16string>{};
+            value = value * 16 + digit_value;
+          }
+          if (value == 0) return optional<u16string>{};
+          result += value;
+          i += 4;
+          break;
+        }
+        default:
+          if (next >= 128 || is_ascii_alphanumeric(next)) return optional<u16string>{};
+          result += next;
+      }
+    } else if (METACHARACTERS.find(c) != u16string::npos) {
+      return optional<u16string>{};
+    } else {
+      result += c;
+    }
+  }
+
+  return result;
+}
+
+static bool folds_within_ascii(char16_t c) {
+  return c < 128 && c != 'k' && c != 'K' && c != 's' && c != 'S';
+}
+
+// Parses the `XXXX` of a `\uXXXX` escape starting at `i`, in the same way as
+// `literal`.
+static optional<char16_t> parse_unicode_escape(const u16string &source, size_t i) {
+  if (i + 4 > source.size()) return optional<char16_t>{};
+  char16_t value = 0;
+  for (size_t j = i; j < i + 4; j++) {
+    int digit_value = hex_digit_value(source[j]);
+    if (digit_value < 0) return optional<char16_t>{};
+    value = value * 16 + digit_value;
+  }
+  if (value == 0) return optional<char16_t>{};
+  return value;
+}
+
+// Skips a character class starting at `i`, returning the index of its closing
+// bracket. Returns 0 if the class could match a line ending.
+static size_t skip_single_line_class(const u16string &source, size_t i) {
+  i++;
+  if (i < source.size() && source[i] == '^') return 0;
+  if (i < source.size() && source[i] == ']') i++;
+  for (; i < source.size(); i++) {
+    char16_t c = source[i];
+    if (c == ']') return i;
+    if (c < 0x20) return 0;
+    if (c == '[' && i + 1 < source.size() && source[i + 1] == ':') return 0;
+    if (c == '\\') {
+      if (++i == source.size()) return 0;
+      char16_t next = source[i];
+      if (is_ascii_alphanumeric(next) && u16string(u"dwSh").find(next) == u16string::npos) return 0;
+    }
+  }
+  return 0;
+}
+
+optional<u16string> Regex::required_literal() const {
+  if (!code || source_.empty()) return optional<u16string>{};
+
+  u16string best;
+  u16string run;
+  bool last_atom_is_literal = false;
+  uint32_t depth = 0;
+  auto end_run = [&]() {
+    if (run.size() > best.size()) best = run;
+    run.clear();
+  };
+
+  for (size_t i = 0; i < source_.size(); i++) {
+    char16_t c = source_[i];
+    optional<char16_t> literal_character;
+
+    switch (c) {
+      case '\\': {
+        if (i + 1 == source_.size()) return optional<u16string>{};
+        char16_t next = source_[++i];
+        if (next == 't') {
+          literal_character = u'\t';
+        } else if (next == 'u') {
+          literal_character = parse_unicode_escape(source_, i + 1);
+          if (!literal_character || *literal_character == '\n' || *literal_character == '\r') {
+            return optional<u16string>{};
+          }
+          i += 4;
+        } else if (next >= 128 || is_ascii_alphanumeric(next)) {
+          // Escapes other than these could match a line ending, refer to
+          // groups, span several characters of the pattern, or depend on
+          // where the search starts.
+          if (u16string(u"dwSbBh").find(next) == u16string::npos) return optional<u16string>{};
+        } else {
+          literal_character = next;
+        }
+        break;
+      }
+
+      case '[':
+        i = skip_single_line_class(source_, i);
+        if (i == 0) return optional<u16string>{};
+        break;
+
+      case '(':
+        if (i + 1 < source_.size() && source_[i + 1] == '?') {
+          char16_t kind = i + 2 < source_.size() ? source_[i + 2] : 0;
+          if (u16string(u":=!<>|'P").find(kind) == u16string::npos) return optional<u16string>{};
+        }
+        depth++;
+        break;
+
+      case ')':
+        if (depth == 0) return optional<u16string>{};
+        depth--;
+        break;
+
+      case '|':
+        if (depth == 0) return optional<u16string>{};
+        break;
+
+      case '*':
+      case '?':
+      case '+':
+      case '{': {
+        bool allows_zero = c != '+';
+        if (c == '{') {
+          size_t j = i + 1;
+          uint32_t minimum = 0;
+          while (j < source_.size() && source_[j] >= '0' && source_[j] <= '9') {
+            minimum = minimum * 10 + (source_[j++] - '0');
+          }
+          while (j < source_.size() && (source_[j] == ',' || (source_[j] >= '0' && source_[j] <= '9'))) j++;
+          if (j == i + 1 || j == source_.size() || source_[j] != '}') {
+            literal_character = c;
+            break;
+          }
+          allows_zero = minimum == 0;
+          i = j;
+        }
+        if (depth == 0) {
+          if (allows_zero && last_atom_is_literal) run.pop_back();
+          end_run();
+        }
+        if (i + 1 < source_.size() && (source_[i + 1] == '?' || source_[i + 1] == '+')) i++;
+        last_atom_is_literal = false;
+        continue;
+      }
+
+      case '.':
+      case '^':
+      case '$':
+        break;
+
+      default:
+        if (c == '\n' || c == '\r') return optional<u16string>{};
+        literal_character = c;
+    }
+
+    // Characters whose case folding the index can't reproduce end the run,
+    // as do characters within groups, which may be optional. Unicode case
+    // folding maps `k` and `s` to characters outside of ASCII.
+    if (literal_character && depth == 0 && !(ignore_case_ && !folds_within_ascii(*literal_character))) {
+      run += *literal_character;
+      last_atom_is_literal = true;
+    } else {
+      if (depth == 0) end_run();
+      last_atom_is_literal = false;
+    }
+  }
+
+  if (depth != 0) return optional<u16string>{};
+  end_run();
+  if (best.empty()) return optional<u16string>{};
+  return best;
+}
+
+static u16string decimal_string(uint32_t value) {
+  std::string digits = std::to_string(value);
+  return u16string(digits.begin(), digits.end());
+}
+
+// Copies the given pattern into `result`, shifting numbered backreferences by
+// `capture_offset` so that they still refer to the right group once the
+// pattern is embedded after other patterns' groups. Returns false for
+// constructs that can't be relocated this way.
+static bool relocate_pattern(const u16string &pattern, uint32_t capture_offset,
+                             uint32_t capture_count, u16string *result) {
+  bool in_class = false;
+  for (size_t i = 0; i < pattern.size(); i++) {
+    char16_t c = pattern[i];
+    char16_t next = i + 1 < pattern.size() ? pattern[i + 1] : 0;
+    char16_t after_next = i + 2 < pattern.size() ? pattern[i + 2] : 0;
+
+    if (c == '\\') {
+      if (next == 'Q') return false;
+      if (next == 'g' && ((after_next >= '0' && after_next <= '9') || after_next == '{')) {
+        size_t digit_index = after_next == '{' ? i + 3 : i + 2;
+        if (digit_index < pattern.size() && pattern[digit_index] >= '0' && pattern[digit_index] <= '9') {
+          return false;
+        }
+      }
+
+      if (!in_class && next >= '1' && next <= '9') {
+        size_t j = i + 1;
+        uint32_t number = 0;
+        while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9') {
+          number = number * 10 + (pattern[j] - '0');
+          j++;
+        }
+
+        if (number <= capture_count) {
+          *result += u"\\g{" + decimal_string(number + capture_offset) + u"}";
+          i = j - 1;
+          continue;
+        } else if (number >= 10) {
+          return false;
+        }
+      }
+
+      *result += c;
+      if (next) *result += next;
+      i++;
+      continue;
+    }
+
+    if (in_class) {
+      if (c == ']') in_class = false;
+    } else if (c == '[') {
+      in_class = true;
+      *result += c;
+      if (next == '^') {
+        *result += next;
+        i++;
+        next = after_next;
+      }
+      if (next == ']') {
+        *result += next;
+        i++;
+      }
+      continue;
+    } else if (c == '(') {
+      if (next == '*') return false;
+      if (next == '?') {
+        if ((after_next >= '0' && after_next <= '9') || after_next == '+' || after_next == '-' ||
+            after_next == 'R' || after_next == '(') {
+          char16_t flag = i + 3 < pattern.size() ? pattern[i + 3] : 0;
+          if (after_next != '-' || (flag >= '0' && flag <= '9')) return false;
+        }
+      }
+    }
+
+    *result += c;
+  }
+
+  return true;
+}
+
+optional<u16string> Regex::alternation(const vector<const Regex *> &regexes) {
+  if (regexes.empty()) return optional<u16string>{};
+
+  u16string result = u"(?:";
+  uint32_t capture_offset = 0;
+  for (size_t i = 0; i < regexes.size(); i++) {
+    const Regex *regex = regexes[i];
+    if (!regex->code || regex->unicode_ != regexes[0]->unicode_) return optional<u16string>{};
+
+    uint32_t capture_count = regex->capture_count();
+    if (i > 0) result += u'|';
+    result += u"(*MARK:" + decimal_string(i) + u")";
+    result += regex->ignore_case_ ? u"(?i:" : u"(?:";
+    if (!relocate_pattern(regex->source_, capture_offset, capture_count, &result)) {
+      return optional<u16string>{};
+    }
+    result += u')';
+    capture_offset += capture_count;
+  }
+  result += u')';
+
+  return result;
+}
+
+static const uint32_t SERIALIZATION_MAGIC = 0x58524753;
+static const uint32_t SERIALIZATION_VERSION = 2;
+
+enum SerializedRegexFlags : uint8_t {
+  IgnoreCase = 1,
+  Unicode = 2,
+};
+
+// A 32-bit FNV-1a hash, used to detect serialized regexes that were
+// corrupted after being written.
+static uint32_t checksum(const uint8_t *bytes, size_t byte_count) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < byte_count; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static void append_source(Serializer &output, uint8_t flags, const u16string &source) {
+  output.append<uint8_t>(flags);
+  output.append<uint32_t>(source.size());
+  for (char16_t c : source) output.append<uint16_t>(c);
+}
+
+bool Regex::serialize(const vector<const Regex *> &regexes, Serializer &output) {
+  vector<const pcre2_code *> codes;
+  for (const Regex *regex : regexes) {
+    if (!regex->code) return false;
+    codes.push_back(regex->code);
+  }
+
+  uint8_t *bytes = nullptr;
+  size_t byte_count = 0;
+  if (!codes.empty() && pcre2_serialize_encode(codes.data(), codes.size(), &bytes, &byte_count, nullptr) < 0) {
+    return false;
+  }
+
+  vector<uint8_t> sources;
+  Serializer sources_output(sources);
+  for (const Regex *regex : regexes) {
+    uint8_t flags = 0;
+    if (regex->ignore_case_) flags |= IgnoreCase;
+    if (regex->unicode_) flags |= Unicode;
+    append_source(sources_output, flags, regex->source_);
+  }
+
+  output.append<uint32_t>(SERIALIZATION_MAGIC);
+  output.append<uint32_t>(SERIALIZATION_VERSION);
+  output.append<uint32_t>(regexes.size());
+  output.append<uint32_t>(checksum(sources.data(), sources.size()));
+  output.append<uint32_t>(checksum(bytes, byte_count));
+  output.append_bytes(sources.data(), sources.size());
+  output.append<uint32_t>(byte_count);
+  output.append_bytes(bytes, byte_count);
+
+  if (bytes) pcre2_serialize_free(bytes);
+  return true;
+}
+
+optional<vector<Regex>> Regex::deserialize(Deserializer &input) {
+  if (input.remaining() < 20 ||
+      input.read<uint32_t>() != SERIALIZATION_MAGIC ||
+      input.read<uint32_t>() != SERIALIZATION_VERSION) {
+    return optional<vector<Regex>>{};
+  }
+
+  uint32_t count = input.read<uint32_t>();
+  uint32_t sources_checksum = input.read<uint32_t>();
+  uint32_t code_checksum = input.read<uint32_t>();
+
+  vector<u16string> sources;
+  vector<uint8_t> flags;
+  vector<uint8_t> source_bytes;
+  Serializer source_bytes_output(source_bytes);
+  for (uint32_t i = 0; i < count; i++) {
+    if (input.remaining() < 5) return optional<vector<Regex>>{};
+    flags.push_back(input.read<uint8_t>());
+    uint32_t length = input.read<uint32_t>();
+    if (input.remaining() / 2 < length) return optional<vector<Regex>>{};
+    u16string source;
+    source.reserve(length);
+    for (uint32_t j = 0; j < length; j++) source.push_back(input.read<uint16_t>());
+    append_source(source_bytes_output, flags.back(), source);
+    sources.push_back(std::move(source));
+  }
+  if (checksum(source_bytes.data(), source_bytes.size()) != sources_checksum) {
+    return optional<vector<Regex>>{};
+  }
+
+  if (input.remaining() < 4) return optional<vector<Regex>>{};
+  uint32_t byte_count = input.read<uint32_t>();
+  const uint8_t *bytes = input.read_bytes(byte_count);
+  if (!bytes) return optional<vector<Regex>>{};
+
+  vector<Regex> result;
+  if (count == 0) return result;
+  result.reserve(count);
+
+  // PCRE checks that the data was written by the same version and
+  // configuration of the library, and with the same code unit width, but
+  // not that the compiled patterns are intact.
+  vector<pcre2_code *> codes(count, nullptr);
+  if (checksum(bytes, byte_count) == code_checksum &&
+      pcre2_serialize_get_number_of_codes(bytes) == static_cast<int32_t>(count) &&
+      pcre2_serialize_decode(codes.data(), count, bytes, nullptr) == static_cast<int32_t>(count)) {
+    for (uint32_t i = 0; i < count; i++) {
+      result.push_back(Regex(codes[i], std::move(sources[i]), flags[i] & IgnoreCase, flags[i] & Unicode));
+    }
+    return result;
+  }
+
+  // The compiled patterns can't be used, so compile them again from their
+  // sources.
+  for (uint32_t i = 0; i < count; i++) {
+    u16string error_message;
+    Regex regex(sources[i], &error_message, flags[i] & IgnoreCase, flags[i] & Unicode);
+    if (!error_message.empty()) return optional<vector<Regex>>{};
+    result.push_back(std::move(regex));
+  }
+  return result;
+}
+
+void Regex::jit_compile() const {
+  static std::mutex jit_compile_mutex;
+  std::lock_guard<std::mutex> guard(jit_compile_mutex);
+  if (needs_jit_compile.load()) {
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE|PCRE2_JIT_PARTIAL_HARD|PCRE2_JIT_PARTIAL_SOFT);
+    needs_jit_compile.store(false);
+  }
+}
+
+void Regex::nfa_compile() const {
+  static std::mutex nfa_compile_mutex;
+  std::lock_guard<std::mutex> guard(nfa_compile_mutex);
+  if (needs_nfa_compile.load()) {
+    u16string pattern = source_.empty()
+      ? u16string(EMPTY_PATTERN)
+      : preprocess_pattern(source_.data(), source_.size());
+    nfa = RegexNFA::compile(pattern, ignore_case_);
+    if (nfa && nfa->capture_count() != capture_count()) nfa.reset();
+    needs_nfa_compile.store(false);
+  }
+}
+
+static std::atomic<uint32_t> default_match_limit{0};
+static std::atomic<uint32_t> default_depth_limit{0};
+static std::atomic<size_t> jit_stack_size{0};
+static const size_t INITIAL_JIT_STACK_SIZE = 32 * 1024;
+static std::atomic<Regex::Engine> default_engine{Regex::Engine::Backtracking};
+
+struct ThreadJITStack {
+  pcre2_jit_stack *stack;
+  size_t size;
+
+  ~ThreadJITStack() {
+    if (stack) pcre2_jit_stack_free(stack);
+  }
+};
+
+static thread_local ThreadJITStack thread_jit_stack{nullptr, 0};
+
+// Called by PCRE at the start of each JIT match, on the thread performing the
+// match. Returning null makes PCRE use its built-in stack.
+static pcre2_jit_stack *get_thread_jit_stack(void *) {
+  size_t size = jit_stack_size.load();
+  if (size == 0) return nullptr;
+  if (thread_jit_stack.size != size) {
+    if (thread_jit_stack.stack) pcre2_jit_stack_free(thread_jit_stack.stack);
+    thread_jit_stack.stack = pcre2_jit_stack_create(std::min(size, INITIAL_JIT_STACK_SIZE), size, nullptr);
+    thread_jit_stack.size = size;
+  }
+  return thread_jit_stack.stack;
+}
+
+void Regex::set_default_limits(uint32_t match_limit, uint32_t depth_limit) {
+  default_match_limit = match_limit;
+  default_depth_limit = depth_limit;
+}
+
+void Regex::set_jit_stack_size(size_t size) {
+  jit_stack_size = size;
+}
+
+void Regex::set_default_engine(Engine engine) {
+  default_engine = engine;
+}
+
+void Regex::set_engine(Engine engine) {
+  engine_ = engine;
+}
+
+bool Regex::uses_nfa_engine() const {
+  switch (engine_ ? *engine_ : default_engine.load()) {
+    case Engine::NFA: return true;
+    case Engine::Automatic: return backtracking_prone_;
+    default: return false;
+  }
+}
+
+static uint32_t builtin_limit(uint32_t what) {
+  uint32_t result = 0;
+  pcre2_config(what, &result);
+  return result;
+}
+
+static uint32_t effective_limit(uint32_t limit, uint32_t default_limit, uint32_t builtin_limit) {
+  if (limit) return limit;
+  if (default_limit) return default_limit;
+  return builtin_limit;
+}
+
 Regex::MatchData::MatchData(const Regex &regex)
-  : data{pcre2_match_data_create_from_pattern(regex.code, nullptr)} {}
+  : data{pcre2_match_data_create_from_pattern(regex.code, nullptr)},
+    context{pcre2_match_context_create(nullptr)},
+    match_limit{0},
+    depth_limit{0},
+    last_match_used_nfa{false} {
+  pcre2_jit_stack_assign(context, get_thread_jit_stack, nullptr);
+}
 
 Regex::MatchData::~MatchData() {
   pcre2_match_data_free(data);
+  pcre2_match_context_free(context);
+}
+
+void Regex::MatchData::set_limits(uint32_t match_limit, uint32_t depth_limit) {
+  this->match_limit = match_limit;
+  this->depth_limit = depth_limit;
+}
+
+bool Regex::MatchData::can_match(const Regex &regex) const {
+  return pcre2_get_ovector_count(data) > regex.capture_count();
+}
+
+const char16_t *Regex::MatchData::mark() const {
+  if (last_match_used_nfa) return nullptr;
+  return reinterpret_cast<const char16_t *>(pcre2_get_mark(data));
+}
+
+optional<pair<size_t, size_t>> Regex::MatchData::capture_offsets(uint32_t group) const {
+  if (group >= pcre2_get_ovector_count(data)) return optional<pair<size_t, size_t>>{};
+  PCRE2_SIZE *ovector = pcre2_get_ovector_pointer(data);
+  if (ovector[2 * group] == PCRE2_UNSET) return optional<pair<size_t, size_t>>{};
+  return pair<size_t, size_t>(ovector[2 * group], ovector[2 * group + 1]);
 }
 
 MatchResult Regex::match(const char16_t *string, size_t length,
                          MatchData &match_data, unsigned options) const {
-  MatchResult result{MatchResult::None, 0, 0};
+  MatchResult result{MatchResult::None, 0, 0, false};
+  if (needs_jit_compile.load()) jit_compile();
 
   unsigned int pcre_options = 0;
   if (!(options & MatchOptions::IsEndSearch)) pcre_options |= PCRE2_PARTIAL_HARD;
   if (!(options & MatchOptions::IsBeginningOfLine)) pcre_options |= PCRE2_NOTBOL;
   if (!(options & MatchOptions::IsEndOfLine)) pcre_options |= PCRE2_NOTEOL;
 
+  static const uint32_t builtin_match_limit = builtin_limit(PCRE2_CONFIG_MATCHLIMIT);
+  static const uint32_t builtin_depth_limit = builtin_limit(PCRE2_CONFIG_RECURSIONLIMIT);
+  pcre2_set_match_limit(match_data.context, effective_limit(
+    match_data.match_limit, default_match_limit, builtin_match_limit
+  ));
+  pcre2_set_recursion_limit(match_data.context, effective_limit(
+    match_data.depth_limit, default_depth_limit, builtin_depth_limit
+  ));
+
+  match_data.last_match_used_nfa = false;
+  if (uses_nfa_engine()) {
+    if (needs_nfa_compile.load()) nfa_compile();
+    if (nfa) {
+      if (!match_data.nfa_workspace) match_data.nfa_workspace.reset(new RegexNFA::Workspace());
+      match_data.last_match_used_nfa = true;
+      RegexNFA::MatchResult nfa_result = nfa->match(
+        string,
+        length,
+        options & MatchOptions::IsBeginningOfLine,
+        options & MatchOptions::IsEndOfLine,
+        options & MatchOptions::IsEndSearch,
+        *match_data.nfa_workspace,
+        pcre2_get_ovector_pointer(match_data.data)
+      );
+      switch (nfa_result.type) {
+        case RegexNFA::MatchResult::None: result.type = MatchResult::None; break;
+        case RegexNFA::MatchResult::Partial: result.type = MatchResult::Partial; break;
+        case RegexNFA::MatchResult::Full: result.type = MatchResult::Full; break;
+      }
+      result.start_offset = nfa_result.start_offset;
+      result.end_offset = nfa_result.end_offset;
+      return result;
+    }
+  }
+
   int status = pcre2_match(
     code,
     reinterpret_cast<const uint16_t *>(string),
@@ -116,7 +835,7 @@ MatchResult Regex::match(const char16_t *string, size_t length,
     0,
     pcre_options,
     match_data.data,
-    nullptr
+    match_data.context
   );
 
   if (status < 0) {
@@ -129,6 +848,12 @@ MatchResult Regex::match(const char16_t *string, size_t length,
       case PCRE2_ERROR_NOMATCH:
         result.type = MatchResult::None;
         break;
+      case PCRE2_ERROR_MATCHLIMIT:
+      case PCRE2_ERROR_RECURSIONLIMIT:
+      case PCRE2_ERROR_JIT_STACKLIMIT:
+        result.type = MatchResult::Error;
+        result.limit_exceeded = true;
+        break;
       default:
         result.type = MatchResult::Error;
         break;
@@ -1,17 +1,34 @@
 #ifndef REGEX_H_
 #define REGEX_H_
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include "optional.h"
+#include "regex-nfa.h"
+#include "serializer.h"
 #include <string>
+#include <utility>
+#include <vector>
 
 struct pcre2_real_code_16;
 struct pcre2_real_match_data_16;
+struct pcre2_real_match_context_16;
 struct BuildRegexResult;
 
 class Regex {
   pcre2_real_code_16 *code;
-  Regex(pcre2_real_code_16 *);
+  std::u16string source_;
+  bool ignore_case_;
+  bool unicode_;
+  bool backtracking_prone_;
+  mutable std::atomic<bool> needs_jit_compile;
+  mutable std::atomic<bool> needs_nfa_compile;
+  mutable std::unique_ptr<RegexNFA> nfa;
+  Regex(pcre2_real_code_16 *, std::u16string &&source, bool ignore_case, bool unicode);
+  void jit_compile() const;
+  void nfa_compile() const;
+  bool uses_nfa_engine() const;
 
  public:
   Regex();
@@ -20,13 +37,114 @@ class Regex {
   Regex(Regex &&);
   ~Regex();
 
+  const std::u16string &source() const;
+  bool ignore_case() const;
+  bool unicode() const;
+  uint32_t capture_count() const;
+
+  // Whether the pattern repeats a group that itself contains an unbounded
+  // repetition, as in `(a+)+b`. Backtracking can take exponential time to
+  // reject subjects that almost match such patterns.
+  bool is_backtracking_prone() const;
+
+  // If this regex can only ever match one fixed string, returns that string.
+  optional<std::u16string> literal() const;
+
+  // Returns the longest string that every match of this regex contains, as
+  // long as it can be shown that matches never span a line ending. Returns an
+  // empty optional if the pattern is too complex to analyze.
+  optional<std::u16string> required_literal() const;
+
+  // Builds a pattern that matches any of the given regexes, tagging each
+  // alternative with a (*MARK) whose name is the index of the regex it came
+  // from. The result must be compiled with `ignore_case` disabled and with the
+  // same `unicode` setting as the given regexes. Returns an empty optional if
+  // the patterns can't be safely combined (e.g. they use absolute subroutine
+  // calls, backtracking verbs, or differ in their `unicode` setting).
+  static optional<std::u16string> alternation(const std::vector<const Regex *> &);
+
+  // Writes the compiled form of the given regexes, so that a later run of the
+  // same program can restore them with `deserialize` instead of compiling
+  // them again. Returns false if any of the regexes failed to compile.
+  static bool serialize(const std::vector<const Regex *> &, Serializer &);
+
+  // Restores regexes written by `serialize`. JIT compilation is deferred until
+  // each regex is first matched. The data includes checksums of the sources
+  // and of the compiled patterns. If the compiled patterns fail their
+  // checksum, or were written by a different version of PCRE, the regexes
+  // are compiled again from their sources. Returns an empty optional if the
+  // data is truncated or the sources fail their checksum. PCRE doesn't
+  // validate the compiled patterns, so the data must still come from a
+  // trusted source such as the application's own cache.
+  static optional<std::vector<Regex>> deserialize(Deserializer &);
+
+  // Sets the match limit and depth limit used by matches whose MatchData has
+  // no limits of its own, bounding the time that a single match attempt can
+  // take on patterns prone to catastrophic backtracking. A limit of 0 restores
+  // PCRE's built-in default.
+  static void set_default_limits(uint32_t match_limit, uint32_t depth_limit);
+
+  // Sets the maximum size of the stack used by JIT-compiled patterns. Each
+  // thread lazily allocates its own stack of this size the first time it runs
+  // a match. A size of 0 uses PCRE's built-in 32K stack.
+  static void set_jit_stack_size(size_t);
+
+  // The algorithms that `match` can use. The backtracking engine runs on
+  // PCRE's JIT and is the fastest for typical patterns. The NFA engine (see
+  // `RegexNFA`) finds the same matches in time proportional to the length of
+  // the subject times the size of the pattern. Patterns that it doesn't
+  // support, such as those with backreferences, lookarounds or the `unicode`
+  // option, always use the backtracking engine.
+  enum class Engine {
+    Backtracking,
+    NFA,
+    // Uses the NFA engine for patterns that are backtracking-prone.
+    Automatic,
+  };
+
+  // Sets the engine used by regexes that haven't been given one with
+  // `set_engine`. Defaults to `Backtracking`.
+  static void set_default_engine(Engine);
+
+  // Sets the engine used by this regex. Like the other setup of a regex, this
+  // must happen before the regex is shared with other threads.
+  void set_engine(Engine);
+
+ private:
+  optional<Engine> engine_;
+
+ public:
+
   class MatchData {
     pcre2_real_match_data_16 *data;
+    pcre2_real_match_context_16 *context;
+    uint32_t match_limit;
+    uint32_t depth_limit;
+    std::unique_ptr<RegexNFA::Workspace> nfa_workspace;
+    bool last_match_used_nfa;
     friend class Regex;
 
    public:
     MatchData(const Regex &);
     ~MatchData();
+
+    // Overrides the default limits for matches performed with this object. A
+    // limit of 0 falls back to the default again.
+    void set_limits(uint32_t match_limit, uint32_t depth_limit);
+
+    // Whether this object has room for the capture groups of the given regex,
+    // and so can be reused for its matches.
+    bool can_match(const Regex &) const;
+
+    // The name of the last (*MARK) passed on the most recent successful
+    // match, or null if there wasn't one.
+    const char16_t *mark() const;
+
+    // The start and end offsets of the given capture group on the most recent
+    // successful match, relative to the searched subject. Group 0 is the
+    // whole match. Returns an empty optional if the group doesn't exist or
+    // didn't participate in the match.
+    optional<std::pair<size_t, size_t>> capture_offsets(uint32_t group) const;
   };
 
   struct MatchResult {
@@ -39,6 +157,10 @@ class Regex {
 
     size_t start_offset;
     size_t end_offset;
+
+    // For errors, whether the match gave up because it exceeded the match
+    // limit, the depth limit or the JIT stack size.
+    bool limit_exceeded;
   };
 
   enum MatchOptions {
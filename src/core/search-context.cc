@@ -0,0 +1,36 @@
+#include "search-context.h"
+#include <vector>
+
+using std::unique_ptr;
+using std::vector;
+
+static const size_t MAX_POOLED_CONTEXTS_PER_THREAD = 4;
+
+static thread_local vector<unique_ptr<SearchContext>> context_pool;
+
+SearchContext::Handle SearchContext::acquire() {
+  if (context_pool.empty()) return Handle{new SearchContext()};
+  Handle result{context_pool.back().release()};
+  context_pool.pop_back();
+  return result;
+}
+
+void SearchContext::Releaser::operator()(SearchContext *context) const {
+  if (context_pool.size() < MAX_POOLED_CONTEXTS_PER_THREAD) {
+    context_pool.push_back(unique_ptr<SearchContext>{context});
+  } else {
+    delete context;
+  }
+}
+
+Regex::MatchData &SearchContext::match_data_for(const Regex &regex) {
+  if (!match_data || !match_data->can_match(regex)) {
+    match_data.reset(new Regex::MatchData(regex));
+  }
+  return *match_data;
+}
+
+Text &SearchContext::empty_chunk_continuation() {
+  chunk_continuation.clear();
+  return chunk_continuation;
+}
@@ -0,0 +1,35 @@
+#ifndef SUPERSTRING_SEARCH_CONTEXT_H_
+#define SUPERSTRING_SEARCH_CONTEXT_H_
+
+#include <memory>
+#include "regex.h"
+#include "text.h"
+
+// Holds the buffers needed to search a TextBuffer, so that code which searches
+// repeatedly can reuse them instead of allocating them for every search.
+class SearchContext {
+  std::unique_ptr<Regex::MatchData> match_data;
+  Text chunk_continuation;
+
+ public:
+  struct Releaser {
+    void operator()(SearchContext *) const;
+  };
+
+  using Handle = std::unique_ptr<SearchContext, Releaser>;
+
+  // Takes a context from a pool owned by the current thread, creating one if
+  // the pool is empty. The context returns to the pool when the handle is
+  // destroyed.
+  static Handle acquire();
+
+  // Returns match data that can hold the results of the given regex's
+  // matches, reusing the previous match data if it is large enough.
+  Regex::MatchData &match_data_for(const Regex &);
+
+  // Returns an empty buffer for text that a search carries over from one
+  // chunk to the next.
+  Text &empty_chunk_continuation();
+};
+
+#endif  // SUPERSTRING_SEARCH_CONTEXT_H_
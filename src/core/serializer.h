@@ -1,6 +1,7 @@
 #ifndef SERIALIZER_H_
 #define SERIALIZER_H_
 
+#include <cstddef>
 #include <vector>
 #include <cstdint>
 
@@ -18,6 +19,20 @@ class Serializer {
       value >>= 8;
     }
   }
+
+  // Writes the value in as few bytes as possible, seven bits at a time,
+  // starting with the lowest.
+  void append_varint(uint32_t value) {
+    while (value >= 0x80) {
+      vector.push_back((value & 0x7F) | 0x80);
+      value >>= 7;
+    }
+    vector.push_back(value);
+  }
+
+  void append_bytes(const uint8_t *bytes, size_t size) {
+    vector.insert(vector.end(), bytes, bytes + size);
+  }
 };
 
 class Deserializer {
@@ -29,6 +44,12 @@ class Deserializer {
     read_ptr(input.data()),
     end_ptr(input.data() + input.size()) {};
 
+  // Reads directly from memory that the caller owns, which must outlive the
+  // deserializer.
+  inline Deserializer(const uint8_t *input, size_t size) :
+    read_ptr(input),
+    end_ptr(input + size) {};
+
   template <typename T>
   T peek() const {
     T value = 0;
@@ -47,6 +68,32 @@ class Deserializer {
     read_ptr += sizeof(T);
     return value;
   }
+
+  uint32_t read_varint() {
+    uint32_t value = 0;
+    for (uint32_t shift = 0; shift < 35 && read_ptr < end_ptr; shift += 7) {
+      uint8_t byte = *(read_ptr++);
+      value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) break;
+    }
+    return value;
+  }
+
+  // Returns the next `size` bytes without copying them, or null if the input
+  // is too short.
+  const uint8_t *read_bytes(size_t size) {
+    if (remaining() < size) {
+      read_ptr = end_ptr;
+      return nullptr;
+    }
+    const uint8_t *result = read_ptr;
+    read_ptr += size;
+    return result;
+  }
+
+  size_t remaining() const {
+    return read_ptr < end_ptr ? end_ptr - read_ptr : 0;
+  }
 };
 
 #endif // SERIALIZER_H_
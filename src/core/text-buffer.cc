@@ -1,6 +1,8 @@
 #include "text-slice.h"
 #include "text-buffer.h"
 #include "regex.h"
+#include "regex-cache.h"
+#include "aho-corasick.h"
 #include <algorithm>
 #include <cassert>
 #include <cwctype>
@@ -22,6 +24,10 @@ uint32_t TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 1024;
 
 static Text EMPTY_TEXT;
 
+// Cancellable searches check whether they were cancelled at least once per
+// this many characters.
+static const uint32_t CANCELLABLE_SEARCH_PIECE_SIZE = 64 * 1024;
+
 struct TextBuffer::Layer {
   Layer *previous_layer;
   Patch patch;
@@ -266,8 +272,28 @@ struct TextBuffer::Layer {
   }
 
   template <typename Callback>
-  void scan_in_range(const Regex &regex, Range range, const Callback &callback, bool splay = false) {
-    Regex::MatchData match_data(regex);
+  SearchStatus scan_in_range(const Regex &regex, Range range, const Callback &callback, bool splay = false) {
+    auto context = SearchContext::acquire();
+    return scan_in_range(regex, *context, range, callback, splay);
+  }
+
+  template <typename Callback>
+  SearchStatus scan_in_range(const Regex &regex, SearchContext &context, Range range,
+                             const Callback &callback, bool splay = false) {
+    return scan_in_range(regex, context.match_data_for(regex), context.empty_chunk_continuation(),
+                         range, callback, splay);
+  }
+
+  // The callback is always invoked before `match_data` is reused for the next
+  // match, so it can inspect the match data of the match it is reporting.
+  //
+  // If `is_cancelled` is given, it is polled before each chunk is searched,
+  // and large chunks are searched in pieces so that it is polled regularly
+  // even when nothing matches.
+  template <typename Callback>
+  SearchStatus scan_in_range(const Regex &regex, Regex::MatchData &match_data, Text &chunk_continuation,
+                             Range range, const Callback &callback, bool splay = false,
+                             const std::function<bool()> &is_cancelled = std::function<bool()>()) {
     range.start = clip_position(range.start).position;
     range.end = clip_position(range.end).position;
 
@@ -275,13 +301,21 @@ struct TextBuffer::Layer {
     Range last_match{Point::max(), Point::max()};
     bool last_match_is_pending = false;
     bool done = false;
-    Text chunk_continuation;
+    SearchStatus status = SearchStatus::Completed;
     TextSlice slice_to_search;
     Point chunk_start_position = range.start;
     Point last_search_end_position = range.start;
     Point slice_to_search_start_position = range.start;
 
-    for_each_chunk_in_range(range.start, range.end, [&](TextSlice chunk) {
+    auto search_chunk = [&](TextSlice chunk) {
+      if (is_cancelled && is_cancelled()) {
+        status = SearchStatus::Cancelled;
+        chunk_continuation.clear();
+        last_match_is_pending = false;
+        done = true;
+        return true;
+      }
+
       Point chunk_end_position = chunk_start_position.traverse(chunk.extent());
       while (last_search_end_position < chunk_end_position) {
         if (last_search_end_position >= chunk_start_position) {
@@ -337,7 +371,9 @@ struct TextBuffer::Layer {
 
         switch (match_result.type) {
           case MatchResult::Error:
+            status = match_result.limit_exceeded ? SearchStatus::LimitExceeded : SearchStatus::Failed;
             chunk_continuation.clear();
+            done = true;
             return true;
 
           case MatchResult::None:
@@ -373,6 +409,15 @@ struct TextBuffer::Layer {
               slice_to_search_start_position.traverse(match_end_position)
             };
 
+            // A match can start at the LF of a CRLF whose CR is at the end of
+            // the previous chunk. Points within CRLF line endings are not
+            // valid, so such a match starts at the CR instead.
+            if (match_result.start_offset == 0 && slice_to_search.front() == '\n' &&
+                last_match.start.column > 0) {
+              last_match.start = clip_position(last_match.start).position;
+              if (match_result.end_offset == 0) last_match.end = last_match.start;
+            }
+
             last_search_end_position = last_match.end;
             if (match_end_position == match_start_position) {
               last_search_end_position.column++;
@@ -406,6 +451,23 @@ struct TextBuffer::Layer {
 
       chunk_start_position = chunk_end_position;
       return false;
+    };
+
+    for_each_chunk_in_range(range.start, range.end, [&](TextSlice chunk) {
+      if (!is_cancelled) return search_chunk(chunk);
+      while (chunk.size() > CANCELLABLE_SEARCH_PIECE_SIZE) {
+        // Pieces never end between a CR and an LF, which would not be a valid
+        // position, or between the halves of a surrogate pair.
+        uint32_t piece_size = CANCELLABLE_SEARCH_PIECE_SIZE;
+        while (piece_size < chunk.size() &&
+               (chunk.data()[piece_size - 1] == '\r' || (chunk.data()[piece_size - 1] & 0xFC00) == 0xD800)) {
+          piece_size++;
+        }
+        auto pieces = chunk.split(piece_size);
+        if (search_chunk(pieces.first)) return true;
+        chunk = pieces.second;
+      }
+      return search_chunk(chunk);
     }, splay);
 
     if (last_match_is_pending) {
@@ -422,30 +484,69 @@ struct TextBuffer::Layer {
         callback(Range{range.end, range.end});
       }
     }
+
+    return status;
   }
 
-  optional<Range> find_in_range(const Regex &regex, Range range, bool splay = false) {
+  optional<Range> find_in_range(const Regex &regex, SearchContext &context, Range range, bool splay = false) {
     optional<Range> result;
-    scan_in_range(regex, range, [&result](Range match_range) -> bool {
+    scan_in_range(regex, context, range, [&result](Range match_range) -> bool {
       result = match_range;
       return true;
     }, splay);
     return result;
   }
 
-  vector<Range> find_all_in_range(const Regex &regex, Range range, bool splay = false) {
+  // Searches windows of lines that end at the end of the range and grow
+  // exponentially, returning the last match in the first window that has
+  // one. Because each window starts at the beginning of a line, this finds
+  // the same match as a forward search of the whole range, unless that search
+  // would report a match spanning the line ending before the window.
+  optional<Range> find_backward_in_range(const Regex &regex, SearchContext &context, Range range,
+                                         bool splay = false) {
+    range.start = clip_position(range.start).position;
+    range.end = clip_position(range.end).position;
+
+    uint32_t window_row_count = 0;
+    for (;;) {
+      Point window_start = range.end.row - range.start.row > window_row_count ?
+        Point(range.end.row - window_row_count, 0) :
+        range.start;
+
+      optional<Range> result;
+      scan_in_range(regex, context, Range{window_start, range.end}, [&result](Range match_range) -> bool {
+        result = match_range;
+        return false;
+      }, splay);
+      if (result || window_start == range.start) return result;
+      window_row_count = 2 * window_row_count + 1;
+    }
+  }
+
+  vector<Range> find_all_in_range(const Regex &regex, SearchContext &context, Range range, bool splay = false) {
     vector<Range> result;
-    scan_in_range(regex, range, [&result](Range match_range) -> bool {
+    scan_in_range(regex, context, range, [&result](Range match_range) -> bool {
       result.push_back(match_range);
       return false;
     }, splay);
     return result;
   }
 
+  CountAllResult count_in_range(const Regex &regex, SearchContext &context, Range range,
+                                uint32_t limit, bool splay = false) {
+    CountAllResult result{0, SearchStatus::Completed};
+    if (limit == 0) return result;
+    result.status = scan_in_range(regex, context, range, [&result, limit](Range) -> bool {
+      return ++result.count == limit;
+    }, splay);
+    return result;
+  }
+
   unsigned find_and_mark_all_in_range(MarkerIndex &index, MarkerIndex::MarkerId first_id,
-                                      bool exclusive, const Regex &regex, Range range, bool splay = false) {
+                                      bool exclusive, const Regex &regex, SearchContext &context,
+                                      Range range, bool splay = false) {
     unsigned id = first_id;
-    scan_in_range(regex, range, [&index, &id, exclusive](Range match_range) -> bool {
+    scan_in_range(regex, context, range, [&index, &id, exclusive](Range match_range) -> bool {
       index.insert(id, match_range.start, match_range.end);
       index.set_exclusive(id, exclusive);
       id++;
@@ -454,6 +555,162 @@ struct TextBuffer::Layer {
     return id - first_id;
   }
 
+  vector<pair<Range, uint32_t>> find_all_multi_in_range(const vector<const Regex *> &regexes,
+                                                        Range range, bool splay = false) {
+    vector<pair<Range, uint32_t>> result;
+    if (regexes.empty()) return result;
+
+    // Sets of plain strings are matched with an automaton over the chunks.
+    vector<u16string> literals;
+    bool ignore_case = regexes.front()->ignore_case();
+    for (const Regex *regex : regexes) {
+      auto literal = regex->literal();
+      if (!literal || regex->unicode() || regex->ignore_case() != ignore_case) break;
+      if (ignore_case && std::any_of(literal->begin(), literal->end(), [](char16_t c) { return c >= 128; })) break;
+      literals.push_back(move(*literal));
+    }
+    if (literals.size() == regexes.size()) {
+      find_all_literals_in_range(AhoCorasick(literals, ignore_case), range, result, splay);
+      return result;
+    }
+
+    // Other patterns are combined into one alternation whose branches are
+    // tagged with the index of the pattern they came from.
+    auto alternation = Regex::alternation(regexes);
+    if (alternation) {
+      u16string error_message;
+      auto combined_regex = RegexCache::shared().get(
+        *alternation, &error_message, false, regexes.front()->unicode()
+      );
+      if (combined_regex) {
+        auto context = SearchContext::acquire();
+        auto &match_data = context->match_data_for(*combined_regex);
+        scan_in_range(*combined_regex, *context, range, [&](Range match_range) -> bool {
+          uint32_t pattern_index = 0;
+          const char16_t *mark = match_data.mark();
+          while (mark && *mark >= '0' && *mark <= '9') {
+            pattern_index = pattern_index * 10 + (*mark - '0');
+            mark++;
+          }
+          result.push_back({match_range, pattern_index});
+          return false;
+        }, splay);
+        return result;
+      }
+    }
+
+    // Patterns that can't be combined are searched individually. To produce
+    // the same results as an alternation, we repeatedly take the leftmost
+    // match, preferring earlier patterns, and resume all searches after it.
+    range.start = clip_position(range.start).position;
+    range.end = clip_position(range.end).position;
+    vector<optional<Range>> next_matches(regexes.size());
+    vector<bool> exhausted(regexes.size(), false);
+    auto context = SearchContext::acquire();
+    Point search_start = range.start;
+    for (;;) {
+      optional<uint32_t> best_index;
+      for (uint32_t i = 0; i < regexes.size(); i++) {
+        if (exhausted[i]) continue;
+        if (!next_matches[i] || next_matches[i]->start < search_start) {
+          next_matches[i] = find_in_range(*regexes[i], *context, Range{search_start, range.end}, splay);
+          if (!next_matches[i]) {
+            exhausted[i] = true;
+            continue;
+          }
+        }
+        if (!best_index || next_matches[i]->start < next_matches[*best_index]->start) {
+          best_index = i;
+        }
+      }
+
+      if (!best_index) break;
+      Range match_range = *next_matches[*best_index];
+      result.push_back({match_range, *best_index});
+      if (match_range.end == range.end) break;
+
+      search_start = match_range.end;
+      if (match_range.start == match_range.end) {
+        search_start.column++;
+        if (clip_position(search_start).position == match_range.end) {
+          search_start.column = 0;
+          search_start.row++;
+        }
+      }
+    }
+
+    return result;
+  }
+
+  void find_all_literals_in_range(const AhoCorasick &automaton, Range range,
+                                  vector<pair<Range, uint32_t>> &result, bool splay) {
+    struct Occurrence {
+      uint32_t start_offset;
+      uint32_t end_offset;
+      uint32_t pattern_index;
+      Point start;
+      Point end;
+    };
+
+    range.start = clip_position(range.start).position;
+    range.end = clip_position(range.end).position;
+
+    // Remember the positions of the most recent characters so that we can
+    // tell where each occurrence started once we reach its end.
+    uint32_t history_size = automaton.max_pattern_length() + 1;
+    vector<Point> position_history(history_size);
+    vector<Occurrence> occurrences;
+    Point position = range.start;
+    uint32_t offset = 0;
+    uint32_t state = AhoCorasick::INITIAL_STATE;
+    position_history[0] = position;
+
+    for_each_chunk_in_range(range.start, range.end, [&](TextSlice chunk) {
+      for (char16_t character : chunk) {
+        if (character == '\n') {
+          position.row++;
+          position.column = 0;
+        } else {
+          position.column++;
+        }
+        offset++;
+        position_history[offset % history_size] = position;
+        state = automaton.step(state, character, [&](uint32_t pattern_index) {
+          uint32_t start_offset = offset - automaton.pattern_length(pattern_index);
+          occurrences.push_back(Occurrence{
+            start_offset,
+            offset,
+            pattern_index,
+            position_history[start_offset % history_size],
+            position
+          });
+        });
+      }
+      return false;
+    }, splay);
+
+    std::sort(occurrences.begin(), occurrences.end(), [](const Occurrence &a, const Occurrence &b) {
+      if (a.start_offset != b.start_offset) return a.start_offset < b.start_offset;
+      return a.pattern_index < b.pattern_index;
+    });
+
+    // Points within CRLF line endings are not valid, so occurrences that start
+    // or end between a CR and an LF are clipped to the start of the line ending.
+    // Searching resumes after each match in the same way as in `scan_in_range`.
+    uint32_t search_start_offset = 0;
+    Point search_start = range.start;
+    for (const Occurrence &occurrence : occurrences) {
+      if (occurrence.start_offset < search_start_offset) continue;
+      Range match_range{clip_position(occurrence.start).position, clip_position(occurrence.end).position};
+      if (match_range.start < search_start) continue;
+      result.push_back({match_range, occurrence.pattern_index});
+
+      search_start_offset = occurrence.end_offset;
+      search_start = match_range.end;
+      if (match_range.start == match_range.end) search_start = Point(search_start.row + 1, 0);
+    }
+  }
+
   struct SubsequenceMatchVariant {
     size_t query_index = 0;
     std::vector<uint32_t> match_indices;
@@ -679,6 +936,10 @@ TextBuffer::TextBuffer() :
   top_layer{base_layer} {}
 
 TextBuffer::~TextBuffer() {
+  for (LiveSearch *live_search : live_searches) {
+    live_search->buffer = nullptr;
+  }
+
   Layer *layer = top_layer;
   while (layer) {
     Layer *previous_layer = layer->previous_layer;
@@ -691,6 +952,8 @@ TextBuffer::TextBuffer(const std::u16string &text) :
   TextBuffer{u16string{text.begin(), text.end()}} {}
 
 void TextBuffer::reset(Text &&new_base_text) {
+  trigram_index.reset();
+
   bool has_snapshot = false;
   auto layer = top_layer;
   while (layer) {
@@ -721,6 +984,15 @@ void TextBuffer::reset(Text &&new_base_text) {
   top_layer->uses_patch = false;
   base_layer = top_layer;
   top_layer->previous_layer = nullptr;
+
+  for (LiveSearch *live_search : live_searches) {
+    live_search->search_in_range(Range{Point(), extent()});
+  }
+}
+
+void TextBuffer::reset(Text &&new_base_text, TrigramIndex &&index) {
+  reset(move(new_base_text));
+  trigram_index.reset(new TrigramIndex(move(index)));
 }
 
 Patch TextBuffer::get_inverted_changes(const Snapshot *snapshot) const {
@@ -788,6 +1060,10 @@ bool TextBuffer::deserialize_changes(Deserializer &deserializer) {
   top_layer->size_ = deserializer.read<uint32_t>();
   top_layer->extent_ = Point(deserializer);
   top_layer->patch = Patch(deserializer);
+
+  for (LiveSearch *live_search : live_searches) {
+    live_search->search_in_range(Range{Point(), extent()});
+  }
   return true;
 }
 
@@ -896,8 +1172,11 @@ void TextBuffer::set_text_in_range(Range old_range, u16string &&string) {
 
   auto start = clip_position(old_range.start);
   auto end = old_range.end == old_range.start ? start : clip_position(old_range.end);
+  splice_top_layer(start, end, Text{move(string)});
+}
+
+void TextBuffer::splice_top_layer(ClipResult start, ClipResult end, Text &&new_text) {
   Point deleted_extent = end.position.traversal(start.position);
-  Text new_text{move(string)};
   Point inserted_extent = new_text.extent();
   Point new_range_end = start.position.traverse(new_text.extent());
   uint32_t deleted_text_size = end.offset - start.offset;
@@ -912,7 +1191,17 @@ void TextBuffer::set_text_in_range(Range old_range, u16string &&string) {
     deleted_text_size
   );
 
-  auto change = top_layer->patch.grab_change_starting_before_new_position(start.position);
+  remove_top_layer_noop_change(start.position);
+
+  for (LiveSearch *live_search : live_searches) {
+    live_search->splice(start.position, deleted_extent, inserted_extent);
+  }
+}
+
+// Removes the top layer's change starting before the given position if its
+// new text matches the text it replaced in the previous layer.
+void TextBuffer::remove_top_layer_noop_change(Point position) {
+  auto change = top_layer->patch.grab_change_starting_before_new_position(position);
   if (change && change->old_text_size == change->new_text->size()) {
     bool change_is_noop = true;
     auto new_text_iter = change->new_text->begin();
@@ -935,16 +1224,394 @@ void TextBuffer::set_text_in_range(Range old_range, u16string &&string) {
 }
 
 optional<Range> TextBuffer::find(const Regex &regex, Range range) const {
-  return top_layer->find_in_range(regex, range, false);
+  return find(regex, *SearchContext::acquire(), range);
+}
+
+optional<Range> TextBuffer::find(const Regex &regex, SearchContext &context, Range range) const {
+  auto search_ranges = indexed_search_ranges(regex, range);
+  if (!search_ranges) return top_layer->find_in_range(regex, context, range, false);
+
+  for (Range search_range : *search_ranges) {
+    auto result = top_layer->find_in_range(regex, context, search_range, false);
+    if (result) return result;
+  }
+  return optional<Range>{};
+}
+
+// Splits a replacement template into literal text and references to capture
+// groups. `$n` and `$nn` refer to groups, `$&` to the whole match, and `$$`
+// inserts a dollar sign, as in JavaScript's `String.prototype.replace`.
+static vector<pair<u16string, int32_t>> parse_replacement(const u16string &replacement,
+                                                          uint32_t capture_count) {
+  vector<pair<u16string, int32_t>> parts;
+  u16string literal;
+  for (size_t i = 0; i < replacement.size(); i++) {
+    char16_t character = replacement[i];
+    if (character == '$' && i + 1 < replacement.size()) {
+      char16_t next = replacement[i + 1];
+      int32_t group = -1;
+      if (next == '$') {
+        literal += '$';
+        i++;
+        continue;
+      } else if (next == '&') {
+        group = 0;
+        i++;
+      } else if (next >= '0' && next <= '9') {
+        group = next - '0';
+        if (i + 2 < replacement.size() && replacement[i + 2] >= '0' && replacement[i + 2] <= '9') {
+          int32_t two_digit_group = group * 10 + (replacement[i + 2] - '0');
+          if (two_digit_group > 0 && static_cast<uint32_t>(two_digit_group) <= capture_count) {
+            group = two_digit_group;
+            i++;
+          }
+        }
+        if (group == 0 || static_cast<uint32_t>(group) > capture_count) {
+          group = -1;
+        } else {
+          i++;
+        }
+      }
+
+      if (group >= 0) {
+        parts.push_back({move(literal), group});
+        literal.clear();
+        continue;
+      }
+    }
+    literal += character;
+  }
+  if (!literal.empty()) parts.push_back({move(literal), -1});
+  return parts;
+}
+
+TextBuffer::ReplaceAllResult TextBuffer::replace_all(const Regex &regex, const u16string &replacement,
+                                                     Range range) {
+  struct Replacement {
+    Range range;
+    u16string old_text;
+    u16string new_text;
+  };
+
+  auto replacement_parts = parse_replacement(replacement, regex.capture_count());
+  vector<Replacement> replacements;
+  auto context = SearchContext::acquire();
+  auto &match_data = context->match_data_for(regex);
+  top_layer->scan_in_range(regex, *context, range, [&](Range match) -> bool {
+    u16string old_text = top_layer->text_in_range(match);
+    u16string new_text;
+
+    // Capture offsets are relative to the text that was searched, which is
+    // not necessarily the whole buffer, so locate each group relative to the
+    // start of the match. A match that ends in the middle of a CRLF is
+    // reported without its CR, so groups within the match are clipped to its
+    // text. Groups captured by lookarounds can lie outside of the match, and
+    // are read from the buffer instead.
+    auto match_offsets = *match_data.capture_offsets(0);
+    for (const auto &part : replacement_parts) {
+      new_text += part.first;
+      if (part.second < 0) continue;
+      auto offsets = match_data.capture_offsets(part.second);
+      if (!offsets) continue;
+      if (offsets->first >= match_offsets.first && offsets->second <= match_offsets.second) {
+        size_t group_start = std::min(offsets->first - match_offsets.first, old_text.size());
+        size_t group_end = std::min(offsets->second - match_offsets.first, old_text.size());
+        if (group_end > group_start) new_text.append(old_text, group_start, group_end - group_start);
+      } else if (offsets->second > offsets->first) {
+        uint32_t match_start_offset = top_layer->clip_position(match.start).offset;
+        Range group_range{
+          top_layer->position_for_offset(match_start_offset + offsets->first - match_offsets.first),
+          top_layer->position_for_offset(match_start_offset + offsets->second - match_offsets.first)
+        };
+        new_text += top_layer->text_in_range(group_range);
+      }
+    }
+
+    if (new_text != old_text) {
+      replacements.push_back(Replacement{match, move(old_text), move(new_text)});
+    }
+    return false;
+  });
+
+  ReplaceAllResult result{static_cast<uint32_t>(replacements.size()), Patch()};
+  if (replacements.empty()) return result;
+
+  if (top_layer == base_layer || top_layer->snapshot_count > 0) {
+    top_layer = new Layer(top_layer);
+  }
+
+  // The matches are sorted, so the changes can be built directly in both
+  // directions, with the new text of each replacement as the old text of its
+  // inverted change.
+  vector<Text> texts;
+  vector<Patch::Change> changes, inverted_changes;
+  texts.reserve(3 * replacements.size());
+  changes.reserve(replacements.size());
+  inverted_changes.reserve(replacements.size());
+  uint32_t size = top_layer->size_;
+  Point previous_old_end, previous_new_end;
+  for (Replacement &replacement : replacements) {
+    ClipResult start = clip_position(replacement.range.start);
+    ClipResult end = clip_position(replacement.range.end);
+    texts.push_back(Text{replacement.new_text});
+    Text *new_text = &texts.back();
+    texts.push_back(Text{replacement.old_text});
+    Text *old_text = &texts.back();
+    texts.push_back(Text{move(replacement.new_text)});
+    Point new_start = previous_new_end.traverse(start.position.traversal(previous_old_end));
+    Point new_end = new_start.traverse(new_text->extent());
+    changes.push_back(Patch::Change{
+      start.position, end.position,
+      new_start, new_end,
+      nullptr, &texts.back(),
+      0, 0, end.offset - start.offset
+    });
+    inverted_changes.push_back(Patch::Change{
+      new_start, new_end,
+      start.position, end.position,
+      new_text, old_text,
+      0, 0, 0
+    });
+    size += new_text->size() - (end.offset - start.offset);
+    previous_old_end = end.position;
+    previous_new_end = new_end;
+  }
+  result.inverted_changes = Patch::from_sorted_changes(inverted_changes);
+
+  // Combine all of the replacements into the top layer at once, then remove
+  // any of the resulting changes that restore the previous layer's text, as
+  // splice_top_layer does for a single change.
+  top_layer->patch.combine(Patch::from_sorted_changes(changes));
+  top_layer->extent_ = previous_new_end.traverse(top_layer->extent_.traversal(previous_old_end));
+  top_layer->size_ = size;
+  Point checked_end;
+  for (const Patch::Change &change : changes) {
+    if (change.new_start < checked_end) continue;
+    remove_top_layer_noop_change(change.new_start);
+    auto combined_change = top_layer->patch.grab_change_starting_before_new_position(change.new_start);
+    checked_end = combined_change ? std::max(combined_change->new_end, change.new_end) : change.new_end;
+  }
+
+  // Live searches are updated once, over the range spanning every replacement.
+  Point start = changes.front().old_start;
+  for (LiveSearch *live_search : live_searches) {
+    live_search->splice(
+      start,
+      previous_old_end.traversal(start),
+      previous_new_end.traversal(start)
+    );
+  }
+
+  return result;
 }
 
 vector<Range> TextBuffer::find_all(const Regex &regex, Range range) const {
-  return top_layer->find_all_in_range(regex, range, false);
+  return find_all(regex, *SearchContext::acquire(), range);
+}
+
+vector<Range> TextBuffer::find_all(const Regex &regex, SearchContext &context, Range range) const {
+  auto search_ranges = indexed_search_ranges(regex, range);
+  if (!search_ranges) return top_layer->find_all_in_range(regex, context, range, false);
+
+  vector<Range> result;
+  for (Range search_range : *search_ranges) {
+    auto matches = top_layer->find_all_in_range(regex, context, search_range, false);
+    result.insert(result.end(), matches.begin(), matches.end());
+  }
+  return result;
+}
+
+optional<Range> TextBuffer::find_backward(const Regex &regex, Range range) const {
+  return top_layer->find_backward_in_range(regex, *SearchContext::acquire(), range, false);
+}
+
+TextBuffer::CountAllResult TextBuffer::count_all(const Regex &regex, Range range,
+                                                 optional<uint32_t> limit) const {
+  auto context = SearchContext::acquire();
+  uint32_t remaining_count = limit ? *limit : UINT32_MAX;
+  auto search_ranges = indexed_search_ranges(regex, range);
+  if (!search_ranges) return top_layer->count_in_range(regex, *context, range, remaining_count, false);
+
+  CountAllResult result{0, SearchStatus::Completed};
+  for (Range search_range : *search_ranges) {
+    auto range_result = top_layer->count_in_range(regex, *context, search_range, remaining_count, false);
+    result.count += range_result.count;
+    remaining_count -= range_result.count;
+    result.status = range_result.status;
+    if (result.status != SearchStatus::Completed || remaining_count == 0) break;
+  }
+  return result;
+}
+
+void TextBuffer::build_trigram_index() {
+  trigram_index.reset(new TrigramIndex(*base_layer->text));
+}
+
+bool TextBuffer::install_trigram_index(TrigramIndex &&index, const Snapshot &snapshot) {
+  if (&snapshot.base_layer != base_layer) return false;
+  trigram_index.reset(new TrigramIndex(move(index)));
+  return true;
+}
+
+void TextBuffer::clear_trigram_index() {
+  trigram_index.reset();
+}
+
+bool TextBuffer::has_trigram_index() const {
+  return static_cast<bool>(trigram_index);
+}
+
+// Describes the changes of a patch in terms of the rows they touch. Changes
+// that touch the same row are merged.
+static vector<TrigramIndex::RowSplice> row_splices_for_patch(const Patch &patch) {
+  vector<TrigramIndex::RowSplice> result;
+  for (const Patch::Change &change : patch.get_changes()) {
+    if (!result.empty() && change.old_start.row < result.back().old_end_row) {
+      result.back().old_end_row = change.old_end.row + 1;
+      result.back().new_end_row = change.new_end.row + 1;
+    } else {
+      result.push_back({change.old_start.row, change.old_end.row + 1, change.new_start.row, change.new_end.row + 1});
+    }
+  }
+  return result;
+}
+
+// Combines the row splices from a text A to a text B with the row splices
+// from B to a text C into row splices from A to C. Splices that touch the
+// same rows of B are merged, so each result spans whole splices of both
+// inputs and its bounds can be mapped through the unchanged rows around it.
+static vector<TrigramIndex::RowSplice> compose_row_splices(
+  const vector<TrigramIndex::RowSplice> &first, const vector<TrigramIndex::RowSplice> &second) {
+  if (first.empty()) return second;
+  if (second.empty()) return first;
+
+  vector<TrigramIndex::RowSplice> result;
+  auto first_iter = first.begin(), second_iter = second.begin();
+  int64_t first_delta = 0, second_delta = 0;
+  while (first_iter != first.end() || second_iter != second.end()) {
+    // Gather the splices that overlap or touch, in rows of B.
+    uint32_t start_row, end_row;
+    if (second_iter == second.end() ||
+        (first_iter != first.end() && first_iter->new_start_row < second_iter->old_start_row)) {
+      start_row = first_iter->new_start_row;
+      end_row = first_iter->new_end_row;
+    } else {
+      start_row = second_iter->old_start_row;
+      end_row = second_iter->old_end_row;
+    }
+    int64_t start_first_delta = first_delta, start_second_delta = second_delta;
+    for (;;) {
+      if (first_iter != first.end() && first_iter->new_start_row <= end_row) {
+        end_row = std::max(end_row, first_iter->new_end_row);
+        first_delta = int64_t(first_iter->new_end_row) - first_iter->old_end_row;
+        ++first_iter;
+      } else if (second_iter != second.end() && second_iter->old_start_row <= end_row) {
+        end_row = std::max(end_row, second_iter->old_end_row);
+        second_delta = int64_t(second_iter->new_end_row) - second_iter->old_end_row;
+        ++second_iter;
+      } else {
+        break;
+      }
+    }
+
+    result.push_back({
+      uint32_t(start_row - start_first_delta),
+      uint32_t(end_row - first_delta),
+      uint32_t(start_row + start_second_delta),
+      uint32_t(end_row + second_delta)
+    });
+  }
+  return result;
+}
+
+// Describes the changes between two layers in terms of the rows they touch.
+vector<TrigramIndex::RowSplice> TextBuffer::row_splices_between(const Layer &base, const Layer &layer) const {
+  vector<const Layer *> layers;
+  for (const Layer *current = &layer; current != &base; current = current->previous_layer) {
+    layers.push_back(current);
+  }
+
+  vector<TrigramIndex::RowSplice> result;
+  for (auto iter = layers.rbegin(); iter != layers.rend(); ++iter) {
+    result = compose_row_splices(result, row_splices_for_patch((*iter)->patch));
+  }
+  return result;
+}
+
+// Returns the parts of the given range that can contain matches according to
+// the trigram index, or an empty optional if the index can't be used for this
+// regex. The index only applies to regexes whose matches lie within a single
+// row, so each candidate row can be searched on its own.
+optional<vector<Range>> TextBuffer::indexed_search_ranges(const Regex &regex, Range range) const {
+  if (!trigram_index) return optional<vector<Range>>{};
+  auto literal = regex.required_literal();
+  if (!literal) return optional<vector<Range>>{};
+  auto base_rows = trigram_index->candidate_rows(*literal);
+  if (!base_rows) return optional<vector<Range>>{};
+
+  // Translate the candidate rows of the base text into rows of the current
+  // text. Rows touched by unflushed changes are always searched.
+  vector<uint32_t> rows;
+  auto row_splices = row_splices_between(*base_layer, *top_layer);
+  auto splice = row_splices.begin();
+  for (uint32_t row : *base_rows) {
+    while (splice != row_splices.end() && splice->old_end_row <= row) {
+      for (uint32_t new_row = splice->new_start_row; new_row < splice->new_end_row; new_row++) {
+        rows.push_back(new_row);
+      }
+      ++splice;
+    }
+    if (splice != row_splices.end() && splice->old_start_row <= row) continue;
+    if (splice == row_splices.begin()) {
+      rows.push_back(row);
+    } else {
+      rows.push_back(row - (splice - 1)->old_end_row + (splice - 1)->new_end_row);
+    }
+  }
+  for (; splice != row_splices.end(); ++splice) {
+    for (uint32_t new_row = splice->new_start_row; new_row < splice->new_end_row; new_row++) {
+      rows.push_back(new_row);
+    }
+  }
+
+  range.start = top_layer->clip_position(range.start).position;
+  range.end = top_layer->clip_position(range.end).position;
+  vector<Range> result;
+  for (size_t i = 0; i < rows.size();) {
+    size_t j = i + 1;
+    while (j < rows.size() && rows[j] == rows[j - 1] + 1) j++;
+    Range search_range{
+      std::max(range.start, Point(rows[i], 0)),
+      std::min(range.end, Point(rows[j - 1] + 1, 0))
+    };
+    if (search_range.start < search_range.end) result.push_back(search_range);
+    i = j;
+  }
+  return result;
+}
+
+TextBuffer::SearchStatus TextBuffer::scan(const Regex &regex, Range range,
+                                          const std::function<bool(Range)> &callback,
+                                          const std::function<bool()> &is_cancelled) const {
+  auto context = SearchContext::acquire();
+  return top_layer->scan_in_range(
+    regex, context->match_data_for(regex), context->empty_chunk_continuation(),
+    range, callback, false, is_cancelled
+  );
+}
+
+vector<pair<Range, uint32_t>> TextBuffer::find_all_multi(const vector<const Regex *> &regexes, Range range) const {
+  return top_layer->find_all_multi_in_range(regexes, range, false);
 }
 
 unsigned TextBuffer::find_and_mark_all(MarkerIndex &index, MarkerIndex::MarkerId next_id,
                                        bool exclusive, const Regex &regex, Range range) const {
-  return top_layer->find_and_mark_all_in_range(index, next_id, exclusive, regex, range, false);
+  return find_and_mark_all(index, next_id, exclusive, regex, *SearchContext::acquire(), range);
+}
+
+unsigned TextBuffer::find_and_mark_all(MarkerIndex &index, MarkerIndex::MarkerId next_id, bool exclusive,
+                                       const Regex &regex, SearchContext &context, Range range) const {
+  return top_layer->find_and_mark_all_in_range(index, next_id, exclusive, regex, context, range, false);
 }
 
 bool TextBuffer::SubsequenceMatch::operator==(const SubsequenceMatch &other) const {
@@ -1012,10 +1679,17 @@ TextBuffer::Snapshot *TextBuffer::create_snapshot() {
   return new Snapshot(*this, *top_layer, *base_layer);
 }
 
+TextBuffer::LiveSearch *TextBuffer::create_live_search(std::shared_ptr<const Regex> regex) {
+  return new LiveSearch(*this, move(regex));
+}
+
 void TextBuffer::flush_changes() {
   if (!top_layer->text) {
+    vector<TrigramIndex::RowSplice> row_splices;
+    if (trigram_index) row_splices = row_splices_between(*base_layer, *top_layer);
     top_layer->text = Text{text()};
     base_layer = top_layer;
+    if (trigram_index) trigram_index->update(row_splices, *top_layer->text);
     consolidate_layers();
   }
 }
@@ -1053,11 +1727,30 @@ vector<pair<const char16_t *, uint32_t>> TextBuffer::Snapshot::primitive_chunks(
 }
 
 optional<Range> TextBuffer::Snapshot::find(const Regex &regex, Range range) const {
-  return layer.find_in_range(regex, range, false);
+  return layer.find_in_range(regex, *SearchContext::acquire(), range, false);
 }
 
 vector<Range> TextBuffer::Snapshot::find_all(const Regex &regex, Range range) const {
-  return layer.find_all_in_range(regex, range, false);
+  return layer.find_all_in_range(regex, *SearchContext::acquire(), range, false);
+}
+
+TextBuffer::CountAllResult TextBuffer::Snapshot::count_all(const Regex &regex, Range range,
+                                                           optional<uint32_t> limit) const {
+  return layer.count_in_range(regex, *SearchContext::acquire(), range, limit ? *limit : UINT32_MAX, false);
+}
+
+TextBuffer::SearchStatus TextBuffer::Snapshot::scan(const Regex &regex, Range range,
+                                                    const std::function<bool(Range)> &callback,
+                                                    const std::function<bool()> &is_cancelled) const {
+  auto context = SearchContext::acquire();
+  return layer.scan_in_range(
+    regex, context->match_data_for(regex), context->empty_chunk_continuation(),
+    range, callback, false, is_cancelled
+  );
+}
+
+vector<pair<Range, uint32_t>> TextBuffer::Snapshot::find_all_multi(const vector<const Regex *> &regexes, Range range) const {
+  return layer.find_all_multi_in_range(regexes, range, false);
 }
 
 vector<SubsequenceMatch> TextBuffer::Snapshot::find_words_with_subsequence_in_range(std::u16string query, const std::u16string &extra_word_characters, Range range) const {
@@ -1068,6 +1761,10 @@ const Text &TextBuffer::Snapshot::base_text() const {
   return *base_layer.text;
 }
 
+TrigramIndex TextBuffer::Snapshot::build_trigram_index() const {
+  return TrigramIndex(*base_layer.text);
+}
+
 TextBuffer::Snapshot::Snapshot(TextBuffer &buffer, TextBuffer::Layer &layer,
                                TextBuffer::Layer &base_layer)
   : buffer{buffer}, layer{layer}, base_layer{base_layer} {}
@@ -1075,7 +1772,12 @@ TextBuffer::Snapshot::Snapshot(TextBuffer &buffer, TextBuffer::Layer &layer,
 void TextBuffer::Snapshot::flush_preceding_changes() {
   if (!layer.text) {
     layer.text = Text{text()};
-    if (layer.is_above_layer(buffer.base_layer)) buffer.base_layer = &layer;
+    if (layer.is_above_layer(buffer.base_layer)) {
+      vector<TrigramIndex::RowSplice> row_splices;
+      if (buffer.trigram_index) row_splices = buffer.row_splices_between(*buffer.base_layer, layer);
+      buffer.base_layer = &layer;
+      if (buffer.trigram_index) buffer.trigram_index->update(row_splices, *layer.text);
+    }
     buffer.consolidate_layers();
   }
 }
@@ -1089,6 +1791,200 @@ TextBuffer::Snapshot::~Snapshot() {
   }
 }
 
+TextBuffer::LiveSearch::LiveSearch(TextBuffer &buffer, std::shared_ptr<const Regex> regex) :
+  buffer{&buffer},
+  regex{move(regex)},
+  next_id{0},
+  match_count_{0} {
+  buffer.live_searches.push_back(this);
+  search_in_range(Range{Point(), buffer.extent()});
+}
+
+TextBuffer::LiveSearch::~LiveSearch() {
+  if (buffer) {
+    auto &live_searches = buffer->live_searches;
+    live_searches.erase(std::find(live_searches.begin(), live_searches.end(), this));
+  }
+}
+
+size_t TextBuffer::LiveSearch::match_count() const {
+  return match_count_;
+}
+
+Range TextBuffer::LiveSearch::get_range(MarkerIndex::MarkerId id) const {
+  return index.get_range(id);
+}
+
+vector<MarkerIndex::MarkerId> TextBuffer::LiveSearch::find_intersecting(Range range) {
+  auto ids = index.find_intersecting(range.start, range.end);
+  return vector<MarkerIndex::MarkerId>(ids.begin(), ids.end());
+}
+
+TextBuffer::LiveSearch::Changes TextBuffer::LiveSearch::take_changes() {
+  Changes result{
+    vector<MarkerIndex::MarkerId>(added_ids.begin(), added_ids.end()),
+    vector<MarkerIndex::MarkerId>(removed_ids.begin(), removed_ids.end())
+  };
+  added_ids = MarkerIndex::MarkerIdSet();
+  removed_ids = MarkerIndex::MarkerIdSet();
+  return result;
+}
+
+void TextBuffer::LiveSearch::add_match(Range range) {
+  MarkerIndex::MarkerId id = next_id++;
+  index.insert(id, range.start, range.end);
+  index.set_exclusive(id, true);
+  added_ids.insert(id);
+  match_count_++;
+}
+
+void TextBuffer::LiveSearch::remove_match(MarkerIndex::MarkerId id) {
+  index.remove(id);
+  if (added_ids.count(id)) {
+    added_ids.erase(id);
+  } else {
+    removed_ids.insert(id);
+  }
+  match_count_--;
+}
+
+void TextBuffer::LiveSearch::splice(Point start, Point deleted_extent, Point inserted_extent) {
+  index.splice(start, deleted_extent, inserted_extent);
+
+  // Include the preceding line, so that matches spanning a line ending can
+  // start before the change.
+  Point search_start{start.row > 0 ? start.row - 1 : 0, 0};
+  search_in_range(Range{search_start, start.traverse(inserted_extent)});
+}
+
+void TextBuffer::LiveSearch::search_in_range(Range range) {
+  if (!buffer || !regex) return;
+  Layer &layer = *buffer->top_layer;
+  Point extent = layer.extent();
+
+  // Search whole lines, including the line ending of the last line, since an
+  // edit can combine a CR and an LF into a single line ending. Start early
+  // enough to find any match that contains the start of the range.
+  range.start = Point(range.start.row, 0);
+  range.end = range.end.row < extent.row ? Point(range.end.row + 1, 0) : extent;
+  for (;;) {
+    Point search_start = range.start;
+    for (MarkerIndex::MarkerId id : index.find_intersecting(range.start, range.start)) {
+      Point marker_start = index.get_start(id);
+      if (marker_start < search_start && index.get_end(id) > range.start) {
+        search_start = Point(marker_start.row, 0);
+      }
+    }
+    if (search_start == range.start) break;
+    range.start = search_start;
+  }
+
+  // Once the search reaches a match that starts after the range and after
+  // the end of every match that overlaps the range, both before and after
+  // the change, the remaining matches are unaffected by the change.
+  auto context = SearchContext::acquire();
+  vector<Range> matches;
+  Point stop = range.end;
+  bool resynchronized = false;
+  Range first_unaffected_match;
+  auto extend_stop_past_previous_matches = [&]() {
+    for (;;) {
+      Point new_stop = stop;
+      for (MarkerIndex::MarkerId id : index.find_intersecting(range.start, stop)) {
+        if (index.get_start(id) < stop && index.get_end(id) > new_stop) new_stop = index.get_end(id);
+      }
+      if (new_stop == stop) break;
+      stop = new_stop;
+    }
+  };
+  extend_stop_past_previous_matches();
+
+  if (range.start == Point() && range.end == extent) {
+    // When searching the entire buffer, there is nothing to resynchronize
+    // with, and any previous matches past the end of the text are removed.
+    matches = layer.find_all_in_range(*regex, *context, range, false);
+  } else {
+    // The text is searched in windows of lines that grow exponentially, so
+    // that we usually don't scan much past the end of the range. Like the rest
+    // of this method, this assumes that matches span at most one line ending,
+    // so the last line of each window is searched again as part of the next.
+    Point window_start = range.start;
+    uint32_t window_row_count = 2;
+    for (;;) {
+      Point window_end = window_start.row + window_row_count > extent.row ?
+        extent :
+        Point(window_start.row + window_row_count, 0);
+
+      bool truncated = false;
+      for (const Range &match : layer.find_all_in_range(*regex, *context, Range{window_start, window_end}, false)) {
+        if (!matches.empty() && (match.start < matches.back().end || match == matches.back())) continue;
+
+        // A match that reaches the end of the window might continue past it.
+        if (match.end == window_end && window_end != extent) {
+          window_start = match.start;
+          truncated = true;
+          break;
+        }
+
+        if (match.start >= stop) {
+          resynchronized = true;
+          first_unaffected_match = match;
+          break;
+        }
+
+        matches.push_back(match);
+        if (match.end > stop) {
+          stop = match.end;
+          extend_stop_past_previous_matches();
+        }
+      }
+
+      if (resynchronized || (window_end == extent && !truncated)) break;
+      if (!truncated) {
+        window_start = Point(window_end.row - 1, 0);
+        if (!matches.empty() && matches.back().end > window_start) window_start = matches.back().end;
+      }
+      window_row_count *= 2;
+    }
+  }
+
+  // Replace the previous matches in the searched range with the new ones,
+  // keeping the markers for matches that didn't change.
+  vector<pair<Range, MarkerIndex::MarkerId>> previous_matches;
+  for (MarkerIndex::MarkerId id : index.find_intersecting(range.start, resynchronized ? stop : Point::max())) {
+    Range marker_range = index.get_range(id);
+    if (marker_range.end == range.start && marker_range.start < range.start) continue;
+    if (resynchronized && marker_range == first_unaffected_match) continue;
+    previous_matches.push_back({marker_range, id});
+  }
+  std::sort(previous_matches.begin(), previous_matches.end(), [](
+    const pair<Range, MarkerIndex::MarkerId> &a,
+    const pair<Range, MarkerIndex::MarkerId> &b
+  ) {
+    if (a.first.start != b.first.start) return a.first.start < b.first.start;
+    return a.first.end < b.first.end;
+  });
+
+  auto previous_match = previous_matches.begin();
+  for (const Range &match : matches) {
+    while (previous_match != previous_matches.end() &&
+           (previous_match->first.start < match.start ||
+            (previous_match->first.start == match.start && previous_match->first.end < match.end))) {
+      remove_match(previous_match->second);
+      ++previous_match;
+    }
+
+    if (previous_match != previous_matches.end() && previous_match->first == match) {
+      ++previous_match;
+    } else {
+      add_match(match);
+    }
+  }
+  for (; previous_match != previous_matches.end(); ++previous_match) {
+    remove_match(previous_match->second);
+  }
+}
+
 void TextBuffer::consolidate_layers() {
   Layer *layer = top_layer;
   vector<Layer *> mutable_layers;
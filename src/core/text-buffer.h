@@ -1,6 +1,8 @@
 #ifndef SUPERSTRING_TEXT_BUFFER_H_
 #define SUPERSTRING_TEXT_BUFFER_H_
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include "text.h"
@@ -9,6 +11,8 @@
 #include "range.h"
 #include "regex.h"
 #include "marker-index.h"
+#include "search-context.h"
+#include "trigram-index.h"
 
 class TextBuffer {
   struct Layer;
@@ -16,10 +20,24 @@ class TextBuffer {
   Layer *top_layer;
   void squash_layers(const std::vector<Layer *> &);
   void consolidate_layers();
+  void splice_top_layer(ClipResult start, ClipResult end, Text &&new_text);
+  void remove_top_layer_noop_change(Point);
+  std::vector<TrigramIndex::RowSplice> row_splices_between(const Layer &base, const Layer &layer) const;
+  optional<std::vector<Range>> indexed_search_ranges(const Regex &, Range) const;
 
 public:
   static uint32_t MAX_CHUNK_SIZE_TO_COPY;
 
+  // How a search ended. Searches stop at the first match attempt that fails,
+  // which is reported as `LimitExceeded` if it ran into one of the limits
+  // configured with `Regex::set_default_limits` or `Regex::set_jit_stack_size`.
+  enum class SearchStatus {
+    Completed,
+    LimitExceeded,
+    Failed,
+    Cancelled
+  };
+
   TextBuffer();
   TextBuffer(std::u16string &&);
   TextBuffer(const std::u16string &text);
@@ -45,7 +63,10 @@ public:
   bool has_astral();
   std::vector<TextSlice> chunks() const;
 
+  // Replaces the text of the buffer, discarding any trigram index of the old
+  // text. The second overload installs the given index of the new text.
   void reset(Text &&);
+  void reset(Text &&, TrigramIndex &&);
   void flush_changes();
   void serialize_changes(Serializer &);
   bool deserialize_changes(Deserializer &);
@@ -53,8 +74,54 @@ public:
 
   optional<Range> find(const Regex &, Range range = Range::all_inclusive()) const;
   std::vector<Range> find_all(const Regex &, Range range = Range::all_inclusive()) const;
+
+  // These overloads reuse the buffers of the given context rather than taking
+  // them from the current thread's pool, which suits callers that search
+  // many times in a row.
+  optional<Range> find(const Regex &, SearchContext &, Range range = Range::all_inclusive()) const;
+  std::vector<Range> find_all(const Regex &, SearchContext &, Range range = Range::all_inclusive()) const;
+
+  // Finds the last match in the given range, searching backward from its end
+  // so that the cost depends on the distance to the match rather than on the
+  // size of the range.
+  optional<Range> find_backward(const Regex &, Range range = Range::all_inclusive()) const;
+
+  struct CountAllResult {
+    uint32_t count;
+    SearchStatus status;
+  };
+
+  // Counts the matches in the given range without collecting them, stopping
+  // once `limit` matches have been found. If the search stops early for any
+  // other reason, the status says why and the count only covers the matches
+  // found before that.
+  CountAllResult count_all(const Regex &, Range range = Range::all_inclusive(),
+                           optional<uint32_t> limit = optional<uint32_t>{}) const;
+  SearchStatus scan(const Regex &, Range, const std::function<bool(Range)> &,
+                    const std::function<bool()> &is_cancelled = std::function<bool()>()) const;
+
+  // Finds the matches of several patterns in one pass. Each result pairs a
+  // match with the index of the pattern that produced it. As with a single
+  // alternation of all the patterns, matches don't overlap: at each position,
+  // the first pattern that matches there wins.
+  std::vector<std::pair<Range, uint32_t>> find_all_multi(const std::vector<const Regex *> &,
+                                                         Range range = Range::all_inclusive()) const;
+  struct ReplaceAllResult {
+    uint32_t replacement_count;
+    Patch inverted_changes;
+  };
+
+  // Replaces every match of the regex in the given range. In the replacement,
+  // `$1`...`$99` insert capture groups, `$&` inserts the whole match and `$$`
+  // inserts a dollar sign. Matches whose replacement is identical to the
+  // matched text are left alone and not counted. The returned patch reverts
+  // the replacements when applied to the new text.
+  ReplaceAllResult replace_all(const Regex &, const std::u16string &replacement,
+                               Range range = Range::all_inclusive());
   unsigned find_and_mark_all(MarkerIndex &, MarkerIndex::MarkerId, bool exclusive,
                              const Regex &, Range range = Range::all_inclusive()) const;
+  unsigned find_and_mark_all(MarkerIndex &, MarkerIndex::MarkerId, bool exclusive,
+                             const Regex &, SearchContext &, Range range = Range::all_inclusive()) const;
 
   struct SubsequenceMatch {
     std::u16string word;
@@ -66,6 +133,20 @@ public:
 
   std::vector<SubsequenceMatch> find_words_with_subsequence_in_range(const std::u16string &, const std::u16string &, Range) const;
 
+  // An optional trigram index of the base text lets `find`, `find_all` and
+  // `count_all` only search the rows that contain a regex's required literal.
+  // Unflushed changes are accounted for by always searching the changed rows,
+  // and the index is updated incrementally whenever changes are flushed.
+  void build_trigram_index();
+  void clear_trigram_index();
+  bool has_trigram_index() const;
+
+  class Snapshot;
+
+  // Installs an index built by `Snapshot::build_trigram_index`, unless the
+  // base text has changed since the snapshot was taken.
+  bool install_trigram_index(TrigramIndex &&, const Snapshot &);
+
   class Snapshot {
     friend class TextBuffer;
     TextBuffer &buffer;
@@ -87,19 +168,76 @@ public:
     std::u16string text() const;
     std::u16string text_in_range(Range) const;
     const Text &base_text() const;
+
+    // Indexes the base text of this snapshot. Like other snapshot methods,
+    // this can be called from a background thread.
+    TrigramIndex build_trigram_index() const;
     optional<Range> find(const Regex &, Range range = Range::all_inclusive()) const;
     std::vector<Range> find_all(const Regex &, Range range = Range::all_inclusive()) const;
+    CountAllResult count_all(const Regex &, Range range = Range::all_inclusive(),
+                             optional<uint32_t> limit = optional<uint32_t>{}) const;
+
+    // Calls the given callback with each match in turn, stopping early if the
+    // callback returns true. This allows matches to be consumed as they are
+    // found rather than after the whole range has been searched. If given,
+    // `is_cancelled` is polled as the search proceeds, and the search stops
+    // with a `Cancelled` status once it returns true.
+    SearchStatus scan(const Regex &, Range, const std::function<bool(Range)> &,
+                      const std::function<bool()> &is_cancelled = std::function<bool()>()) const;
+    std::vector<std::pair<Range, uint32_t>> find_all_multi(const std::vector<const Regex *> &,
+                                                           Range range = Range::all_inclusive()) const;
     std::vector<SubsequenceMatch> find_words_with_subsequence_in_range(std::u16string query, const std::u16string &extra_word_characters, Range range) const;
   };
 
   friend class Snapshot;
   Snapshot *create_snapshot();
 
+  // Keeps the matches of a regex in a MarkerIndex up to date as the buffer
+  // changes. After each edit, only the lines surrounding the change are
+  // searched again. The ids of markers that were added or removed since the
+  // last call to `take_changes` are accumulated, so clients can update their
+  // highlights without looking at every match.
+  class LiveSearch {
+    friend class TextBuffer;
+    TextBuffer *buffer;
+    std::shared_ptr<const Regex> regex;
+    MarkerIndex index;
+    MarkerIndex::MarkerId next_id;
+    size_t match_count_;
+    MarkerIndex::MarkerIdSet added_ids;
+    MarkerIndex::MarkerIdSet removed_ids;
+
+    LiveSearch(TextBuffer &, std::shared_ptr<const Regex>);
+    void splice(Point start, Point deleted_extent, Point inserted_extent);
+    void search_in_range(Range);
+    void add_match(Range);
+    void remove_match(MarkerIndex::MarkerId);
+
+  public:
+    struct Changes {
+      std::vector<MarkerIndex::MarkerId> added;
+      std::vector<MarkerIndex::MarkerId> removed;
+    };
+
+    ~LiveSearch();
+    size_t match_count() const;
+    Range get_range(MarkerIndex::MarkerId) const;
+    std::vector<MarkerIndex::MarkerId> find_intersecting(Range);
+    Changes take_changes();
+  };
+
+  LiveSearch *create_live_search(std::shared_ptr<const Regex>);
+
   bool is_modified(const Snapshot *) const;
   Patch get_inverted_changes(const Snapshot *) const;
 
   size_t layer_count()  const;
   std::string get_dot_graph() const;
+
+private:
+  friend class LiveSearch;
+  std::vector<LiveSearch *> live_searches;
+  std::unique_ptr<TrigramIndex> trigram_index;
 };
 
 #endif  // SUPERSTRING_TEXT_BUFFER_H_
@@ -1,6 +1,11 @@
 #include "text-diff.h"
 #include "libmba-diff.h"
 #include "text-slice.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <string.h>
 #include <ostream>
@@ -18,28 +23,528 @@ static Point previous_column(Point position) {
 
 static int MAX_EDIT_DISTANCE = 4 * 1024;
 
-Patch text_diff(const Text &old_text, const Text &new_text) {
-  Patch result;
-  Text empty;
-  Text cr{u"\r"};
-  Text lf{u"\n"};
+// Lines that occur more often than this in a region are too common to anchor
+// the line diff there.
+static const uint32_t MAX_LINE_OCCURRENCES = 64;
 
+static const uint32_t NO_LINE = UINT32_MAX;
+
+// Texts are only split into segments that are diffed concurrently when the
+// segments would have at least this many lines.
+static const uint32_t MIN_SEGMENT_ROW_COUNT = 16 * 1024;
+
+// Each thread diffs this many segments on average, so that threads that are
+// given segments with fewer changes don't sit idle.
+static const uint32_t SEGMENTS_PER_THREAD = 4;
+
+// The number of lines that are considered for the anchor line that ends each
+// segment.
+static const uint32_t ANCHOR_CANDIDATE_ROW_COUNT = 256;
+
+struct Line {
+  const char16_t *data;
+  uint32_t length;
+};
+
+struct LineHash {
+  size_t operator()(const Line &line) const {
+    size_t result = 2166136261u;
+    for (uint32_t i = 0; i < line.length; i++) {
+      result = (result ^ line.data[i]) * 16777619u;
+    }
+    return result;
+  }
+};
+
+struct LineEqual {
+  bool operator()(const Line &a, const Line &b) const {
+    return a.length == b.length && memcmp(a.data, b.data, a.length * sizeof(char16_t)) == 0;
+  }
+};
+
+using LineIds = std::unordered_map<Line, uint32_t, LineHash, LineEqual>;
+
+static uint32_t line_offset(const Text &text, uint32_t row) {
+  return row < text.line_offsets.size() ? text.line_offsets[row] : text.size();
+}
+
+// Identifies each line in the given rows, including its newline, by the
+// content it has, so that lines can be compared as integers.
+static vector<uint32_t> get_line_ids(const Text &text, uint32_t start_row, uint32_t end_row,
+                                     LineIds &line_ids) {
+  vector<uint32_t> result;
+  result.reserve(end_row - start_row);
+  for (uint32_t row = start_row; row < end_row; row++) {
+    uint32_t start = line_offset(text, row);
+    Line line{text.data() + start, line_offset(text, row + 1) - start};
+    auto entry = line_ids.emplace(line, line_ids.size());
+    result.push_back(entry.first->second);
+  }
+  return result;
+}
+
+struct LineRange {
+  uint32_t old_start;
+  uint32_t old_end;
+  uint32_t new_start;
+  uint32_t new_end;
+};
+
+// Finds runs of matching lines with a histogram diff. Each region is split at
+// the longest run that contains the rarest lines in the region, and then the
+// lines before and after that run are matched in the same way. Regions without
+// a line that is rare enough are diffed line by line instead.
+static vector<LineRange> match_lines(const vector<uint32_t> &old_lines,
+                                     const vector<uint32_t> &new_lines,
+                                     uint32_t line_id_count) {
+  vector<LineRange> result;
+  vector<uint32_t> occurrence_counts(line_id_count, 0);
+  vector<uint32_t> last_occurrences(line_id_count, NO_LINE);
+  vector<uint32_t> previous_occurrences(old_lines.size(), NO_LINE);
   vector<diff_edit> edit_script;
+  vector<LineRange> regions{
+    LineRange{0, static_cast<uint32_t>(old_lines.size()), 0, static_cast<uint32_t>(new_lines.size())}
+  };
+
+  while (!regions.empty()) {
+    LineRange region = regions.back();
+    regions.pop_back();
+
+    uint32_t prefix_length = 0;
+    while (region.old_start + prefix_length < region.old_end &&
+           region.new_start + prefix_length < region.new_end &&
+           old_lines[region.old_start + prefix_length] == new_lines[region.new_start + prefix_length]) {
+      prefix_length++;
+    }
+    if (prefix_length > 0) {
+      result.push_back(LineRange{
+        region.old_start, region.old_start + prefix_length,
+        region.new_start, region.new_start + prefix_length
+      });
+      region.old_start += prefix_length;
+      region.new_start += prefix_length;
+    }
+
+    uint32_t suffix_length = 0;
+    while (region.old_start + suffix_length < region.old_end &&
+           region.new_start + suffix_length < region.new_end &&
+           old_lines[region.old_end - suffix_length - 1] == new_lines[region.new_end - suffix_length - 1]) {
+      suffix_length++;
+    }
+    if (suffix_length > 0) {
+      result.push_back(LineRange{
+        region.old_end - suffix_length, region.old_end,
+        region.new_end - suffix_length, region.new_end
+      });
+      region.old_end -= suffix_length;
+      region.new_end -= suffix_length;
+    }
+
+    if (region.old_start == region.old_end || region.new_start == region.new_end) continue;
 
+    for (uint32_t i = region.old_start; i < region.old_end; i++) {
+      uint32_t line = old_lines[i];
+      previous_occurrences[i] = last_occurrences[line];
+      last_occurrences[line] = i;
+      occurrence_counts[line]++;
+    }
+
+    LineRange best_run{0, 0, 0, 0};
+    uint32_t best_run_count = MAX_LINE_OCCURRENCES;
+    for (uint32_t j = region.new_start; j < region.new_end;) {
+      uint32_t line = new_lines[j];
+      uint32_t next_j = j + 1;
+      if (occurrence_counts[line] > 0 && occurrence_counts[line] <= best_run_count) {
+        for (uint32_t i = last_occurrences[line]; i != NO_LINE; i = previous_occurrences[i]) {
+          LineRange run{i, i + 1, j, j + 1};
+          uint32_t run_count = occurrence_counts[line];
+          while (run.old_start > region.old_start && run.new_start > region.new_start &&
+                 old_lines[run.old_start - 1] == new_lines[run.new_start - 1]) {
+            run.old_start--;
+            run.new_start--;
+            run_count = std::min(run_count, occurrence_counts[old_lines[run.old_start]]);
+          }
+          while (run.old_end < region.old_end && run.new_end < region.new_end &&
+                 old_lines[run.old_end] == new_lines[run.new_end]) {
+            run_count = std::min(run_count, occurrence_counts[old_lines[run.old_end]]);
+            run.old_end++;
+            run.new_end++;
+          }
+
+          if (run.old_end - run.old_start > best_run.old_end - best_run.old_start ||
+              run_count < best_run_count) {
+            best_run = run;
+            best_run_count = run_count;
+          }
+          next_j = std::max(next_j, run.new_end);
+        }
+      }
+      j = next_j;
+    }
+
+    for (uint32_t i = region.old_start; i < region.old_end; i++) {
+      uint32_t line = old_lines[i];
+      last_occurrences[line] = NO_LINE;
+      occurrence_counts[line] = 0;
+    }
+
+    if (best_run.old_start == best_run.old_end) {
+      edit_script.clear();
+      int edit_distance = diff(
+        old_lines.data() + region.old_start,
+        region.old_end - region.old_start,
+        new_lines.data() + region.new_start,
+        region.new_end - region.new_start,
+        MAX_EDIT_DISTANCE,
+        &edit_script
+      );
+      if (edit_distance == -1 || edit_distance >= MAX_EDIT_DISTANCE) continue;
+
+      uint32_t old_line = region.old_start, new_line = region.new_start;
+      for (const diff_edit &edit : edit_script) {
+        switch (edit.op) {
+          case DIFF_MATCH:
+            if (edit.len > 0) {
+              result.push_back(LineRange{old_line, old_line + edit.len, new_line, new_line + edit.len});
+            }
+            old_line += edit.len;
+            new_line += edit.len;
+            break;
+          case DIFF_DELETE:
+            old_line += edit.len;
+            break;
+          case DIFF_INSERT:
+            new_line += edit.len;
+            break;
+        }
+      }
+      continue;
+    }
+
+    result.push_back(best_run);
+    regions.push_back(LineRange{region.old_start, best_run.old_start, region.new_start, best_run.new_start});
+    regions.push_back(LineRange{best_run.old_end, region.old_end, best_run.new_end, region.new_end});
+  }
+
+  std::sort(result.begin(), result.end(), [](const LineRange &a, const LineRange &b) {
+    return a.old_start < b.old_start;
+  });
+  return result;
+}
+
+static void append_edit(vector<diff_edit> &edit_script, diff_op op, uint32_t length) {
+  if (length == 0) return;
+  if (!edit_script.empty() && edit_script.back().op == op) {
+    edit_script.back().len += length;
+  } else {
+    edit_script.push_back(diff_edit{op, 0, length});
+  }
+}
+
+// Diffs the characters of the lines that the line diff couldn't match. Hunks
+// that differ by more than the maximum edit distance are replaced as a whole.
+static void append_hunk_edits(vector<diff_edit> &edit_script, vector<diff_edit> &hunk_edit_script,
+                              const Text &old_text, uint32_t old_start, uint32_t old_end,
+                              const Text &new_text, uint32_t new_start, uint32_t new_end) {
+  if (old_start == old_end || new_start == new_end) {
+    append_edit(edit_script, DIFF_DELETE, old_end - old_start);
+    append_edit(edit_script, DIFF_INSERT, new_end - new_start);
+    return;
+  }
+
+  hunk_edit_script.clear();
   int edit_distance = diff(
-    old_text.content.data(),
-    old_text.content.size(),
-    new_text.content.data(),
-    new_text.content.size(),
+    old_text.data() + old_start,
+    old_end - old_start,
+    new_text.data() + new_start,
+    new_end - new_start,
     MAX_EDIT_DISTANCE,
-    &edit_script
+    &hunk_edit_script
   );
 
   if (edit_distance == -1 || edit_distance >= MAX_EDIT_DISTANCE) {
-    result.splice(Point(), old_text.extent(), new_text.extent(), old_text, new_text);
-    return result;
+    append_edit(edit_script, DIFF_DELETE, old_end - old_start);
+    append_edit(edit_script, DIFF_INSERT, new_end - new_start);
+    return;
   }
 
+  for (const diff_edit &edit : hunk_edit_script) {
+    append_edit(edit_script, edit.op, edit.len);
+  }
+}
+
+// Diffs the given rows of the texts line by line, so that the character diff
+// only runs on the lines in between, and differences in one part of a large
+// text don't prevent the rest of it from being diffed precisely.
+static void append_line_edits(vector<diff_edit> &edit_script,
+                              const Text &old_text, uint32_t old_start_row, uint32_t old_end_row,
+                              const Text &new_text, uint32_t new_start_row, uint32_t new_end_row) {
+  LineIds line_ids;
+  line_ids.reserve(old_end_row - old_start_row);
+  vector<uint32_t> old_lines = get_line_ids(old_text, old_start_row, old_end_row, line_ids);
+  vector<uint32_t> new_lines = get_line_ids(new_text, new_start_row, new_end_row, line_ids);
+
+  vector<diff_edit> hunk_edit_script;
+  uint32_t old_row = old_start_row, new_row = new_start_row;
+  for (const LineRange &match : match_lines(old_lines, new_lines, line_ids.size())) {
+    append_hunk_edits(
+      edit_script, hunk_edit_script,
+      old_text, line_offset(old_text, old_row), line_offset(old_text, old_start_row + match.old_start),
+      new_text, line_offset(new_text, new_row), line_offset(new_text, new_start_row + match.new_start)
+    );
+    append_edit(
+      edit_script, DIFF_MATCH,
+      line_offset(old_text, old_start_row + match.old_end) - line_offset(old_text, old_start_row + match.old_start)
+    );
+    old_row = old_start_row + match.old_end;
+    new_row = new_start_row + match.new_end;
+  }
+  append_hunk_edits(
+    edit_script, hunk_edit_script,
+    old_text, line_offset(old_text, old_row), line_offset(old_text, old_end_row),
+    new_text, line_offset(new_text, new_row), line_offset(new_text, new_end_row)
+  );
+}
+
+// Calls the callback with each index below the task count, spreading the
+// calls over the given number of threads, including the calling thread.
+template <typename Callback>
+static void run_tasks(unsigned thread_count, size_t task_count, const Callback &callback) {
+  std::atomic<size_t> next_task_index{0};
+  auto run_remaining_tasks = [&]() {
+    for (;;) {
+      size_t task_index = next_task_index++;
+      if (task_index >= task_count) break;
+      callback(task_index);
+    }
+  };
+
+  thread_count = std::min<size_t>(std::max(thread_count, 1u), task_count);
+  vector<std::thread> threads;
+  for (unsigned i = 1; i < thread_count; i++) {
+    threads.push_back(std::thread(run_remaining_tasks));
+  }
+  run_remaining_tasks();
+  for (auto &thread : threads) thread.join();
+}
+
+struct AnchorLine {
+  uint32_t old_row;
+  uint32_t new_row;
+};
+
+// Finds the lines at the candidate rows of the old text that occur exactly
+// once in both texts, and keeps the longest sequence of them that has the
+// same order in both texts, as in a patience diff. Only the candidate lines
+// are counted, so that the rest of the texts only need to be hashed, which is
+// done in chunks on separate threads.
+static vector<AnchorLine> find_anchor_lines(const Text &old_text, uint32_t old_start_row, uint32_t old_end_row,
+                                            const Text &new_text, uint32_t new_start_row, uint32_t new_end_row,
+                                            const vector<uint32_t> &candidate_rows, unsigned thread_count) {
+  auto get_line = [](const Text &text, uint32_t row) {
+    uint32_t start = line_offset(text, row);
+    return Line{text.data() + start, line_offset(text, row + 1) - start};
+  };
+
+  std::unordered_map<size_t, uint32_t> candidate_indices;
+  for (uint32_t i = 0; i < candidate_rows.size(); i++) {
+    candidate_indices.emplace(LineHash()(get_line(old_text, candidate_rows[i])), i);
+  }
+
+  struct Occurrences {
+    uint32_t count;
+    uint32_t row;
+  };
+
+  size_t chunk_count = thread_count;
+  vector<vector<Occurrences>> chunk_occurrences(2 * chunk_count);
+  run_tasks(thread_count, 2 * chunk_count, [&](size_t task_index) {
+    bool is_old = task_index < chunk_count;
+    const Text &text = is_old ? old_text : new_text;
+    uint32_t start_row = is_old ? old_start_row : new_start_row;
+    uint32_t end_row = is_old ? old_end_row : new_end_row;
+    size_t chunk_index = task_index % chunk_count;
+    uint32_t chunk_start_row = start_row + (end_row - start_row) * chunk_index / chunk_count;
+    uint32_t chunk_end_row = start_row + (end_row - start_row) * (chunk_index + 1) / chunk_count;
+
+    vector<Occurrences> &occurrences = chunk_occurrences[task_index];
+    occurrences.assign(candidate_rows.size(), Occurrences{0, 0});
+    for (uint32_t row = chunk_start_row; row < chunk_end_row; row++) {
+      auto candidate = candidate_indices.find(LineHash()(get_line(text, row)));
+      if (candidate == candidate_indices.end()) continue;
+      occurrences[candidate->second].count++;
+      occurrences[candidate->second].row = row;
+    }
+  });
+
+  // Lines whose hashes collide are either counted together, in which case
+  // they aren't unique, or they are told apart here.
+  vector<AnchorLine> unique_lines;
+  for (uint32_t i = 0; i < candidate_rows.size(); i++) {
+    uint32_t old_count = 0, new_count = 0, new_row = 0;
+    for (size_t j = 0; j < chunk_count; j++) {
+      old_count += chunk_occurrences[j][i].count;
+      new_count += chunk_occurrences[chunk_count + j][i].count;
+      if (chunk_occurrences[chunk_count + j][i].count > 0) new_row = chunk_occurrences[chunk_count + j][i].row;
+    }
+    if (old_count == 1 && new_count == 1 &&
+        LineEqual()(get_line(old_text, candidate_rows[i]), get_line(new_text, new_row))) {
+      unique_lines.push_back(AnchorLine{candidate_rows[i], new_row});
+    }
+  }
+
+  // Patience sorting: the top of each pile is the unique line that ends the
+  // shortest increasing sequence of that length found so far.
+  vector<uint32_t> pile_tops;
+  vector<uint32_t> previous_lines(unique_lines.size(), NO_LINE);
+  for (uint32_t i = 0; i < unique_lines.size(); i++) {
+    auto pile = std::lower_bound(
+      pile_tops.begin(), pile_tops.end(), unique_lines[i].new_row,
+      [&](uint32_t top, uint32_t new_row) { return unique_lines[top].new_row < new_row; }
+    );
+    if (pile != pile_tops.begin()) previous_lines[i] = *(pile - 1);
+    if (pile == pile_tops.end()) {
+      pile_tops.push_back(i);
+    } else {
+      *pile = i;
+    }
+  }
+
+  vector<AnchorLine> result;
+  for (uint32_t i = pile_tops.empty() ? NO_LINE : pile_tops.back(); i != NO_LINE; i = previous_lines[i]) {
+    result.push_back(unique_lines[i]);
+  }
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+// Diffs the given rows of the texts. When there are enough of them, they are
+// split at unique lines that both texts share into segments that are diffed
+// concurrently, and whose edit scripts are then joined in order.
+static void append_segment_edits(vector<diff_edit> &edit_script,
+                                 const Text &old_text, uint32_t old_start_row, uint32_t old_end_row,
+                                 const Text &new_text, uint32_t new_start_row, uint32_t new_end_row,
+                                 unsigned thread_count) {
+  uint32_t old_row_count = old_end_row - old_start_row;
+  uint32_t new_row_count = new_end_row - new_start_row;
+  if (thread_count < 2 ||
+      old_row_count < 2 * MIN_SEGMENT_ROW_COUNT ||
+      new_row_count < 2 * MIN_SEGMENT_ROW_COUNT) {
+    append_line_edits(edit_script, old_text, old_start_row, old_end_row, new_text, new_start_row, new_end_row);
+    return;
+  }
+
+  // The texts are split at the first anchor line that can be found after each
+  // multiple of the segment length. Each segment ends right before an anchor
+  // line, except for the last one.
+  uint32_t segment_row_count = std::max(
+    MIN_SEGMENT_ROW_COUNT,
+    old_row_count / (thread_count * SEGMENTS_PER_THREAD)
+  );
+  vector<uint32_t> candidate_rows;
+  for (uint32_t row = old_start_row + segment_row_count; row + segment_row_count <= old_end_row;
+       row += segment_row_count) {
+    for (uint32_t i = 0; i < ANCHOR_CANDIDATE_ROW_COUNT; i++) {
+      candidate_rows.push_back(row + i);
+    }
+  }
+
+  vector<LineRange> segments;
+  LineRange segment{old_start_row, 0, new_start_row, 0};
+  uint32_t segment_index = 0;
+  for (const AnchorLine &anchor_line : find_anchor_lines(
+    old_text, old_start_row, old_end_row,
+    new_text, new_start_row, new_end_row,
+    candidate_rows, thread_count
+  )) {
+    uint32_t next_segment_index = (anchor_line.old_row - old_start_row) / segment_row_count;
+    if (next_segment_index == segment_index) continue;
+    segment_index = next_segment_index;
+    segment.old_end = anchor_line.old_row;
+    segment.new_end = anchor_line.new_row;
+    segments.push_back(segment);
+    segment.old_start = anchor_line.old_row + 1;
+    segment.new_start = anchor_line.new_row + 1;
+  }
+  segment.old_end = old_end_row;
+  segment.new_end = new_end_row;
+  segments.push_back(segment);
+
+  vector<vector<diff_edit>> segment_edit_scripts(segments.size());
+  run_tasks(thread_count, segments.size(), [&](size_t segment_index) {
+    const LineRange &segment = segments[segment_index];
+    append_line_edits(
+      segment_edit_scripts[segment_index],
+      old_text, segment.old_start, segment.old_end,
+      new_text, segment.new_start, segment.new_end
+    );
+  });
+
+  for (uint32_t i = 0; i < segments.size(); i++) {
+    for (const diff_edit &edit : segment_edit_scripts[i]) {
+      append_edit(edit_script, edit.op, edit.len);
+    }
+    if (i + 1 < segments.size()) {
+      uint32_t anchor_row = segments[i].old_end;
+      append_edit(
+        edit_script, DIFF_MATCH,
+        line_offset(old_text, anchor_row + 1) - line_offset(old_text, anchor_row)
+      );
+    }
+  }
+}
+
+Patch text_diff(const Text &old_text, const Text &new_text, unsigned thread_count) {
+  // The rows that the texts share at their start and end are matched without
+  // hashing them, so that small edits to large texts stay cheap.
+  const char16_t *old_data = old_text.data(), *new_data = new_text.data();
+  uint32_t old_size = old_text.size(), new_size = new_text.size();
+  uint32_t old_row_count = old_text.line_offsets.size();
+  uint32_t new_row_count = new_text.line_offsets.size();
+  uint32_t common_prefix_length = 0;
+  while (common_prefix_length < old_size && common_prefix_length < new_size &&
+         old_data[common_prefix_length] == new_data[common_prefix_length]) {
+    common_prefix_length++;
+  }
+  uint32_t common_prefix_rows = old_text.position_for_offset(common_prefix_length, 0, false).row;
+
+  uint32_t common_prefix_offset = line_offset(old_text, common_prefix_rows);
+  uint32_t common_suffix_length = 0;
+  while (common_suffix_length < old_size - common_prefix_offset &&
+         common_suffix_length < new_size - common_prefix_offset &&
+         old_data[old_size - common_suffix_length - 1] == new_data[new_size - common_suffix_length - 1]) {
+    common_suffix_length++;
+  }
+  uint32_t common_suffix_rows = old_row_count - 1 -
+    old_text.position_for_offset(old_size - common_suffix_length, 0, false).row;
+
+  vector<diff_edit> edit_script;
+  append_edit(edit_script, DIFF_MATCH, common_prefix_offset);
+  append_segment_edits(
+    edit_script,
+    old_text, common_prefix_rows, old_row_count - common_suffix_rows,
+    new_text, common_prefix_rows, new_row_count - common_suffix_rows,
+    thread_count
+  );
+  append_edit(edit_script, DIFF_MATCH, old_size - line_offset(old_text, old_row_count - common_suffix_rows));
+
+  // The edit script is in order, so the changes can be collected and built
+  // into a patch at once. Adjacent changes are merged by the patch.
+  vector<Patch::Change> changes;
+  std::deque<Text> texts;
+  auto add_change = [&changes, &texts](Point old_start, Point old_end, Point new_start,
+                                       Point new_end, Text &&deleted_text, Text &&inserted_text) {
+    texts.push_back(move(deleted_text));
+    Text *old_change_text = &texts.back();
+    texts.push_back(move(inserted_text));
+    Text *new_change_text = &texts.back();
+    changes.push_back(Patch::Change{
+      old_start, old_end, new_start, new_end,
+      old_change_text, new_change_text,
+      0, 0, 0
+    });
+  };
+
   size_t old_offset = 0;
   size_t new_offset = 0;
   Point old_position;
@@ -55,7 +560,11 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         if (new_text.at(new_offset) == '\n' &&
             ((old_offset > 0 && old_text.at(old_offset - 1) == '\r') ||
              (new_offset > 0 && new_text.at(new_offset - 1) == '\r'))) {
-          result.splice(new_position, Point(1, 0), Point(1, 0), lf, lf);
+          add_change(
+            old_position, old_position.traverse(Point(1, 0)),
+            new_position, new_position.traverse(Point(1, 0)),
+            Text{u"\n"}, Text{u"\n"}
+          );
           old_position.row++;
           old_position.column = 0;
           new_position.row++;
@@ -72,7 +581,11 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         if (new_text.at(new_offset - 1) == '\r' &&
             ((old_offset < old_text.size() && old_text.at(old_offset) == '\n') ||
              (new_offset < new_text.size() && new_text.at(new_offset) == '\n'))) {
-          result.splice(previous_column(new_position), Point(0, 1), Point(0, 1), cr, cr);
+          add_change(
+            previous_column(old_position), old_position,
+            previous_column(new_position), new_position,
+            Text{u"\r"}, Text{u"\r"}
+          );
         }
         break;
 
@@ -81,7 +594,7 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         Text deleted_text{old_text.begin() + old_offset, old_text.begin() + deletion_end};
         old_offset = deletion_end;
         Point next_old_position = old_text.position_for_offset(old_offset, 0, false);
-        result.splice(new_position, next_old_position.traversal(old_position), Point(), deleted_text, empty);
+        add_change(old_position, next_old_position, new_position, new_position, move(deleted_text), Text{});
         old_position = next_old_position;
         break;
       }
@@ -91,12 +604,12 @@ Patch text_diff(const Text &old_text, const Text &new_text) {
         Text inserted_text{new_text.begin() + new_offset, new_text.begin() + insertion_end};
         new_offset = insertion_end;
         Point next_new_position = new_text.position_for_offset(new_offset, 0, false);
-        result.splice(new_position, Point(), next_new_position.traversal(new_position), empty, inserted_text);
+        add_change(old_position, old_position, new_position, next_new_position, Text{}, move(inserted_text));
         new_position = next_new_position;
         break;
       }
     }
   }
 
-  return result;
+  return Patch::from_sorted_changes(changes);
 }
@@ -4,6 +4,7 @@
 #include "patch.h"
 #include "text.h"
 
-Patch text_diff(const Text &old_text, const Text &new_text);
+// Diffs large texts in segments on up to `thread_count` threads.
+Patch text_diff(const Text &old_text, const Text &new_text, unsigned thread_count = 1);
 
 #endif  // SUPERSTRING_TEXT_DIFF_H
\ No newline at end of file
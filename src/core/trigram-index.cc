@@ -0,0 +1,163 @@
+#include "trigram-index.h"
+#include <algorithm>
+#include <iterator>
+
+using std::pair;
+using std::u16string;
+using std::vector;
+
+static inline uint64_t fold_case(char16_t c) {
+  return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// The number of updates after which every row list is brought up to date, so
+// that reading a stale list never has to apply more than this many updates.
+static const size_t MAX_PENDING_UPDATE_COUNT = 32;
+
+TrigramIndex::TrigramIndex() : first_pending_generation{0}, row_count_{1} {}
+
+TrigramIndex::TrigramIndex(const Text &text) :
+  first_pending_generation{0}, row_count_{text.extent().row + 1} {
+  vector<pair<Trigram, uint32_t>> entries;
+  add_rows(text, 0, row_count_, entries);
+  for (const auto &entry : entries) {
+    RowList &row_list = rows_by_trigram[entry.first];
+    row_list.generation = 0;
+    row_list.rows.push_back(entry.second);
+  }
+}
+
+// Appends a (trigram, row) pair for each distinct trigram of the given rows,
+// sorted by trigram and then by row.
+void TrigramIndex::add_rows(const Text &text, uint32_t start_row, uint32_t end_row,
+                            vector<pair<Trigram, uint32_t>> &entries) const {
+  size_t first_entry = entries.size();
+  vector<Trigram> row_trigrams;
+  for (uint32_t row = start_row; row < end_row; row++) {
+    const char16_t *line = text.data() + text.line_offsets[row];
+    uint32_t length = text.line_length_for_row(row);
+    if (length < 3) continue;
+
+    row_trigrams.clear();
+    Trigram trigram = (fold_case(line[0]) << 16) | fold_case(line[1]);
+    for (uint32_t i = 2; i < length; i++) {
+      trigram = ((trigram << 16) | fold_case(line[i])) & 0xFFFFFFFFFFFF;
+      row_trigrams.push_back(trigram);
+    }
+    std::sort(row_trigrams.begin(), row_trigrams.end());
+    row_trigrams.erase(std::unique(row_trigrams.begin(), row_trigrams.end()), row_trigrams.end());
+    for (Trigram row_trigram : row_trigrams) entries.push_back({row_trigram, row});
+  }
+  std::sort(entries.begin() + first_entry, entries.end());
+}
+
+// Removes the rows that were replaced and shifts the rows after each splice.
+void TrigramIndex::apply_splices(vector<uint32_t> &rows, const vector<RowSplice> &splices) {
+  auto splice = splices.begin();
+  size_t kept_count = 0;
+  for (uint32_t row : rows) {
+    while (splice != splices.end() && splice->old_end_row <= row) splice++;
+    if (splice != splices.end() && splice->old_start_row <= row) continue;
+    if (splice == splices.begin()) {
+      rows[kept_count++] = row;
+    } else {
+      auto &previous_splice = *(splice - 1);
+      rows[kept_count++] = row - previous_splice.old_end_row + previous_splice.new_end_row;
+    }
+  }
+  rows.resize(kept_count);
+}
+
+void TrigramIndex::bring_up_to_date(RowList &row_list) const {
+  uint32_t generation = first_pending_generation + pending_splices.size();
+  for (; row_list.generation < generation; row_list.generation++) {
+    apply_splices(row_list.rows, pending_splices[row_list.generation - first_pending_generation]);
+  }
+}
+
+void TrigramIndex::compact() {
+  for (auto iter = rows_by_trigram.begin(); iter != rows_by_trigram.end();) {
+    bring_up_to_date(iter->second);
+    if (iter->second.rows.empty()) {
+      iter = rows_by_trigram.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  first_pending_generation += pending_splices.size();
+  pending_splices.clear();
+}
+
+void TrigramIndex::update(const vector<RowSplice> &splices, const Text &new_text) {
+  if (splices.empty()) return;
+
+  // The replaced rows are dropped from each list when it is brought up to
+  // date, so only the lists that gain rows need to be touched now.
+  pending_splices.push_back(splices);
+  uint32_t generation = first_pending_generation + pending_splices.size();
+
+  // Index the inserted rows, merging them into the existing row lists.
+  vector<pair<Trigram, uint32_t>> entries;
+  for (const RowSplice &splice : splices) {
+    add_rows(new_text, splice.new_start_row, splice.new_end_row, entries);
+  }
+  std::sort(entries.begin(), entries.end());
+  for (auto entry = entries.begin(); entry != entries.end();) {
+    auto entries_end = entry;
+    while (entries_end != entries.end() && entries_end->first == entry->first) entries_end++;
+
+    auto inserted = rows_by_trigram.insert({entry->first, RowList{{}, generation}});
+    RowList &row_list = inserted.first->second;
+    bring_up_to_date(row_list);
+    vector<uint32_t> &rows = row_list.rows;
+    size_t original_size = rows.size();
+    for (auto iter = entry; iter != entries_end; ++iter) rows.push_back(iter->second);
+    std::inplace_merge(rows.begin(), rows.begin() + original_size, rows.end());
+    entry = entries_end;
+  }
+
+  row_count_ = new_text.extent().row + 1;
+  if (pending_splices.size() >= MAX_PENDING_UPDATE_COUNT) compact();
+}
+
+optional<vector<uint32_t>> TrigramIndex::candidate_rows(const u16string &text) const {
+  if (text.size() < 3) return optional<vector<uint32_t>>{};
+
+  vector<const vector<uint32_t> *> row_lists;
+  vector<RowList> shifted_row_lists;
+  shifted_row_lists.reserve(text.size() - 2);
+  Trigram trigram = (fold_case(text[0]) << 16) | fold_case(text[1]);
+  for (size_t i = 2; i < text.size(); i++) {
+    trigram = ((trigram << 16) | fold_case(text[i])) & 0xFFFFFFFFFFFF;
+    auto iter = rows_by_trigram.find(trigram);
+    if (iter == rows_by_trigram.end()) return vector<uint32_t>();
+    const RowList &row_list = iter->second;
+    if (row_list.generation == first_pending_generation + pending_splices.size()) {
+      row_lists.push_back(&row_list.rows);
+    } else {
+      shifted_row_lists.push_back(row_list);
+      bring_up_to_date(shifted_row_lists.back());
+      row_lists.push_back(&shifted_row_lists.back().rows);
+    }
+  }
+
+  std::sort(row_lists.begin(), row_lists.end(), [](const vector<uint32_t> *a, const vector<uint32_t> *b) {
+    return a->size() < b->size();
+  });
+  vector<uint32_t> result = *row_lists.front();
+  vector<uint32_t> intersection;
+  for (size_t i = 1; i < row_lists.size() && !result.empty(); i++) {
+    intersection.clear();
+    std::set_intersection(
+      result.begin(), result.end(),
+      row_lists[i]->begin(), row_lists[i]->end(),
+      std::back_inserter(intersection)
+    );
+    result.swap(intersection);
+  }
+  return result;
+}
+
+uint32_t TrigramIndex::row_count() const {
+  return row_count_;
+}
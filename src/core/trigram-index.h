@@ -0,0 +1,67 @@
+#ifndef SUPERSTRING_TRIGRAM_INDEX_H_
+#define SUPERSTRING_TRIGRAM_INDEX_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "optional.h"
+#include "text.h"
+
+// Maps each sequence of three characters to the rows of a text that contain
+// it, so that searches for text of at least three characters can skip the
+// rows that can't match. Sequences are indexed with ASCII letters folded to
+// lower case, which lets the same index serve case-insensitive searches.
+class TrigramIndex {
+ public:
+  // Describes rows `old_start_row` up to `old_end_row` being replaced by rows
+  // `new_start_row` up to `new_end_row` of the new text. End rows are
+  // exclusive.
+  struct RowSplice {
+    uint32_t old_start_row;
+    uint32_t old_end_row;
+    uint32_t new_start_row;
+    uint32_t new_end_row;
+  };
+
+  TrigramIndex();
+  explicit TrigramIndex(const Text &);
+
+  // Updates the index after the indexed text has been changed into
+  // `new_text`. The splices must be sorted and must not overlap. Only the
+  // row lists of the trigrams in the inserted rows are updated right away;
+  // the other lists are shifted when they are next read, and all of them are
+  // brought up to date once enough updates have accumulated.
+  void update(const std::vector<RowSplice> &, const Text &new_text);
+
+  // Returns the sorted rows that contain every three-character sequence of
+  // the given text, or an empty optional if the text is too short for the
+  // index to narrow down the rows.
+  optional<std::vector<uint32_t>> candidate_rows(const std::u16string &) const;
+
+  uint32_t row_count() const;
+
+ private:
+  using Trigram = uint64_t;
+
+  // The rows containing a trigram, as of the given number of updates.
+  struct RowList {
+    std::vector<uint32_t> rows;
+    uint32_t generation;
+  };
+
+  void add_rows(const Text &, uint32_t start_row, uint32_t end_row,
+                std::vector<std::pair<Trigram, uint32_t>> &entries) const;
+  static void apply_splices(std::vector<uint32_t> &rows, const std::vector<RowSplice> &);
+  void bring_up_to_date(RowList &) const;
+  void compact();
+
+  std::unordered_map<Trigram, RowList> rows_by_trigram;
+
+  // The splices of the updates that some row lists haven't been shifted by
+  // yet, starting with update number `first_pending_generation`.
+  std::vector<std::vector<RowSplice>> pending_splices;
+  uint32_t first_pending_generation;
+  uint32_t row_count_;
+};
+
+#endif  // SUPERSTRING_TRIGRAM_INDEX_H_
@@ -190,6 +190,107 @@ describe('Patch', function () {
     patch2.delete();
   })
 
+  it('can rebase patches over concurrent patches', () => {
+    const patch = new Patch()
+    patch.splice({row: 0, column: 2}, {row: 0, column: 3}, {row: 0, column: 2}, 'cde', 'XY')
+    const concurrentPatch = new Patch()
+    concurrentPatch.splice({row: 0, column: 3}, {row: 0, column: 0}, {row: 0, column: 1}, '', 'Q')
+
+    const rebasedPatch = patch.rebase(concurrentPatch)
+    assert.deepEqual(JSON.parse(JSON.stringify(rebasedPatch.getChanges())), [
+      {
+        oldStart: {row: 0, column: 2}, oldEnd: {row: 0, column: 3},
+        newStart: {row: 0, column: 2}, newEnd: {row: 0, column: 4},
+        oldText: 'c', newText: 'XY'
+      },
+      {
+        oldStart: {row: 0, column: 4}, oldEnd: {row: 0, column: 6},
+        newStart: {row: 0, column: 5}, newEnd: {row: 0, column: 5},
+        oldText: 'de', newText: ''
+      }
+    ])
+
+    const rebasedConcurrentPatch = concurrentPatch.rebase(patch, true)
+    assert.deepEqual(JSON.parse(JSON.stringify(rebasedConcurrentPatch.getChanges())), [
+      {
+        oldStart: {row: 0, column: 4}, oldEnd: {row: 0, column: 4},
+        newStart: {row: 0, column: 4}, newEnd: {row: 0, column: 5},
+        oldText: '', newText: 'Q'
+      }
+    ])
+
+    assert.throws(() => patch.rebase({}))
+
+    patch.delete()
+    concurrentPatch.delete()
+    rebasedPatch.delete()
+    rebasedConcurrentPatch.delete()
+  })
+
+  it('can return its changes packed into a typed array', () => {
+    const patch = new Patch()
+    patch.splice({row: 0, column: 3}, {row: 0, column: 4}, {row: 0, column: 5}, 'ciao', 'hello')
+    patch.splice({row: 1, column: 2}, {row: 0, column: 0}, {row: 1, column: 1}, '', 'a\nb')
+    patch.splice({row: 4, column: 0}, {row: 0, column: 2}, {row: 0, column: 1})
+
+    const {changes, text} = patch.getChangesPacked()
+    assert(changes instanceof Uint32Array)
+    assert.equal(text, 'ciaohelloa\nb')
+    assert.deepEqual(Array.from(changes), [
+      0, 3, 0, 7, 0, 3, 0, 8, 0, 4, 4, 9,
+      1, 2, 1, 2, 1, 2, 2, 1, 9, 9, 9, 12,
+      3, 0, 3, 2, 4, 0, 4, 1, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF
+    ])
+
+    const emptyPatch = new Patch()
+    assert.deepEqual(Array.from(emptyPatch.getChangesPacked().changes), [])
+    assert.equal(emptyPatch.getChangesPacked().text, '')
+
+    patch.delete()
+    emptyPatch.delete()
+  })
+
+  it('can translate many positions at once', () => {
+    const patch = new Patch()
+    patch.splice({row: 0, column: 5}, {row: 0, column: 3}, {row: 0, column: 1})
+    patch.splice({row: 1, column: 0}, {row: 0, column: 0}, {row: 2, column: 3})
+
+    const oldPositions = new Uint32Array([2, 4, 0, 2, 0, 6, 0, 10, 1, 0])
+    assert.deepEqual(Array.from(patch.translateOldPositions(oldPositions)), [4, 4, 0, 2, 0, 5, 0, 8, 1, 0])
+    assert.deepEqual(Array.from(patch.translateOldPositions(oldPositions, true)), [4, 4, 0, 2, 0, 6, 0, 8, 3, 3])
+
+    const newPositions = new Uint32Array([3, 5, 0, 6, 2, 0])
+    assert.deepEqual(Array.from(patch.translateNewPositions(newPositions)), [1, 2, 0, 8, 1, 0])
+
+    assert.throws(() => patch.translateOldPositions([2, 4]), TypeError, 'Expected a Uint32Array of row and column pairs')
+    assert.throws(() => patch.translateOldPositions(new Uint32Array([2, 4, 0])), TypeError, 'Expected a Uint32Array of row and column pairs')
+    assert.throws(() => patch.translateNewPositions(new Int32Array([2, 4])), TypeError, 'Expected a Uint32Array of row and column pairs')
+
+    patch.delete()
+  })
+
+  it('reports the shape of its tree and rebalances it after deep accesses', () => {
+    const patch = new Patch()
+    for (let i = 0; i < 1000; i++) {
+      patch.splice({row: i, column: 0}, {row: 0, column: 1}, {row: 0, column: 2})
+    }
+    assert.equal(patch.getTreeStats().rebalanceCount, 0)
+
+    patch.changeForNewPosition({row: 0, column: 0})
+    assert.equal(patch.getTreeStats().maxAccessDepth, 999)
+    for (const row of [500, 250, 750, 125, 875]) {
+      patch.changeForNewPosition({row, column: 0})
+    }
+
+    const stats = patch.getTreeStats()
+    assert(stats.accessCount > 1000)
+    assert(stats.totalAccessDepth >= 999)
+    assert(stats.rotationCount > 0)
+    assert.equal(stats.rebalanceCount, 1)
+
+    patch.delete()
+  })
+
   it('can serialize/deserialize patches', () => {
     const emptyPatch = Patch.deserialize(new Patch().serialize())
     assert.equal(emptyPatch.getChangeCount(), 0)
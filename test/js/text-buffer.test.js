@@ -1241,6 +1241,305 @@ describe('TextBuffer', () => {
     })
   })
 
+  describe('.findAllMultiSync', () => {
+    if (!TextBuffer.prototype.findAllMultiSync) return
+
+    it('returns every match of any of the patterns along with the index of the pattern', () => {
+      const buffer = new TextBuffer('// TODO: fix\n// FIXME: a1 b22')
+
+      assert.deepEqual(buffer.findAllMultiSync(['TODO', 'FIXME']), [
+        {range: Range(Point(0, 3), Point(0, 7)), patternIndex: 0},
+        {range: Range(Point(1, 3), Point(1, 8)), patternIndex: 1}
+      ])
+      assert.deepEqual(buffer.findAllMultiSync([/\d+/, /fix/i]), [
+        {range: Range(Point(0, 9), Point(0, 12)), patternIndex: 1},
+        {range: Range(Point(1, 3), Point(1, 6)), patternIndex: 1},
+        {range: Range(Point(1, 11), Point(1, 12)), patternIndex: 0},
+        {range: Range(Point(1, 14), Point(1, 16)), patternIndex: 0}
+      ])
+      assert.deepEqual(buffer.findAllMultiInRangeSync([/\d+/, /fix/i], Range(Point(1, 0), Point(1, 12))), [
+        {range: Range(Point(1, 3), Point(1, 6)), patternIndex: 1},
+        {range: Range(Point(1, 11), Point(1, 12)), patternIndex: 0}
+      ])
+    })
+  })
+
+  describe('.findBackwardInRangeSync', () => {
+    if (!TextBuffer.prototype.findBackwardInRangeSync) return
+
+    it('returns the last match in the range', () => {
+      const buffer = new TextBuffer('ab\nab\nxy\nxy')
+      assert.deepEqual(buffer.findBackwardSync(/ab/), Range(Point(1, 0), Point(1, 2)))
+      assert.deepEqual(buffer.findBackwardInRangeSync(/ab/, Range(Point(0, 0), Point(1, 1))), Range(Point(0, 0), Point(0, 2)))
+      assert.equal(buffer.findBackwardInRangeSync(/xy/, Range(Point(0, 0), Point(2, 1))), null)
+    })
+  })
+
+  describe('.countAll and .countAllSync', () => {
+    if (!TextBuffer.prototype.countAllSync) return
+
+    it('counts the matches in the buffer, up to an optional limit', async () => {
+      const buffer = new TextBuffer('abc\nabd\nxab')
+      assert.equal(buffer.countAllSync(/ab/), 3)
+      assert.equal(buffer.countAllSync(/ab/, {range: Range(Point(0, 1), Point(2, 0))}), 1)
+      assert.equal(buffer.countAllSync(/ab/, {limit: 2}), 2)
+      assert.equal(await buffer.countAll(/ab/), 3)
+      assert.equal(await buffer.countAll(/ab/, {limit: 1}), 1)
+    })
+  })
+
+  describe('.buildTrigramIndex', () => {
+    if (!TextBuffer.prototype.buildTrigramIndex) return
+
+    it('returns the same results when searching with the index', async () => {
+      const buffer = new TextBuffer('function a() {}\nconst b = 1\nfunction c() {}')
+      assert.equal(await buffer.buildTrigramIndex(), true)
+
+      buffer.setTextInRange(Range(Point(1, 0), Point(1, 0)), 'function ')
+      assert.deepEqual(buffer.findAllSync(/function/), [
+        Range(Point(0, 0), Point(0, 8)),
+        Range(Point(1, 0), Point(1, 8)),
+        Range(Point(2, 0), Point(2, 8))
+      ])
+      assert.equal(buffer.countAllSync(/Function/i), 3)
+
+      buffer.clearTrigramIndex()
+      assert.equal(buffer.countAllSync(/function/), 3)
+    })
+  })
+
+  describe('.replaceAllSync', () => {
+    if (!TextBuffer.prototype.replaceAllSync) return
+
+    it('replaces every match and returns a patch that reverts the replacements', () => {
+      const buffer = new TextBuffer('a1 b22\nc333')
+      const {replacementCount, invertedChanges} = buffer.replaceAllSync(/([a-z])(\d+)/, '$2$1')
+      assert.equal(replacementCount, 3)
+      assert.equal(buffer.getText(), '1a 22b\n333c')
+
+      for (const change of invertedChanges.getChanges().reverse()) {
+        buffer.setTextInRange({start: change.oldStart, end: change.oldEnd}, change.newText)
+      }
+      assert.equal(buffer.getText(), 'a1 b22\nc333')
+
+      assert.equal(buffer.replaceAllInRangeSync(/\d/, '#', Range(Point(1, 0), Point(1, 2))).replacementCount, 2)
+      assert.equal(buffer.getText(), 'a1 b22\n##33')
+    })
+  })
+
+  describe('.findAllStreaming', () => {
+    if (!TextBuffer.prototype.findAllStreaming) return
+
+    it('delivers matches in batches of packed ranges', async () => {
+      const buffer = new TextBuffer('ab\nab\nab\nab\nab')
+      const batches = []
+      const result = await buffer.findAllStreaming(/b/, {batchSize: 2}, (batch) => {
+        batches.push(Array.from(batch))
+      })
+      assert.deepEqual(result, {matchCount: 5, cancelled: false})
+      assert.deepEqual(batches, [
+        [0, 1, 0, 2, 1, 1, 1, 2],
+        [2, 1, 2, 2, 3, 1, 3, 2],
+        [4, 1, 4, 2]
+      ])
+    })
+
+    it('stops at the maximum number of matches', async () => {
+      const buffer = new TextBuffer('ab\nab\nab\nab\nab')
+      let matchValues = 0
+      const result = await buffer.findAllStreaming(/a/, {range: Range(Point(1, 0), Point(4, 2)), maxCount: 3}, (batch) => {
+        matchValues += batch.length
+      })
+      assert.deepEqual(result, {matchCount: 3, cancelled: false})
+      assert.equal(matchValues, 12)
+    })
+
+    it('can be cancelled from the batch callback or by an edit', async () => {
+      const buffer = new TextBuffer('a'.repeat(100000))
+      let batchCount = 0
+      const result = await buffer.findAllStreaming(/a/, {batchSize: 10}, () => {
+        batchCount++
+        return false
+      })
+      assert.isTrue(result.cancelled)
+      assert.equal(batchCount, 1)
+
+      const promise = buffer.findAllStreaming(/a/, {batchSize: 10, cancelOnEdit: true}, () => {})
+      buffer.setText('b')
+      assert.isTrue((await promise).cancelled)
+    })
+
+    it('rejects searches that fail', async () => {
+      const buffer = new TextBuffer('\uD800a')
+      let error
+      try {
+        await buffer.findAllStreaming(/a/u, () => {})
+      } catch (e) {
+        error = e
+      }
+      assert.match(error.message, /search failed/)
+    })
+  })
+
+  describe('.searchFiles', () => {
+    if (!TextBuffer.searchFiles) return
+
+    it('reports the matches in each file along with their line text', async () => {
+      const directory = temp.mkdirSync()
+      const paths = ['a', 'b', 'c', 'missing'].map(name => path.join(directory, name))
+      fs.writeFileSync(paths[0], 'abc\nxbx\n')
+      fs.writeFileSync(paths[1], 'none')
+      fs.writeFileSync(paths[2], 'b\u0000b')
+
+      const results = []
+      const {cancelled} = await TextBuffer.searchFiles(paths, /b/, {threadCount: 2}, (result) => {
+        results.push(result)
+      })
+      assert.isFalse(cancelled)
+      results.sort((a, b) => a.path < b.path ? -1 : 1)
+
+      assert.equal(results.length, 2)
+      assert.deepEqual(results[0], {
+        path: paths[0],
+        matches: [
+          {range: Range(Point(0, 1), Point(0, 2)), lineText: 'abc'},
+          {range: Range(Point(1, 1), Point(1, 2)), lineText: 'xbx'}
+        ],
+        reachedMatchLimit: false
+      })
+      assert.equal(results[1].path, paths[3])
+      assert.equal(results[1].error.code, 'ENOENT')
+
+      const limitedResults = []
+      await TextBuffer.searchFiles([paths[0]], /b/, {maxMatchesPerFile: 1}, (result) => {
+        limitedResults.push(result)
+      })
+      assert.equal(limitedResults[0].matches.length, 1)
+      assert.isTrue(limitedResults[0].reachedMatchLimit)
+    })
+  })
+
+  describe('.setRegexLimits', () => {
+    if (!TextBuffer.setRegexLimits) return
+
+    afterEach(() => TextBuffer.setRegexLimits())
+
+    it('rejects async searches that exceed the match limit', async () => {
+      const buffer = new TextBuffer('aa\n' + 'a'.repeat(30) + 'b')
+      TextBuffer.setRegexLimits({matchLimit: 10000})
+
+      let error
+      try {
+        await buffer.findAll(/(a+)+$/)
+      } catch (e) {
+        error = e
+      }
+      assert.match(error.message, /match limit/)
+
+      const result = await buffer.findAllStreaming(/(a+)+$/, () => {})
+      assert.equal(result.matchCount, 1)
+      assert.isTrue(result.limitExceeded)
+    })
+
+    it('throws or rejects when counting exceeds the match limit', async () => {
+      const buffer = new TextBuffer('aa\n' + 'a'.repeat(30) + 'b')
+      TextBuffer.setRegexLimits({matchLimit: 10000})
+
+      assert.throws(() => buffer.countAllSync(/(a+)+$/), /match limit/)
+
+      let error
+      try {
+        await buffer.countAll(/(a+)+$/)
+      } catch (e) {
+        error = e
+      }
+      assert.match(error.message, /match limit/)
+    })
+  })
+
+  describe('.setRegexEngine', () => {
+    if (!TextBuffer.setRegexEngine) return
+
+    afterEach(() => {
+      TextBuffer.setRegexEngine()
+      TextBuffer.setRegexLimits()
+    })
+
+    it('matches backtracking-prone patterns without exceeding the match limit', async () => {
+      const buffer = new TextBuffer('aa\n' + 'a'.repeat(30) + 'b')
+      TextBuffer.setRegexLimits({matchLimit: 10000})
+      TextBuffer.setRegexEngine('automatic')
+
+      const ranges = await buffer.findAll(/(a+)+$/)
+      assert.deepEqual(ranges, [Range(Point(0, 0), Point(0, 2))])
+      assert.throws(() => TextBuffer.setRegexEngine('dfa'), /Unknown regex engine/)
+    })
+  })
+
+  describe('.createLiveSearch', () => {
+    if (!TextBuffer.prototype.createLiveSearch) return
+
+    it('keeps the matches of a pattern up to date as the buffer changes', () => {
+      const buffer = new TextBuffer('ab\nab\nab')
+      const search = buffer.createLiveSearch(/a+b/)
+      assert.equal(search.getMatchCount(), 3)
+      const initialChanges = search.takeChanges()
+      assert.equal(initialChanges.added.length, 3)
+      assert.deepEqual(initialChanges.removed, [])
+
+      buffer.setTextInRange(Range(Point(1, 0), Point(1, 1)), 'x')
+      assert.equal(search.getMatchCount(), 2)
+      const changes = search.takeChanges()
+      assert.deepEqual(changes.added, [])
+      assert.equal(changes.removed.length, 1)
+
+      buffer.setTextInRange(Range(Point(2, 0), Point(2, 0)), 'aa')
+      const [id] = search.findIntersecting(Point(2, 0), Point(2, 0))
+      assert.deepEqual(search.getRange(id), Range(Point(2, 0), Point(2, 4)))
+      search.destroy()
+    })
+  })
+
+  describe('.getRegexCacheStats', () => {
+    if (!TextBuffer.getRegexCacheStats) return
+
+    it('reuses compiled patterns across buffers and calls', async () => {
+      const buffer1 = new TextBuffer('abc\ndef')
+      const buffer2 = new TextBuffer('xbz')
+      const pattern = 'b' + Date.now()
+
+      const statsBefore = TextBuffer.getRegexCacheStats()
+      assert.deepEqual(buffer1.findAllSync(pattern), [])
+      assert.deepEqual(buffer2.findAllSync(pattern), [])
+      assert.deepEqual(await buffer1.findAll(pattern), [])
+      const statsAfter = TextBuffer.getRegexCacheStats()
+
+      assert.equal(statsAfter.misses - statsBefore.misses, 1)
+      assert.equal(statsAfter.hits - statsBefore.hits, 2)
+      assert.isAtMost(statsAfter.size, statsAfter.capacity)
+    })
+  })
+
+  describe('.serializeRegexCache and .loadRegexCache', () => {
+    if (!TextBuffer.serializeRegexCache) return
+
+    it('preloads the cached regexes from a previous run', () => {
+      const buffer = new TextBuffer('abc\ndef')
+      const pattern = 'e' + Date.now()
+      buffer.findAllSync(pattern)
+      const serialized = TextBuffer.serializeRegexCache()
+
+      TextBuffer.setRegexCacheCapacity(0)
+      TextBuffer.setRegexCacheCapacity(128)
+      assert.equal(TextBuffer.loadRegexCache(serialized), true)
+      const statsBefore = TextBuffer.getRegexCacheStats()
+      assert.deepEqual(buffer.findAllSync(pattern), [])
+      assert.equal(TextBuffer.getRegexCacheStats().hits - statsBefore.hits, 1)
+
+      assert.equal(TextBuffer.loadRegexCache(Buffer.from('invalid')), false)
+    })
+  })
+
   describe('.findWordsWithSubsequence and .findWordsWithSubsequenceInRange', () => {
     it('doesn\'t crash intermittently', () => {
       let buffer;
@@ -0,0 +1,129 @@
+#include "test-helpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "file-searcher.h"
+
+using std::string;
+using std::u16string;
+using std::vector;
+using Match = FileSearcher::Match;
+using FileResult = FileSearcher::FileResult;
+
+static string write_temp_file(const string &name, const string &content) {
+  const char *directory = getenv("TMPDIR");
+  if (!directory) directory = getenv("TEMP");
+  if (!directory) directory = "/tmp";
+  string path = string(directory) + "/superstring-file-searcher-test-" + name;
+  FILE *file = fopen(path.c_str(), "wb");
+  fwrite(content.data(), 1, content.size(), file);
+  fclose(file);
+  return path;
+}
+
+static bool operator==(const Match &left, const Match &right) {
+  return left.range == right.range && left.line_index == right.line_index;
+}
+
+static std::ostream &operator<<(std::ostream &stream, const Match &match) {
+  return stream << match.range;
+}
+
+TEST_CASE("FileSearcher::search_file - returns each match with the text of its line") {
+  string path = write_temp_file("basic", "abc\r\ndefg abf\nh\xc3\xa9" "ab");
+  FileSearcher searcher(std::make_shared<Regex>(u"ab\\w", nullptr), "UTF-8");
+  REQUIRE(searcher.has_valid_encoding());
+
+  FileResult result = searcher.search_file(path);
+  REQUIRE(result.error_number == 0);
+  REQUIRE(!result.reached_match_limit);
+  REQUIRE(result.matches == vector<Match>({
+    Match{Range{Point{0, 0}, Point{0, 3}}, 0},
+    Match{Range{Point{1, 5}, Point{1, 8}}, 1},
+  }));
+  REQUIRE(result.line_texts == vector<u16string>({u"abc", u"defg abf"}));
+
+  FileSearcher latin1_searcher(std::make_shared<Regex>(u"Ã©", nullptr), "ISO-8859-1");
+  FileResult latin1_result = latin1_searcher.search_file(path);
+  REQUIRE(latin1_result.matches == vector<Match>({
+    Match{Range{Point{2, 1}, Point{2, 3}}, 0},
+  }));
+  REQUIRE(latin1_result.line_texts == vector<u16string>({u"hÃ©ab"}));
+
+  remove(path.c_str());
+}
+
+TEST_CASE("FileSearcher::search_file - limits the number of matches per file") {
+  string path = write_temp_file("limit", "a a a\na");
+  FileSearcher searcher(std::make_shared<Regex>(u"a", nullptr), "UTF-8", 2);
+
+  FileResult result = searcher.search_file(path);
+  REQUIRE(result.reached_match_limit);
+  REQUIRE(result.matches == vector<Match>({
+    Match{Range{Point{0, 0}, Point{0, 1}}, 0},
+    Match{Range{Point{0, 2}, Point{0, 3}}, 0},
+  }));
+
+  // Matches on the same line share its text.
+  REQUIRE(result.line_texts == vector<u16string>({u"a a a"}));
+
+  remove(path.c_str());
+}
+
+TEST_CASE("FileSearcher::search_file - skips binary files and reports errors") {
+  string path = write_temp_file("binary", string("abc\0abc", 7));
+  FileSearcher searcher(std::make_shared<Regex>(u"abc", nullptr), "UTF-8");
+  FileResult result = searcher.search_file(path);
+  REQUIRE(result.error_number == 0);
+  REQUIRE(result.matches.empty());
+
+  FileSearcher utf16_searcher(std::make_shared<Regex>(u"b", nullptr), "UTF-16LE");
+  string utf16_path = write_temp_file("utf16", string("a\0b\0", 4));
+  REQUIRE(utf16_searcher.search_file(utf16_path).matches.size() == 1);
+  FileSearcher lowercase_utf16_searcher(std::make_shared<Regex>(u"b", nullptr), "utf16le");
+  REQUIRE(lowercase_utf16_searcher.search_file(utf16_path).matches.size() == 1);
+
+  result = searcher.search_file(path + "-missing");
+  REQUIRE(result.error_number != 0);
+  REQUIRE(string(result.error_syscall) == "open");
+
+  FileSearcher invalid_searcher(std::make_shared<Regex>(u"abc", nullptr), "NOT-AN-ENCODING");
+  REQUIRE(!invalid_searcher.has_valid_encoding());
+
+  remove(path.c_str());
+  remove(utf16_path.c_str());
+}
+
+TEST_CASE("FileSearcher::search_files - searches many files on several threads") {
+  vector<string> paths;
+  for (unsigned i = 0; i < 40; i++) {
+    string content;
+    for (unsigned j = 0; j < i; j++) content += "line " + std::to_string(j) + " x\n";
+    paths.push_back(write_temp_file("many-" + std::to_string(i), content));
+  }
+  paths.push_back(paths[0] + "-missing");
+
+  FileSearcher searcher(std::make_shared<Regex>(u"x", nullptr), "UTF-8");
+  vector<unsigned> match_counts(paths.size(), 0);
+  unsigned error_count = 0;
+  searcher.search_files(paths, 4, [&](FileResult &&result) {
+    if (result.error_number) {
+      error_count++;
+    } else {
+      auto index = std::find(paths.begin(), paths.end(), result.path) - paths.begin();
+      match_counts[index] += result.matches.size();
+    }
+    return false;
+  });
+
+  REQUIRE(error_count == 1);
+  for (unsigned i = 0; i < 40; i++) REQUIRE(match_counts[i] == i);
+
+  unsigned callback_count = 0;
+  searcher.search_files(paths, 4, [&](FileResult &&) {
+    callback_count++;
+    return callback_count == 3;
+  });
+  REQUIRE(callback_count == 3);
+
+  for (const string &path : paths) remove(path.c_str());
+}
@@ -1,4 +1,7 @@
 #include "test-helpers.h"
+#include <future>
+#include <sstream>
+#include "text-slice.h"
 
 using Change = Patch::Change;
 using std::vector;
@@ -214,6 +217,254 @@ TEST_CASE("Patch::splice - inconsistent old text") {
   }));
 }
 
+TEST_CASE("Patch::combine - overlapping and adjacent changes") {
+  Patch patch;
+  patch.splice(Point {0, 2}, Point {0, 3}, Point {0, 5}, Text {u"abc"}, Text {u"12345"});
+  patch.splice(Point {1, 0}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"x"});
+  patch.splice(Point {3, 0}, Point {0, 2}, Point {0, 2}, Text {u"de"}, Text {u"fg"});
+
+  Patch other_patch;
+  other_patch.splice(Point {0, 6}, Point {0, 2}, Point {0, 1}, Text {u"5z"}, Text {u"w"});
+  other_patch.splice(Point {1, 1}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"y"});
+  other_patch.splice(Point {3, 0}, Point {0, 2}, Point {0, 2}, Text {u"fg"}, Text {u"de"});
+  other_patch.splice(Point {4, 0}, Point {0, 0}, Point {1, 0}, Text {u""}, Text {u"\n"});
+
+  REQUIRE(patch.combine(other_patch));
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 2}, Point {0, 6},
+      Point {0, 2}, Point {0, 7},
+      get_text(u"abcz").get(),
+      get_text(u"1234w").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {1, 0}, Point {1, 0},
+      Point {1, 0}, Point {1, 2},
+      get_text(u"").get(),
+      get_text(u"xy").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {4, 0}, Point {4, 0},
+      Point {4, 0}, Point {5, 0},
+      get_text(u"").get(),
+      get_text(u"\n").get(),
+      0, 0, 0
+    },
+  }));
+  REQUIRE(patch.get_changes().back().preceding_old_text_size == 4);
+  REQUIRE(patch.get_changes().back().preceding_new_text_size == 7);
+
+  Patch inconsistent_patch;
+  inconsistent_patch.splice(Point {0, 0}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"q"});
+  inconsistent_patch.splice(Point {0, 4}, Point {1, 0}, Point {0, 0}, Text {u"a\n"}, Text {u""});
+  REQUIRE(!patch.combine(inconsistent_patch));
+  REQUIRE(patch.get_changes().size() == 3);
+  REQUIRE(patch.get_changes().front() == (Change {
+    Point {0, 2}, Point {0, 6},
+    Point {0, 2}, Point {0, 7},
+    get_text(u"abcz").get(),
+    get_text(u"1234w").get(),
+    0, 0, 0
+  }));
+}
+
+TEST_CASE("Patch::combine - random changes") {
+  auto build_patch = [](Generator &rand, Text &text) {
+    Patch patch;
+    for (uint32_t i = 0, count = rand() % 20; i < count; i++) {
+      Range deleted_range = get_random_range(rand, text);
+      Text deleted_text{TextSlice(text).slice(deleted_range)};
+      Text inserted_text = get_random_text(rand);
+      Point inserted_extent = inserted_text.extent();
+      text.splice(deleted_range.start, deleted_range.extent(), inserted_text);
+      patch.splice(
+        deleted_range.start,
+        deleted_range.extent(),
+        inserted_extent,
+        std::move(deleted_text),
+        std::move(inserted_text)
+      );
+    }
+    return patch;
+  };
+
+  auto apply_patch = [](const Patch &patch, Text text) {
+    auto changes = patch.get_changes();
+    for (auto change = changes.rbegin(); change != changes.rend(); ++change) {
+      text.splice(change->old_start, change->old_end.traversal(change->old_start), *change->new_text);
+    }
+    return text;
+  };
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 300; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    Text original_text{get_random_string(rand, 100)};
+    Text text{original_text};
+    Patch patch = build_patch(rand, text);
+    Patch other_patch = build_patch(rand, text);
+
+    for (bool left_to_right : {true, false}) {
+      Patch merged_patch = patch.copy();
+      Patch::SPLICING_COMBINE_CHANGE_COUNT_RATIO = UINT32_MAX;
+      REQUIRE(merged_patch.combine(other_patch, left_to_right));
+
+      Patch spliced_patch = patch.copy();
+      Patch::SPLICING_COMBINE_CHANGE_COUNT_RATIO = 0;
+      REQUIRE(spliced_patch.combine(other_patch, left_to_right));
+      Patch::SPLICING_COMBINE_CHANGE_COUNT_RATIO = 8;
+
+      REQUIRE(merged_patch.get_changes() == spliced_patch.get_changes());
+      REQUIRE(apply_patch(merged_patch, original_text) == text);
+    }
+  }
+}
+
+TEST_CASE("Patch::copy and Patch::invert - share texts with the original") {
+  Patch patch;
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 4}, Text {u"abc"}, Text {u"1234"});
+
+  Patch copied_patch = patch.copy();
+  Patch inverted_patch = patch.invert();
+  REQUIRE(copied_patch.get_changes().front().old_text == patch.get_changes().front().old_text);
+  REQUIRE(inverted_patch.get_changes().front().old_text == patch.get_changes().front().new_text);
+
+  patch.splice(Point {0, 6}, Point {0, 1}, Point {0, 1}, Text {u"2"}, Text {u"x"});
+  patch.splice(Point {0, 2}, Point {0, 10}, Point {0, 0}, Text {u"xxx1x34yyy"}, Text {u""});
+  patch.clear();
+
+  REQUIRE(copied_patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 5}, Point {0, 8},
+      Point {0, 5}, Point {0, 9},
+      get_text(u"abc").get(),
+      get_text(u"1234").get(),
+      0, 0, 0
+    },
+  }));
+  REQUIRE(inverted_patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 5}, Point {0, 9},
+      Point {0, 5}, Point {0, 8},
+      get_text(u"1234").get(),
+      get_text(u"abc").get(),
+      0, 0, 0
+    },
+  }));
+}
+
+TEST_CASE("Patch::from_sorted_changes") {
+  Text text_1{u"abc"}, text_2{u"1234"}, text_3{u"d"}, text_4{u""}, text_5{u"e"}, text_6{u"56"};
+  Patch patch = Patch::from_sorted_changes({
+    Change {
+      Point {0, 5}, Point {0, 8},
+      Point {0, 5}, Point {0, 9},
+      &text_1, &text_2,
+      0, 0, 0
+    },
+    Change {
+      Point {0, 8}, Point {0, 9},
+      Point {0, 9}, Point {0, 9},
+      &text_3, &text_4,
+      0, 0, 0
+    },
+    Change {
+      Point {1, 2}, Point {1, 3},
+      Point {1, 1}, Point {1, 3},
+      &text_5, &text_6,
+      0, 0, 0
+    },
+    Change {
+      Point {2, 0}, Point {2, 4},
+      Point {2, 1}, Point {2, 1},
+      nullptr, nullptr,
+      0, 0, 4
+    },
+  });
+
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 5}, Point {0, 9},
+      Point {0, 5}, Point {0, 9},
+      get_text(u"abcd").get(),
+      get_text(u"1234").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {1, 2}, Point {1, 3},
+      Point {1, 1}, Point {1, 3},
+      get_text(u"e").get(),
+      get_text(u"56").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {2, 0}, Point {2, 4},
+      Point {2, 1}, Point {2, 1},
+      nullptr, nullptr,
+      0, 0, 0
+    },
+  }));
+  REQUIRE(patch.get_changes().back().preceding_old_text_size == 5);
+  REQUIRE(patch.get_changes().back().preceding_new_text_size == 6);
+  REQUIRE(patch.get_changes().back().old_text_size == 4);
+
+  patch.splice(Point {1, 2}, Point {0, 2}, Point {0, 0}, Text {u"6x"}, Text {u""});
+  REQUIRE(patch.get_changes()[1] == (Change {
+    Point {1, 2}, Point {1, 4},
+    Point {1, 1}, Point {1, 2},
+    get_text(u"ex").get(),
+    get_text(u"5").get(),
+    0, 0, 0
+  }));
+}
+
+TEST_CASE("Patch::clear - reuses storage for later changes") {
+  Patch patch;
+  for (uint32_t i = 0; i < 100; i++) {
+    patch.splice(Point {0, 2 * i}, Point {0, 1}, Point {0, 1}, Text {u"a"}, Text {u"b"});
+  }
+  REQUIRE(patch.get_change_count() == 100);
+
+  patch.clear();
+  REQUIRE(patch.get_change_count() == 0);
+
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 4}, Text {u"abc"}, Text {u"1234"});
+  patch.splice(Point {1, 0}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"x"});
+  Patch moved_patch = std::move(patch);
+  patch.splice(Point {0, 1}, Point {0, 1}, Point {0, 0}, Text {u"y"}, Text {u""});
+
+  REQUIRE(moved_patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 5}, Point {0, 8},
+      Point {0, 5}, Point {0, 9},
+      get_text(u"abc").get(),
+      get_text(u"1234").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {1, 0}, Point {1, 0},
+      Point {1, 0}, Point {1, 1},
+      get_text(u"").get(),
+      get_text(u"x").get(),
+      3, 4, 0
+    },
+  }));
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 1}, Point {0, 2},
+      Point {0, 1}, Point {0, 1},
+      get_text(u"y").get(),
+      get_text(u"").get(),
+      0, 0, 1
+    },
+  }));
+}
+
 TEST_CASE("Patch::find_changes_in_new_range") {
   Patch patch;
 
@@ -259,6 +510,147 @@ TEST_CASE("Patch::find_changes_in_new_range") {
   }));
 }
 
+TEST_CASE("Patch::translate_positions") {
+  Patch patch;
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {0, 1});
+  patch.splice(Point {1, 0}, Point {0, 0}, Point {2, 3});
+
+  vector<Point> old_positions {
+    Point {2, 4}, Point {0, 2}, Point {0, 5}, Point {0, 6},
+    Point {0, 8}, Point {0, 10}, Point {1, 0}
+  };
+  REQUIRE(patch.translate_positions(old_positions, Patch::TranslationDirection::OldToNew) == vector<Point>({
+    Point {4, 4}, Point {0, 2}, Point {0, 5}, Point {0, 5},
+    Point {0, 6}, Point {0, 8}, Point {1, 0}
+  }));
+  REQUIRE(patch.translate_positions(old_positions, Patch::TranslationDirection::OldToNew,
+                                    Patch::ClipDirection::Forward) == vector<Point>({
+    Point {4, 4}, Point {0, 2}, Point {0, 5}, Point {0, 6},
+    Point {0, 6}, Point {0, 8}, Point {3, 3}
+  }));
+
+  vector<Point> new_positions {
+    Point {0, 5}, Point {0, 6}, Point {2, 0}, Point {3, 3}, Point {3, 5}, Point {4, 1}
+  };
+  REQUIRE(patch.translate_positions(new_positions, Patch::TranslationDirection::NewToOld,
+                                    Patch::ClipDirection::Forward) == vector<Point>({
+    Point {0, 5}, Point {0, 8}, Point {1, 0}, Point {1, 0}, Point {1, 2}, Point {2, 1}
+  }));
+
+  REQUIRE(Patch().translate_positions(old_positions, Patch::TranslationDirection::NewToOld) == old_positions);
+  REQUIRE(patch.translate_positions({}, Patch::TranslationDirection::OldToNew).empty());
+}
+
+// Splicing a "\r" next to a "\n" changes the number of rows, so these patches
+// only use "\n" line endings.
+static Text get_random_text_without_cr(Generator &rand, uint32_t length) {
+  const std::u16string alphabet = u"abcd\n";
+  std::u16string result;
+  for (uint32_t i = 0; i < length; i++) result += alphabet[rand() % alphabet.size()];
+  return Text{result};
+}
+
+static Patch get_random_patch(Generator &rand, const Text &text) {
+  Patch patch;
+  Text mutated_text{text};
+  for (uint32_t i = 0, n = rand() % 5; i < n; i++) {
+    Range deleted_range = get_random_range(rand, mutated_text);
+    Text deleted_text{TextSlice(mutated_text).slice(deleted_range)};
+    Text inserted_text = get_random_text_without_cr(rand, rand() % 5);
+    Point inserted_extent = inserted_text.extent();
+    mutated_text.splice(deleted_range.start, deleted_range.extent(), inserted_text);
+    patch.splice(
+      deleted_range.start,
+      deleted_range.extent(),
+      inserted_extent,
+      std::move(deleted_text),
+      std::move(inserted_text)
+    );
+  }
+  return patch;
+}
+
+static Text apply_patch(const Text &text, const Patch &patch) {
+  Text result{text};
+  for (const Change &change : patch.get_changes()) {
+    Range old_range{change.new_start, change.new_start.traverse(change.old_end.traversal(change.old_start))};
+    REQUIRE(Text{TextSlice(result).slice(old_range)} == *change.old_text);
+    result.splice(old_range.start, old_range.extent(), *change.new_text);
+  }
+  return result;
+}
+
+TEST_CASE("Patch::rebase") {
+  Patch patch;
+  patch.splice(Point {0, 2}, Point {0, 3}, Point {0, 2}, Text {u"cde"}, Text {u"XY"});
+
+  Patch concurrent_patch;
+  concurrent_patch.splice(Point {0, 3}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"Q"});
+  concurrent_patch.splice(Point {0, 8}, Point {0, 1}, Point {0, 2}, Text {u"h"}, Text {u"ZZ"});
+
+  REQUIRE(patch.rebase(concurrent_patch, Patch::RebaseTieBreak::ThisFirst).get_changes() == vector<Change>({
+    Change {
+      Point {0, 2}, Point {0, 3},
+      Point {0, 2}, Point {0, 4},
+      get_text(u"c").get(),
+      get_text(u"XY").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {0, 4}, Point {0, 6},
+      Point {0, 5}, Point {0, 5},
+      get_text(u"de").get(),
+      get_text(u"").get(),
+      0, 0, 0
+    },
+  }));
+
+  REQUIRE(concurrent_patch.rebase(patch, Patch::RebaseTieBreak::ConcurrentFirst).get_changes() == vector<Change>({
+    Change {
+      Point {0, 4}, Point {0, 4},
+      Point {0, 4}, Point {0, 5},
+      get_text(u"").get(),
+      get_text(u"Q").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {0, 6}, Point {0, 7},
+      Point {0, 7}, Point {0, 9},
+      get_text(u"h").get(),
+      get_text(u"ZZ").get(),
+      0, 0, 0
+    },
+  }));
+
+  SECTION("insertions at the same position are ordered by the tie break") {
+    Patch insertion, concurrent_insertion;
+    insertion.splice(Point {0, 1}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"a"});
+    concurrent_insertion.splice(Point {0, 1}, Point {0, 0}, Point {0, 1}, Text {u""}, Text {u"b"});
+    REQUIRE(insertion.rebase(concurrent_insertion, Patch::RebaseTieBreak::ThisFirst).get_changes()[0].new_start == Point(0, 1));
+    REQUIRE(insertion.rebase(concurrent_insertion, Patch::RebaseTieBreak::ConcurrentFirst).get_changes()[0].new_start == Point(0, 2));
+  }
+
+  SECTION("rebasing over each other converges") {
+    auto t = time(nullptr);
+    for (uint32_t i = 0; i < 1000; i++) {
+      uint32_t seed = t * 1000 + i;
+      Generator rand(seed);
+      Text text = get_random_text_without_cr(rand, 40);
+      Patch patch = get_random_patch(rand, text);
+      Patch concurrent_patch = get_random_patch(rand, text);
+
+      INFO("Seed: " << seed << ", text: " << text << ", patch: " << patch.get_json() <<
+           ", concurrent patch: " << concurrent_patch.get_json());
+      Patch rebased_patch = patch.rebase(concurrent_patch, Patch::RebaseTieBreak::ThisFirst);
+      Patch rebased_concurrent_patch = concurrent_patch.rebase(patch, Patch::RebaseTieBreak::ConcurrentFirst);
+      REQUIRE(
+        apply_patch(apply_patch(text, concurrent_patch), rebased_patch) ==
+        apply_patch(apply_patch(text, patch), rebased_concurrent_patch)
+      );
+    }
+  }
+}
+
 TEST_CASE("Patch::serialize") {
   Patch patch;
 
@@ -327,3 +719,161 @@ TEST_CASE("Patch::serialize") {
     }
   }));
 }
+
+TEST_CASE("Patch::serialize - texts") {
+  Patch patch;
+  patch.splice(Point {0, 5}, Point {0, 3}, Point {1, 1}, Text {u"abc"}, Text {u"12\n3"});
+  patch.splice(Point {2, 0}, Point {0, 2}, Point {0, 0}, optional<Text> {}, Text {u""}, 2);
+  patch.splice(Point {0, 1}, Point {0, 1}, Point {0, 0}, Text {u"α"}, Text {u""});
+
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  patch.serialize(serializer);
+
+  Deserializer deserializer(bytes.data(), bytes.size());
+  Patch patch_copy(deserializer);
+  REQUIRE(patch_copy.get_changes() == patch.get_changes());
+  REQUIRE(patch_copy.get_changes()[2].old_text_size == 2);
+  REQUIRE(patch_copy.get_changes()[2].preceding_old_text_size == 4);
+
+  for (size_t size = 0; size < bytes.size(); size++) {
+    Deserializer truncated_deserializer(bytes.data(), size);
+    Patch truncated_patch(truncated_deserializer);
+    REQUIRE(truncated_patch.get_change_count() <= patch.get_change_count());
+  }
+}
+
+TEST_CASE("Patch::serialize - reads version 1") {
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  serializer.append<uint32_t>(1);
+  serializer.append<uint32_t>(2);
+
+  // The root, which has a right child
+  for (uint32_t value : {0u, 3u, 0u, 4u, 0u, 5u, 0u, 5u}) serializer.append<uint32_t>(value);
+  serializer.append<uint32_t>(1);
+  serializer.append<uint32_t>(3);
+  for (char16_t character : u"abc") if (character) serializer.append<uint16_t>(character);
+  serializer.append<uint32_t>(1);
+  serializer.append<uint32_t>(4);
+  for (char16_t character : u"1234") if (character) serializer.append<uint16_t>(character);
+
+  serializer.append<uint32_t>(2);
+  for (uint32_t value : {0u, 3u, 0u, 0u, 0u, 2u, 0u, 2u}) serializer.append<uint32_t>(value);
+  serializer.append<uint32_t>(0);
+  serializer.append<uint32_t>(3);
+  serializer.append<uint32_t>(0);
+
+  Deserializer deserializer(bytes);
+  Patch patch(deserializer);
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change {
+      Point {0, 5}, Point {0, 8},
+      Point {0, 5}, Point {0, 9},
+      get_text(u"abc").get(),
+      get_text(u"1234").get(),
+      0, 0, 0
+    },
+    Change {
+      Point {0, 10}, Point {0, 13},
+      Point {0, 11}, Point {0, 11},
+      nullptr, nullptr,
+      0, 0, 0
+    },
+  }));
+  REQUIRE(patch.get_changes().back().old_text_size == 3);
+}
+
+TEST_CASE("Patch - concurrent reads") {
+  Generator rand(0);
+  Patch patch;
+  Text text{get_random_string(rand, 5000)};
+  for (uint32_t i = 0; i < 1000; i++) {
+    Range deleted_range = get_random_range(rand, text);
+    Text deleted_text{TextSlice(text).slice(deleted_range)};
+    Text inserted_text = get_random_text(rand);
+    Point inserted_extent = inserted_text.extent();
+    text.splice(deleted_range.start, deleted_range.extent(), inserted_text);
+    patch.splice(
+      deleted_range.start,
+      deleted_range.extent(),
+      inserted_extent,
+      std::move(deleted_text),
+      std::move(inserted_text)
+    );
+  }
+
+  vector<Point> positions;
+  vector<Range> ranges;
+  for (uint32_t i = 0; i < 200; i++) {
+    positions.push_back(Point(rand() % 600, rand() % 40));
+    Point start(rand() % 600, rand() % 40);
+    ranges.push_back(Range{start, start.traverse(Point(rand() % 20, rand() % 40))});
+  }
+
+  const Patch &frozen_patch = patch;
+  auto read_patch = [&frozen_patch, &positions, &ranges]() {
+    vector<uint8_t> bytes;
+    Serializer serializer(bytes);
+    frozen_patch.serialize(serializer);
+
+    std::stringstream result;
+    result << bytes.size() << frozen_patch.copy().get_changes().size() << frozen_patch.invert().get_change_count();
+    for (const Change &change : frozen_patch.get_changes()) result << change;
+    for (const Range &range : ranges) {
+      for (const Change &change : frozen_patch.get_changes_in_new_range(range.start, range.end)) result << change;
+      for (const Change &change : frozen_patch.get_changes_in_old_range(range.start, range.end)) result << change;
+    }
+    for (const Point &position : positions) {
+      result << frozen_patch.get_change_starting_before_new_position(position);
+      result << frozen_patch.get_change_ending_after_new_position(position);
+    }
+    for (const Point &position : frozen_patch.translate_positions(positions, Patch::TranslationDirection::OldToNew)) {
+      result << position;
+    }
+    return result.str();
+  };
+
+  std::string expected_result = read_patch();
+  vector<std::future<std::string>> readers;
+  for (uint32_t i = 0; i < 8; i++) {
+    readers.push_back(std::async(std::launch::async, [&read_patch]() {
+      std::string result;
+      for (uint32_t j = 0; j < 5; j++) result = read_patch();
+      return result;
+    }));
+  }
+
+  for (auto &reader : readers) REQUIRE(reader.get() == expected_result);
+  REQUIRE(read_patch() == expected_result);
+}
+
+TEST_CASE("Patch - rebalances after deep accesses") {
+  Patch patch;
+  for (uint32_t i = 0; i < 1000; i++) {
+    patch.splice(Point(i, 0), Point(0, 1), Point(0, 2), Text{u"a"}, Text{u"bc"});
+  }
+  auto changes = patch.get_changes();
+  REQUIRE(patch.get_tree_stats().rebalance_count == 0);
+  REQUIRE(patch.get_tree_stats().max_access_depth < 5);
+
+  // Sequential edits leave the tree as a vine, so accessing its other end
+  // descends through every change.
+  patch.grab_change_starting_before_new_position(Point(0, 0));
+  REQUIRE(patch.get_tree_stats().max_access_depth == 999);
+  for (uint32_t row : {500, 250, 750, 125, 875}) {
+    patch.grab_change_starting_before_new_position(Point(row, 0));
+  }
+  REQUIRE(patch.get_tree_stats().rebalance_count == 1);
+  REQUIRE(patch.get_changes() == changes);
+
+  for (uint32_t row = 0; row < 1000; row += 100) {
+    Patch::TreeStats stats_before = patch.get_tree_stats();
+    patch.grab_change_starting_before_new_position(Point(row, 0));
+    Patch::TreeStats stats_after = patch.get_tree_stats();
+    REQUIRE(stats_after.access_count == stats_before.access_count + 1);
+    REQUIRE(stats_after.total_access_depth - stats_before.total_access_depth < 40);
+    REQUIRE(stats_after.rotation_count > stats_before.rotation_count);
+  }
+  REQUIRE(patch.get_tree_stats().rebalance_count == 1);
+}
@@ -0,0 +1,486 @@
+#include "test-helpers.h"
+#include <future>
+#include "regex.h"
+#include "regex-cache.h"
+
+using std::u16string;
+using std::vector;
+using MatchResult = Regex::MatchResult;
+
+TEST_CASE("RegexCache::get - returns the same compiled regex for the same pattern and flags") {
+  RegexCache cache(4);
+  u16string error_message;
+
+  auto regex1 = cache.get(u"a+b", &error_message);
+  auto regex2 = cache.get(u"a+b", &error_message);
+  auto regex3 = cache.get(u"a+b", &error_message, true);
+  auto regex4 = cache.get(u"a+b", &error_message, false, true);
+  REQUIRE(error_message.empty());
+  REQUIRE(regex1 == regex2);
+  REQUIRE(regex1 != regex3);
+  REQUIRE(regex1 != regex4);
+  REQUIRE(regex3 != regex4);
+
+  auto stats = cache.get_stats();
+  REQUIRE(stats.hits == 1);
+  REQUIRE(stats.misses == 3);
+  REQUIRE(stats.size == 3);
+
+  Regex::MatchData match_data(*regex3);
+  MatchResult result = regex3->match(u"xAAB", 4, match_data, Regex::IsEndSearch);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.start_offset == 1);
+  REQUIRE(result.end_offset == 4);
+}
+
+TEST_CASE("RegexCache::get - evicts the least recently used entries") {
+  RegexCache cache(2);
+  u16string error_message;
+
+  auto regex_a = cache.get(u"a", &error_message);
+  auto regex_b = cache.get(u"b", &error_message);
+  REQUIRE(cache.get(u"a", &error_message) == regex_a);
+
+  auto regex_c = cache.get(u"c", &error_message);
+  REQUIRE(cache.get_stats().evictions == 1);
+  REQUIRE(cache.get_stats().size == 2);
+
+  // 'b' was the least recently used entry, so it was evicted, but the regex
+  // remains usable by anyone still holding a reference to it.
+  REQUIRE(cache.get(u"a", &error_message) == regex_a);
+  REQUIRE(cache.get(u"c", &error_message) == regex_c);
+  REQUIRE(cache.get(u"b", &error_message) != regex_b);
+  Regex::MatchData match_data(*regex_b);
+  REQUIRE(regex_b->match(u"b", 1, match_data, Regex::IsEndSearch).type == MatchResult::Full);
+
+  cache.set_capacity(1);
+  REQUIRE(cache.get_stats().size == 1);
+  REQUIRE(cache.get_stats().capacity == 1);
+
+  cache.clear();
+  auto stats = cache.get_stats();
+  REQUIRE(stats.size == 0);
+  REQUIRE(stats.hits == 0);
+  REQUIRE(stats.misses == 0);
+}
+
+TEST_CASE("RegexCache::get - does not cache invalid patterns") {
+  RegexCache cache;
+  u16string error_message;
+
+  REQUIRE(cache.get(u"(", &error_message) == nullptr);
+  REQUIRE(!error_message.empty());
+  REQUIRE(cache.get_stats().size == 0);
+
+  error_message.clear();
+  REQUIRE(cache.get(u"(", &error_message) == nullptr);
+  REQUIRE(!error_message.empty());
+}
+
+TEST_CASE("RegexCache::serialize - preloads the cached regexes into another cache") {
+  RegexCache cache;
+  u16string error_message;
+  cache.get(u"a+b", &error_message);
+  cache.get(u"A+B", &error_message, true);
+  cache.get(u"a+b", &error_message);
+
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  cache.serialize(serializer);
+
+  RegexCache new_cache(1);
+  Deserializer deserializer(bytes);
+  REQUIRE(new_cache.deserialize(deserializer));
+  REQUIRE(new_cache.get_stats().size == 1);
+
+  // The most recently used regex is kept, and is found without compiling it.
+  auto regex = new_cache.get(u"a+b", &error_message);
+  REQUIRE(new_cache.get_stats().hits == 1);
+  REQUIRE(new_cache.get_stats().misses == 0);
+  Regex::MatchData match_data(*regex);
+  REQUIRE(regex->match(u"caab", 4, match_data, Regex::IsEndSearch).type == MatchResult::Full);
+
+  bytes[0]++;
+  Deserializer invalid_deserializer(bytes);
+  REQUIRE(!new_cache.deserialize(invalid_deserializer));
+}
+
+TEST_CASE("RegexCache::get - can be used from multiple threads") {
+  RegexCache cache(8);
+  vector<std::future<bool>> futures;
+
+  for (unsigned i = 0; i < 4; i++) {
+    futures.push_back(std::async(std::launch::async, [&cache, i]() {
+      for (unsigned j = 0; j < 200; j++) {
+        u16string error_message;
+        u16string pattern = u"x" + u16string(1 + (i + j) % 12, u'y');
+        auto regex = cache.get(pattern, &error_message);
+        if (!regex) return false;
+
+        u16string subject = u"axyyyyyyyyyyyyz";
+        Regex::MatchData match_data(*regex);
+        if (regex->match(subject.data(), subject.size(), match_data, Regex::IsEndSearch).type != MatchResult::Full) {
+          return false;
+        }
+      }
+      return true;
+    }));
+  }
+
+  for (auto &future : futures) REQUIRE(future.get());
+
+  auto stats = cache.get_stats();
+  REQUIRE(stats.hits + stats.misses == 800);
+  REQUIRE(stats.size <= 8);
+}
+
+TEST_CASE("Regex::literal - returns the text matched by patterns without special characters") {
+  REQUIRE(*Regex(u"abc", nullptr).literal() == u"abc");
+  REQUIRE(*Regex(u"a\\.b\\\\c\\r\\n", nullptr).literal() == u"a.b\\c\r\n");
+  REQUIRE(*Regex(u"\\u00e9", nullptr).literal() == u"é");
+  REQUIRE(!Regex(u"a.c", nullptr).literal());
+  REQUIRE(!Regex(u"ab*", nullptr).literal());
+  REQUIRE(!Regex(u"\\d", nullptr).literal());
+  REQUIRE(!Regex(u"", nullptr).literal());
+}
+
+TEST_CASE("Regex::required_literal - returns the longest text that every match contains") {
+  REQUIRE(*Regex(u"abc", nullptr).required_literal() == u"abc");
+  REQUIRE(*Regex(u"ab\\.c+d", nullptr).required_literal() == u"ab.c");
+  REQUIRE(*Regex(u"x*hello\\d*world", nullptr).required_literal() == u"hello");
+  REQUIRE(*Regex(u"(a|b)function[a-z]+", nullptr).required_literal() == u"function");
+  REQUIRE(*Regex(u"\\bfoo?bar\\b", nullptr).required_literal() == u"bar");
+  REQUIRE(*Regex(u"abc{2}de", nullptr).required_literal() == u"abc");
+  REQUIRE(*Regex(u"ab{0,3}", nullptr).required_literal() == u"a");
+  REQUIRE(*Regex(u"Method", nullptr, true).required_literal() == u"Method");
+  REQUIRE(*Regex(u"Fork", nullptr, true).required_literal() == u"For");
+
+  // Patterns that have no required text or whose matches could span lines
+  REQUIRE(!Regex(u"a|bcd", nullptr).required_literal());
+  REQUIRE(!Regex(u"abc\\s", nullptr).required_literal());
+  REQUIRE(!Regex(u"abc[^d]", nullptr).required_literal());
+  REQUIRE(!Regex(u"abc\\n", nullptr).required_literal());
+  REQUIRE(!Regex(u"\\Aabc", nullptr).required_literal());
+  REQUIRE(!Regex(u"(?s)abc", nullptr).required_literal());
+  REQUIRE(!Regex(u".*", nullptr).required_literal());
+  REQUIRE(!Regex(u"", nullptr).required_literal());
+}
+
+TEST_CASE("Regex::alternation - combines patterns into one regex whose matches are tagged with a mark") {
+  Regex digits(u"\\d+", nullptr);
+  Regex repeated(u"(\\w)\\1", nullptr, true);
+  Regex quoted(u"(['\"]).*?\\1", nullptr);
+
+  auto pattern = Regex::alternation({&digits, &repeated, &quoted});
+  REQUIRE(pattern);
+
+  u16string error_message;
+  Regex combined(*pattern, &error_message);
+  REQUIRE(error_message.empty());
+  REQUIRE(combined.capture_count() == 2);
+
+  Regex::MatchData match_data(combined);
+  MatchResult result = combined.match(u"xY aA 'b' 42", 12, match_data, Regex::IsEndSearch);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.start_offset == 3);
+  REQUIRE(result.end_offset == 5);
+  REQUIRE(u16string(match_data.mark()) == u"1");
+
+  result = combined.match(u"'ab' 42", 7, match_data, Regex::IsEndSearch);
+  REQUIRE(result.start_offset == 0);
+  REQUIRE(result.end_offset == 4);
+  REQUIRE(u16string(match_data.mark()) == u"2");
+
+  Regex unicode(u"a", nullptr, false, true);
+  REQUIRE(!Regex::alternation({&digits, &unicode}));
+}
+
+TEST_CASE("Regex::serialize - restores compiled regexes without compiling them again") {
+  Regex words(u"(\\w+) \\1", nullptr);
+  Regex insensitive(u"\\bcat", nullptr, true);
+  Regex unicode(u"\\x{1F600}+", nullptr, false, true);
+
+  vector<uint8_t> bytes;
+  Serializer serializer(bytes);
+  REQUIRE(Regex::serialize({&words, &insensitive, &unicode}, serializer));
+
+  Deserializer deserializer(bytes);
+  auto regexes = Regex::deserialize(deserializer);
+  REQUIRE(regexes);
+  REQUIRE(regexes->size() == 3);
+  REQUIRE((*regexes)[0].source() == words.source());
+  REQUIRE((*regexes)[0].capture_count() == 1);
+  REQUIRE((*regexes)[1].ignore_case());
+  REQUIRE(!(*regexes)[1].unicode());
+  REQUIRE((*regexes)[2].unicode());
+
+  const Regex &restored_words = (*regexes)[0];
+  Regex::MatchData match_data(restored_words);
+  MatchResult result = restored_words.match(u"a bb bb", 7, match_data, Regex::IsEndSearch);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.start_offset == 2);
+  REQUIRE(result.end_offset == 7);
+
+  const Regex &restored_insensitive = (*regexes)[1];
+  Regex::MatchData insensitive_match_data(restored_insensitive);
+  result = restored_insensitive.match(u"Concat CAT", 10, insensitive_match_data, Regex::IsEndSearch);
+  REQUIRE(result.start_offset == 7);
+
+  const Regex &restored_unicode = (*regexes)[2];
+  Regex::MatchData unicode_match_data(restored_unicode);
+  result = restored_unicode.match(u"x\U0001F600\U0001F600", 5, unicode_match_data, Regex::IsEndSearch);
+  REQUIRE(result.start_offset == 1);
+  REQUIRE(result.end_offset == 5);
+
+  // Regexes whose compiled patterns were corrupted are compiled again from
+  // their sources, and corrupted sources are rejected.
+  vector<uint8_t> corrupted_bytes(bytes);
+  corrupted_bytes[corrupted_bytes.size() - 8] ^= 0xFF;
+  Deserializer corrupted_deserializer(corrupted_bytes);
+  auto recompiled_regexes = Regex::deserialize(corrupted_deserializer);
+  REQUIRE(recompiled_regexes);
+  REQUIRE(recompiled_regexes->size() == 3);
+  REQUIRE((*recompiled_regexes)[1].ignore_case());
+  Regex::MatchData recompiled_match_data((*recompiled_regexes)[0]);
+  result = (*recompiled_regexes)[0].match(u"a bb bb", 7, recompiled_match_data, Regex::IsEndSearch);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.start_offset == 2);
+
+  corrupted_bytes = bytes;
+  corrupted_bytes[25]++;
+  Deserializer corrupted_source_deserializer(corrupted_bytes);
+  REQUIRE(!Regex::deserialize(corrupted_source_deserializer));
+
+  // Truncated data and regexes that failed to compile are rejected.
+  vector<uint8_t> truncated_bytes(bytes.begin(), bytes.end() - 1);
+  Deserializer truncated_deserializer(truncated_bytes);
+  REQUIRE(!Regex::deserialize(truncated_deserializer));
+
+  u16string error_message;
+  Regex invalid(u"(", &error_message);
+  REQUIRE(!Regex::serialize({&words, &invalid}, serializer));
+}
+
+TEST_CASE("Regex::is_backtracking_prone - detects nested unbounded repetitions") {
+  REQUIRE(Regex(u"(a+)+b", nullptr).is_backtracking_prone());
+  REQUIRE(Regex(u"(?:\\w+\\s?)*$", nullptr).is_backtracking_prone());
+  REQUIRE(Regex(u"((ab*)c)*", nullptr).is_backtracking_prone());
+  REQUIRE(Regex(u"(x[a-z]*){2,}", nullptr).is_backtracking_prone());
+
+  REQUIRE(!Regex(u"a+b+", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"(a+)?b", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"(ab){2,5}", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"(?>a+)+b", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"(a++)+b", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"[(a+)]+", nullptr).is_backtracking_prone());
+  REQUIRE(!Regex(u"\\(a+\\)+", nullptr).is_backtracking_prone());
+}
+
+TEST_CASE("Regex::set_engine - matches backtracking-prone patterns in linear time") {
+  Regex regex(u"(a+)+$", nullptr);
+  u16string subject(5000, u'a');
+  subject += u"b";
+  Regex::MatchData match_data(regex);
+  match_data.set_limits(100000, 0);
+
+  MatchResult result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Error);
+
+  regex.set_engine(Regex::Engine::Automatic);
+  result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::None);
+
+  // Partial matches and capture groups are reported in the same way by both
+  // engines.
+  result = regex.match(u"baa", 3, match_data, Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Partial);
+  REQUIRE(result.start_offset == 1);
+  result = regex.match(u"baa", 3, match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.start_offset == 1);
+  REQUIRE(result.end_offset == 3);
+  REQUIRE(match_data.capture_offsets(1)->first == 1);
+  REQUIRE(match_data.capture_offsets(1)->second == 3);
+
+  // Patterns that it doesn't support fall back to backtracking.
+  Regex backreference(u"(a)\\1", nullptr);
+  backreference.set_engine(Regex::Engine::NFA);
+  Regex::MatchData backreference_match_data(backreference);
+  result = backreference.match(u"baa", 3, backreference_match_data, Regex::IsEndSearch);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(backreference_match_data.capture_offsets(1)->first == 1);
+}
+
+TEST_CASE("Regex::set_default_engine - applies to regexes without an engine of their own") {
+  // Restores the default engine even if an assertion fails.
+  struct DefaultEngineScope {
+    DefaultEngineScope(Regex::Engine engine) { Regex::set_default_engine(engine); }
+    ~DefaultEngineScope() { Regex::set_default_engine(Regex::Engine::Backtracking); }
+  };
+
+  u16string subject(5000, u'a');
+  subject += u"b";
+  Regex regex(u"(a+)+$", nullptr);
+  Regex backtracking_regex(u"(a+)+$", nullptr);
+  backtracking_regex.set_engine(Regex::Engine::Backtracking);
+  Regex::MatchData match_data(regex);
+  match_data.set_limits(100000, 0);
+
+  DefaultEngineScope scope(Regex::Engine::Automatic);
+  MatchResult result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::None);
+  result = backtracking_regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Error);
+}
+
+TEST_CASE("Regex::set_engine - the NFA engine finds the same matches as backtracking") {
+  const char16_t *patterns[] = {
+    u"a+b", u"(a|ab)(c|bcd)(d*)", u"(a+)+$", u"^a*?b", u"\\bab?\\b", u"\\Bb+",
+    u"[^\\r\\n]+$", u"(?:a|)*b", u"(|a)+", u"(a?)*?b", u"c{2,3}", u"[a-c]{1,}d?",
+    u"(?<name>a)(b)?", u".\\r?$", u"\\Ab", u"^$", u"\\s\\w", u"[\\d_-]+", u"(a*)+",
+    u"(a|b)*?c", u"\\x61\\x{62}", u"[^ab]", u"^|a", u"\\W", u"$", u"\\b", u"(ab|a)(bc|c)?",
+    u"(a|b|)+?$", u"b(?:a{0,2}b)*", u"[A-b]\\n?", u"", u"(\\w+\\s?)*$", u"\\h+\\V",
+    u"(?:(a)|(b))+", u"(a{1,2}){2,}", u"\\ba|b\\b", u"(\\B|a)+", u"(?:$|a)+", u"[\\r]?a",
+    u"a|ab|abc", u"[]a]", u"[^]a]+", u"(a+|b+)*c", u".*\\n", u"^\\s",
+  };
+  const u16string alphabet = u"abcdAB_ \r\n";
+
+  auto check_matches = [](const char16_t *pattern, bool ignore_case, const u16string &subject) {
+    Regex regex(pattern, nullptr, ignore_case);
+    Regex nfa_regex(pattern, nullptr, ignore_case);
+    nfa_regex.set_engine(Regex::Engine::NFA);
+    Regex::MatchData match_data(regex);
+    for (unsigned options = 0; options < 8; options++) {
+      MatchResult expected = regex.match(subject.data(), subject.size(), match_data, options);
+      vector<optional<std::pair<size_t, size_t>>> expected_captures;
+      for (uint32_t group = 0; group <= regex.capture_count(); group++) {
+        expected_captures.push_back(match_data.capture_offsets(group));
+      }
+
+      MatchResult result = nfa_regex.match(subject.data(), subject.size(), match_data, options);
+
+      REQUIRE(result.type == expected.type);
+      if (result.type == MatchResult::None) continue;
+      REQUIRE(result.start_offset == expected.start_offset);
+      REQUIRE(result.end_offset == expected.end_offset);
+      if (result.type == MatchResult::Partial) continue;
+      for (uint32_t group = 0; group <= regex.capture_count(); group++) {
+        REQUIRE((match_data.capture_offsets(group) == expected_captures[group]));
+      }
+    }
+  };
+
+  // Cases where PCRE starts a match between a `\r` and a `\n`, and where it
+  // ends nested loops over groups that can match the empty string.
+  const struct {
+    const char16_t *pattern;
+    bool ignore_case;
+    const char16_t *subject;
+  } cases[] = {
+    {u"\\Wfoo", false, u"bar\r\nfoo"},
+    {u"\\sa", false, u"x\r\na"},
+    {u"[^x]a", false, u"x\r\na"},
+    {u"(^\\n){1,2}", false, u"  \r\n\r"},
+    {u"(((a{0,3}?b+?|\\n\\r{1,2})*\\s?)*(\\b[^a]a)*)+", true, u" "},
+    {u"\\D([ab]?[\\s]*?(\\n?)*)*", false, u"\nb\r\r"},
+  };
+  for (const auto &test_case : cases) {
+    check_matches(test_case.pattern, test_case.ignore_case, test_case.subject);
+  }
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 300; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const char16_t *pattern = patterns[rand() % (sizeof(patterns) / sizeof(patterns[0]))];
+    u16string subject;
+    for (uint32_t j = 0, length = rand() % 12; j < length; j++) {
+      subject += alphabet[rand() % alphabet.size()];
+    }
+    check_matches(pattern, rand() % 2, subject);
+  }
+}
+
+TEST_CASE("Regex::MatchData::capture_offsets - returns the offsets of each capture group") {
+  using Offsets = std::pair<size_t, size_t>;
+  Regex regex(u"(a+)(x)?(b)", nullptr);
+  Regex::MatchData match_data(regex);
+  regex.match(u"caab", 4, match_data, Regex::IsEndSearch);
+  REQUIRE(*match_data.capture_offsets(0) == Offsets(1, 4));
+  REQUIRE(*match_data.capture_offsets(1) == Offsets(1, 3));
+  REQUIRE(!match_data.capture_offsets(2));
+  REQUIRE(*match_data.capture_offsets(3) == Offsets(3, 4));
+  REQUIRE(!match_data.capture_offsets(4));
+}
+
+TEST_CASE("Regex::MatchData::can_match - larger match data finds the same matches") {
+  Regex large_regex(u"(a)(b)(c)(d)(e)(f)(g)(h)", nullptr);
+  const char16_t *patterns[] = {u"ab\\r?$", u"(a)(b)?c", u"a\\nb", u"(\\w+)\\s", u"(?<=a)(b+)", u"((a|b)*)c"};
+  const char16_t *subjects[] = {u"xab\r", u"xa", u"aab", u"xabc", u"ab\r\nb", u"abab c", u"ba"};
+
+  for (auto engine : {Regex::Engine::Backtracking, Regex::Engine::NFA}) {
+    for (const char16_t *pattern : patterns) {
+      Regex regex(pattern, nullptr);
+      regex.set_engine(engine);
+      for (const char16_t *subject : subjects) {
+        u16string text(subject);
+        for (unsigned options = 0; options < 8; options++) {
+          Regex::MatchData large_match_data(large_regex);
+          large_regex.match(u"abcdefgh", 8, large_match_data, Regex::IsEndSearch);
+          REQUIRE(large_match_data.can_match(regex));
+
+          Regex::MatchData match_data(regex);
+          auto result = regex.match(text.data(), text.size(), match_data, options);
+          auto large_result = regex.match(text.data(), text.size(), large_match_data, options);
+          REQUIRE(large_result.type == result.type);
+          if (result.type == Regex::MatchResult::None) continue;
+          REQUIRE(large_result.start_offset == result.start_offset);
+          REQUIRE(large_result.end_offset == result.end_offset);
+          if (result.type != Regex::MatchResult::Full) continue;
+          for (uint32_t group = 0; group <= regex.capture_count(); group++) {
+            REQUIRE((large_match_data.capture_offsets(group) == match_data.capture_offsets(group)));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Regex::MatchData::set_limits - stops match attempts that exceed the match limit") {
+  Regex regex(u"(a+)+$", nullptr);
+  u16string subject(30, u'a');
+  subject += u"b";
+
+  Regex::MatchData match_data(regex);
+  match_data.set_limits(10000, 0);
+  MatchResult result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Error);
+  REQUIRE(result.limit_exceeded);
+
+  result = regex.match(u"aab", 3, match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::None);
+  REQUIRE(!result.limit_exceeded);
+
+  Regex::set_default_limits(10000, 0);
+  Regex::MatchData default_match_data(regex);
+  result = regex.match(subject.data(), subject.size(), default_match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  Regex::set_default_limits(0, 0);
+  REQUIRE(result.limit_exceeded);
+}
+
+TEST_CASE("Regex::set_jit_stack_size - allows deeply nested matches") {
+  Regex regex(u"(?:(a)|b)*$", nullptr);
+  u16string subject(200000, u'a');
+  Regex::MatchData match_data(regex);
+  MatchResult result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  REQUIRE(result.type == MatchResult::Error);
+  REQUIRE(result.limit_exceeded);
+
+  Regex::set_jit_stack_size(64 * 1024 * 1024);
+  result = regex.match(subject.data(), subject.size(), match_data, Regex::IsEndSearch | Regex::IsEndOfLine);
+  Regex::set_jit_stack_size(0);
+  REQUIRE(result.type == MatchResult::Full);
+  REQUIRE(result.end_offset == subject.size());
+}
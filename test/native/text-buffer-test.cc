@@ -4,6 +4,7 @@
 #include "text-slice.h"
 #include "regex.h"
 #include <future>
+#include <set>
 #include <unistd.h>
 
 using std::move;
@@ -427,6 +428,796 @@ TEST_CASE("TextBuffer::find_all - empty matches") {
   }));
 }
 
+TEST_CASE("TextBuffer::find_backward") {
+  TextBuffer buffer{u"abc\r\nab\n\n\nxyz\nxy"};
+  Regex regex(u"ab", nullptr);
+  REQUIRE(*buffer.find_backward(regex) == (Range{Point{1, 0}, Point{1, 2}}));
+  REQUIRE(*buffer.find_backward(regex, {{0, 0}, {1, 1}}) == (Range{Point{0, 0}, Point{0, 2}}));
+  REQUIRE(!buffer.find_backward(regex, {{0, 1}, {1, 1}}));
+  REQUIRE(*buffer.find_backward(Regex(u"xyz?", nullptr)) == (Range{Point{5, 0}, Point{5, 2}}));
+  REQUIRE(*buffer.find_backward(Regex(u"c\r\na", nullptr)) == (Range{Point{0, 2}, Point{1, 1}}));
+}
+
+TEST_CASE("TextBuffer::find_backward - random edits") {
+  TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"ab\r\n";
+    auto random_string = [&](uint32_t length) {
+      u16string result;
+      for (uint32_t j = 0; j < length; j++) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+
+    TextBuffer buffer{random_string(40)};
+    for (uint32_t j = 0; j < 5; j++) {
+      buffer.set_text_in_range(get_random_range(rand, buffer), random_string(rand() % 5));
+    }
+
+    for (const char16_t *pattern : {u"a+", u"b[ab]*", u"(?:ab)+"}) {
+      Regex regex(pattern, nullptr);
+      Range range = get_random_range(rand, buffer);
+      auto matches = buffer.find_all(regex, range);
+      auto match = buffer.find_backward(regex, range);
+      if (matches.empty()) {
+        REQUIRE(!match);
+      } else {
+        REQUIRE(match);
+        REQUIRE(*match == matches.back());
+      }
+    }
+  }
+}
+
+TEST_CASE("TextBuffer::count_all") {
+  TextBuffer buffer{u"abc\r\ndef abc\nab\n"};
+  Regex regex(u"ab", nullptr);
+  REQUIRE(buffer.count_all(regex).count == 3);
+  REQUIRE(buffer.count_all(regex, {{0, 1}, {2, 1}}).count == 1);
+  REQUIRE(buffer.count_all(regex, Range::all_inclusive(), 2).count == 2);
+  REQUIRE(buffer.count_all(regex, Range::all_inclusive(), 0).count == 0);
+  REQUIRE(buffer.count_all(Regex(u"^", nullptr)).count == buffer.find_all(Regex(u"^", nullptr)).size());
+  REQUIRE(buffer.count_all(regex).status == TextBuffer::SearchStatus::Completed);
+
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u"ab");
+  REQUIRE(buffer.count_all(regex).count == 4);
+  REQUIRE(snapshot->count_all(regex).count == 3);
+  delete snapshot;
+
+  buffer.set_text(u"aab\naa\n" + u16string(30, 'a') + u"b");
+  Regex::set_default_limits(10000, 0);
+  auto result = buffer.count_all(Regex(u"(a+)+$", nullptr));
+  Regex::set_default_limits(0, 0);
+  REQUIRE(result.status == TextBuffer::SearchStatus::LimitExceeded);
+  REQUIRE(result.count == 1);
+}
+
+TEST_CASE("TrigramIndex::candidate_rows") {
+  TrigramIndex index(Text{u"abcd\nxyz\nABCDE\r\nab\nbcd"});
+  REQUIRE(index.row_count() == 5);
+  REQUIRE(*index.candidate_rows(u"bcd") == vector<uint32_t>({0, 2, 4}));
+  REQUIRE(*index.candidate_rows(u"abcd") == vector<uint32_t>({0, 2}));
+  REQUIRE(*index.candidate_rows(u"cde") == vector<uint32_t>({2}));
+  REQUIRE(index.candidate_rows(u"abz")->empty());
+  REQUIRE(!index.candidate_rows(u"ab"));
+
+  Text new_text{u"abcd\nxyz\nxyz abc\nnew\nABCDE\r\nbcd"};
+  index.update({{1, 2, 1, 4}, {3, 4, 5, 5}}, new_text);
+  REQUIRE(index.row_count() == 6);
+  REQUIRE(*index.candidate_rows(u"xyz") == vector<uint32_t>({1, 2}));
+  REQUIRE(*index.candidate_rows(u"abc") == vector<uint32_t>({0, 2, 4}));
+  REQUIRE(*index.candidate_rows(u"bcd") == vector<uint32_t>({0, 4, 5}));
+  REQUIRE(index.candidate_rows(u"new")->size() == 1);
+}
+
+TEST_CASE("TrigramIndex::update - random updates") {
+  auto t = time(nullptr);
+  for (uint i = 0; i < 20; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"abAB";
+    auto random_line = [&]() {
+      u16string result;
+      for (uint32_t j = rand() % 6; j > 0; j--) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+    auto join_lines = [](const vector<u16string> &lines) {
+      u16string result;
+      for (size_t j = 0; j < lines.size(); j++) {
+        if (j > 0) result += u"\n";
+        result += lines[j];
+      }
+      return result;
+    };
+
+    vector<u16string> lines;
+    for (uint32_t j = 0; j < 20; j++) lines.push_back(random_line());
+    TrigramIndex index(Text{join_lines(lines)});
+
+    for (uint32_t j = 0; j < 100; j++) {
+      // Replace up to two disjoint groups of rows, leaving at least one row
+      // in the text.
+      vector<TrigramIndex::RowSplice> splices;
+      vector<u16string> new_lines;
+      uint32_t old_row = 0;
+      for (uint32_t k = rand() % 2 + 1; k > 0 && old_row < lines.size(); k--) {
+        uint32_t start_row = old_row + rand() % (lines.size() - old_row);
+        uint32_t end_row = start_row + 1 + rand() % std::min<uint32_t>(3, lines.size() - start_row);
+        new_lines.insert(new_lines.end(), lines.begin() + old_row, lines.begin() + start_row);
+        uint32_t new_start_row = new_lines.size();
+        for (uint32_t l = rand() % 4 + 1; l > 0; l--) new_lines.push_back(random_line());
+        splices.push_back({start_row, end_row, new_start_row, static_cast<uint32_t>(new_lines.size())});
+        old_row = end_row;
+      }
+      new_lines.insert(new_lines.end(), lines.begin() + old_row, lines.end());
+      lines = new_lines;
+
+      Text new_text{join_lines(lines)};
+      index.update(splices, new_text);
+      TrigramIndex rebuilt_index(new_text);
+      REQUIRE(index.row_count() == rebuilt_index.row_count());
+      for (const char16_t *trigram : {u"aba", u"bbb", u"aab", u"bab", u"aaaa"}) {
+        REQUIRE(*index.candidate_rows(trigram) == *rebuilt_index.candidate_rows(trigram));
+      }
+    }
+  }
+}
+
+TEST_CASE("TextBuffer::build_trigram_index - random edits") {
+  TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"abAB\r\n";
+    auto random_string = [&](uint32_t length) {
+      u16string result;
+      for (uint32_t j = 0; j < length; j++) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+
+    TextBuffer indexed_buffer{random_string(60)};
+    TextBuffer buffer{indexed_buffer.text()};
+    indexed_buffer.build_trigram_index();
+    REQUIRE(indexed_buffer.has_trigram_index());
+
+    vector<TextBuffer::Snapshot *> snapshots;
+    for (uint32_t j = 0; j < 10; j++) {
+      Range edit_range = get_random_range(rand, buffer);
+      u16string edit_text = random_string(rand() % 5);
+      buffer.set_text_in_range(edit_range, u16string(edit_text));
+      indexed_buffer.set_text_in_range(edit_range, move(edit_text));
+      REQUIRE(indexed_buffer.text() == buffer.text());
+
+      switch (rand() % 4) {
+        case 0:
+          indexed_buffer.flush_changes();
+          break;
+        case 1:
+          snapshots.push_back(indexed_buffer.create_snapshot());
+          break;
+        case 2:
+          if (!snapshots.empty()) {
+            snapshots.back()->flush_preceding_changes();
+            delete snapshots.back();
+            snapshots.pop_back();
+          }
+          break;
+      }
+
+      Range range = get_random_range(rand, buffer);
+      for (const char16_t *pattern : {u"aba", u"ab+a", u"Abb", u"b[ab]ba", u"bab+a"}) {
+        bool ignore_case = rand() % 2;
+        Regex regex(pattern, nullptr, ignore_case);
+        REQUIRE(indexed_buffer.find_all(regex, range) == buffer.find_all(regex, range));
+        REQUIRE(indexed_buffer.find(regex, range) == buffer.find(regex, range));
+        REQUIRE(indexed_buffer.count_all(regex, range, 2).count == buffer.count_all(regex, range, 2).count);
+      }
+    }
+
+    for (auto snapshot : snapshots) delete snapshot;
+  }
+}
+
+TEST_CASE("TextBuffer::reset - discards or replaces the trigram index") {
+  TextBuffer buffer{u"abc\ndef"};
+  buffer.build_trigram_index();
+  buffer.reset(Text{u"def\nabc"});
+  REQUIRE(!buffer.has_trigram_index());
+  REQUIRE(buffer.find_all(Regex(u"abc", nullptr)) == vector<Range>({Range{Point{1, 0}, Point{1, 3}}}));
+
+  Text new_text{u"xyz\nabc\nabc"};
+  TrigramIndex index(new_text);
+  auto snapshot = buffer.create_snapshot();
+  buffer.reset(move(new_text), move(index));
+  REQUIRE(buffer.has_trigram_index());
+  REQUIRE(buffer.find_all(Regex(u"abc", nullptr)) == vector<Range>({
+    Range{Point{1, 0}, Point{1, 3}},
+    Range{Point{2, 0}, Point{2, 3}},
+  }));
+  REQUIRE(snapshot->text() == u"def\nabc");
+  delete snapshot;
+}
+
+TEST_CASE("Snapshot::scan") {
+  TextBuffer buffer{u"abc\ndefg\nhijkl"};
+  auto snapshot = buffer.create_snapshot();
+  buffer.set_text_in_range({{0, 0}, {0, 0}}, u"xyz ");
+  Regex regex(u"\\w+", nullptr);
+
+  vector<Range> matches;
+  snapshot->scan(regex, Range::all_inclusive(), [&matches](Range match) {
+    matches.push_back(match);
+    return false;
+  });
+  REQUIRE(matches == snapshot->find_all(regex));
+
+  matches.clear();
+  snapshot->scan(regex, {{0, 1}, {2, 2}}, [&matches](Range match) {
+    matches.push_back(match);
+    return matches.size() == 2;
+  });
+  REQUIRE(matches == vector<Range>({
+    Range{Point{0, 1}, Point{0, 3}},
+    Range{Point{1, 0}, Point{1, 4}},
+  }));
+
+  delete snapshot;
+}
+
+TEST_CASE("Snapshot - concurrent readers") {
+  Generator rand(0);
+  TextBuffer buffer{get_random_string(rand, 5000)};
+  vector<TextBuffer::Snapshot *> pinning_snapshots;
+  for (uint32_t i = 0; i < 300; i++) {
+    buffer.set_text_in_range(get_random_range(rand, buffer), get_random_string(rand, rand() % 10));
+    if (i % 100 == 0) pinning_snapshots.push_back(buffer.create_snapshot());
+  }
+
+  auto snapshot = buffer.create_snapshot();
+  Regex regex(u"[a-d]+\\n", nullptr);
+  vector<Range> ranges;
+  for (uint32_t i = 0; i < 50; i++) ranges.push_back(get_random_range(rand, buffer));
+
+  auto read_snapshot = [snapshot, &regex, &ranges]() {
+    u16string result;
+    for (const TextSlice &chunk : snapshot->chunks()) result.append(chunk.begin(), chunk.end());
+    for (const Range &range : ranges) {
+      for (const TextSlice &chunk : snapshot->chunks_in_range(range)) result.append(chunk.begin(), chunk.end());
+      result += snapshot->text_in_range(range);
+    }
+    for (const Range &match : snapshot->find_all(regex)) {
+      result += snapshot->text_in_range(match);
+    }
+    return result;
+  };
+
+  u16string expected_result = read_snapshot();
+  vector<std::future<u16string>> readers;
+  for (uint32_t i = 0; i < 8; i++) {
+    readers.push_back(std::async(std::launch::async, read_snapshot));
+  }
+
+  for (auto &reader : readers) REQUIRE(reader.get() == expected_result);
+  REQUIRE(snapshot->text() == buffer.text());
+
+  delete snapshot;
+  for (auto pinning_snapshot : pinning_snapshots) delete pinning_snapshot;
+}
+
+TEST_CASE("TextBuffer::find - matches that start at the LF of a CRLF split across chunks") {
+  TextBuffer buffer{u"ab\r"};
+  buffer.set_text_in_range({{1, 0}, {1, 0}}, u"\ncd");
+  REQUIRE(buffer.text() == u"ab\r\ncd");
+  REQUIRE(buffer.find(Regex(u"\\nc", nullptr)) == (Range{Point{0, 2}, Point{1, 1}}));
+  REQUIRE(buffer.find(Regex(u"\\n", nullptr)) == (Range{Point{0, 2}, Point{1, 0}}));
+  REQUIRE(buffer.find_all(Regex(u"(?=\\n)", nullptr)) == vector<Range>({Range{Point{0, 2}, Point{0, 2}}}));
+}
+
+TEST_CASE("TextBuffer::find - reuses the buffers of a search context") {
+  TextBuffer buffer{u"abc\ndef abc\nghi"};
+  Regex letters(u"[a-z]+", nullptr);
+  Regex groups(u"(a)(b)(c)", nullptr);
+
+  SearchContext context;
+  auto &match_data = context.match_data_for(groups);
+  REQUIRE(match_data.can_match(letters));
+  REQUIRE(!SearchContext().match_data_for(letters).can_match(groups));
+
+  REQUIRE(buffer.find_all(letters, context) == buffer.find_all(letters));
+  REQUIRE(buffer.find_all(groups, context) == vector<Range>({
+    Range{Point{0, 0}, Point{0, 3}},
+    Range{Point{1, 4}, Point{1, 7}},
+  }));
+  REQUIRE(&context.match_data_for(letters) == &match_data);
+  REQUIRE(*buffer.find(letters, context, {{1, 1}, {3, 0}}) == (Range{Point{1, 1}, Point{1, 3}}));
+
+  MarkerIndex index;
+  REQUIRE(buffer.find_and_mark_all(index, 0, false, groups, context) == 2);
+
+  // Searches nested within other searches take their own pooled context.
+  vector<Range> nested_matches;
+  buffer.scan(letters, Range::all_inclusive(), [&](Range match) {
+    auto nested_match = buffer.find(groups, match);
+    if (nested_match) nested_matches.push_back(*nested_match);
+    return false;
+  });
+  REQUIRE(nested_matches == buffer.find_all(groups));
+}
+
+TEST_CASE("TextBuffer::scan - reports searches that exceed the match limit") {
+  TextBuffer buffer{u"aab\naa\n" + u16string(30, 'a') + u"b"};
+  Regex regex(u"(a+)+$", nullptr);
+  vector<Range> matches;
+  auto record_match = [&matches](Range match) {
+    matches.push_back(match);
+    return false;
+  };
+
+  Regex::set_default_limits(10000, 0);
+  auto status = buffer.scan(regex, {{0, 0}, {2, 0}}, record_match);
+  REQUIRE(status == TextBuffer::SearchStatus::Completed);
+  REQUIRE(matches == vector<Range>({Range{Point{1, 0}, Point{1, 2}}}));
+
+  matches.clear();
+  status = buffer.scan(regex, Range::all_inclusive(), record_match);
+  Regex::set_default_limits(0, 0);
+  REQUIRE(status == TextBuffer::SearchStatus::LimitExceeded);
+  REQUIRE(matches == vector<Range>({Range{Point{1, 0}, Point{1, 2}}}));
+}
+
+TEST_CASE("TextBuffer::scan - can be cancelled during a search without matches") {
+  TextBuffer buffer{u16string(1024 * 1024, 'a') + u"b"};
+  Regex regex(u"b", nullptr);
+  vector<Range> matches;
+  auto record_match = [&matches](Range match) {
+    matches.push_back(match);
+    return false;
+  };
+
+  uint32_t poll_count = 0;
+  auto status = buffer.scan(regex, Range::all_inclusive(), record_match, [&poll_count]() {
+    return ++poll_count == 3;
+  });
+  REQUIRE(status == TextBuffer::SearchStatus::Cancelled);
+  REQUIRE(poll_count == 3);
+  REQUIRE(matches.empty());
+
+  // Searching a large chunk in pieces finds the same matches, including ones
+  // that span the ends of pieces.
+  u16string text;
+  while (text.size() < 300 * 1024) text += u"xyz\r\nab";
+  buffer.set_text(u16string(text));
+  Regex line_ending_regex(u"z\r\na", nullptr);
+  status = buffer.scan(line_ending_regex, Range::all_inclusive(), record_match, []() { return false; });
+  REQUIRE(status == TextBuffer::SearchStatus::Completed);
+  REQUIRE(matches == buffer.find_all(line_ending_regex));
+  REQUIRE(matches.size() == text.size() / 7);
+}
+
+// Applies a patch to a string using raw offsets. A patch can refer to points
+// between a CR and an LF (e.g. when a replacement removed the text between
+// them), which TextBuffer::set_text_in_range would clip.
+static u16string apply_patch(const u16string &text, const Patch &patch) {
+  vector<size_t> row_offsets{0};
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '\n') row_offsets.push_back(i + 1);
+  }
+
+  u16string result;
+  size_t offset = 0;
+  for (const auto &change : patch.get_changes()) {
+    size_t change_start = row_offsets[change.old_start.row] + change.old_start.column;
+    size_t change_end = row_offsets[change.old_end.row] + change.old_end.column;
+    result.append(text, offset, change_start - offset);
+    result += change.new_text->content;
+    offset = change_end;
+  }
+  result.append(text, offset, u16string::npos);
+  return result;
+}
+
+TEST_CASE("TextBuffer::find_all - NFA engine") {
+  TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"ab\r\n";
+    auto random_string = [&](uint32_t length) {
+      u16string result;
+      for (uint32_t j = 0; j < length; j++) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+
+    TextBuffer buffer{random_string(40)};
+    for (uint32_t j = 0; j < 5; j++) {
+      buffer.set_text_in_range(get_random_range(rand, buffer), random_string(rand() % 5));
+    }
+
+    for (const char16_t *pattern : {u"(a+)+b", u"(?:ab)+?", u"b[ab]*", u"a\\r?$", u"^b|a$"}) {
+      Regex regex(pattern, nullptr);
+      Regex nfa_regex(pattern, nullptr);
+      nfa_regex.set_engine(Regex::Engine::NFA);
+      Range range = get_random_range(rand, buffer);
+      REQUIRE(buffer.find_all(nfa_regex, range) == buffer.find_all(regex, range));
+    }
+  }
+}
+
+TEST_CASE("TextBuffer::replace_all - NFA engine") {
+  Regex letter_and_digits(u"([a-z])(\\d+)", nullptr);
+  Regex digits(u"\\d+", nullptr);
+  letter_and_digits.set_engine(Regex::Engine::NFA);
+  digits.set_engine(Regex::Engine::NFA);
+
+  TextBuffer buffer{u"a1 b22\nc333"};
+  auto result = buffer.replace_all(letter_and_digits, u"$2$1");
+  REQUIRE(result.replacement_count == 3);
+  REQUIRE(buffer.text() == u"1a 22b\n333c");
+  result = buffer.replace_all(digits, u"<$&>");
+  REQUIRE(buffer.text() == u"<1>a <22>b\n<333>c");
+}
+
+TEST_CASE("TextBuffer::replace_all - basic") {
+  TextBuffer buffer{u"a1 b22\r\nc333 d\r\n"};
+  auto result = buffer.replace_all(Regex(u"([a-z])(\\d+)", nullptr), u"$2$1-$$-$&-$3");
+  REQUIRE(result.replacement_count == 3);
+  REQUIRE(buffer.text() == u"1a-$-a1-$3 22b-$-b22-$3\r\n333c-$-c333-$3 d\r\n");
+  REQUIRE(buffer.is_modified());
+
+  REQUIRE(apply_patch(buffer.text(), result.inverted_changes) == u"a1 b22\r\nc333 d\r\n");
+  buffer.set_text_in_range({{1, 0}, {1, 14}}, u"c333");
+  buffer.set_text_in_range({{0, 0}, {0, 23}}, u"a1 b22");
+  REQUIRE(!buffer.is_modified());
+
+  result = buffer.replace_all(Regex(u"^", nullptr), u"// ", {{1, 0}, {2, 0}});
+  REQUIRE(result.replacement_count == 2);
+  REQUIRE(buffer.text() == u"a1 b22\r\n// c333 d\r\n// ");
+
+  result = buffer.replace_all(Regex(u"\\w+", nullptr), u"$&");
+  REQUIRE(result.replacement_count == 0);
+  REQUIRE(result.inverted_changes.get_change_count() == 0);
+
+  // Replacements that restore the original text leave no changes behind.
+  TextBuffer restored_buffer{u"a1 a2\na3"};
+  restored_buffer.set_text_in_range({{0, 3}, {0, 4}}, u"b");
+  restored_buffer.set_text_in_range({{1, 0}, {1, 1}}, u"b");
+  REQUIRE(restored_buffer.is_modified());
+  result = restored_buffer.replace_all(Regex(u"b", nullptr), u"a");
+  REQUIRE(result.replacement_count == 2);
+  REQUIRE(restored_buffer.text() == u"a1 a2\na3");
+  REQUIRE(!restored_buffer.is_modified());
+}
+
+TEST_CASE("TextBuffer::replace_all - capture groups outside of the match") {
+  TextBuffer buffer{u"xabbb xab"};
+  auto result = buffer.replace_all(Regex(u"a(?=(b+))", nullptr), u"[$1]");
+  REQUIRE(result.replacement_count == 2);
+  REQUIRE(buffer.text() == u"x[bbb]bbb x[b]b");
+
+  buffer.set_text(u"xa ya\r\nxa");
+  result = buffer.replace_all(Regex(u"(?<=(x|\n))a", nullptr), u"<$1>");
+  REQUIRE(result.replacement_count == 2);
+  REQUIRE(buffer.text() == u"x<x> ya\r\nx<x>");
+  REQUIRE(apply_patch(buffer.text(), result.inverted_changes) == u"xa ya\r\nxa");
+}
+
+TEST_CASE("TextBuffer::replace_all - random edits") {
+  for (uint32_t i = 0; i < 50; i++) {
+    auto t = time(nullptr);
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    TextBuffer buffer{get_random_string(rand, 20)};
+    u16string snapshot_text = buffer.text();
+    auto snapshot = buffer.create_snapshot();
+    for (uint32_t j = 0; j < 5; j++) {
+      buffer.set_text_in_range(get_random_range(rand, buffer), get_random_string(rand, 5));
+    }
+
+    const char16_t *patterns[] = {u"a", u"(\\w)\\w", u"\\s+", u"b(\\w?)"};
+    Regex regex(patterns[rand() % 4], nullptr);
+    u16string replacement = rand() % 2 ? u"<$1>" : u"";
+    Range range = get_random_range(rand, buffer);
+    u16string original_text = buffer.text();
+
+    TextBuffer expected_buffer{original_text};
+    auto matches = expected_buffer.find_all(regex, range);
+    for (auto iter = matches.rbegin(); iter != matches.rend(); ++iter) {
+      u16string new_text = replacement;
+      if (!new_text.empty() && regex.capture_count() > 0) {
+        auto match_text = expected_buffer.text_in_range(*iter);
+        Regex::MatchData match_data(regex);
+        regex.match(match_text.data(), match_text.size(), match_data, Regex::IsEndSearch);
+        auto group = match_data.capture_offsets(1);
+        new_text = u"<" + (group ? match_text.substr(group->first, group->second - group->first) : u"") + u">";
+      }
+      expected_buffer.set_text_in_range(*iter, move(new_text));
+    }
+
+    auto result = buffer.replace_all(regex, replacement, range);
+    REQUIRE(buffer.text() == expected_buffer.text());
+    REQUIRE(snapshot->text() == snapshot_text);
+
+    REQUIRE(apply_patch(buffer.text(), result.inverted_changes) == original_text);
+    delete snapshot;
+  }
+}
+
+using PatternMatches = vector<pair<Range, uint32_t>>;
+
+// Finds the matches of several patterns in the same way as
+// TextBuffer::find_all_multi, but one search at a time.
+static PatternMatches find_all_multi_slowly(TextBuffer &buffer, const vector<const Regex *> &regexes) {
+  PatternMatches result;
+  Point search_start;
+  Point end = buffer.extent();
+  for (;;) {
+    optional<pair<Range, uint32_t>> best_match;
+    for (uint32_t i = 0; i < regexes.size(); i++) {
+      auto match = buffer.find(*regexes[i], Range{search_start, end});
+      if (match && (!best_match || match->start < best_match->first.start)) best_match = pair<Range, uint32_t>(*match, i);
+    }
+    if (!best_match) break;
+    result.push_back(*best_match);
+    Range match_range = best_match->first;
+    if (match_range.end == end) break;
+    search_start = match_range.end;
+    if (match_range.start == match_range.end) {
+      search_start.column++;
+      if (buffer.clip_position(search_start).position == match_range.end) search_start = Point(search_start.row + 1, 0);
+    }
+  }
+  return result;
+}
+
+TEST_CASE("TextBuffer::find_all_multi - literals") {
+  TextBuffer buffer{u"// TODO: fix\r\n// FIXME todo\r\nTODOFIXME"};
+  Regex todo(u"TODO", nullptr);
+  Regex fixme(u"FIXME", nullptr);
+  Regex fix(u"FIX", nullptr);
+  Regex line_ending(u"\\r\\n", nullptr);
+
+  REQUIRE(buffer.find_all_multi({&todo, &fixme}) == PatternMatches({
+    {Range{Point{0, 3}, Point{0, 7}}, 0},
+    {Range{Point{1, 3}, Point{1, 8}}, 1},
+    {Range{Point{2, 0}, Point{2, 4}}, 0},
+    {Range{Point{2, 4}, Point{2, 9}}, 1},
+  }));
+
+  // When several patterns match at the same position, the first one wins.
+  REQUIRE(buffer.find_all_multi({&fix, &fixme}, Range{Point{1, 0}, Point{1, UINT32_MAX}}) == PatternMatches({
+    {Range{Point{1, 3}, Point{1, 6}}, 0},
+  }));
+
+  REQUIRE(buffer.find_all_multi({&line_ending, &todo}) == PatternMatches({
+    {Range{Point{0, 3}, Point{0, 7}}, 1},
+    {Range{Point{0, 12}, Point{1, 0}}, 0},
+    {Range{Point{1, 13}, Point{2, 0}}, 0},
+    {Range{Point{2, 0}, Point{2, 4}}, 1},
+  }));
+
+  Regex todo_ignoring_case(u"todo", nullptr, true);
+  Regex fixme_ignoring_case(u"fixme", nullptr, true);
+  buffer.set_text_in_range({{1, 9}, {1, 11}}, u"TO");
+  REQUIRE(buffer.text() == u"// TODO: fix\r\n// FIXME TOdo\r\nTODOFIXME");
+  REQUIRE(buffer.find_all_multi({&todo_ignoring_case, &fixme_ignoring_case}) == PatternMatches({
+    {Range{Point{0, 3}, Point{0, 7}}, 0},
+    {Range{Point{1, 3}, Point{1, 8}}, 1},
+    {Range{Point{1, 9}, Point{1, 13}}, 0},
+    {Range{Point{2, 0}, Point{2, 4}}, 0},
+    {Range{Point{2, 4}, Point{2, 9}}, 1},
+  }));
+}
+
+TEST_CASE("TextBuffer::find_all_multi - regexes") {
+  TextBuffer buffer{u"abba cddc 1234\nxyzzy"};
+  Regex word_with_double_letter(u"\\w*(\\w)\\1\\w*", nullptr);
+  Regex digits(u"\\d+", nullptr);
+  Regex line_start(u"^(x)(y)", nullptr);
+
+  REQUIRE(buffer.find_all_multi({&digits, &line_start, &word_with_double_letter}) == PatternMatches({
+    {Range{Point{0, 0}, Point{0, 4}}, 2},
+    {Range{Point{0, 5}, Point{0, 9}}, 2},
+    {Range{Point{0, 10}, Point{0, 14}}, 0},
+    {Range{Point{1, 0}, Point{1, 2}}, 1},
+    {Range{Point{1, 2}, Point{1, 5}}, 2},
+  }));
+
+  // Backreferences still refer to the group within their own pattern.
+  Regex repeated_x(u"(x)\\1", nullptr);
+  Regex repeated_z(u"(z)\\1", nullptr);
+  REQUIRE(buffer.find_all_multi({&repeated_x, &repeated_z}) == PatternMatches({
+    {Range{Point{1, 2}, Point{1, 4}}, 1},
+  }));
+
+  // Patterns that can't be combined into one regex are searched separately.
+  Regex unicode_digits(u"\\d+", nullptr, false, true);
+  REQUIRE(buffer.find_all_multi({&unicode_digits, &word_with_double_letter}) ==
+          buffer.find_all_multi({&digits, &word_with_double_letter}));
+
+  Regex empty(u"", nullptr);
+  REQUIRE(TextBuffer{u"ab"}.find_all_multi({&empty, &unicode_digits}) == PatternMatches({
+    {Range{Point{0, 0}, Point{0, 0}}, 0},
+    {Range{Point{0, 1}, Point{0, 1}}, 0},
+    {Range{Point{0, 2}, Point{0, 2}}, 0},
+  }));
+  REQUIRE(TextBuffer{u"ab"}.find_all_multi({}) == PatternMatches());
+}
+
+TEST_CASE("TextBuffer::find_all_multi - random edits") {
+  TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"ab\r\n";
+    auto random_string = [&](uint32_t length) {
+      u16string result;
+      for (uint32_t j = 0; j < length; j++) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+
+    TextBuffer buffer{random_string(40)};
+    for (uint32_t j = 0; j < 5; j++) {
+      buffer.set_text_in_range(get_random_range(rand, buffer), random_string(rand() % 5));
+    }
+
+    vector<Regex> literals;
+    for (uint32_t j = 0, n = 1 + rand() % 4; j < n; j++) {
+      // Matches that start or end within a CRLF are clipped, which makes the
+      // order of ties ambiguous when patterns are searched one at a time.
+      u16string literal = random_string(1 + rand() % 3);
+      if (literal.front() == '\n' || literal.back() == '\r') {
+        j--;
+        continue;
+      }
+      u16string pattern;
+      for (char16_t c : literal) {
+        if (c == '\r') pattern += u"\\r";
+        else if (c == '\n') pattern += u"\\n";
+        else pattern += c;
+      }
+      literals.push_back(Regex(pattern, nullptr));
+    }
+
+    vector<Regex> regexes;
+    regexes.push_back(Regex(u"a+b", nullptr));
+    regexes.push_back(Regex(u"(b)\\1", nullptr));
+    regexes.push_back(Regex(u"\\r?\\n", nullptr));
+    regexes.push_back(Regex(u"b\\r?a", nullptr));
+
+    vector<const Regex *> literal_pointers, regex_pointers;
+    for (const Regex &regex : literals) literal_pointers.push_back(&regex);
+    for (const Regex &regex : regexes) regex_pointers.push_back(&regex);
+    regex_pointers.insert(regex_pointers.begin() + rand() % regex_pointers.size(), &literals.front());
+
+    REQUIRE(buffer.find_all_multi(literal_pointers) == find_all_multi_slowly(buffer, literal_pointers));
+    REQUIRE(buffer.find_all_multi(regex_pointers) == find_all_multi_slowly(buffer, regex_pointers));
+  }
+}
+
+// Applies the changes reported by a live search to a set of ids, and returns
+// the ranges of the resulting markers in order.
+static vector<Range> apply_live_search_changes(TextBuffer::LiveSearch *live_search,
+                                               std::set<MarkerIndex::MarkerId> &ids) {
+  auto changes = live_search->take_changes();
+  for (auto id : changes.removed) REQUIRE(ids.erase(id) == 1);
+  for (auto id : changes.added) REQUIRE(ids.insert(id).second);
+  REQUIRE(live_search->match_count() == ids.size());
+
+  vector<Range> result;
+  for (auto id : ids) result.push_back(live_search->get_range(id));
+  std::sort(result.begin(), result.end(), [](const Range &a, const Range &b) {
+    return a.start < b.start || (a.start == b.start && a.end < b.end);
+  });
+  return result;
+}
+
+TEST_CASE("TextBuffer::LiveSearch - basic") {
+  TextBuffer buffer{u"abc def\nghi abc\njkl\n"};
+  auto live_search = buffer.create_live_search(std::make_shared<Regex>(u"abc", nullptr));
+  std::set<MarkerIndex::MarkerId> ids;
+
+  REQUIRE(apply_live_search_changes(live_search, ids) == vector<Range>({
+    Range{Point{0, 0}, Point{0, 3}},
+    Range{Point{1, 4}, Point{1, 7}},
+  }));
+
+  // Only matches near the edit are reported as changed.
+  buffer.set_text_in_range({{2, 0}, {2, 3}}, u"xabcx");
+  auto changes = live_search->take_changes();
+  REQUIRE(changes.added.size() == 1);
+  REQUIRE(changes.removed.empty());
+  REQUIRE(live_search->get_range(changes.added[0]) == (Range{Point{2, 1}, Point{2, 4}}));
+  ids.insert(changes.added[0]);
+
+  buffer.set_text_in_range({{1, 5}, {1, 5}}, u"-");
+  changes = live_search->take_changes();
+  REQUIRE(changes.added.empty());
+  REQUIRE(changes.removed.size() == 1);
+  ids.erase(changes.removed[0]);
+  REQUIRE(live_search->match_count() == 2);
+
+  // Matches that are added and removed again before the changes are taken
+  // are not reported.
+  buffer.set_text_in_range({{0, 4}, {0, 4}}, u"abc");
+  buffer.set_text_in_range({{0, 4}, {0, 7}}, u"");
+  changes = live_search->take_changes();
+  REQUIRE(changes.added.empty());
+  REQUIRE(changes.removed.empty());
+
+  buffer.set_text(u"abcabc");
+  REQUIRE(apply_live_search_changes(live_search, ids) == vector<Range>({
+    Range{Point{0, 0}, Point{0, 3}},
+    Range{Point{0, 3}, Point{0, 6}},
+  }));
+  REQUIRE(live_search->find_intersecting(Range{Point{0, 4}, Point{0, 4}}).size() == 1);
+
+  buffer.reset(Text{u"xyz\nabc"});
+  REQUIRE(apply_live_search_changes(live_search, ids) == vector<Range>({
+    Range{Point{1, 0}, Point{1, 3}},
+  }));
+
+  delete live_search;
+}
+
+TEST_CASE("TextBuffer::LiveSearch - random edits") {
+  TextBuffer::MAX_CHUNK_SIZE_TO_COPY = 2;
+
+  const vector<u16string> patterns{u"a+", u"ab*", u"a\\nb", u"\\r?\\n", u"a[^\\n]*b"};
+
+  auto t = time(nullptr);
+  for (uint i = 0; i < 100; i++) {
+    uint32_t seed = t * 1000 + i;
+    Generator rand(seed);
+    cout << "seed: " << seed << "\n";
+
+    const u16string alphabet = u"ab \r\n";
+    auto random_string = [&](uint32_t length) {
+      u16string result;
+      for (uint32_t j = 0; j < length; j++) result += alphabet[rand() % alphabet.size()];
+      return result;
+    };
+
+    TextBuffer buffer{random_string(60)};
+    auto regex = std::make_shared<Regex>(patterns[rand() % patterns.size()], nullptr);
+    auto live_search = buffer.create_live_search(regex);
+    std::set<MarkerIndex::MarkerId> ids;
+
+    for (uint32_t j = 0; j < 20; j++) {
+      if (rand() % 4 == 0) {
+        buffer.replace_all(Regex(u"b+", nullptr), random_string(rand() % 3), get_random_range(rand, buffer));
+      } else {
+        buffer.set_text_in_range(get_random_range(rand, buffer), random_string(rand() % 8));
+      }
+      if (rand() % 3 == 0) continue;
+      REQUIRE(apply_live_search_changes(live_search, ids) == buffer.find_all(*regex));
+    }
+
+    delete live_search;
+  }
+}
+
 TEST_CASE("TextBuffer::find_words_with_subsequence_in_range") {
   {
     TextBuffer buffer{u"banana band bandana banana"};
@@ -104,6 +104,80 @@ TEST_CASE("text_diff - old text is a suffix of new text") {
   }));
 }
 
+TEST_CASE("text_diff - many changes in a large text") {
+  std::u16string old_content, new_content;
+  for (uint32_t i = 0; i < 10000; i++) {
+    std::u16string line = u"line " + std::u16string(i % 50, u'x') + u"\n";
+    old_content += line;
+    if (i % 5 == 0) line.insert(0, u"changed ");
+    new_content += line;
+  }
+  Text old_text{old_content};
+  Text new_text{new_content};
+
+  // The edit distance of the whole text is much larger than the maximum, but
+  // each line that changed is still diffed on its own.
+  Patch patch = text_diff(old_text, new_text);
+  vector<Change> changes = patch.get_changes();
+  REQUIRE(changes.size() == 2000);
+  for (uint32_t i = 0; i < changes.size(); i++) {
+    REQUIRE(changes[i] == (Change{
+      Point{i * 5, 0}, Point{i * 5, 0},
+      Point{i * 5, 0}, Point{i * 5, 8},
+      get_text(u"").get(), get_text(u"changed ").get(),
+      0, 0, 0
+    }));
+  }
+}
+
+TEST_CASE("text_diff - large texts on multiple threads") {
+  std::u16string old_content, new_content;
+  for (uint32_t i = 0; i < 100000; i++) {
+    std::string number = std::to_string(i);
+    std::u16string line = u"line " + std::u16string(number.begin(), number.end()) + (i % 2 ? u"\r\n" : u"\n");
+    old_content += line;
+    if (i % 10 == 0) line.insert(0, u"changed ");
+    if (i % 1000 != 995) new_content += line;
+  }
+  Text old_text{old_content};
+  Text new_text{new_content};
+
+  // The texts are split at unique lines that they share, and the segments in
+  // between are diffed concurrently, with the same result as on one thread.
+  Patch patch = text_diff(old_text, new_text, 4);
+  Patch single_threaded_patch = text_diff(old_text, new_text);
+  vector<Change> changes = patch.get_changes();
+  REQUIRE(changes.size() == 10100);
+  REQUIRE(changes == single_threaded_patch.get_changes());
+
+  for (const Change &change : changes) {
+    old_text.splice(change.new_start, change.old_end.traversal(change.old_start), *change.new_text);
+  }
+  REQUIRE(old_text == new_text);
+}
+
+TEST_CASE("text_diff - replaced lines between unchanged lines") {
+  Text old_text{u"abc\ndef\nghi\njkl\n"};
+  Text new_text{u"abc\nxyz\nghi\njkm\n"};
+
+  Patch patch = text_diff(old_text, new_text);
+
+  REQUIRE(patch.get_changes() == vector<Change>({
+    Change{
+      Point{1, 0}, Point{1, 3},
+      Point{1, 0}, Point{1, 3},
+      get_text(u"def").get(), get_text(u"xyz").get(),
+      0, 0, 0
+    },
+    Change{
+      Point{3, 2}, Point{3, 3},
+      Point{3, 2}, Point{3, 3},
+      get_text(u"l").get(), get_text(u"m").get(),
+      0, 0, 0
+    },
+  }));
+}
+
 TEST_CASE("text_diff - randomized changes") {
   auto t = time(nullptr);
   for (uint i = 0; i < 100; i++) {